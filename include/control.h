@@ -56,6 +56,7 @@ struct CommandLineArguments {
 	bool exit;
 	bool securemode;
 	bool noautoexec;
+	bool startup_trace;
 	std::string working_dir;
 	std::string lang;
 	std::string machine;
@@ -62,6 +62,7 @@ extern int32_t CPU_CycleLimit;
 extern int64_t CPU_IODelayRemoved;
 extern bool CPU_CycleAutoAdjust;
 extern Bitu CPU_AutoDetermineMode;
+extern bool CPU_DynamicScheduling;
 
 extern ArchitectureType CPU_ArchitectureType;
 
@@ -79,6 +80,9 @@ constexpr bool CPU_UseRwxMemProtect = true;
 
 Bits CPU_Core_Normal_Run() noexcept;
 Bits CPU_Core_Normal_Trap_Run() noexcept;
+Bits CPU_Core_Normal_Step() noexcept;
+Bits CPU_Core_Cached_Run() noexcept;
+Bits CPU_Core_Cached_Trap_Run() noexcept;
 Bits CPU_Core_Simple_Run() noexcept;
 Bits CPU_Core_Simple_Trap_Run() noexcept;
 Bits CPU_Core_Full_Run() noexcept;
@@ -89,6 +93,12 @@ Bits CPU_Core_Dynrec_Trap_Run() noexcept;
 Bits CPU_Core_Prefetch_Run() noexcept;
 Bits CPU_Core_Prefetch_Trap_Run() noexcept;
 
+// Lets a dynamic core service the due PIC events itself when its cycles run
+// out, so it can keep running to the next event deadline instead of being
+// re-entered from the main loop. Returns false if the core has to return:
+// the millisecond is over or the decoder has been switched.
+bool CPU_ServiceEventsInCore(CPU_Decoder* core);
+
 void CPU_Reset_AutoAdjust(void);
 
 
@@ -0,0 +1,99 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_CPU_PROFILING_H
+#define DOSBOX_CPU_PROFILING_H
+
+#include "dosbox.h"
+
+#include <array>
+#include <cstdint>
+
+// Instrumentation of the CPU cores, enabled with the 'cpu_profiling' build
+// option. The executed instructions are counted by category together with
+// the expensive CPU events, and the per-second rates are reported as Tracy
+// plots and as rows of the 'cpu_profile.csv' file.
+//
+// The normal core counts every executed instruction; the dynamic cores emit
+// the counting call into the translated blocks, so their counts reflect
+// executed (not translated) code as well.
+
+enum class CpuProfileCounter : uint8_t {
+	// Instruction categories
+	Alu,
+	DataTransfer,
+	Stack,
+	Branch,
+	String,
+	Fpu,
+	SegmentLoad,
+	Io,
+	Interrupt,
+	System,
+	Other,
+
+	// Events
+	Exception,
+	InterruptCall,
+	PageFault,
+	TaskSwitch,
+	CodeCacheInvalidation,
+	DecoderEntry,
+
+	NumCounters,
+
+	// Prefix bytes, not counted
+	None = NumCounters,
+};
+
+constexpr auto NumCpuProfileCounters = static_cast<size_t>(
+        CpuProfileCounter::NumCounters);
+
+// Offset of the two-byte (0x0f-prefixed) opcodes in the opcode index
+constexpr uint16_t CpuProfileTwoByteOpcodes = 0x100;
+
+#if C_CPU_PROFILING
+
+extern std::array<uint64_t, NumCpuProfileCounters> cpu_profile_counters;
+
+// Counts an instruction by its opcode; two-byte opcodes are passed as
+// CpuProfileTwoByteOpcodes plus the second byte. Only the lowest 9 bits are
+// used, so the normal core's opcode index can be passed as-is.
+void CPU_ProfileOpcode(Bitu opcode);
+
+static inline void CPU_ProfileEvent(const CpuProfileCounter counter)
+{
+	++cpu_profile_counters[static_cast<size_t>(counter)];
+}
+
+void CPU_Profiling_Init();
+
+#	define CPU_PROFILE_OPCODE(opcode) CPU_ProfileOpcode(opcode)
+#	define CPU_PROFILE_EVENT(counter) \
+		CPU_ProfileEvent(CpuProfileCounter::counter)
+
+#else
+
+#	define CPU_PROFILE_OPCODE(opcode)
+#	define CPU_PROFILE_EVENT(counter)
+
+#endif // C_CPU_PROFILING
+
+#endif
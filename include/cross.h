@@ -146,6 +146,15 @@ bool read_directory_first(dir_information* dirp, char* entry_name, bool& is_dire
 bool read_directory_next(dir_information* dirp, char* entry_name, bool& is_directory);
 void close_directory(dir_information* dirp);
 
+struct DirectoryEntry {
+	std::string name  = {};
+	bool is_directory = false;
+};
+
+// Lists the same entries as the functions above, but without sharing any
+// state between the calls, so several threads can list directories at once
+bool list_directory(const char* dirname, std::vector<DirectoryEntry>& entries);
+
 FILE *fopen_wrap_ro_fallback(const std::string &filename, bool &is_readonly);
 
 bool wild_match(const char *haystack, const char *needle);
@@ -118,6 +118,12 @@ enum { HAND_NONE=0,HAND_FILE,HAND_DEVICE};
 void DOS_SetupFiles (void);
 bool DOS_ReadFile(uint16_t handle,uint8_t * data,uint16_t * amount, bool fcb = false);
 bool DOS_WriteFile(uint16_t handle,uint8_t * data,uint16_t * amount,bool fcb = false);
+// Transfer the data straight between the file and the guest memory at the
+// linear address, without going through the copy buffer where possible
+bool DOS_ReadFileToMemory(uint16_t handle, PhysPt address, uint16_t* amount, bool fcb = false);
+bool DOS_WriteFileFromMemory(uint16_t handle, PhysPt address, uint16_t* amount, bool fcb = false);
+// Reads more than the 64 KB a DOS call can, for the emulator's own transfers
+bool DOS_ReadFileBulk(uint16_t handle, uint8_t* data, uint32_t* amount);
 bool DOS_SeekFile(uint16_t handle,uint32_t * pos,uint32_t type,bool fcb = false);
 bool DOS_CloseFile(uint16_t handle,bool fcb = false,uint8_t * refcnt = nullptr);
 bool DOS_FlushFile(uint16_t handle);
@@ -125,6 +131,9 @@ bool DOS_DuplicateEntry(uint16_t entry,uint16_t * newentry);
 bool DOS_ForceDuplicateEntry(uint16_t entry,uint16_t newentry);
 bool DOS_GetFileDate(uint16_t entry, uint16_t* otime, uint16_t* odate);
 bool DOS_SetFileDate(uint16_t entry, uint16_t ntime, uint16_t ndate);
+// Changes on every write to a file through DOS, so the emulator's own readers
+// can skip checking the files they hold for changes while it stays the same
+uint32_t DOS_GetFileChangeCount();
 
 uint16_t DOS_GetBiosTimePacked();
 uint16_t DOS_GetBiosDatePacked();
@@ -184,6 +193,10 @@ bool DOS_UnlinkFile(const char* const name);
 bool DOS_FindFirst(const char* search, FatAttributeFlags attr,
                    bool fcb_findfirst = false);
 bool DOS_FindNext(void);
+// Lets the drive list the directory tree below a directory ahead of a
+// command searching through all of it, until DOS_StopPrefetching is called
+void DOS_PrefetchTree(const char* const dir);
+void DOS_StopPrefetching();
 bool DOS_Canonicalize(const char* const name, char* const canonicalized);
 std::string DOS_Canonicalize(const char* const name);
 bool DOS_CreateTempFile(char* const name, uint16_t* entry);
@@ -22,7 +22,10 @@
 
 #include "dosbox.h"
 
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "bit_view.h"
@@ -116,6 +119,9 @@ public:
 	}
 
 	virtual bool	Read(uint8_t * data,uint16_t * size)=0;
+	// Reads more than the 64 KB a DOS call is limited to, for the
+	// emulator's own transfers. Files that can do it in one go override it.
+	virtual bool ReadBulk(uint8_t* data, uint32_t* size);
 	virtual bool	Write(uint8_t * data,uint16_t * size)=0;
 	virtual bool	Seek(uint32_t * pos,uint32_t type)=0;
 	virtual bool	Close()=0;
@@ -187,6 +193,7 @@ public:
 	localFile(const localFile&)            = delete; // prevent copying
 	localFile& operator=(const localFile&) = delete; // prevent assignment
 	bool Read(uint8_t* data, uint16_t* size) override;
+	bool ReadBulk(uint8_t* data, uint32_t* size) override;
 	bool Write(uint8_t* data, uint16_t* size) override;
 	bool Seek(uint32_t* pos, uint32_t type) override;
 	bool Close() override;
@@ -257,42 +264,67 @@ public:
 	void  DeleteEntry          (const char* path, bool ignoreLastDir = false);
 	void  EmptyCache           (void);
 
+	// Keeps the cached directories up to date with the changes made to
+	// them on the host, instead of relying on RESCAN. Only available on
+	// hosts with inotify; returns false elsewhere.
+	bool WatchHostChanges();
+
+	// Lists the directories below a host directory on worker threads, for
+	// the commands walking through a whole tree. The cache reads them in
+	// from those listings until StopPrefetching is called.
+	void PrefetchTree(const char* host_dir);
+	void StopPrefetching();
+	// Waits until the workers listed as far ahead as they go
+	void WaitForPrefetching();
+
 	void SetLabel(const char *name, bool cdrom, bool allowupdate);
 	const char *GetLabel() const { return label; }
 
+	class CFileInfo;
+
+	// Hash lookups of a directory's entries that would otherwise need a
+	// walk through the whole directory
+	struct NameIndex {
+		// The entries with generated short names, by their host name
+		std::unordered_map<std::string, CFileInfo*> longNames = {};
+		// The shortest "~number" part of the generated short names, by
+		// the part before it (including the '~')
+		std::unordered_map<std::string, size_t> minNumberSizes = {};
+		// All the entries, by their Wine-style short name; built on the
+		// first lookup of such a name
+		std::unordered_map<std::string, CFileInfo*> wineNames = {};
+		bool hasWineNames = false;
+		// While a directory is read in, its entries are appended and
+		// only sorted at the end, with their short names kept here
+		std::unordered_set<std::string> loadingShortNames = {};
+		bool isLoading = false;
+	};
+
 	class CFileInfo {
 	public:
-		CFileInfo(void)
-		        : orgname{0},
-		          shortname{0},
-		          isOverlayDir(false),
-		          isDir(false),
-		          id(MAX_OPENDIRS),
-		          nextEntry(0),
-		          shortNr(0),
-		          fileList(0),
-		          longNameList(0)
-		{}
-
-		virtual ~CFileInfo()
+		CFileInfo() = default;
+		CFileInfo(const CFileInfo&)            = delete;
+		CFileInfo& operator=(const CFileInfo&) = delete;
+
+		~CFileInfo()
 		{
 			for (auto p : fileList) {
 				delete p;
 			}
-			fileList.clear();
-			longNameList.clear();
 		}
 
-		char        orgname[CROSS_LEN];
-		char        shortname[DOS_NAMELENGTH_ASCII];
-		bool        isOverlayDir;
-		bool        isDir;
-		uint16_t      id;
-		Bitu        nextEntry;
-		unsigned    shortNr;
-		// contents
-		std::vector<CFileInfo*> fileList;
-		std::vector<CFileInfo*> longNameList;
+		std::string orgname                   = {};
+		char shortname[DOS_NAMELENGTH_ASCII]  = {};
+		bool isOverlayDir                     = false;
+		bool isDir                            = false;
+		uint16_t id                           = MAX_OPENDIRS;
+		Bitu nextEntry                        = 0;
+		unsigned shortNr                      = 0;
+		// contents, sorted by short name
+		std::vector<CFileInfo*> fileList      = {};
+		std::vector<CFileInfo*> longNameList  = {};
+		// only allocated for directories
+		std::unique_ptr<NameIndex> index      = {};
 	};
 
 private:
@@ -301,6 +333,8 @@ private:
 
 	bool		RemoveTrailingDot	(char* shortname);
 	Bits		GetLongName		(CFileInfo* info, char* shortname, const size_t shortname_len);
+	bool		IsShortNameTaken	(CFileInfo* dir, char* shortname);
+	CFileInfo*	FindWineName		(CFileInfo* dir, const char* shortname);
 	void		CreateShortName		(CFileInfo* dir, CFileInfo* info);
 	unsigned        CreateShortNameID       (CFileInfo* dir, const char* name);
 	int		CompareShortname	(const char* compareName, const char* shortName);
@@ -309,11 +343,26 @@ private:
 	CFileInfo*	FindDirInfo		(const char* path, char* expandedPath);
 	bool		RemoveSpaces		(char* str);
 	bool		OpenDir			(CFileInfo* dir, const char* path, uint16_t& id);
-	void		CreateEntry		(CFileInfo* dir, const char* name, bool is_directory);
+	CFileInfo*	CreateEntry		(CFileInfo* dir, const char* name, bool is_directory);
+	NameIndex&	GetNameIndex		(CFileInfo* dir);
+	void		FinishLoading		(CFileInfo* dir);
 	void		CopyEntry		(CFileInfo* dir, CFileInfo* from);
 	uint16_t		GetFreeID		(CFileInfo* dir);
 	void		Clear			(void);
 
+	CFileInfo*	FindHostEntry		(CFileInfo* dir, const char* name);
+	void		AddHostEntry		(CFileInfo* dir, const char* name, bool is_directory);
+	void		RemoveHostEntry		(CFileInfo* dir, const char* name);
+	void		ApplyHostChanges	();
+	bool		ReadPrefetched		(CFileInfo* dir);
+
+	class HostWatcher;
+	std::unique_ptr<HostWatcher> watcher;
+	bool applyingHostChanges = false;
+
+	class DirPrefetcher;
+	std::unique_ptr<DirPrefetcher> prefetcher;
+
 	CFileInfo*	dirBase;
 	char		dirPath				[CROSS_LEN];
 	char		basePath			[CROSS_LEN];
@@ -365,6 +414,10 @@ public:
 	virtual uint8_t GetMediaByte(void)=0;
 	virtual void SetDir(const char *path);
 	virtual void EmptyCache() { dirCache.EmptyCache(); }
+	// Starts listing the directory tree below a directory ahead of the
+	// searches going through all of it, on the drives where it helps
+	virtual void PrefetchTree(const char* /*dir*/) {}
+	void StopPrefetching() { dirCache.StopPrefetching(); }
 	virtual bool isRemote(void)=0;
 	virtual bool isRemovable(void)=0;
 	virtual Bits UnMount(void)=0;
@@ -21,6 +21,7 @@
 
 #include "dosbox.h"
 
+#include <map>
 #include <memory>
 #include <unordered_set>
 #include <string>
@@ -111,6 +112,7 @@ public:
 	bool isRemote(void) override;
 	bool isRemovable(void) override;
 	Bits UnMount(void) override;
+	void PrefetchTree(const char* dir) override;
 	const char* GetBasedir() const
 	{
 		return basedir;
@@ -483,6 +485,8 @@ private:
 	bool vfile_name_exists(const std::string& name) const;
 };
 
+struct OverlayBlockMap;
+
 class Overlay_Drive final : public localDrive {
 public:
 	Overlay_Drive(const char *startdir,
@@ -493,6 +497,7 @@ public:
 	              uint16_t _free_clusters,
 	              uint8_t _mediaid,
 	              uint8_t &error);
+	~Overlay_Drive() override;
 
 	bool FileOpen(DOS_File** file, char* name, uint32_t flags) override;
 	bool FileCreate(DOS_File** file, char* name,
@@ -510,6 +515,12 @@ public:
 	std::pair<FILE*, std_fs::path> create_file_in_overlay(const char* dos_filename,
 	                                                      const char* mode);
 
+	// Large files are copied to the overlay block by block as they get
+	// written to; the map tells which blocks are still in the base file
+	std::shared_ptr<OverlayBlockMap> create_block_map(const char* dos_filename,
+	                                                  uint64_t base_size);
+	std::shared_ptr<OverlayBlockMap> get_block_map(const char* dos_filename);
+
 	Bits UnMount(void) override;
 	bool TestDir(char* dir) override;
 	bool RemoveDir(char* dir) override;
@@ -541,6 +552,24 @@ private:
 	void remove_special_file_from_disk(const char* dosname, const char* operation);
 	void add_special_file_to_disk(const char* dosname, const char* operation);
 	std::string create_filename_of_special_operation(const char* dosname, const char* operation);
+	std::string get_special_file_path(const char* dosname, const char* operation);
+
+	void load_block_map(const char* dosname);
+	void remove_block_map(const char* dosname);
+	bool copy_remaining_blocks(const char* dosname);
+	std::map<std::string, std::shared_ptr<OverlayBlockMap>> block_maps = {};
+
+	// The deleted files and directories, the cached names and the block
+	// maps are kept in an index file as well, so mounting doesn't need to
+	// walk the overlay directory
+	bool load_index();
+	void write_index();
+	void journal_index(char operation, const char* kind, const std::string& name);
+	uint64_t get_index_stamp();
+	void stamp_index();
+	FILE* index_file         = nullptr;
+	size_t index_num_records = 0;
+
 	void convert_overlay_to_DOSname_in_base(char* dirname );
 	//For caching the update_cache routine.
 	std::vector<std::string> DOSnames_cache; //Also set is probably better.
@@ -0,0 +1,36 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_EMS_H
+#define DOSBOX_EMS_H
+
+#include "dosbox.h"
+
+#include "setup.h"
+
+// The EMS type the 'ems' setting asks for: 0 when disabled, 1 for mixed
+// mode, 2 for an EMS board and 3 for EMM386
+Bitu GetEMSType(Section_prop* section);
+
+// The EMS type in use, which is 0 when EMS is disabled or not available on
+// the machine
+Bitu EMS_GetType();
+
+#endif
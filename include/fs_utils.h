@@ -122,6 +122,57 @@ inline auto make_check_fseek_func(const std::string& module_name,
 	return check_fseek_lambda;
 }
 
+// A read-only view of an entire host file mapped into memory. The mapping is
+// shared, so all processes mapping the same file are backed by the same pages
+// in the host's page cache instead of each holding a private copy.
+//
+// Check 'IsOpen()' after construction; the mapping fails for empty files,
+// missing files, or on platforms without memory-mapped file support.
+//
+class ReadOnlyFileMapping {
+public:
+	explicit ReadOnlyFileMapping(const std_fs::path& path) noexcept;
+	~ReadOnlyFileMapping();
+
+	ReadOnlyFileMapping(const ReadOnlyFileMapping&)            = delete;
+	ReadOnlyFileMapping& operator=(const ReadOnlyFileMapping&) = delete;
+
+	bool IsOpen() const noexcept
+	{
+		return data != nullptr;
+	}
+
+	const uint8_t* Data() const noexcept
+	{
+		return data;
+	}
+
+	size_t Size() const noexcept
+	{
+		return size;
+	}
+
+	// Asks the host to start reading the whole file into the page cache
+	// ahead of use. Returns immediately.
+	void Prefetch() const noexcept;
+
+private:
+	const uint8_t* data = nullptr;
+	size_t size         = 0;
+	void* handle        = nullptr;
+};
+
+// Replaces the given host memory with a private copy-on-write view of a part
+// of a file, so the file contents only get read in as they are accessed. The
+// changes made to the memory never reach the file.
+//
+// The address, the size, and the file offset must be multiples of the host's
+// page size. Returns false, leaving the memory untouched, if that isn't the
+// case, or on platforms without memory-mapped file support.
+//
+bool map_file_over_memory(const std_fs::path& path, uint64_t offset,
+                          void* address, size_t size) noexcept;
+
 // Convert a filesystem time to a raw time_t value
 std::time_t to_time_t(const std_fs::file_time_type &fs_time);
 
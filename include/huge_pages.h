@@ -0,0 +1,103 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_HUGE_PAGES_H
+#define DOSBOX_HUGE_PAGES_H
+
+#include <cstddef>
+#include <new>
+#include <string>
+
+// Huge-page backing for the large, randomly accessed host allocations
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The guest RAM, the paging TLB arrays and the dynamic core's code cache are
+// each several megabytes large and accessed all over the place, so with 4K
+// host pages they need far more TLB entries than the host CPU has. Backing
+// them with 2 MB pages takes that pressure off.
+//
+// Explicit huge pages come from the pool the administrator reserved (see
+// /proc/sys/vm/nr_hugepages) and transparent huge pages are assembled by the
+// kernel when it can. Hosts without either get regular memory.
+
+enum class HugePageMode { Off, Transparent, Explicit };
+
+enum class HugePageBacking { None, Transparent, Explicit };
+
+constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+// Set from the 'huge_pages' setting before the memory is allocated
+void HUGEPAGES_SetMode(const std::string& mode);
+HugePageMode HUGEPAGES_GetMode();
+
+// Allocates host memory aligned to at least the host's page size, backed by
+// huge pages as far as the mode and the host allow. Returns nullptr when the
+// allocation fails altogether.
+void* HUGEPAGES_Allocate(size_t num_bytes, bool executable = false);
+void HUGEPAGES_Free(void* ptr);
+
+// The backing of memory returned by HUGEPAGES_Allocate
+HugePageBacking HUGEPAGES_GetBacking(const void* ptr);
+
+// Asks the kernel to use transparent huge pages for the 2 MB-aligned parts
+// of existing memory, for the allocations not made by HUGEPAGES_Allocate.
+HugePageBacking HUGEPAGES_Advise(void* ptr, size_t num_bytes);
+
+const char* HUGEPAGES_ToString(HugePageBacking backing);
+
+// Allocator for the containers holding the large allocations
+template <typename T>
+class HugePageAllocator {
+public:
+	using value_type = T;
+
+	HugePageAllocator() noexcept = default;
+
+	template <typename U>
+	HugePageAllocator(const HugePageAllocator<U>&) noexcept
+	{}
+
+	T* allocate(const size_t n)
+	{
+		const auto ptr = HUGEPAGES_Allocate(n * sizeof(T));
+		if (!ptr) {
+			throw std::bad_alloc();
+		}
+		return static_cast<T*>(ptr);
+	}
+
+	void deallocate(T* ptr, size_t) noexcept
+	{
+		HUGEPAGES_Free(ptr);
+	}
+
+	template <typename U>
+	bool operator==(const HugePageAllocator<U>&) const noexcept
+	{
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const HugePageAllocator<U>&) const noexcept
+	{
+		return false;
+	}
+};
+
+#endif
@@ -49,6 +49,7 @@ HostPt MEM_GetBlockPage();
 uint32_t MEM_FreeTotal();                      // free 4 KB pages
 uint32_t MEM_FreeLargest();                    // largest free 4 KB pages block
 uint32_t MEM_TotalPages();                     // total amount of 4 KB pages
+uint32_t MEM_NumHandles();                     // size of the handle table
 uint32_t MEM_AllocatedPages(MemHandle handle); // amount of allocated pages of handle
 MemHandle MEM_AllocatePages(Bitu pages, bool sequence);
 MemHandle MEM_GetNextFreePage();
@@ -240,6 +240,19 @@ extern PagingBlock paging;
 
 PageHandler * MEM_GetPageHandler(Bitu phys_page);
 
+// The handler of a physical page with the host memory its reads and writes
+// can access directly; the host pointers are nullptr where the accesses have
+// to go through the handler. Used to link pages into the TLB; plain RAM, ROM
+// and unmapped pages are resolved from a compact page type table without
+// calling into the handler.
+struct PageMapping {
+	PageHandler* handler = nullptr;
+	HostPt read          = nullptr;
+	HostPt write         = nullptr;
+};
+
+PageMapping MEM_GetPageMapping(Bitu phys_page);
+
 
 /* Unaligned address handlers */
 uint16_t mem_unalignedreadw(PhysPt address);
@@ -73,5 +73,10 @@ void PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val = 0);
 void PIC_RemoveEvents(PIC_EventHandler handler);
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, uint32_t val);
 
+// Marks an event as safe to leave out of snapshots, because its device
+// schedules it again when a snapshot is loaded. Snapshots aren't saved while
+// any other event is pending, as it would be lost.
+void PIC_AddSnapshotSafeEvent(PIC_EventHandler handler);
+
 void PIC_SetIRQMask(uint32_t irq, bool masked);
 #endif
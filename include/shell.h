@@ -26,6 +26,9 @@
 #include <optional>
 #include <stack>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "callback.h"
 #include "programs.h"
@@ -45,6 +48,21 @@ public:
 	virtual void Reset()                  = 0;
 	virtual std::optional<uint8_t> Read() = 0;
 
+	// Continues reading at a position counted in bytes from the start.
+	// Readers that can't seek read their way up to it.
+	virtual void Seek(size_t position)
+	{
+		Reset();
+		while (position-- > 0 && Read()) {}
+	}
+
+	// Whether the contents changed since the last call, which makes the
+	// positions taken before then stale
+	virtual bool HasChanged()
+	{
+		return false;
+	}
+
 	ByteReader()                             = default;
 	ByteReader(const ByteReader&)            = delete;
 	ByteReader& operator=(const ByteReader&) = delete;
@@ -85,10 +103,24 @@ public:
 private:
 	[[nodiscard]] std::string ExpandedBatchLine(std::string_view line) const;
 	[[nodiscard]] std::string GetLine();
+	void IndexLabels();
 
 	const HostShell& shell;
 	CommandLine cmd;
 	std::unique_ptr<ByteReader> reader;
+	// The position of the next byte the reader returns
+	size_t position = 0;
+
+	// The positions after the label lines, by their upper-case label.
+	// Only the first of the labels with the same name is kept, as that's
+	// the one GOTO jumps to.
+	std::unordered_map<std::string, size_t> label_positions = {};
+	// All the label lines, in their order, for the labels that can't be
+	// looked up by their name
+	std::vector<std::pair<std::string, size_t>> label_lines = {};
+	size_t indexed_size = 0;
+	bool has_label_index = false;
+
 	bool echo;
 };
 
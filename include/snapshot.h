@@ -0,0 +1,186 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SNAPSHOT_H
+#define DOSBOX_SNAPSHOT_H
+
+#include "dosbox.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "setup.h"
+#include "std_filesystem.h"
+
+// Whole-machine snapshots
+// ~~~~~~~~~~~~~~~~~~~~~~~
+// A snapshot captures the CPU, memory, chipset, video and DOS state of the
+// emulated machine so it can be resumed later, skipping the boot and the
+// program's own loading screens. Of the sound devices, only the Sound Blaster
+// and the OPL chip are part of it; the others carry on from the state they're
+// in when it's loaded. The modules holding machine state register a component
+// with a save and a load function; each component is stored as a separate
+// zlib-compressed chunk of the snapshot file.
+//
+// Components that can't capture their state at every moment, like a sound
+// card in the middle of a DMA transfer or a device with events pending in the
+// PIC queue, also register a ready check. A requested save waits for all of
+// them to be ready, and is refused if they don't become ready in time.
+//
+// Guest RAM is stored uncompressed at an aligned offset at the end of the
+// file, with the all-zero pages left as holes in the file. On hosts with
+// memory-mapped files it's restored as a private copy-on-write mapping of the
+// file, so resuming doesn't need to read it up-front.
+//
+// Snapshots can only be resumed by the same DOSBox build running the same
+// machine configuration. The settings the components depend on are stored in
+// the header, so the load fails without touching the machine otherwise.
+
+class SnapshotWriter {
+public:
+	void WriteBytes(const void* data, const size_t num_bytes)
+	{
+		const auto bytes = static_cast<const uint8_t*>(data);
+		buffer.insert(buffer.end(), bytes, bytes + num_bytes);
+	}
+
+	template <typename T>
+	void Write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>,
+		              "Only plain data can be written as-is");
+		WriteBytes(&value, sizeof(T));
+	}
+
+	void WriteString(const std::string& str)
+	{
+		Write(static_cast<uint32_t>(str.size()));
+		WriteBytes(str.data(), str.size());
+	}
+
+	const std::vector<uint8_t>& Data() const
+	{
+		return buffer;
+	}
+
+private:
+	std::vector<uint8_t> buffer = {};
+};
+
+// Reads back what the component's save function wrote. Reading past the end
+// of the data marks the reader as failed and yields zeroed values, so the
+// load functions only need to check 'IsValid()' once they're done.
+class SnapshotReader {
+public:
+	explicit SnapshotReader(const std::vector<uint8_t>& data) : buffer(data) {}
+
+	bool ReadBytes(void* data, const size_t num_bytes)
+	{
+		if (num_bytes > buffer.size() - pos) {
+			memset(data, 0, num_bytes);
+			pos   = buffer.size();
+			valid = false;
+			return false;
+		}
+		memcpy(data, buffer.data() + pos, num_bytes);
+		pos += num_bytes;
+		return true;
+	}
+
+	template <typename T>
+	T Read()
+	{
+		static_assert(std::is_trivially_copyable_v<T>,
+		              "Only plain data can be read as-is");
+		T value;
+		ReadBytes(&value, sizeof(T));
+		return value;
+	}
+
+	template <typename T>
+	void Read(T& value)
+	{
+		value = Read<T>();
+	}
+
+	std::string ReadString()
+	{
+		const auto size = Read<uint32_t>();
+		if (size > buffer.size() - pos) {
+			pos   = buffer.size();
+			valid = false;
+			return {};
+		}
+		std::string str(reinterpret_cast<const char*>(buffer.data() + pos), size);
+		pos += size;
+		return str;
+	}
+
+	// Skips the rest of the data, for the load functions that can't use it
+	void SkipRemaining()
+	{
+		pos = buffer.size();
+	}
+
+	// All the data was consumed without reading past its end
+	bool IsValid() const
+	{
+		return valid && pos == buffer.size();
+	}
+
+private:
+	const std::vector<uint8_t>& buffer;
+	size_t pos = 0;
+	bool valid = true;
+};
+
+using SnapshotSaveHandler = void (*)(SnapshotWriter& writer);
+using SnapshotLoadHandler = void (*)(SnapshotReader& reader);
+using SnapshotReadyCheck  = bool (*)();
+
+// Registers a component of the machine state. Registering the same name again
+// replaces the handlers, so modules that get re-initialised can call this
+// from their constructors. The components are loaded in registration order.
+// The optional ready check tells whether the component's state can be saved
+// at the moment.
+void SNAPSHOT_AddComponent(const char* name, SnapshotSaveHandler save_handler,
+                           SnapshotLoadHandler load_handler,
+                           SnapshotReadyCheck ready_check = nullptr);
+
+// Saving and loading take the nesting level of the emulation loop, which has
+// to match for the DOS shell and the host-side interrupt handlers to be in
+// the same state as when the snapshot was saved. Loading with a different
+// level only warns, as the snapshot usually stays inside the running program.
+// Saving fails without writing anything while a component isn't ready.
+bool SNAPSHOT_Save(const std_fs::path& path, int machine_depth);
+bool SNAPSHOT_Load(const std_fs::path& path, int machine_depth);
+
+// Carries out a requested save or load. Called from the main loop, between
+// runs of the CPU core, with the nesting level of the emulation loop. A save
+// request is held for up to a second of emulated time while a component isn't
+// ready.
+void SNAPSHOT_RunPendingRequest(int machine_depth);
+
+void SNAPSHOT_Init(Section* sec);
+
+#endif
@@ -1088,6 +1088,7 @@ void VGA_StartResize();
 void VGA_StartResizeAfter(const uint16_t delay_ms);
 
 void VGA_SetupDrawing(uint32_t val);
+void VGA_AddSnapshotSafeEvents();
 void VGA_CheckScanLength(void);
 void VGA_ChangedBank(void);
 
@@ -0,0 +1,616 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "avi_writer.h"
+
+#include <cassert>
+#include <cstring>
+#include <functional>
+
+#include "cross.h"
+#include "logging.h"
+#include "mem.h"
+#include "support.h"
+
+#include "zmbv/zmbv.h"
+
+// Keep every RIFF segment within 1 GB, as recommended by the OpenDML spec
+// for compatibility with AVI 1.0 readers
+static constexpr uint64_t MaxSegmentSize = 1024 * 1024 * 1024;
+
+// Bounds the memory used by the legacy 'idx1' index of the first segment;
+// the first segment is closed early when its index would grow larger
+static constexpr uint32_t LegacyIndexEntrySize  = 16;
+static constexpr uint32_t MaxLegacyIndexEntries = 1024 * 1024;
+
+static constexpr uint32_t StdIndexHeaderSize   = 24;
+static constexpr uint32_t StdIndexEntrySize    = 8;
+static constexpr uint32_t SuperIndexHeaderSize = 24;
+static constexpr uint32_t SuperIndexEntrySize  = 16;
+
+static constexpr uint32_t ChunkHeaderSize = 8;
+static constexpr uint32_t ListHeaderSize  = 12;
+
+static constexpr uint32_t DmlhSize        = 248;
+static constexpr uint32_t SampleFrameSize = 4;
+
+static constexpr uint8_t AviIndexOfIndexes = 0x00;
+static constexpr uint8_t AviIndexOfChunks  = 0x01;
+
+static constexpr uint32_t AviifKeyframe     = 0x10;
+static constexpr uint32_t DeltaFrameSizeBit = 0x80000000;
+
+// Little-endian serialisation helpers for the RIFF structures
+static void put_4cc(std::vector<uint8_t>& buf, const char* fourcc)
+{
+	buf.insert(buf.end(), fourcc, fourcc + 4);
+}
+
+static void put_word(std::vector<uint8_t>& buf, const uint16_t val)
+{
+	buf.resize(buf.size() + sizeof(val));
+	host_writew(buf.data() + buf.size() - sizeof(val), val);
+}
+
+static void put_dword(std::vector<uint8_t>& buf, const uint32_t val)
+{
+	buf.resize(buf.size() + sizeof(val));
+	host_writed(buf.data() + buf.size() - sizeof(val), val);
+}
+
+static void put_qword(std::vector<uint8_t>& buf, const uint64_t val)
+{
+	buf.resize(buf.size() + sizeof(val));
+	host_writeq(buf.data() + buf.size() - sizeof(val), val);
+}
+
+static void patch_dword(std::vector<uint8_t>& buf, const size_t pos,
+                        const uint32_t val)
+{
+	assert(pos + sizeof(val) <= buf.size());
+	host_writed(buf.data() + pos, val);
+}
+
+AviWriter::~AviWriter()
+{
+	Close();
+}
+
+void AviWriter::Open(FILE* _handle, const VideoFormat& _format)
+{
+	assert(_handle);
+
+	if (is_open) {
+		Close();
+	}
+
+	handle            = _handle;
+	format            = _format;
+	sample_rate       = 0;
+	file_size         = 0;
+	num_failed_writes = 0;
+	exceeded_capacity = false;
+
+	streams = {};
+	memcpy(streams[Video].chunk_id.data(), "00dc", 4);
+	memcpy(streams[Audio].chunk_id.data(), "01wb", 4);
+
+	for (auto& stream : streams) {
+		stream.std_index.reserve(MaxStdIndexEntries);
+	}
+
+	legacy_index.clear();
+	first_segment_frames = 0;
+	first_segment_size   = 0;
+	first_movi_list_size = 0;
+
+	write_buffer.clear();
+	write_buffer.reserve(WriteBufferSize);
+
+	// The queue cannot be restarted once stopped, so we need a fresh one
+	// for every file
+	write_fifo = std::make_unique<RWQueue<AviWriteTask>>(MaxQueuedWrites);
+
+	const auto worker_function = std::bind(&AviWriter::WriteQueuedBlocks, this);
+	io_thread = std::thread(worker_function);
+	set_thread_name(io_thread, "dosbox:aviwrite");
+
+	is_open = true;
+
+	// Reserve the space for the file header; it's rewritten with the final
+	// values when the file is closed
+	const auto header = BuildFileHeader();
+	Append(header.data(), header.size());
+
+	segment_start    = 0;
+	movi_list_start  = header_size - ListHeaderSize;
+	is_first_segment = true;
+}
+
+void AviWriter::Close()
+{
+	if (!is_open) {
+		return;
+	}
+
+	EndSegment();
+	WriteAt(0, BuildFileHeader());
+	FlushWriteBuffer();
+
+	// Let the I/O thread finish the pending writes
+	write_fifo->Stop();
+	if (io_thread.joinable()) {
+		io_thread.join();
+	}
+	write_fifo.reset();
+
+	fclose(handle);
+	handle = nullptr;
+
+	if (num_failed_writes) {
+		LOG_WARNING("CAPTURE: Failed to write %u blocks of the video capture; "
+		            "the file is probably incomplete",
+		            num_failed_writes);
+	}
+
+	legacy_index = {};
+	write_buffer = {};
+	streams      = {};
+
+	is_open = false;
+}
+
+void AviWriter::AddVideoChunk(const uint8_t* data, const uint32_t size,
+                              const bool is_keyframe)
+{
+	constexpr auto duration_in_frames = 1;
+	AddChunk(Video, data, size, duration_in_frames, is_keyframe);
+}
+
+void AviWriter::AddAudioChunk(const int16_t* data, const uint32_t num_sample_frames,
+                              const uint32_t _sample_rate)
+{
+	sample_rate = _sample_rate;
+
+	constexpr auto is_keyframe = true;
+	AddChunk(Audio,
+	         reinterpret_cast<const uint8_t*>(data),
+	         num_sample_frames * SampleFrameSize,
+	         num_sample_frames,
+	         is_keyframe);
+}
+
+void AviWriter::AddChunk(const StreamId stream_id, const uint8_t* data,
+                         const uint32_t size, const uint32_t duration,
+                         const bool is_keyframe)
+{
+	assert(is_open);
+	if (exceeded_capacity) {
+		return;
+	}
+
+	const auto padded_size = (size + 1) & ~1u;
+
+	// Start a new RIFF segment if the chunk and the indexes that will
+	// follow it wouldn't fit into the current one
+	uint64_t index_reserve = 0;
+	for (const auto& stream : streams) {
+		index_reserve += ChunkHeaderSize + StdIndexHeaderSize +
+		                 StdIndexEntrySize * (stream.std_index.size() + 1);
+	}
+	if (is_first_segment) {
+		index_reserve += ChunkHeaderSize + legacy_index.size() +
+		                 LegacyIndexEntrySize;
+	}
+
+	const auto segment_used = file_size - segment_start;
+	const auto projected_size = segment_used + ChunkHeaderSize + padded_size +
+	                            index_reserve;
+
+	const auto legacy_index_full = is_first_segment &&
+	                               legacy_index.size() >=
+	                                       MaxLegacyIndexEntries *
+	                                               LegacyIndexEntrySize;
+
+	if (projected_size > MaxSegmentSize || legacy_index_full) {
+		EndSegment();
+		BeginSegment();
+		if (exceeded_capacity) {
+			return;
+		}
+	}
+
+	auto& stream = streams[stream_id];
+	if (stream.std_index.size() >= MaxStdIndexEntries) {
+		FlushStdIndex(stream_id);
+		if (exceeded_capacity) {
+			return;
+		}
+	}
+
+	const auto chunk_pos = file_size;
+	const auto data_pos  = chunk_pos + ChunkHeaderSize;
+
+	// Standard index offsets point past the chunk header and are relative
+	// to the start of the segment's movie list
+	StdIndexEntry entry = {};
+	entry.offset = check_cast<uint32_t>(data_pos - movi_list_start);
+	entry.size   = size | (is_keyframe ? 0 : DeltaFrameSizeBit);
+	stream.std_index.push_back(entry);
+	stream.std_index_duration += duration;
+	stream.length += duration;
+
+	// Legacy index offsets point at the chunk header and are relative to
+	// the 'movi' list type
+	if (is_first_segment) {
+		constexpr auto list_type_pos = ChunkHeaderSize;
+
+		put_4cc(legacy_index, stream.chunk_id.data());
+		put_dword(legacy_index, is_keyframe ? AviifKeyframe : 0);
+		put_dword(legacy_index,
+		          check_cast<uint32_t>(chunk_pos -
+		                               (movi_list_start + list_type_pos)));
+		put_dword(legacy_index, size);
+
+		if (stream_id == Video) {
+			++first_segment_frames;
+		}
+	}
+
+	AppendChunkHeader(stream.chunk_id.data(), size);
+	Append(data, size);
+	if (padded_size != size) {
+		constexpr uint8_t pad_byte = 0;
+		Append(&pad_byte, 1);
+	}
+}
+
+// Writes the chunks collected since the last flush into a standard index
+// chunk, then registers it in the stream's super index
+void AviWriter::FlushStdIndex(const StreamId stream_id)
+{
+	auto& stream = streams[stream_id];
+	if (stream.std_index.empty()) {
+		return;
+	}
+	if (stream.super_index.size() >= MaxSuperIndexEntries) {
+		stream.std_index.clear();
+		return;
+	}
+
+	const auto num_entries = check_cast<uint32_t>(stream.std_index.size());
+	const auto index_size = StdIndexHeaderSize + StdIndexEntrySize * num_entries;
+
+	std::vector<uint8_t> ix = {};
+	ix.reserve(ChunkHeaderSize + index_size);
+
+	const char ix_fourcc[] = {'i', 'x', '0', static_cast<char>('0' + stream_id)};
+	put_4cc(ix, ix_fourcc);
+	put_dword(ix, index_size);
+	put_word(ix, StdIndexEntrySize / sizeof(uint32_t)); // wLongsPerEntry
+	ix.push_back(0);                                    // bIndexSubType
+	ix.push_back(AviIndexOfChunks);                     // bIndexType
+	put_dword(ix, num_entries);                         // nEntriesInUse
+	put_4cc(ix, stream.chunk_id.data());                // dwChunkId
+	put_qword(ix, movi_list_start);                     // qwBaseOffset
+	put_dword(ix, 0);                                   // dwReserved3
+
+	for (const auto& entry : stream.std_index) {
+		put_dword(ix, entry.offset);
+		put_dword(ix, entry.size);
+	}
+
+	SuperIndexEntry super_entry = {};
+	super_entry.offset   = file_size;
+	super_entry.size     = check_cast<uint32_t>(ix.size());
+	super_entry.duration = stream.std_index_duration;
+
+	Append(ix.data(), ix.size());
+
+	stream.std_index.clear();
+	stream.std_index_duration = 0;
+
+	// Update the super index in the file header straight away, so
+	// interrupted captures are still mostly recoverable
+	const auto entry_num = check_cast<uint32_t>(stream.super_index.size());
+	stream.super_index.push_back(super_entry);
+
+	std::vector<uint8_t> entry_bytes = {};
+	put_qword(entry_bytes, super_entry.offset);
+	put_dword(entry_bytes, super_entry.size);
+	put_dword(entry_bytes, super_entry.duration);
+
+	const auto entries_pos = stream.super_index_pos + ChunkHeaderSize +
+	                         SuperIndexHeaderSize;
+	WriteAt(entries_pos + entry_num * SuperIndexEntrySize, std::move(entry_bytes));
+
+	std::vector<uint8_t> count_bytes = {};
+	put_dword(count_bytes, entry_num + 1);
+
+	constexpr auto entries_in_use_pos = ChunkHeaderSize + 4;
+	WriteAt(stream.super_index_pos + entries_in_use_pos, std::move(count_bytes));
+
+	if (stream.super_index.size() >= MaxSuperIndexEntries && !exceeded_capacity) {
+		LOG_WARNING("CAPTURE: Video capture reached the maximum length "
+		            "supported by its index; further frames are dropped");
+		exceeded_capacity = true;
+	}
+}
+
+void AviWriter::BeginSegment()
+{
+	assert(!is_first_segment);
+
+	segment_start = file_size;
+
+	constexpr uint32_t placeholder_size = 0;
+	AppendChunkHeader("RIFF", placeholder_size);
+	Append("AVIX", 4);
+
+	movi_list_start = file_size;
+	AppendChunkHeader("LIST", placeholder_size);
+	Append("movi", 4);
+}
+
+void AviWriter::EndSegment()
+{
+	for (const auto stream_id : {Video, Audio}) {
+		FlushStdIndex(stream_id);
+	}
+
+	const auto movi_list_size = check_cast<uint32_t>(
+	        file_size - (movi_list_start + ChunkHeaderSize));
+
+	if (is_first_segment) {
+		// The legacy index follows the first movie list; the sizes are
+		// written as part of the final file header
+		first_movi_list_size = movi_list_size;
+
+		AppendChunkHeader("idx1", check_cast<uint32_t>(legacy_index.size()));
+		Append(legacy_index.data(), legacy_index.size());
+		legacy_index = {};
+
+		first_segment_size = check_cast<uint32_t>(file_size - ChunkHeaderSize);
+		is_first_segment = false;
+		return;
+	}
+
+	std::vector<uint8_t> size_bytes = {};
+	put_dword(size_bytes,
+	          check_cast<uint32_t>(file_size - segment_start - ChunkHeaderSize));
+	WriteAt(segment_start + 4, std::move(size_bytes));
+
+	size_bytes = {};
+	put_dword(size_bytes, movi_list_size);
+	WriteAt(movi_list_start + 4, std::move(size_bytes));
+}
+
+std::vector<uint8_t> AviWriter::BuildFileHeader()
+{
+	std::vector<uint8_t> h = {};
+
+	const auto& video = streams[Video];
+	const auto& audio = streams[Audio];
+
+	const auto audio_rate = sample_rate ? sample_rate : 1;
+
+	put_4cc(h, "RIFF");
+	put_dword(h, first_segment_size);
+	put_4cc(h, "AVI ");
+
+	put_4cc(h, "LIST");
+	const auto hdrl_size_pos = h.size();
+	put_dword(h, 0);
+	put_4cc(h, "hdrl");
+
+	put_4cc(h, "avih");
+	put_dword(h, 56); // # of bytes to follow
+	put_dword(h, static_cast<uint32_t>(1000000 / format.frames_per_second));
+	put_dword(h, 0);                    // MaxBytesPerSec
+	put_dword(h, 0);                    // PaddingGranularity
+	put_dword(h, 0x110);                // Flags, 0x10 has index, 0x100 interleaved
+	put_dword(h, first_segment_frames); // TotalFrames of the first segment
+	put_dword(h, 0);                    // InitialFrames
+	put_dword(h, NumStreams);           // Stream count
+	put_dword(h, 0);                    // SuggestedBufferSize
+	put_dword(h, format.width);         // Width
+	put_dword(h, format.height);        // Height
+	put_dword(h, 0);                    // TimeScale
+	put_dword(h, 0);                    // DataRate
+	put_dword(h, 0);                    // StartTime
+	put_dword(h, 0);                    // DataLength
+
+	const auto super_index_size = SuperIndexHeaderSize +
+	                              SuperIndexEntrySize * MaxSuperIndexEntries;
+
+	auto put_super_index = [&](Stream& stream) {
+		stream.super_index_pos = check_cast<uint32_t>(h.size());
+
+		put_4cc(h, "indx");
+		put_dword(h, super_index_size);
+		put_word(h, SuperIndexEntrySize / sizeof(uint32_t)); // wLongsPerEntry
+		h.push_back(0);                                      // bIndexSubType
+		h.push_back(AviIndexOfIndexes);                      // bIndexType
+		put_dword(h, check_cast<uint32_t>(stream.super_index.size()));
+		put_4cc(h, stream.chunk_id.data());
+		put_dword(h, 0); // dwReserved[3]
+		put_dword(h, 0);
+		put_dword(h, 0);
+
+		for (const auto& entry : stream.super_index) {
+			put_qword(h, entry.offset);
+			put_dword(h, entry.size);
+			put_dword(h, entry.duration);
+		}
+		// Unused entries are zeroed
+		h.resize(stream.super_index_pos + ChunkHeaderSize + super_index_size);
+	};
+
+	// Video stream list
+	put_4cc(h, "LIST");
+	put_dword(h, 4 + 8 + 56 + 8 + 40 + ChunkHeaderSize + super_index_size);
+	put_4cc(h, "strl");
+
+	put_4cc(h, "strh");
+	put_dword(h, 56);        // # of bytes to follow
+	put_4cc(h, "vids");      // Type
+	put_4cc(h, CODEC_4CC);   // Handler
+	put_dword(h, 0);         // Flags
+	put_dword(h, 0);         // Reserved, MS says: wPriority, wLanguage
+	put_dword(h, 0);         // InitialFrames
+	put_dword(h, 1000000);   // Scale
+	put_dword(h, static_cast<uint32_t>(1000000 * format.frames_per_second));
+	put_dword(h, 0);            // Start
+	put_dword(h, video.length); // Length of the whole stream
+	put_dword(h, 0);            // SuggestedBufferSize
+	put_dword(h, ~0u);          // Quality
+	put_dword(h, 0);            // SampleSize
+	put_dword(h, 0);            // Frame
+	put_dword(h, 0);            // Frame
+
+	put_4cc(h, "strf");
+	put_dword(h, 40);            // # of bytes to follow
+	put_dword(h, 40);            // Size
+	put_dword(h, format.width);  // Width
+	put_dword(h, format.height); // Height
+	put_dword(h, 0);             // Planes, Count
+	put_4cc(h, CODEC_4CC);       // Compression
+	put_dword(h, format.width * format.height * 4); // SizeImage
+	put_dword(h, 0); // XPelsPerMeter
+	put_dword(h, 0); // YPelsPerMeter
+	put_dword(h, 0); // ClrUsed: Number of colors used
+	put_dword(h, 0); // ClrImportant: Number of colors important
+
+	put_super_index(streams[Video]);
+
+	// Audio stream list
+	put_4cc(h, "LIST");
+	put_dword(h, 4 + 8 + 56 + 8 + 16 + ChunkHeaderSize + super_index_size);
+	put_4cc(h, "strl");
+
+	put_4cc(h, "strh");
+	put_dword(h, 56); // # of bytes to follow
+	put_4cc(h, "auds");
+	put_dword(h, 0);               // Format (Optionally)
+	put_dword(h, 0);               // Flags
+	put_dword(h, 0);               // Reserved, MS says: wPriority, wLanguage
+	put_dword(h, 0);               // InitialFrames
+	put_dword(h, SampleFrameSize); // Scale
+	put_dword(h, audio_rate * SampleFrameSize); // Rate, actual rate is scale/rate
+	put_dword(h, 0);               // Start
+	put_dword(h, audio.length);    // Length of the whole stream
+	put_dword(h, 0);               // SuggestedBufferSize
+	put_dword(h, ~0u);             // Quality
+	put_dword(h, SampleFrameSize); // SampleSize
+	put_dword(h, 0);               // Frame
+	put_dword(h, 0);               // Frame
+
+	put_4cc(h, "strf");
+	put_dword(h, 16);         // # of bytes to follow
+	put_word(h, 1);           // Format, WAVE_ZMBV_FORMAT_PCM
+	put_word(h, 2);           // Number of channels
+	put_dword(h, audio_rate); // SamplesPerSec
+	put_dword(h, audio_rate * SampleFrameSize); // AvgBytesPerSec
+	put_word(h, 4);                             // BlockAlign
+	put_word(h, 16);                            // BitsPerSample
+
+	put_super_index(streams[Audio]);
+
+	// OpenDML extended header
+	put_4cc(h, "LIST");
+	put_dword(h, 4 + ChunkHeaderSize + DmlhSize);
+	put_4cc(h, "odml");
+	put_4cc(h, "dmlh");
+	put_dword(h, DmlhSize);
+	put_dword(h, video.length); // TotalFrames of the whole file
+	h.resize(h.size() + DmlhSize - 4);
+
+	patch_dword(h,
+	            hdrl_size_pos,
+	            check_cast<uint32_t>(h.size() - (hdrl_size_pos + 4)));
+
+	put_4cc(h, "LIST");
+	put_dword(h, first_movi_list_size);
+	put_4cc(h, "movi");
+
+	header_size = check_cast<uint32_t>(h.size());
+	return h;
+}
+
+void AviWriter::Append(const void* data, const size_t size)
+{
+	const auto bytes = static_cast<const uint8_t*>(data);
+	write_buffer.insert(write_buffer.end(), bytes, bytes + size);
+	file_size += size;
+
+	if (write_buffer.size() >= WriteBufferSize) {
+		FlushWriteBuffer();
+	}
+}
+
+void AviWriter::AppendChunkHeader(const char* fourcc, const uint32_t size)
+{
+	std::array<uint8_t, ChunkHeaderSize> header = {};
+	memcpy(header.data(), fourcc, 4);
+	host_writed(header.data() + 4, size);
+	Append(header.data(), header.size());
+}
+
+void AviWriter::WriteAt(const uint64_t offset, std::vector<uint8_t> data)
+{
+	// The patched up area might still be sitting in the write buffer
+	FlushWriteBuffer();
+
+	AviWriteTask task = {static_cast<int64_t>(offset), std::move(data)};
+	write_fifo->Enqueue(std::move(task));
+}
+
+void AviWriter::FlushWriteBuffer()
+{
+	if (write_buffer.empty()) {
+		return;
+	}
+	AviWriteTask task = {-1, std::move(write_buffer)};
+	write_fifo->Enqueue(std::move(task));
+
+	write_buffer = {};
+	write_buffer.reserve(WriteBufferSize);
+}
+
+void AviWriter::WriteQueuedBlocks()
+{
+	while (auto task = write_fifo->Dequeue()) {
+		const auto is_patch = task->offset >= 0;
+
+		if (is_patch && cross_fseeko(handle, task->offset, SEEK_SET) != 0) {
+			++num_failed_writes;
+			continue;
+		}
+
+		const auto size = task->data.size();
+		if (fwrite(task->data.data(), 1, size, handle) != size) {
+			++num_failed_writes;
+		}
+
+		if (is_patch) {
+			cross_fseeko(handle, 0, SEEK_END);
+		}
+	}
+}
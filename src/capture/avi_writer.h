@@ -0,0 +1,172 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_AVI_WRITER_H
+#define DOSBOX_AVI_WRITER_H
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "rwqueue.h"
+
+// A block of bytes for the AVI writer's I/O thread to write to the file.
+// Blocks with a negative offset are appended to the end of the file, the
+// rest overwrite previously written data at the given offset (used to patch
+// up sizes and indexes).
+struct AviWriteTask {
+	int64_t offset            = -1;
+	std::vector<uint8_t> data = {};
+};
+
+// Streaming AVI writer with OpenDML (AVI 2.0) large file support.
+//
+// The file is split into RIFF segments of at most 1 GB each. The first one is
+// a regular 'AVI ' segment with a legacy 'idx1' index, so short captures
+// remain playable by AVI 1.0 readers; the rest are 'AVIX' extension segments.
+// Every stream has a fixed-size super index in its stream header that points
+// to standard 'ix##' index chunks written into the movie lists as the capture
+// progresses. This keeps the memory usage constant no matter how long the
+// capture runs.
+//
+// The chunks are collected in large buffers which are written to disk by a
+// background I/O thread.
+//
+class AviWriter {
+public:
+	struct VideoFormat {
+		uint16_t width          = 0;
+		uint16_t height         = 0;
+		float frames_per_second = 0.0f;
+	};
+
+	AviWriter() = default;
+	~AviWriter();
+
+	// Takes ownership of the passed in file handle
+	void Open(FILE* handle, const VideoFormat& format);
+	void Close();
+
+	bool IsOpen() const
+	{
+		return is_open;
+	}
+
+	void AddVideoChunk(const uint8_t* data, const uint32_t size,
+	                   const bool is_keyframe);
+
+	// Interleaved 16-bit stereo sample frames
+	void AddAudioChunk(const int16_t* data, const uint32_t num_sample_frames,
+	                   const uint32_t sample_rate);
+
+	// prevent copying
+	AviWriter(const AviWriter&) = delete;
+	// prevent assignment
+	AviWriter& operator=(const AviWriter&) = delete;
+
+private:
+	enum StreamId { Video = 0, Audio = 1, NumStreams = 2 };
+
+	// Each entry of the super indexes covers a standard index chunk of up
+	// to this many chunks, or a whole RIFF segment if that's shorter. With
+	// one audio chunk per video frame, this allows for more than two days
+	// of 70 Hz footage.
+	static constexpr uint32_t MaxStdIndexEntries   = 16384;
+	static constexpr uint32_t MaxSuperIndexEntries = 1024;
+
+	static constexpr uint32_t WriteBufferSize = 4 * 1024 * 1024;
+	static constexpr auto MaxQueuedWrites     = 4;
+
+	struct StdIndexEntry {
+		uint32_t offset = 0;
+		uint32_t size   = 0;
+	};
+
+	struct SuperIndexEntry {
+		uint64_t offset   = 0;
+		uint32_t size     = 0;
+		uint32_t duration = 0;
+	};
+
+	struct Stream {
+		std::array<char, 4> chunk_id = {};
+
+		// Standard index of the chunks since the last 'ix##' chunk
+		std::vector<StdIndexEntry> std_index = {};
+		uint32_t std_index_duration          = 0;
+
+		std::vector<SuperIndexEntry> super_index = {};
+
+		// Position of the stream's super index in the file header
+		uint32_t super_index_pos = 0;
+
+		// Frames for video, sample frames for audio
+		uint32_t length = 0;
+	};
+
+	void AddChunk(const StreamId stream_id, const uint8_t* data,
+	              const uint32_t size, const uint32_t duration,
+	              const bool is_keyframe);
+
+	void FlushStdIndex(const StreamId stream_id);
+	void BeginSegment();
+	void EndSegment();
+
+	std::vector<uint8_t> BuildFileHeader();
+
+	void Append(const void* data, const size_t size);
+	void AppendChunkHeader(const char* fourcc, const uint32_t size);
+	void WriteAt(const uint64_t offset, std::vector<uint8_t> data);
+	void FlushWriteBuffer();
+
+	void WriteQueuedBlocks();
+
+	std::unique_ptr<RWQueue<AviWriteTask>> write_fifo = {};
+	std::thread io_thread                             = {};
+	bool is_open                                      = false;
+
+	FILE* handle                      = nullptr;
+	std::vector<uint8_t> write_buffer = {};
+	uint32_t num_failed_writes        = 0;
+
+	VideoFormat format     = {};
+	uint32_t sample_rate   = 0;
+	uint32_t header_size   = 0;
+	uint64_t file_size     = 0;
+	bool exceeded_capacity = false;
+
+	std::array<Stream, NumStreams> streams = {};
+
+	// The current RIFF segment
+	uint64_t segment_start   = 0;
+	uint64_t movi_list_start = 0;
+	bool is_first_segment    = true;
+
+	// The first segment's legacy 'idx1' index and frame count
+	std::vector<uint8_t> legacy_index = {};
+	uint32_t first_segment_frames     = 0;
+	uint32_t first_segment_size       = 0;
+	uint32_t first_movi_list_size     = 0;
+};
+
+#endif // DOSBOX_AVI_WRITER_H
@@ -52,6 +52,8 @@ static struct {
 		CaptureState video = {};
 	} state = {};
 
+	bool offline_rendering = false;
+
 	struct {
 		int32_t audio              = 1;
 		int32_t midi               = 1;
@@ -96,6 +98,20 @@ bool CAPTURE_IsCapturingVideo()
 	return capture.state.video != CaptureState::Off;
 }
 
+bool CAPTURE_IsRenderingOffline()
+{
+	return capture.offline_rendering &&
+	       (CAPTURE_IsCapturingAudio() || CAPTURE_IsCapturingVideo());
+}
+
+static void maybe_log_offline_rendering()
+{
+	if (capture.offline_rendering) {
+		LOG_MSG("CAPTURE: Rendering offline; emulation will run unthrottled "
+		        "until capturing stops");
+	}
+}
+
 static const char* capture_type_to_string(const CaptureType type)
 {
 	switch (type) {
@@ -357,6 +373,7 @@ void CAPTURE_StartVideoCapture()
 	switch (capture.state.video) {
 	case CaptureState::Off:
 		capture.state.video = CaptureState::Pending;
+		maybe_log_offline_rendering();
 		break;
 	case CaptureState::Pending:
 	case CaptureState::InProgress:
@@ -454,6 +471,7 @@ static void handle_capture_audio_event(bool pressed)
 		// Capturing the audio output will start in the next few
 		// milliseconds when CAPTURE_AddAudioData is called
 		capture.state.audio = CaptureState::Pending;
+		maybe_log_offline_rendering();
 		break;
 	case CaptureState::Pending:
 		// It's practically impossible to hit this branch; handling it
@@ -597,6 +615,8 @@ static void capture_init(Section* sec)
 		capture.path = "capture";
 	}
 
+	capture.offline_rendering = secprop->Get_bool("offline_rendering");
+
 	const std::string prefs = secprop->Get_string("default_image_capture_formats");
 
 	image_capturer = std::make_unique<ImageCapturer>(prefs);
@@ -661,6 +681,16 @@ static void init_capture_dosbox_settings(Section_prop& secprop)
 	        "default).");
 	assert(path_prop);
 
+	auto* bool_prop = secprop.Add_bool("offline_rendering", when_idle, false);
+	bool_prop->Set_help(
+	        "Render audio and video captures offline (disabled by default). While audio or\n"
+	        "video is being captured, emulation runs as fast as the host allows instead\n"
+	        "of in real time, and the captured audio is generated from emulated time\n"
+	        "alone, so the recording plays back at the correct speed. Live audio output is\n"
+	        "silenced while rendering offline. Useful for recording long demos in less\n"
+	        "time than they take to play.");
+	assert(bool_prop);
+
 	auto* str_prop = secprop.Add_string("default_image_capture_formats",
 	                                    when_idle,
 	                                    "upscaled");
@@ -686,6 +716,25 @@ static void init_capture_dosbox_settings(Section_prop& secprop)
 	        "Keybindings for taking single screenshots in specific formats are also\n"
 	        "available.");
 	assert(str_prop);
+
+	auto* int_prop = secprop.Add_int("video_compression_level", when_idle, 6);
+	int_prop->Set_help(
+	        "zlib compression level of the ZMBV video captures, from 0 (fastest, largest\n"
+	        "files) to 9 (slowest, smallest files) (6 by default). Video frames are encoded\n"
+	        "on a separate thread, so higher levels only slow down the emulation if the\n"
+	        "encoder can't keep up with the frame rate.");
+	int_prop->SetMinMax(0, 9);
+	assert(int_prop);
+
+	str_prop = secprop.Add_string("video_compression_strategy", when_idle, "filtered");
+	str_prop->Set_help(
+	        "zlib compression strategy of the ZMBV video captures ('filtered' by default):\n"
+	        "  filtered:  Best suited for the delta frames ZMBV produces.\n"
+	        "  default:   Standard zlib strategy.\n"
+	        "  huffman:   Huffman coding only; fastest, but produces larger files.\n"
+	        "  rle:       Run-length encoding; fast, good for flat-colour content.");
+	str_prop->Set_values({"filtered", "default", "huffman", "rle"});
+	assert(str_prop);
 }
 
 void CAPTURE_AddConfigSection(const config_ptr_t& conf)
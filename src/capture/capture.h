@@ -75,6 +75,11 @@ bool CAPTURE_IsCapturingPostRenderImage();
 bool CAPTURE_IsCapturingMidi();
 bool CAPTURE_IsCapturingVideo();
 
+// True while audio or video is being captured with 'offline_rendering'
+// enabled. Emulation then runs unthrottled and the mixer produces output purely
+// from emulated time, bypassing the audio device.
+bool CAPTURE_IsRenderingOffline();
+
 // Only used internally in the capture module
 int32_t get_next_capture_index(const CaptureType type);
 
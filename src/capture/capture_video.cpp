@@ -20,26 +20,38 @@
  */
 
 #include "capture.h"
+#include "capture_video.h"
+#include "avi_writer.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <memory>
+#include <thread>
 
+#include "control.h"
 #include "math_utils.h"
 #include "mem.h"
 #include "render.h"
+#include "rwqueue.h"
+#include "setup.h"
 #include "support.h"
+#include "timer.h"
 
 #include "zmbv/zmbv.h"
 
 static constexpr auto NumSampleFramesInBuffer = 16 * 1024;
 
-static constexpr auto SampleFrameSize  = 4;
 static constexpr auto NumAudioChannels = 2;
 
-static constexpr auto AviHeaderSize = 500;
+// Frames waiting to be encoded. When the encoder falls behind by this many
+// frames, queueing the next frame blocks the emulation until there's room.
+static constexpr auto MaxQueuedFrames = 8;
 
+// Only accessed from the encoder thread while capturing, and from the main
+// thread once the encoder thread has finished
 static struct {
-	FILE* handle = nullptr;
+	AviWriter writer = {};
 
 	uint32_t frames          = 0;
 	VideoCodec* codec        = nullptr;
@@ -48,21 +60,29 @@ static struct {
 	PixelFormat pixel_format = {};
 	float frames_per_second  = 0.0f;
 
-	uint32_t written           = 0;
-	uint32_t buf_size          = 0;
-	std::vector<uint8_t> buf   = {};
-	std::vector<uint8_t> index = {};
-	uint32_t index_used        = 0;
+	uint32_t buf_size        = 0;
+	std::vector<uint8_t> buf = {};
 
-	struct {
-		int16_t buf[NumSampleFramesInBuffer][NumAudioChannels] = {};
-
-		uint32_t sample_rate     = 0;
-		uint32_t buf_frames_used = 0;
-		uint32_t bytes_written   = 0;
-	} audio = {};
+	VideoCodec::CompressOptions compress_options = {};
 } video = {};
 
+// Main thread state that feeds the encoder thread
+static struct {
+	std::unique_ptr<RWQueue<VideoCaptureTask>> fifo = {};
+	std::thread worker = {};
+	bool is_open       = false;
+
+	// Audio output accumulated since the last queued frame
+	std::vector<int16_t> pending_audio = {};
+	uint32_t sample_rate               = 0;
+
+	struct {
+		int64_t total_encode_us = 0;
+		uint32_t num_frames     = 0;
+		size_t max_queue_depth  = 0;
+	} stats = {};
+} encoder = {};
+
 static ZMBV_FORMAT to_zmbv_format(const PixelFormat format)
 {
 	switch (format) {
@@ -98,261 +118,47 @@ static uint8_t to_bytes_per_pixel(const ZMBV_FORMAT format)
 	return ZMBV_ToBytesPerPixel(format);
 }
 
-static void add_avi_chunk(const char* tag, const uint32_t size,
-                          const void* data, const uint32_t flags)
-{
-	uint8_t chunk[8] = {};
-
-	chunk[0] = tag[0];
-	chunk[1] = tag[1];
-	chunk[2] = tag[2];
-	chunk[3] = tag[3];
-
-	host_writed(&chunk[4], size);
-
-	// Write the actual data
-	fwrite(chunk, 1, 8, video.handle);
-
-	auto writesize = (size + 1) & ~1;
-	fwrite(data, 1, writesize, video.handle);
-
-	auto pos = video.written + 4;
-	video.written += writesize + 8;
-
-	if (video.index_used + 16 >= video.index.size()) {
-		video.index.resize(video.index.size() + 16 * 4096);
-	}
-
-	auto index = video.index.data() + video.index_used;
-	video.index_used += 16;
-
-	index[0] = tag[0];
-	index[1] = tag[1];
-	index[2] = tag[2];
-	index[3] = tag[3];
-
-	host_writed(index + 4, flags);
-	host_writed(index + 8, pos);
-	host_writed(index + 12, size);
-}
-
-void capture_video_finalise()
+static void finalise_avi_file()
 {
-	if (!video.handle) {
+	if (!video.writer.IsOpen()) {
 		return;
 	}
 	if (video.codec) {
 		video.codec->FinishVideo();
 	}
+	video.writer.Close();
 
-	uint8_t avi_header[AviHeaderSize];
-	uint32_t header_pos = 0;
-
-#define AVIOUT4(_S_) \
-	memcpy(&avi_header[header_pos], _S_, 4); \
-	header_pos += 4;
-#define AVIOUTw(_S_) \
-	host_writew(&avi_header[header_pos], _S_); \
-	header_pos += 2;
-#define AVIOUTd(_S_) \
-	host_writed(&avi_header[header_pos], _S_); \
-	header_pos += 4;
-
-	// Try and write an avi header
-	AVIOUT4("RIFF"); // Riff header
-	AVIOUTd(AviHeaderSize + video.written - 8 + video.index_used);
-	AVIOUT4("AVI ");
-	AVIOUT4("LIST");
-
-	const auto main_list = header_pos;
-	// TODO size of list
-	AVIOUTd(0);
-	AVIOUT4("hdrl");
-
-	AVIOUT4("avih");
-	// # of bytes to follow
-	AVIOUTd(56);
-	/* Microseconds per frame */
-	AVIOUTd((uint32_t)(1000000 / video.frames_per_second));
-	AVIOUTd(0);
-	AVIOUTd(0);            /* PaddingGranularity (whatever that might be) */
-	AVIOUTd(0x110);        /* Flags,0x10 has index, 0x100 interleaved */
-	AVIOUTd(video.frames); /* TotalFrames */
-	AVIOUTd(0);            /* InitialFrames */
-	AVIOUTd(2);            /* Stream count */
-	AVIOUTd(0);            /* SuggestedBufferSize */
-	AVIOUTd(static_cast<uint32_t>(video.width));  /* Width */
-	AVIOUTd(static_cast<uint32_t>(video.height)); /* Height */
-	AVIOUTd(0); /* TimeScale:  Unit used to measure time */
-	AVIOUTd(0); /* DataRate:   Data rate of playback     */
-	AVIOUTd(0); /* StartTime:  Starting time of AVI data */
-	AVIOUTd(0); /* DataLength: Size of AVI data chunk    */
-
-	// Video stream list
-	AVIOUT4("LIST");
-	AVIOUTd(4 + 8 + 56 + 8 + 40); /* Size of the list */
-	AVIOUT4("strl");
-
-	// Video stream header
-	AVIOUT4("strh");
-	AVIOUTd(56);        /* # of bytes to follow */
-	AVIOUT4("vids");    /* Type */
-	AVIOUT4(CODEC_4CC); /* Handler */
-	AVIOUTd(0);         /* Flags */
-	AVIOUTd(0);         /* Reserved, MS says: wPriority, wLanguage */
-	AVIOUTd(0);         /* InitialFrames */
-	AVIOUTd(1000000);   /* Scale */
-
-	/* Rate: Rate/Scale == samples/second */
-	AVIOUTd((uint32_t)(1000000 * video.frames_per_second));
-	AVIOUTd(0);            /* Start */
-	AVIOUTd(video.frames); /* Length */
-	AVIOUTd(0);            /* SuggestedBufferSize */
-	AVIOUTd(~0);           /* Quality */
-	AVIOUTd(0);            /* SampleSize */
-	AVIOUTd(0);            /* Frame */
-	AVIOUTd(0);            /* Frame */
-
-	// The video stream format
-	AVIOUT4("strf");
-	AVIOUTd(40);                                  /* # of bytes to follow */
-	AVIOUTd(40);                                  /* Size */
-	AVIOUTd(static_cast<uint32_t>(video.width));  /* Width */
-	AVIOUTd(static_cast<uint32_t>(video.height)); /* Height */
-	//		OUTSHRT(1); OUTSHRT(24);     /* Planes, Count */
-	AVIOUTd(0);
-	AVIOUT4(CODEC_4CC); /* Compression */
-	AVIOUTd(video.width * video.height *
-	        4); /* SizeImage (in
-	                                                           bytes?) */
-	AVIOUTd(0); /* XPelsPerMeter */
-	AVIOUTd(0); /* YPelsPerMeter */
-	AVIOUTd(0); /* ClrUsed: Number of colors used */
-	AVIOUTd(0); /* ClrImportant: Number of colors important */
-
-	// Audio stream list
-	AVIOUT4("LIST");
-	AVIOUTd(4 + 8 + 56 + 8 + 16); /* Length of list in bytes */
-	AVIOUT4("strl");
-
-	// The audio stream header
-	AVIOUT4("strh");
-	AVIOUTd(56); /* # of bytes to follow */
-	AVIOUT4("auds");
-	AVIOUTd(0); /* Format (Optionally) */
-	AVIOUTd(0); /* Flags */
-	AVIOUTd(0); /* Reserved, MS says: wPriority, wLanguage */
-	AVIOUTd(0); /* InitialFrames */
-	AVIOUTd(4); /* Scale */
-
-	/* Rate, actual rate is scale/rate */
-	AVIOUTd(video.audio.sample_rate * SampleFrameSize);
-	AVIOUTd(0); /* Start */
-
-	if (!video.audio.sample_rate) {
-		video.audio.sample_rate = 1;
-	}
-
-	AVIOUTd(video.audio.bytes_written / SampleFrameSize); /* Length */
-	AVIOUTd(0);               /* SuggestedBufferSize */
-	AVIOUTd(~0);              /* Quality */
-	AVIOUTd(SampleFrameSize); /* SampleSize */
-	AVIOUTd(0);               /* Frame */
-	AVIOUTd(0);               /* Frame */
-
-	// The audio stream format
-	AVIOUT4("strf");
-	AVIOUTd(16);                      /* # of bytes to follow */
-	AVIOUTw(1);                       /* Format, WAVE_ZMBV_FORMAT_PCM */
-	AVIOUTw(2);                       /* Number of channels */
-	AVIOUTd(video.audio.sample_rate); /* SamplesPerSec */
-	AVIOUTd(video.audio.sample_rate * SampleFrameSize); /* AvgBytesPerSec*/
-	AVIOUTw(4);                                         /* BlockAlign */
-	AVIOUTw(16);                                        /* BitsPerSample */
-
-	int nmain = header_pos - main_list - 4;
-
-	// Finish stream list, i.e. put number of bytes in the list to
-	// proper pos
-	int njunk = AviHeaderSize - 8 - 12 - header_pos;
-	AVIOUT4("JUNK");
-	AVIOUTd(njunk);
-
-	// Fix the size of the main list
-	header_pos = main_list;
-	AVIOUTd(nmain);
-	header_pos = AviHeaderSize - 12;
-	AVIOUT4("LIST");
-
-	// Length of list in bytes
-	AVIOUTd(video.written + 4);
-	AVIOUT4("movi");
-
-	// First add the index table to the end
-	memcpy(video.index.data(), "idx1", 4);
-	host_writed(video.index.data() + 4, video.index_used - 8);
-	fwrite(video.index.data(), 1, video.index_used, video.handle);
-
-	fseek(video.handle, 0, SEEK_SET);
-	fwrite(&avi_header, 1, AviHeaderSize, video.handle);
-
-	fclose(video.handle);
 	delete video.codec;
-	video.handle = nullptr;
-}
-
-void capture_video_add_audio_data(const uint32_t sample_rate,
-                                  const uint32_t num_sample_frames,
-                                  const int16_t* sample_frames)
-{
-	if (!video.handle) {
-		return;
-	}
-	auto frames_left = NumSampleFramesInBuffer - video.audio.buf_frames_used;
-	if (frames_left > num_sample_frames) {
-		frames_left = num_sample_frames;
-	}
-
-	memcpy(&video.audio.buf[video.audio.buf_frames_used],
-	       sample_frames,
-	       frames_left * SampleFrameSize);
-
-	video.audio.buf_frames_used += frames_left;
-	video.audio.sample_rate = sample_rate;
+	video.codec = nullptr;
 }
 
 static void create_avi_file(const uint16_t width, const uint16_t height,
                             const PixelFormat pixel_format,
                             const float frames_per_second, ZMBV_FORMAT format)
 {
-	video.handle = CAPTURE_CreateFile(CaptureType::Video);
-	if (!video.handle) {
+	const auto handle = CAPTURE_CreateFile(CaptureType::Video);
+	if (!handle) {
 		return;
 	}
 	video.codec = new VideoCodec();
-	if (!video.codec->SetupCompress(width, height)) {
+	if (!video.codec->SetupCompress(width, height, video.compress_options)) {
+		fclose(handle);
+		delete video.codec;
+		video.codec = nullptr;
 		return;
 	}
 
 	video.buf_size = video.codec->NeededSize(width, height, format);
 	video.buf.resize(video.buf_size);
 
-	video.index.resize(16 * 4096);
-	video.index_used = 8;
-
 	video.width             = width;
 	video.height            = height;
 	video.pixel_format      = pixel_format;
 	video.frames_per_second = frames_per_second;
 
-	for (auto i = 0; i < AviHeaderSize; ++i) {
-		fputc(0, video.handle);
-	}
+	video.writer.Open(handle, {width, height, frames_per_second});
 
-	video.frames                = 0;
-	video.written               = 0;
-	video.audio.buf_frames_used = 0;
-	video.audio.bytes_written   = 0;
+	video.frames = 0;
 }
 
 // Performs some transforms on the passed down rendered image to make sure
@@ -439,9 +245,11 @@ static void compress_raw_frame(const RenderedImage& image)
 	}
 }
 
-void capture_video_add_frame(const RenderedImage& image, const float frames_per_second)
+static void encode_frame(const VideoCaptureTask& task)
 {
-	const auto& src = image.params;
+	const auto& image             = task.image;
+	const auto& src               = image.params;
+	const auto frames_per_second = task.frames_per_second;
 	assert(src.width <= SCALER_MAXWIDTH);
 
 	// To reconstruct the raw image, we must skip every second row when
@@ -455,22 +263,22 @@ void capture_video_add_frame(const RenderedImage& image, const float frames_per_
 	        src.height / (src.rendered_double_scan ? 2 : 1));
 
 	// Disable capturing if any of the test fails
-	if (video.handle && (video.width != raw_width || video.height != raw_height ||
+	if (video.writer.IsOpen() && (video.width != raw_width || video.height != raw_height ||
 	                     video.pixel_format != src.pixel_format ||
 	                     video.frames_per_second != frames_per_second)) {
-		capture_video_finalise();
+		finalise_avi_file();
 	}
 
 	const auto zmbv_format = to_zmbv_format(src.pixel_format);
 
-	if (!video.handle) {
+	if (!video.writer.IsOpen()) {
 		create_avi_file(raw_width,
 		                raw_height,
 		                src.pixel_format,
 		                frames_per_second,
 		                zmbv_format);
 	}
-	if (!video.handle) {
+	if (!video.writer.IsOpen()) {
 		return;
 	}
 
@@ -491,19 +299,136 @@ void capture_video_add_frame(const RenderedImage& image, const float frames_per_
 		return;
 	}
 
-	add_avi_chunk("00dc", written, video.buf.data(), codec_flags & 1 ? 0x10 : 0x0);
+	const auto is_keyframe = (codec_flags & 1) != 0;
+	video.writer.AddVideoChunk(video.buf.data(),
+	                           check_cast<uint32_t>(written),
+	                           is_keyframe);
 	video.frames++;
 
-	//		LOG_MSG("CAPTURE: Frame %d video %d audio
-	//%d",video.frames, written, video.audio_buf_frames_used *4 );
-	if (video.audio.buf_frames_used) {
-		add_avi_chunk("01wb",
-		              video.audio.buf_frames_used * SampleFrameSize,
-		              video.audio.buf,
-		              0);
-
-		video.audio.bytes_written = video.audio.buf_frames_used *
-		                            SampleFrameSize;
-		video.audio.buf_frames_used = 0;
+	const auto num_sample_frames = check_cast<uint32_t>(task.audio.size() /
+	                                                    NumAudioChannels);
+	if (num_sample_frames) {
+		video.writer.AddAudioChunk(task.audio.data(),
+		                           num_sample_frames,
+		                           task.sample_rate);
+	}
+}
+
+static void encode_queued_frames()
+{
+	while (auto task = encoder.fifo->Dequeue()) {
+		const auto start_us = GetTicksUs();
+
+		encode_frame(*task);
+		task->image.free();
+
+		encoder.stats.total_encode_us += GetTicksUsSince(start_us);
+		++encoder.stats.num_frames;
+	}
+}
+
+static int to_zlib_strategy(const std::string& pref)
+{
+	if (pref == "default") {
+		return Z_DEFAULT_STRATEGY;
+	}
+	if (pref == "huffman") {
+		return Z_HUFFMAN_ONLY;
+	}
+	if (pref == "rle") {
+		return Z_RLE;
+	}
+	return Z_FILTERED;
+}
+
+static void start_encoder()
+{
+	assert(!encoder.is_open);
+
+	const auto section = static_cast<Section_prop*>(
+	        control->GetSection("capture"));
+	assert(section);
+
+	// Leave some cores for the emulation and the other worker threads
+	const auto num_cores = static_cast<int>(std::thread::hardware_concurrency());
+
+	video.compress_options.level = section->Get_int("video_compression_level");
+	video.compress_options.strategy = to_zlib_strategy(
+	        section->Get_string("video_compression_strategy"));
+	video.compress_options.numSearchThreads = std::clamp(num_cores / 2, 1, 8);
+
+	encoder.stats = {};
+	encoder.pending_audio.clear();
+
+	encoder.fifo   = std::make_unique<RWQueue<VideoCaptureTask>>(MaxQueuedFrames);
+	encoder.worker = std::thread(encode_queued_frames);
+	set_thread_name(encoder.worker, "dosbox:zmbv");
+
+	encoder.is_open = true;
+}
+
+void capture_video_finalise()
+{
+	if (!encoder.is_open) {
+		return;
 	}
+
+	// Let the encoder finish the queued frames
+	encoder.fifo->Stop();
+	if (encoder.worker.joinable()) {
+		encoder.worker.join();
+	}
+	encoder.fifo.reset();
+	encoder.is_open = false;
+
+	finalise_avi_file();
+
+	const auto& stats = encoder.stats;
+	if (stats.num_frames) {
+		LOG_MSG("CAPTURE: Encoded %u video frames in %.2f ms per frame on "
+		        "average, with up to %zu frames queued",
+		        stats.num_frames,
+		        static_cast<double>(stats.total_encode_us) /
+		                (stats.num_frames * 1000.0),
+		        stats.max_queue_depth);
+	}
+}
+
+void capture_video_add_audio_data(const uint32_t sample_rate,
+                                  const uint32_t num_sample_frames,
+                                  const int16_t* sample_frames)
+{
+	if (!encoder.is_open) {
+		return;
+	}
+	constexpr auto MaxPendingSamples = NumSampleFramesInBuffer * NumAudioChannels;
+
+	const auto num_samples = std::min(num_sample_frames * NumAudioChannels,
+	                                  MaxPendingSamples -
+	                                          static_cast<uint32_t>(
+	                                                  encoder.pending_audio.size()));
+
+	encoder.pending_audio.insert(encoder.pending_audio.end(),
+	                             sample_frames,
+	                             sample_frames + num_samples);
+	encoder.sample_rate = sample_rate;
+}
+
+void capture_video_add_frame(const RenderedImage& image, const float frames_per_second)
+{
+	if (!encoder.is_open) {
+		start_encoder();
+	}
+
+	VideoCaptureTask task = {image.deep_copy(),
+	                         frames_per_second,
+	                         std::move(encoder.pending_audio),
+	                         encoder.sample_rate};
+	encoder.pending_audio = {};
+	encoder.pending_audio.reserve(task.audio.capacity());
+
+	encoder.fifo->Enqueue(std::move(task));
+
+	encoder.stats.max_queue_depth = std::max(encoder.stats.max_queue_depth,
+	                                         encoder.fifo->Size());
 }
@@ -24,6 +24,20 @@
 
 #include "render.h"
 
+#include <vector>
+
+// A rendered frame plus the audio output since the previous frame, queued for
+// the video encoder thread. The encoder frees the image after encoding it, so
+// it must be a deep copy.
+struct VideoCaptureTask {
+	RenderedImage image     = {};
+	float frames_per_second = 0.0f;
+
+	// Interleaved 16-bit stereo sample frames
+	std::vector<int16_t> audio = {};
+	uint32_t sample_rate       = 0;
+};
+
 void capture_video_add_frame(const RenderedImage& image,
                              const float frames_per_second);
 
@@ -0,0 +1,1127 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// The cached core is an interpreter that decodes every instruction only
+// once. The decoded instructions are kept per page of linear memory and are
+// executed through threaded dispatch, which skips the prefix, ModRM and
+// immediate decoding that the normal core repeats for every instruction it
+// runs.
+//
+// Only the most frequently executed integer instructions are predecoded, all
+// the others are handed over to the normal core one at a time. Before a
+// predecoded instruction runs, its bytes are compared against the code in
+// memory; if they differ, the instruction is decoded again. This keeps
+// self-modifying code working without write-protecting the code pages, which
+// would clash with the dynamic core's page handlers when switching cores.
+
+#include "dosbox.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "callback.h"
+#include "cpu.h"
+#include "lazyflags.h"
+#include "mem.h"
+#include "mem_unaligned.h"
+#include "paging.h"
+#include "pic.h"
+#include "regs.h"
+#include "tracy.h"
+
+#if C_DEBUG
+#include "debug.h"
+#endif
+
+#include "modrm.h"
+
+#if (!C_CORE_INLINE)
+#define LoadMb(off) mem_readb(off)
+#define LoadMw(off) mem_readw(off)
+#define LoadMd(off) mem_readd(off)
+#define SaveMb(off,val)	mem_writeb(off,val)
+#define SaveMw(off,val)	mem_writew(off,val)
+#define SaveMd(off,val)	mem_writed(off,val)
+#else
+#define LoadMb(off) mem_readb_inline(off)
+#define LoadMw(off) mem_readw_inline(off)
+#define LoadMd(off) mem_readd_inline(off)
+#define SaveMb(off,val)	mem_writeb_inline(off,val)
+#define SaveMw(off,val)	mem_writew_inline(off,val)
+#define SaveMd(off,val)	mem_writed_inline(off,val)
+#endif
+
+#define LoadRb(reg) reg
+#define LoadRw(reg) reg
+#define LoadRd(reg) reg
+
+#define SaveRb(reg,val)	reg=val
+#define SaveRw(reg,val)	reg=val
+#define SaveRd(reg,val)	reg=val
+
+#include "instructions.h"
+
+#define MOVB(op1,op2,load,save) save(op1,op2);
+#define MOVW(op1,op2,load,save) save(op1,op2);
+#define MOVD(op1,op2,load,save) save(op1,op2);
+
+extern Bitu cycle_count;
+
+// GCC and Clang support taking the address of labels, which lets every
+// handler jump straight to the next one instead of going through a shared
+// switch statement.
+#if defined(__GNUC__)
+#define CACHED_CORE_THREADED 1
+#else
+#define CACHED_CORE_THREADED 0
+#endif
+
+// All forms of the two operand ALU and MOV instructions, in the order the
+// decoder computes them in.
+#define ALU_FORMS(X, kind) \
+	X(kind##_EbGb_R) X(kind##_EbGb_M) X(kind##_EwGw_R) \
+	X(kind##_EwGw_M) X(kind##_EdGd_R) X(kind##_EdGd_M) \
+	X(kind##_GbEb_R) X(kind##_GbEb_M) X(kind##_GwEw_R) \
+	X(kind##_GwEw_M) X(kind##_GdEd_R) X(kind##_GdEd_M) \
+	X(kind##_EbIb_R) X(kind##_EbIb_M) X(kind##_EwIw_R) \
+	X(kind##_EwIw_M) X(kind##_EdId_R) X(kind##_EdId_M)
+
+#define JCC_FORMS(X, size) \
+	X(JO_##size) X(JNO_##size) X(JB_##size) X(JNB_##size) \
+	X(JZ_##size) X(JNZ_##size) X(JBE_##size) X(JNBE_##size) \
+	X(JS_##size) X(JNS_##size) X(JP_##size) X(JNP_##size) \
+	X(JL_##size) X(JNL_##size) X(JLE_##size) X(JNLE_##size)
+
+#define CACHED_CORE_OPS(X) \
+	X(Fallback) \
+	ALU_FORMS(X, ADD) ALU_FORMS(X, OR) ALU_FORMS(X, ADC) \
+	ALU_FORMS(X, SBB) ALU_FORMS(X, AND) ALU_FORMS(X, SUB) \
+	ALU_FORMS(X, XOR) ALU_FORMS(X, CMP) ALU_FORMS(X, TEST) \
+	ALU_FORMS(X, MOV) \
+	X(INC_Eb_R) X(INC_Eb_M) X(INC_Ew_R) X(INC_Ew_M) X(INC_Ed_R) X(INC_Ed_M) \
+	X(DEC_Eb_R) X(DEC_Eb_M) X(DEC_Ew_R) X(DEC_Ew_M) X(DEC_Ed_R) X(DEC_Ed_M) \
+	X(PUSH_Rw) X(PUSH_Rd) X(POP_Rw) X(POP_Rd) X(PUSH_Iw) X(PUSH_Id) \
+	X(LEA_Gw) X(LEA_Gd) \
+	X(MOVZX_GwEb_R) X(MOVZX_GwEb_M) X(MOVZX_GdEb_R) X(MOVZX_GdEb_M) \
+	X(MOVZX_GdEw_R) X(MOVZX_GdEw_M) \
+	X(MOVSX_GwEb_R) X(MOVSX_GwEb_M) X(MOVSX_GdEb_R) X(MOVSX_GdEb_M) \
+	X(MOVSX_GdEw_R) X(MOVSX_GdEw_M) \
+	JCC_FORMS(X, 16) JCC_FORMS(X, 32) \
+	X(JMP_16) X(JMP_32) X(CALL_16) X(CALL_32) X(RET_16) X(RET_32) \
+	X(LOOPw_CX) X(LOOPw_ECX) X(LOOPd_CX) X(LOOPd_ECX) \
+	X(NOP)
+
+enum class Op : uint16_t {
+#define CACHED_OP_ENUM(name) name,
+	CACHED_CORE_OPS(CACHED_OP_ENUM)
+#undef CACHED_OP_ENUM
+};
+
+enum AluKind { Add, Or, Adc, Sbb, And, Sub, Xor, Cmp, Test, Mov };
+
+// Offsets of the operand forms in ALU_FORMS
+enum AluOperands { EG = 0, GE = 6, EI = 12 };
+
+enum OperandSize { Byte = 0, Word = 1, Dword = 2 };
+
+constexpr auto NumAluForms = 18;
+
+static_assert(static_cast<int>(Op::OR_EbGb_R) ==
+              static_cast<int>(Op::ADD_EbGb_R) + NumAluForms);
+static_assert(static_cast<int>(Op::MOV_EdId_M) ==
+              static_cast<int>(Op::ADD_EbGb_R) + (Mov + 1) * NumAluForms - 1);
+static_assert(static_cast<int>(Op::JO_32) == static_cast<int>(Op::JO_16) + 16);
+
+static constexpr Op alu_op(const AluKind kind, const AluOperands operands,
+                           const OperandSize size, const bool is_mem)
+{
+	return static_cast<Op>(static_cast<int>(Op::ADD_EbGb_R) +
+	                       kind * NumAluForms + operands + size * 2 +
+	                       (is_mem ? 1 : 0));
+}
+
+static constexpr Op offset_op(const Op op, const int offset)
+{
+	return static_cast<Op>(static_cast<int>(op) + offset);
+}
+
+constexpr auto MaxInstructionLength = 16;
+constexpr auto MaxPrefixes          = 4;
+constexpr uint32_t CodePageSize     = 4096;
+
+// Pages decoded under more distinct code addresses than this are dropped
+// all at once
+constexpr size_t MaxCachedPages = 512;
+
+static const uint32_t zero_register = 0;
+
+union RegisterPtr {
+	uint8_t* b = nullptr;
+	uint16_t* w;
+	uint32_t* d;
+};
+
+struct DecodedInstruction {
+	// The instruction's bytes, to detect modified code
+	std::array<uint8_t, MaxInstructionLength> bytes = {};
+	std::array<uint64_t, 2> byte_masks              = {};
+	uint8_t length                                  = 0;
+	bool compare_bytewise                           = false;
+
+	Op op = Op::Fallback;
+
+	// The ModRM reg field or implied register, and the ModRM register
+	// operand
+	RegisterPtr reg = {};
+	RegisterPtr rm  = {};
+
+	// Immediate value or relative jump displacement
+	uint32_t imm = 0;
+
+	// Memory operand
+	struct {
+		const uint32_t* base  = &zero_register;
+		const uint32_t* index = &zero_register;
+		uint32_t disp         = 0;
+		uint32_t mask         = 0xffff;
+		uint8_t scale         = 0;
+		SegNames seg          = ds;
+	} ea = {};
+};
+
+struct DecodedPage {
+	// One-based positions in the instructions vector by page offset, zero
+	// if nothing has been decoded at the offset yet
+	std::array<uint16_t, CodePageSize> index    = {};
+	std::vector<DecodedInstruction> instructions = {};
+};
+
+static struct {
+	std::unordered_map<uint32_t, std::unique_ptr<DecodedPage>> pages = {};
+
+	DecodedPage* current_page = nullptr;
+	uint32_t current_key      = UINT32_MAX;
+} cache;
+
+// Run by the normal core for code that can't be read directly
+static const DecodedInstruction unmapped_code = {};
+
+class CodeReader {
+public:
+	CodeReader(const uint8_t* code_start, const uint32_t available_bytes)
+	        : code(code_start),
+	          available(std::min(available_bytes,
+	                             static_cast<uint32_t>(MaxInstructionLength)))
+	{}
+
+	// prevent copying
+	CodeReader(const CodeReader&) = delete;
+	// prevent assignment
+	CodeReader& operator=(const CodeReader&) = delete;
+
+	uint8_t Fetchb()
+	{
+		if (pos >= available) {
+			overrun = true;
+			return 0;
+		}
+		return code[pos++];
+	}
+
+	uint16_t Fetchw()
+	{
+		const uint16_t lo = Fetchb();
+		const uint16_t hi = Fetchb();
+		return static_cast<uint16_t>(lo | (hi << 8));
+	}
+
+	uint32_t Fetchd()
+	{
+		const uint32_t lo = Fetchw();
+		const uint32_t hi = Fetchw();
+		return lo | (hi << 16);
+	}
+
+	uint32_t Fetchbs()
+	{
+		return static_cast<uint32_t>(static_cast<int8_t>(Fetchb()));
+	}
+
+	uint32_t Fetchws()
+	{
+		return static_cast<uint32_t>(static_cast<int16_t>(Fetchw()));
+	}
+
+	uint8_t Position() const
+	{
+		return pos;
+	}
+
+	bool Overrun() const
+	{
+		return overrun;
+	}
+
+private:
+	const uint8_t* code = nullptr;
+	uint32_t available  = 0;
+	uint8_t pos         = 0;
+	bool overrun        = false;
+};
+
+static uint32_t* reg32(const uint8_t reg)
+{
+	return lookupRMEAregd[0xc0 + reg];
+}
+
+static void set_registers(DecodedInstruction& insn, const uint8_t rm,
+                          const OperandSize size)
+{
+	switch (size) {
+	case Byte:
+		insn.reg.b = lookupRMregb[rm];
+		if (rm >= 0xc0) {
+			insn.rm.b = lookupRMEAregb[rm];
+		}
+		break;
+	case Word:
+		insn.reg.w = lookupRMregw[rm];
+		if (rm >= 0xc0) {
+			insn.rm.w = lookupRMEAregw[rm];
+		}
+		break;
+	case Dword:
+		insn.reg.d = lookupRMregd[rm];
+		if (rm >= 0xc0) {
+			insn.rm.d = lookupRMEAregd[rm];
+		}
+		break;
+	}
+}
+
+// Decodes the ModRM byte with its SIB byte and displacement, and returns it
+static uint8_t decode_modrm(CodeReader& reader, DecodedInstruction& insn,
+                            const bool addr_32,
+                            const std::optional<SegNames> seg_override)
+{
+	const auto rm = reader.Fetchb();
+	if (rm >= 0xc0) {
+		return rm;
+	}
+	const auto mod = rm >> 6;
+	auto& ea       = insn.ea;
+	auto seg       = ds;
+
+	if (!addr_32) {
+		struct Mode16 {
+			uint8_t base;
+			uint8_t index;
+			SegNames seg;
+		};
+		constexpr uint8_t None = 8;
+		constexpr Mode16 modes[8] = {{3, 6, ds}, {3, 7, ds}, {5, 6, ss},
+		                             {5, 7, ss}, {6, None, ds},
+		                             {7, None, ds}, {5, None, ss},
+		                             {3, None, ds}};
+		ea.mask = 0xffff;
+		if (mod == 0 && (rm & 7) == 6) {
+			ea.disp = reader.Fetchw();
+		} else {
+			const auto& mode = modes[rm & 7];
+			ea.base          = reg32(mode.base);
+			if (mode.index != None) {
+				ea.index = reg32(mode.index);
+			}
+			seg = mode.seg;
+		}
+		if (mod == 1) {
+			ea.disp = reader.Fetchbs();
+		} else if (mod == 2) {
+			ea.disp = reader.Fetchw();
+		}
+	} else {
+		ea.mask    = 0xffffffff;
+		auto base = static_cast<uint8_t>(rm & 7);
+		if (base == 4) {
+			const auto sib   = reader.Fetchb();
+			const auto index = (sib >> 3) & 7;
+			base             = sib & 7;
+			if (index != 4) {
+				ea.index = reg32(static_cast<uint8_t>(index));
+				ea.scale = static_cast<uint8_t>(sib >> 6);
+			}
+		}
+		if (mod == 0 && base == 5) {
+			ea.disp = reader.Fetchd();
+		} else {
+			ea.base = reg32(base);
+			if (base == 4 || base == 5) {
+				seg = ss;
+			}
+		}
+		if (mod == 1) {
+			ea.disp = reader.Fetchbs();
+		} else if (mod == 2) {
+			ea.disp = reader.Fetchd();
+		}
+	}
+	ea.seg = seg_override.value_or(seg);
+	return rm;
+}
+
+// Decodes the instruction at the start of the passed in code, leaving the
+// operation as fallback if the instruction isn't predecoded
+static DecodedInstruction decode_instruction(const uint8_t* code,
+                                             const uint32_t available,
+                                             const bool big)
+{
+	DecodedInstruction insn = {};
+	CodeReader reader(code, available);
+
+	auto op_32 = big;
+	auto addr_32 = big;
+	std::optional<SegNames> seg_override = {};
+
+	auto decode = [&]() -> Op {
+		uint8_t opcode = 0;
+		for (auto num_prefixes = 0;; ++num_prefixes) {
+			opcode = reader.Fetchb();
+			if (num_prefixes == MaxPrefixes) {
+				return Op::Fallback;
+			}
+			switch (opcode) {
+			case 0x26: seg_override = es; continue;
+			case 0x2e: seg_override = cs; continue;
+			case 0x36: seg_override = ss; continue;
+			case 0x3e: seg_override = ds; continue;
+			case 0x64: seg_override = fs; continue;
+			case 0x65: seg_override = gs; continue;
+			case 0x66: op_32 = !big; continue;
+			case 0x67: addr_32 = !big; continue;
+			}
+			break;
+		}
+		const auto size_v = op_32 ? Dword : Word;
+
+		auto modrm = [&](const OperandSize size) {
+			const auto rm = decode_modrm(reader, insn, addr_32, seg_override);
+			set_registers(insn, rm, size);
+			return rm;
+		};
+		auto fetch_imm = [&](const OperandSize size) -> uint32_t {
+			switch (size) {
+			case Byte: return reader.Fetchb();
+			case Word: return reader.Fetchw();
+			case Dword: return reader.Fetchd();
+			}
+			return 0;
+		};
+
+		if (opcode < 0x40 && (opcode & 7) < 6) {
+			const auto kind = static_cast<AluKind>(opcode >> 3);
+			const auto size = (opcode & 1) ? size_v : Byte;
+			switch (opcode & 7) {
+			case 0:
+			case 1: {
+				const auto rm = modrm(size);
+				return alu_op(kind, EG, size, rm < 0xc0);
+			}
+			case 2:
+			case 3: {
+				const auto rm = modrm(size);
+				return alu_op(kind, GE, size, rm < 0xc0);
+			}
+			default:
+				set_registers(insn, 0xc0, size);
+				insn.imm = fetch_imm(size);
+				return alu_op(kind, EI, size, false);
+			}
+		}
+		switch (opcode) {
+		case 0x0f: break;
+		case 0x40: case 0x41: case 0x42: case 0x43:
+		case 0x44: case 0x45: case 0x46: case 0x47:
+		case 0x48: case 0x49: case 0x4a: case 0x4b:
+		case 0x4c: case 0x4d: case 0x4e: case 0x4f: {
+			set_registers(insn, static_cast<uint8_t>(0xc0 + (opcode & 7)), size_v);
+			const auto inc = op_32 ? Op::INC_Ed_R : Op::INC_Ew_R;
+			const auto dec = op_32 ? Op::DEC_Ed_R : Op::DEC_Ew_R;
+			return opcode < 0x48 ? inc : dec;
+		}
+		case 0x50: case 0x51: case 0x52: case 0x53:
+		case 0x54: case 0x55: case 0x56: case 0x57:
+			set_registers(insn, static_cast<uint8_t>(0xc0 + (opcode & 7)), size_v);
+			return op_32 ? Op::PUSH_Rd : Op::PUSH_Rw;
+		case 0x58: case 0x59: case 0x5a: case 0x5b:
+		case 0x5c: case 0x5d: case 0x5e: case 0x5f:
+			set_registers(insn, static_cast<uint8_t>(0xc0 + (opcode & 7)), size_v);
+			return op_32 ? Op::POP_Rd : Op::POP_Rw;
+		case 0x68:
+			insn.imm = fetch_imm(size_v);
+			return op_32 ? Op::PUSH_Id : Op::PUSH_Iw;
+		case 0x6a:
+			insn.imm = reader.Fetchbs();
+			return op_32 ? Op::PUSH_Id : Op::PUSH_Iw;
+		case 0x70: case 0x71: case 0x72: case 0x73:
+		case 0x74: case 0x75: case 0x76: case 0x77:
+		case 0x78: case 0x79: case 0x7a: case 0x7b:
+		case 0x7c: case 0x7d: case 0x7e: case 0x7f:
+			insn.imm = reader.Fetchbs();
+			return offset_op(op_32 ? Op::JO_32 : Op::JO_16, opcode & 0xf);
+		case 0x80:
+		case 0x81:
+		case 0x83: {
+			const auto size = opcode == 0x80 ? Byte : size_v;
+			const auto rm   = modrm(size);
+			insn.imm = opcode == 0x83 ? reader.Fetchbs() : fetch_imm(size);
+			const auto kind = static_cast<AluKind>((rm >> 3) & 7);
+			return alu_op(kind, EI, size, rm < 0xc0);
+		}
+		case 0x84:
+		case 0x85:
+		case 0x88:
+		case 0x89:
+		case 0x8a:
+		case 0x8b: {
+			const auto size = (opcode & 1) ? size_v : Byte;
+			const auto rm   = modrm(size);
+			const auto kind = opcode < 0x88 ? Test : Mov;
+			return alu_op(kind, (opcode & 2) ? GE : EG, size, rm < 0xc0);
+		}
+		case 0x8d:
+			if (modrm(size_v) >= 0xc0) {
+				return Op::Fallback;
+			}
+			return op_32 ? Op::LEA_Gd : Op::LEA_Gw;
+		case 0x90: return Op::NOP;
+		case 0xa8:
+		case 0xa9: {
+			const auto size = (opcode & 1) ? size_v : Byte;
+			set_registers(insn, 0xc0, size);
+			insn.imm = fetch_imm(size);
+			return alu_op(Test, EI, size, false);
+		}
+		case 0xb0: case 0xb1: case 0xb2: case 0xb3:
+		case 0xb4: case 0xb5: case 0xb6: case 0xb7:
+		case 0xb8: case 0xb9: case 0xba: case 0xbb:
+		case 0xbc: case 0xbd: case 0xbe: case 0xbf: {
+			const auto size = opcode < 0xb8 ? Byte : size_v;
+			set_registers(insn, static_cast<uint8_t>(0xc0 + (opcode & 7)), size);
+			insn.imm = fetch_imm(size);
+			return alu_op(Mov, EI, size, false);
+		}
+		case 0xc3: return op_32 ? Op::RET_32 : Op::RET_16;
+		case 0xc6:
+		case 0xc7:
+		case 0xf6:
+		case 0xf7: {
+			const auto size = (opcode & 1) ? size_v : Byte;
+			const auto rm   = modrm(size);
+			if ((rm >> 3) & 7) {
+				return Op::Fallback;
+			}
+			insn.imm = fetch_imm(size);
+			const auto kind = opcode < 0xf6 ? Mov : Test;
+			return alu_op(kind, EI, size, rm < 0xc0);
+		}
+		case 0xe2:
+			insn.imm = reader.Fetchbs();
+			if (op_32) {
+				return addr_32 ? Op::LOOPd_ECX : Op::LOOPd_CX;
+			}
+			return addr_32 ? Op::LOOPw_ECX : Op::LOOPw_CX;
+		case 0xe8:
+			insn.imm = op_32 ? reader.Fetchd() : reader.Fetchws();
+			return op_32 ? Op::CALL_32 : Op::CALL_16;
+		case 0xe9:
+			insn.imm = op_32 ? reader.Fetchd() : reader.Fetchws();
+			return op_32 ? Op::JMP_32 : Op::JMP_16;
+		case 0xeb:
+			insn.imm = reader.Fetchbs();
+			return op_32 ? Op::JMP_32 : Op::JMP_16;
+		case 0xfe:
+		case 0xff: {
+			const auto size = opcode == 0xfe ? Byte : size_v;
+			const auto rm   = modrm(size);
+			const auto which = (rm >> 3) & 7;
+			if (which > 1) {
+				return Op::Fallback;
+			}
+			const auto base = which == 0 ? Op::INC_Eb_R : Op::DEC_Eb_R;
+			return offset_op(base, size * 2 + (rm < 0xc0 ? 1 : 0));
+		}
+		default: return Op::Fallback;
+		}
+
+		// Two byte opcodes
+		const auto opcode_0f = reader.Fetchb();
+		switch (opcode_0f) {
+		case 0x80: case 0x81: case 0x82: case 0x83:
+		case 0x84: case 0x85: case 0x86: case 0x87:
+		case 0x88: case 0x89: case 0x8a: case 0x8b:
+		case 0x8c: case 0x8d: case 0x8e: case 0x8f:
+			insn.imm = op_32 ? reader.Fetchd() : reader.Fetchws();
+			return offset_op(op_32 ? Op::JO_32 : Op::JO_16, opcode_0f & 0xf);
+		case 0xb6:
+		case 0xbe: {
+			const auto rm = decode_modrm(reader, insn, addr_32, seg_override);
+			set_registers(insn, rm, size_v);
+			insn.rm.b = rm >= 0xc0 ? lookupRMEAregb[rm] : nullptr;
+			const auto base = opcode_0f == 0xb6
+			                        ? (op_32 ? Op::MOVZX_GdEb_R : Op::MOVZX_GwEb_R)
+			                        : (op_32 ? Op::MOVSX_GdEb_R : Op::MOVSX_GwEb_R);
+			return offset_op(base, rm < 0xc0 ? 1 : 0);
+		}
+		case 0xb7:
+		case 0xbf: {
+			if (!op_32) {
+				return Op::Fallback;
+			}
+			const auto rm = decode_modrm(reader, insn, addr_32, seg_override);
+			set_registers(insn, rm, Dword);
+			insn.rm.w = rm >= 0xc0 ? lookupRMEAregw[rm] : nullptr;
+			const auto base = opcode_0f == 0xb7 ? Op::MOVZX_GdEw_R
+			                                    : Op::MOVSX_GdEw_R;
+			return offset_op(base, rm < 0xc0 ? 1 : 0);
+		}
+		default: return Op::Fallback;
+		}
+	};
+
+	insn.op     = decode();
+	insn.length = reader.Position();
+	if (reader.Overrun()) {
+		insn.op = Op::Fallback;
+	}
+
+	std::memcpy(insn.bytes.data(), code, insn.length);
+
+	std::array<uint8_t, MaxInstructionLength> mask = {};
+	std::fill_n(mask.begin(), insn.length, static_cast<uint8_t>(0xff));
+	insn.byte_masks[0] = read_unaligned_uint64(mask.data());
+	insn.byte_masks[1] = read_unaligned_uint64(mask.data() + 8);
+
+	// Comparing whole 64-bit words would read past the end of the page
+	insn.compare_bytewise = available < (insn.length > 8 ? 16u : 8u);
+	return insn;
+}
+
+static inline bool code_matches(const uint8_t* code,
+                                const DecodedInstruction& insn) noexcept
+{
+	if (insn.compare_bytewise) {
+		return std::memcmp(code, insn.bytes.data(), insn.length) == 0;
+	}
+	auto diff = (read_unaligned_uint64(code) ^
+	             read_unaligned_uint64(insn.bytes.data())) &
+	            insn.byte_masks[0];
+	if (insn.length > 8) {
+		diff |= (read_unaligned_uint64(code + 8) ^
+		         read_unaligned_uint64(insn.bytes.data() + 8)) &
+		        insn.byte_masks[1];
+	}
+	return diff == 0;
+}
+
+static void select_page(const uint32_t key)
+{
+	auto it = cache.pages.find(key);
+	if (it == cache.pages.end()) {
+		if (cache.pages.size() >= MaxCachedPages) {
+			cache.pages.clear();
+		}
+		it = cache.pages.emplace(key, std::make_unique<DecodedPage>()).first;
+	}
+	cache.current_key  = key;
+	cache.current_page = it->second.get();
+}
+
+static const DecodedInstruction* decode_into_page(DecodedPage& page,
+                                                  const uint32_t offset,
+                                                  const uint8_t* code)
+{
+	auto insn = decode_instruction(code, CodePageSize - offset, cpu.code.big);
+
+	auto& slot = page.index[offset];
+	if (!slot) {
+		page.instructions.emplace_back();
+		slot = static_cast<uint16_t>(page.instructions.size());
+	}
+	auto& entry = page.instructions[slot - 1];
+	entry       = insn;
+	return &entry;
+}
+
+static inline const DecodedInstruction* find_instruction(const PhysPt cseip) noexcept
+{
+	const auto tlb_base = get_tlb_read(cseip);
+	if (!tlb_base) {
+		return &unmapped_code;
+	}
+	const auto key = ((cseip >> 12) << 1) | (cpu.code.big ? 1 : 0);
+	if (key != cache.current_key) {
+		select_page(key);
+	}
+	auto& page        = *cache.current_page;
+	const auto offset = cseip & (CodePageSize - 1);
+	const auto code   = tlb_base + cseip;
+
+	const auto slot = page.index[offset];
+	if (slot) {
+		const auto& insn = page.instructions[slot - 1];
+		if (code_matches(code, insn)) {
+			return &insn;
+		}
+	}
+	return decode_into_page(page, offset, code);
+}
+
+static inline uint32_t get_ea_offset(const DecodedInstruction& insn) noexcept
+{
+	return (*insn.ea.base + (*insn.ea.index << insn.ea.scale) + insn.ea.disp) &
+	       insn.ea.mask;
+}
+
+static inline PhysPt get_ea(const DecodedInstruction& insn) noexcept
+{
+	return SegPhys(insn.ea.seg) + get_ea_offset(insn);
+}
+
+#if C_DEBUG
+#if C_HEAVY_DEBUG
+#define CHECK_BREAKPOINT()                   \
+	if (DEBUG_HeavyIsBreakpoint()) {     \
+		FillFlags();                 \
+		return debugCallback;        \
+	}
+#else
+#define CHECK_BREAKPOINT()
+#endif
+#define DEBUG_STEP()        \
+	CHECK_BREAKPOINT();  \
+	cycle_count++;
+#else
+#define DEBUG_STEP()
+#endif
+
+// The fallback steps the debugger itself in CPU_Core_Normal_Step, so it
+// doesn't count the instruction a second time
+#define FETCH_INSTRUCTION()                                  \
+	if (CPU_Cycles-- <= 0) {                             \
+		goto slice_end;                              \
+	}                                                    \
+	insn = find_instruction(SegPhys(cs) + reg_eip);      \
+	if (insn->op != Op::Fallback) {                      \
+		DEBUG_STEP();                                \
+	}
+
+#if CACHED_CORE_THREADED
+#define OPCODE(name) op_##name:
+#define NEXT_INSTRUCTION()                     \
+	{                                      \
+		FETCH_INSTRUCTION();           \
+		goto* dispatch_table[static_cast<size_t>(insn->op)]; \
+	}
+#else
+#define OPCODE(name) case Op::name:
+#define NEXT_INSTRUCTION() continue
+#endif
+
+#define FINISH_INSTRUCTION()         \
+	reg_eip += insn->length;     \
+	NEXT_INSTRUCTION()
+
+#define ALU_HANDLERS(kind)                                                      \
+	OPCODE(kind##_EbGb_R)                                                   \
+	{                                                                       \
+		kind##B(*insn->rm.b, *insn->reg.b, LoadRb, SaveRb);             \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_EbGb_M)                                                   \
+	{                                                                       \
+		const auto eaa = get_ea(*insn);                                 \
+		kind##B(eaa, *insn->reg.b, LoadMb, SaveMb);                     \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_EwGw_R)                                                   \
+	{                                                                       \
+		kind##W(*insn->rm.w, *insn->reg.w, LoadRw, SaveRw);             \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_EwGw_M)                                                   \
+	{                                                                       \
+		const auto eaa = get_ea(*insn);                                 \
+		kind##W(eaa, *insn->reg.w, LoadMw, SaveMw);                     \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_EdGd_R)                                                   \
+	{                                                                       \
+		kind##D(*insn->rm.d, *insn->reg.d, LoadRd, SaveRd);             \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_EdGd_M)                                                   \
+	{                                                                       \
+		const auto eaa = get_ea(*insn);                                 \
+		kind##D(eaa, *insn->reg.d, LoadMd, SaveMd);                     \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_GbEb_R)                                                   \
+	{                                                                       \
+		kind##B(*insn->reg.b, *insn->rm.b, LoadRb, SaveRb);             \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_GbEb_M)                                                   \
+	{                                                                       \
+		kind##B(*insn->reg.b, LoadMb(get_ea(*insn)), LoadRb, SaveRb);   \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_GwEw_R)                                                   \
+	{                                                                       \
+		kind##W(*insn->reg.w, *insn->rm.w, LoadRw, SaveRw);             \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_GwEw_M)                                                   \
+	{                                                                       \
+		kind##W(*insn->reg.w, LoadMw(get_ea(*insn)), LoadRw, SaveRw);   \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_GdEd_R)                                                   \
+	{                                                                       \
+		kind##D(*insn->reg.d, *insn->rm.d, LoadRd, SaveRd);             \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_GdEd_M)                                                   \
+	{                                                                       \
+		kind##D(*insn->reg.d, LoadMd(get_ea(*insn)), LoadRd, SaveRd);   \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_EbIb_R)                                                   \
+	{                                                                       \
+		kind##B(*insn->rm.b, static_cast<uint8_t>(insn->imm), LoadRb,   \
+		        SaveRb);                                                \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_EbIb_M)                                                   \
+	{                                                                       \
+		const auto eaa = get_ea(*insn);                                 \
+		kind##B(eaa, static_cast<uint8_t>(insn->imm), LoadMb, SaveMb); \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_EwIw_R)                                                   \
+	{                                                                       \
+		kind##W(*insn->rm.w, static_cast<uint16_t>(insn->imm), LoadRw,  \
+		        SaveRw);                                                \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_EwIw_M)                                                   \
+	{                                                                       \
+		const auto eaa = get_ea(*insn);                                 \
+		kind##W(eaa, static_cast<uint16_t>(insn->imm), LoadMw, SaveMw); \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_EdId_R)                                                   \
+	{                                                                       \
+		kind##D(*insn->rm.d, insn->imm, LoadRd, SaveRd);                \
+	}                                                                       \
+	FINISH_INSTRUCTION();                                                   \
+	OPCODE(kind##_EdId_M)                                                   \
+	{                                                                       \
+		const auto eaa = get_ea(*insn);                                 \
+		kind##D(eaa, insn->imm, LoadMd, SaveMd);                        \
+	}                                                                       \
+	FINISH_INSTRUCTION();
+
+#define INCDEC_HANDLERS(kind)                                     \
+	OPCODE(kind##_Eb_R)                                       \
+	{                                                         \
+		kind##B(*insn->rm.b, LoadRb, SaveRb);             \
+	}                                                         \
+	FINISH_INSTRUCTION();                                     \
+	OPCODE(kind##_Eb_M)                                       \
+	{                                                         \
+		const auto eaa = get_ea(*insn);                   \
+		kind##B(eaa, LoadMb, SaveMb);                     \
+	}                                                         \
+	FINISH_INSTRUCTION();                                     \
+	OPCODE(kind##_Ew_R)                                       \
+	{                                                         \
+		kind##W(*insn->rm.w, LoadRw, SaveRw);             \
+	}                                                         \
+	FINISH_INSTRUCTION();                                     \
+	OPCODE(kind##_Ew_M)                                       \
+	{                                                         \
+		const auto eaa = get_ea(*insn);                   \
+		kind##W(eaa, LoadMw, SaveMw);                     \
+	}                                                         \
+	FINISH_INSTRUCTION();                                     \
+	OPCODE(kind##_Ed_R)                                       \
+	{                                                         \
+		kind##D(*insn->rm.d, LoadRd, SaveRd);             \
+	}                                                         \
+	FINISH_INSTRUCTION();                                     \
+	OPCODE(kind##_Ed_M)                                       \
+	{                                                         \
+		const auto eaa = get_ea(*insn);                   \
+		kind##D(eaa, LoadMd, SaveMd);                     \
+	}                                                         \
+	FINISH_INSTRUCTION();
+
+#define JCC_HANDLERS(cc)                                                      \
+	OPCODE(J##cc##_16)                                                    \
+	{                                                                     \
+		const auto disp = TFLG_##cc ? insn->imm : 0;                  \
+		reg_ip = static_cast<uint16_t>(reg_ip + insn->length + disp); \
+	}                                                                     \
+	NEXT_INSTRUCTION();                                                   \
+	OPCODE(J##cc##_32)                                                    \
+	{                                                                     \
+		const auto disp = TFLG_##cc ? insn->imm : 0;                  \
+		reg_eip += insn->length + disp;                               \
+	}                                                                     \
+	NEXT_INSTRUCTION();
+
+Bits CPU_Core_Cached_Run() noexcept
+{
+	ZoneScoped;
+	const DecodedInstruction* insn = nullptr;
+
+#if CACHED_CORE_THREADED
+	static const void* const dispatch_table[] = {
+#define CACHED_OP_LABEL(name) &&op_##name,
+	        CACHED_CORE_OPS(CACHED_OP_LABEL)
+#undef CACHED_OP_LABEL
+	};
+	NEXT_INSTRUCTION();
+#else
+	for (;;) {
+		FETCH_INSTRUCTION();
+		switch (insn->op) {
+#endif
+
+	OPCODE(Fallback)
+	{
+		// The cycle of the instruction has already been consumed
+		const auto ret = CPU_Core_Normal_Step();
+		if (ret) {
+			return ret;
+		}
+		if (cpudecoder != &CPU_Core_Cached_Run) {
+			if (cpudecoder == &CPU_Core_Normal_Trap_Run) {
+				cpudecoder = &CPU_Core_Cached_Trap_Run;
+			}
+			FillFlags();
+			return CBRET_NONE;
+		}
+		if (GETFLAG(IF) && PIC_IRQCheck) {
+			FillFlags();
+			return CBRET_NONE;
+		}
+	}
+	NEXT_INSTRUCTION();
+
+	ALU_HANDLERS(ADD)
+	ALU_HANDLERS(OR)
+	ALU_HANDLERS(ADC)
+	ALU_HANDLERS(SBB)
+	ALU_HANDLERS(AND)
+	ALU_HANDLERS(SUB)
+	ALU_HANDLERS(XOR)
+	ALU_HANDLERS(CMP)
+	ALU_HANDLERS(TEST)
+	ALU_HANDLERS(MOV)
+
+	INCDEC_HANDLERS(INC)
+	INCDEC_HANDLERS(DEC)
+
+	OPCODE(PUSH_Rw)
+	CPU_Push16(*insn->rm.w);
+	FINISH_INSTRUCTION();
+	OPCODE(PUSH_Rd)
+	CPU_Push32(*insn->rm.d);
+	FINISH_INSTRUCTION();
+	OPCODE(POP_Rw)
+	*insn->rm.w = CPU_Pop16();
+	FINISH_INSTRUCTION();
+	OPCODE(POP_Rd)
+	*insn->rm.d = CPU_Pop32();
+	FINISH_INSTRUCTION();
+	OPCODE(PUSH_Iw)
+	CPU_Push16(static_cast<uint16_t>(insn->imm));
+	FINISH_INSTRUCTION();
+	OPCODE(PUSH_Id)
+	CPU_Push32(insn->imm);
+	FINISH_INSTRUCTION();
+
+	OPCODE(LEA_Gw)
+	*insn->reg.w = static_cast<uint16_t>(get_ea_offset(*insn));
+	FINISH_INSTRUCTION();
+	OPCODE(LEA_Gd)
+	*insn->reg.d = get_ea_offset(*insn);
+	FINISH_INSTRUCTION();
+
+	OPCODE(MOVZX_GwEb_R)
+	*insn->reg.w = *insn->rm.b;
+	FINISH_INSTRUCTION();
+	OPCODE(MOVZX_GwEb_M)
+	*insn->reg.w = LoadMb(get_ea(*insn));
+	FINISH_INSTRUCTION();
+	OPCODE(MOVZX_GdEb_R)
+	*insn->reg.d = *insn->rm.b;
+	FINISH_INSTRUCTION();
+	OPCODE(MOVZX_GdEb_M)
+	*insn->reg.d = LoadMb(get_ea(*insn));
+	FINISH_INSTRUCTION();
+	OPCODE(MOVZX_GdEw_R)
+	*insn->reg.d = *insn->rm.w;
+	FINISH_INSTRUCTION();
+	OPCODE(MOVZX_GdEw_M)
+	*insn->reg.d = LoadMw(get_ea(*insn));
+	FINISH_INSTRUCTION();
+	OPCODE(MOVSX_GwEb_R)
+	*insn->reg.w = static_cast<uint16_t>(static_cast<int8_t>(*insn->rm.b));
+	FINISH_INSTRUCTION();
+	OPCODE(MOVSX_GwEb_M)
+	*insn->reg.w = static_cast<uint16_t>(
+	        static_cast<int8_t>(LoadMb(get_ea(*insn))));
+	FINISH_INSTRUCTION();
+	OPCODE(MOVSX_GdEb_R)
+	*insn->reg.d = static_cast<uint32_t>(static_cast<int8_t>(*insn->rm.b));
+	FINISH_INSTRUCTION();
+	OPCODE(MOVSX_GdEb_M)
+	*insn->reg.d = static_cast<uint32_t>(
+	        static_cast<int8_t>(LoadMb(get_ea(*insn))));
+	FINISH_INSTRUCTION();
+	OPCODE(MOVSX_GdEw_R)
+	*insn->reg.d = static_cast<uint32_t>(static_cast<int16_t>(*insn->rm.w));
+	FINISH_INSTRUCTION();
+	OPCODE(MOVSX_GdEw_M)
+	*insn->reg.d = static_cast<uint32_t>(
+	        static_cast<int16_t>(LoadMw(get_ea(*insn))));
+	FINISH_INSTRUCTION();
+
+	JCC_HANDLERS(O)
+	JCC_HANDLERS(NO)
+	JCC_HANDLERS(B)
+	JCC_HANDLERS(NB)
+	JCC_HANDLERS(Z)
+	JCC_HANDLERS(NZ)
+	JCC_HANDLERS(BE)
+	JCC_HANDLERS(NBE)
+	JCC_HANDLERS(S)
+	JCC_HANDLERS(NS)
+	JCC_HANDLERS(P)
+	JCC_HANDLERS(NP)
+	JCC_HANDLERS(L)
+	JCC_HANDLERS(NL)
+	JCC_HANDLERS(LE)
+	JCC_HANDLERS(NLE)
+
+	OPCODE(JMP_16)
+	reg_eip = static_cast<uint16_t>(reg_eip + insn->length + insn->imm);
+	NEXT_INSTRUCTION();
+	OPCODE(JMP_32)
+	reg_eip += insn->length + insn->imm;
+	NEXT_INSTRUCTION();
+	OPCODE(CALL_16)
+	{
+		const auto return_ip = reg_eip + insn->length;
+		CPU_Push16(static_cast<uint16_t>(return_ip));
+		reg_eip = static_cast<uint16_t>(return_ip + insn->imm);
+	}
+	NEXT_INSTRUCTION();
+	OPCODE(CALL_32)
+	{
+		const auto return_eip = reg_eip + insn->length;
+		CPU_Push32(return_eip);
+		reg_eip = return_eip + insn->imm;
+	}
+	NEXT_INSTRUCTION();
+	OPCODE(RET_16)
+	reg_eip = CPU_Pop16();
+	NEXT_INSTRUCTION();
+	OPCODE(RET_32)
+	reg_eip = CPU_Pop32();
+	NEXT_INSTRUCTION();
+
+	OPCODE(LOOPw_CX)
+	{
+		const auto disp = --reg_cx ? insn->imm : 0;
+		reg_ip = static_cast<uint16_t>(reg_ip + insn->length + disp);
+	}
+	NEXT_INSTRUCTION();
+	OPCODE(LOOPw_ECX)
+	{
+		const auto disp = --reg_ecx ? insn->imm : 0;
+		reg_ip = static_cast<uint16_t>(reg_ip + insn->length + disp);
+	}
+	NEXT_INSTRUCTION();
+	OPCODE(LOOPd_CX)
+	{
+		const auto disp = --reg_cx ? insn->imm : 0;
+		reg_eip += insn->length + disp;
+	}
+	NEXT_INSTRUCTION();
+	OPCODE(LOOPd_ECX)
+	{
+		const auto disp = --reg_ecx ? insn->imm : 0;
+		reg_eip += insn->length + disp;
+	}
+	NEXT_INSTRUCTION();
+
+	OPCODE(NOP)
+	FINISH_INSTRUCTION();
+
+#if !CACHED_CORE_THREADED
+		}
+	}
+#endif
+
+slice_end:
+	FillFlags();
+	return CBRET_NONE;
+}
+
+Bits CPU_Core_Cached_Trap_Run() noexcept
+{
+	const auto old_cycles = CPU_Cycles;
+	CPU_Cycles = 1;
+	cpu.trap_skip = false;
+
+	const auto ret = CPU_Core_Cached_Run();
+	if (!cpu.trap_skip) {
+		CPU_DebugException(DBINT_STEP, reg_eip);
+	}
+	CPU_Cycles = old_cycles - 1;
+	cpudecoder = &CPU_Core_Cached_Run;
+
+	return ret;
+}
+
+void CPU_Core_Cached_Init()
+{
+	cache.pages.clear();
+	cache.current_page = nullptr;
+	cache.current_key  = UINT32_MAX;
+}
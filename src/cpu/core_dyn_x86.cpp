@@ -42,6 +42,7 @@
 
 #include "callback.h"
 #include "cpu.h"
+#include "cpu_profiling.h"
 #include "debug.h"
 #include "fpu.h"
 #include "inout.h"
@@ -285,7 +286,7 @@ static BlockReturn sync_normal_fpu_and_run_dyn_code(const uint8_t* code) noexcep
 	return gen_runcode(code);
 }
 
-static Bits sync_dh_fpu_and_run_normal_core() noexcept
+static void sync_dh_fpu_to_normal() noexcept
 {
 	if (last_core == CoreType::Dynamic) {
 		maybe_sync_host_fpu_to_dh();
@@ -296,6 +297,11 @@ static Bits sync_dh_fpu_and_run_normal_core() noexcept
 		FPU_SetPRegsFrom(dyn_dh_fpu.state.st_reg);
 		last_core = CoreType::Normal;
 	}
+}
+
+static Bits sync_dh_fpu_and_run_normal_core() noexcept
+{
+	sync_dh_fpu_to_normal();
 	assert(!dyn_dh_fpu.state_used);
 	return CPU_Core_Normal_Run();
 }
@@ -340,7 +346,8 @@ restart_core:
 	/* Find correct Dynamic Block to run */
 	CacheBlock * block=chandler->FindCacheBlock(ip_point&4095);
 	if (!block) {
-		if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
+		if (!chandler->IsInterpreted() &&
+		    (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4))) {
 			block=CreateCacheBlock(chandler,ip_point,32);
 		} else {
 			int32_t old_cycles=CPU_Cycles;
@@ -393,6 +400,9 @@ run_block:
 		if (DEBUG_HeavyIsBreakpoint()) return debugCallback;
 #endif
 #endif
+		if (CPU_ServiceEventsInCore(&CPU_Core_Dyn_X86_Run)) {
+			goto restart_core;
+		}
 		return CBRET_NONE;
 	case BR_CallBack:
 		return core_dyn.callback;
@@ -515,6 +525,20 @@ void CPU_Core_Dyn_X86_Cache_Close(void) {
 	cache_close();
 }
 
+void CPU_Core_Dyn_X86_Cache_Clear()
+{
+	cache_clear();
+}
+
+// Brings the FPU state of the normal core up to date, so it can be saved or
+// replaced; the dynamic core picks it up again on its next run
+void CPU_Core_Dyn_X86_SyncFPU()
+{
+#if defined(X86_DYNFPU_DH_ENABLED)
+	sync_dh_fpu_to_normal();
+#endif
+}
+
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu) {
 #if defined(X86_DYNFPU_DH_ENABLED)
 	dyn_dh_fpu.dh_fpu_enabled=dh_fpu;
@@ -2245,6 +2245,11 @@ restart_prefix:
 					(decode.page.invmap[decode.page.index-1]>=4))) goto illegalopcode;
 			}
 		}
+#if C_CPU_PROFILING
+		if (opcode != 0x0f) {
+			gen_call_function((void *)&CPU_ProfileOpcode, "%Id", opcode);
+		}
+#endif
 		switch (opcode) {
 
 		case 0x00:dyn_dop_ebgb(DOP_ADD);break;
@@ -2266,6 +2271,10 @@ restart_prefix:
 		case 0x0f:
 		{
 			Bitu dual_code=decode_fetchb();
+#if C_CPU_PROFILING
+			gen_call_function((void *)&CPU_ProfileOpcode, "%Id",
+			                  CpuProfileTwoByteOpcodes + dual_code);
+#endif
 			switch (dual_code) {
 			/* LAR */
 			case 0x02: dyn_larlsl(true);break;
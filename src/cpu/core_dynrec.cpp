@@ -45,6 +45,7 @@
 
 #include "callback.h"
 #include "cpu.h"
+#include "cpu_profiling.h"
 #include "debug.h"
 #include "inout.h"
 #include "lazyflags.h"
@@ -117,6 +118,18 @@ enum BlockReturn {
 	BR_SMCBlock
 };
 
+// fpu operations that backends defining DRC_USE_FPU_DOUBLE_OPS generate inline
+enum DrcFpuOp {
+	DRC_FOP_ADD,
+	DRC_FOP_MUL,
+	DRC_FOP_SUB,
+	DRC_FOP_SUBR,
+	DRC_FOP_DIV,
+	DRC_FOP_DIVR,
+	DRC_FOP_SQRT,
+	DRC_FOP_ABS
+};
+
 // identificator to signal self-modification of the currently executed block
 #define SMC_CURRENT_BLOCK	0xffff
 
@@ -253,8 +266,10 @@ Bits CPU_Core_Dynrec_Run() noexcept
 		CacheBlock *block = chandler->FindCacheBlock(ip_point & 4095);
 		if (!block) {
 			// no block found, thus translate the instruction stream
-			// unless the instruction is known to be modified
-			if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
+			// unless the instruction is known to be modified or the
+			// page's code is modified too often to be worth it
+			if (!chandler->IsInterpreted() &&
+			    (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4))) {
 				// translate up to 32 instructions
 				block=CreateCacheBlock(chandler,ip_point,32);
 			} else {
@@ -305,13 +320,15 @@ run_block:
 			break;
 
 		case BR_Cycles:
-			// cycles went negative, return from the core to handle
-			// external events, schedule the pic...
+			// cycles went negative, service the external events and
+			// keep running to the next deadline, or return from the
+			// core to let the main loop do it
 #if C_DEBUG
 #if C_HEAVY_DEBUG
 			if (DEBUG_HeavyIsBreakpoint()) return debugCallback;
 #endif
 #endif
+			if (CPU_ServiceEventsInCore(&CPU_Core_Dynrec_Run)) break;
 			return CBRET_NONE;
 
 		case BR_CallBack:
@@ -385,4 +402,9 @@ void CPU_Core_Dynrec_Cache_Close(void) {
 	cache_close();
 }
 
+void CPU_Core_Dynrec_Cache_Clear()
+{
+	cache_clear();
+}
+
 #endif
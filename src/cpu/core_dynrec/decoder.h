@@ -87,6 +87,11 @@ restart_prefix:
 					(decode.page.invmap[decode.page.index-1]>=4))) goto illegalopcode;
 			}
 		}
+#if C_CPU_PROFILING
+		if (opcode != 0x0f) {
+			gen_call_function_I((void*)&CPU_ProfileOpcode, opcode);
+		}
+#endif
 		switch (opcode) {
 		// instructions 'op reg8,reg8' and 'op [],reg8'
 		case 0x00:dyn_dop_ebgb(DOP_ADD);break;
@@ -176,6 +181,10 @@ restart_prefix:
 		case 0x0f:
 		{
 			Bitu dual_code=decode_fetchb();
+#if C_CPU_PROFILING
+			gen_call_function_I((void*)&CPU_ProfileOpcode,
+			                    CpuProfileTwoByteOpcodes + dual_code);
+#endif
 			switch (dual_code) {
 				case 0x00:
 					if ((reg_flags & FLAG_VM) || (!cpu.pmode)) goto illegalopcode;
@@ -52,6 +52,56 @@ static void FPU_FFREE(Bitu st) {
 #endif
 
 
+// fpu.regs[st] = fpu.regs[st] op fpu.regs[other]
+static void dyn_fpu_arith(DrcFpuOp op,HostReg st,HostReg other) {
+#if defined(DRC_USE_FPU_DOUBLE_OPS) && !C_FPU_X86
+	static_assert(sizeof(FPU_Reg) == sizeof(double), "fpu registers must be plain doubles");
+	gen_fop_double(op,&fpu.regs[0].d,st,other);
+#else
+	switch (op) {
+	case DRC_FOP_ADD:  gen_call_function_RR((void*)&FPU_FADD,st,other); break;
+	case DRC_FOP_MUL:  gen_call_function_RR((void*)&FPU_FMUL,st,other); break;
+	case DRC_FOP_SUB:  gen_call_function_RR((void*)&FPU_FSUB,st,other); break;
+	case DRC_FOP_SUBR: gen_call_function_RR((void*)&FPU_FSUBR,st,other); break;
+	case DRC_FOP_DIV:  gen_call_function_RR((void*)&FPU_FDIV,st,other); break;
+	case DRC_FOP_DIVR: gen_call_function_RR((void*)&FPU_FDIVR,st,other); break;
+	default: IllegalOptionDynrec("dyn_fpu_arith");
+	}
+#endif
+}
+
+// fpu.regs[st] = fpu.regs[st] op fpu.regs[8], the value loaded from memory
+static void dyn_fpu_arith_ea(DrcFpuOp op,HostReg st) {
+#if defined(DRC_USE_FPU_DOUBLE_OPS) && !C_FPU_X86
+	gen_mov_dword_to_reg_imm(FC_OP2,8);
+	gen_fop_double(op,&fpu.regs[0].d,st,FC_OP2);
+#else
+	switch (op) {
+	case DRC_FOP_ADD:  gen_call_function_R((void*)&FPU_FADD_EA,st); break;
+	case DRC_FOP_MUL:  gen_call_function_R((void*)&FPU_FMUL_EA,st); break;
+	case DRC_FOP_SUB:  gen_call_function_R((void*)&FPU_FSUB_EA,st); break;
+	case DRC_FOP_SUBR: gen_call_function_R((void*)&FPU_FSUBR_EA,st); break;
+	case DRC_FOP_DIV:  gen_call_function_R((void*)&FPU_FDIV_EA,st); break;
+	case DRC_FOP_DIVR: gen_call_function_R((void*)&FPU_FDIVR_EA,st); break;
+	default: IllegalOptionDynrec("dyn_fpu_arith_ea");
+	}
+#endif
+}
+
+// fpu.regs[TOP] = op(fpu.regs[TOP])
+static void dyn_fpu_unary(DrcFpuOp op) {
+#if defined(DRC_USE_FPU_DOUBLE_OPS) && !C_FPU_X86
+	gen_mov_word_to_reg(FC_OP1,(void*)(&TOP),true);
+	gen_fop_double_unary(op,&fpu.regs[0].d,FC_OP1);
+#else
+	switch (op) {
+	case DRC_FOP_SQRT: gen_call_function_raw((void*)&FPU_FSQRT); break;
+	case DRC_FOP_ABS:  gen_call_function_raw((void*)&FPU_FABS); break;
+	default: IllegalOptionDynrec("dyn_fpu_unary");
+	}
+#endif
+}
+
 static inline void dyn_fpu_top() {
 	gen_mov_word_to_reg(FC_OP2,(void*)(&TOP),true);
 	gen_add_imm(FC_OP2,decode.modrm.rm);
@@ -71,10 +121,10 @@ static void dyn_eatree() {
 	Bitu group = decode.modrm.reg&7; //It is already that, but compilers.
 	switch (group){
 	case 0x00:		// FADD ST,STi
-		gen_call_function_R((void*)&FPU_FADD_EA,FC_OP1);
+		dyn_fpu_arith_ea(DRC_FOP_ADD,FC_OP1);
 		break;
 	case 0x01:		// FMUL  ST,STi
-		gen_call_function_R((void*)&FPU_FMUL_EA,FC_OP1);
+		dyn_fpu_arith_ea(DRC_FOP_MUL,FC_OP1);
 		break;
 	case 0x02:		// FCOM  STi
 		gen_call_function_R((void*)&FPU_FCOM_EA,FC_OP1);
@@ -84,16 +134,16 @@ static void dyn_eatree() {
 		gen_call_function_raw((void*)&FPU_FPOP);
 		break;
 	case 0x04:		// FSUB  ST,STi
-		gen_call_function_R((void*)&FPU_FSUB_EA,FC_OP1);
+		dyn_fpu_arith_ea(DRC_FOP_SUB,FC_OP1);
 		break;	
 	case 0x05:		// FSUBR ST,STi
-		gen_call_function_R((void*)&FPU_FSUBR_EA,FC_OP1);
+		dyn_fpu_arith_ea(DRC_FOP_SUBR,FC_OP1);
 		break;
 	case 0x06:		// FDIV  ST,STi
-		gen_call_function_R((void*)&FPU_FDIV_EA,FC_OP1);
+		dyn_fpu_arith_ea(DRC_FOP_DIV,FC_OP1);
 		break;
 	case 0x07:		// FDIVR ST,STi
-		gen_call_function_R((void*)&FPU_FDIVR_EA,FC_OP1);
+		dyn_fpu_arith_ea(DRC_FOP_DIVR,FC_OP1);
 		break;
 	default:
 		break;
@@ -107,10 +157,10 @@ static void dyn_fpu_esc0(){
 		dyn_fpu_top();
 		switch (decode.modrm.reg){
 		case 0x00:		//FADD ST,STi
-			gen_call_function_RR((void*)&FPU_FADD,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_ADD,FC_OP1,FC_OP2);
 			break;
 		case 0x01:		// FMUL  ST,STi
-			gen_call_function_RR((void*)&FPU_FMUL,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_MUL,FC_OP1,FC_OP2);
 			break;
 		case 0x02:		// FCOM  STi
 			gen_call_function_RR((void*)&FPU_FCOM,FC_OP1,FC_OP2);
@@ -120,16 +170,16 @@ static void dyn_fpu_esc0(){
 			gen_call_function_raw((void*)&FPU_FPOP);
 			break;
 		case 0x04:		// FSUB  ST,STi
-			gen_call_function_RR((void*)&FPU_FSUB,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_SUB,FC_OP1,FC_OP2);
 			break;	
 		case 0x05:		// FSUBR ST,STi
-			gen_call_function_RR((void*)&FPU_FSUBR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_SUBR,FC_OP1,FC_OP2);
 			break;
 		case 0x06:		// FDIV  ST,STi
-			gen_call_function_RR((void*)&FPU_FDIV,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_DIV,FC_OP1,FC_OP2);
 			break;
 		case 0x07:		// FDIVR ST,STi
-			gen_call_function_RR((void*)&FPU_FDIVR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_DIVR,FC_OP1,FC_OP2);
 			break;
 		default:
 			break;
@@ -176,7 +226,7 @@ static void dyn_fpu_esc1(){
 				gen_call_function_raw((void*)&FPU_FCHS);
 				break;
 			case 0x01:       /* FABS */
-				gen_call_function_raw((void*)&FPU_FABS);
+				dyn_fpu_unary(DRC_FOP_ABS);
 				break;
 			case 0x02:       /* UNKNOWN */
 			case 0x03:       /* ILLEGAL */
@@ -262,7 +312,7 @@ static void dyn_fpu_esc1(){
 				gen_call_function_raw((void*)&FPU_FYL2XP1);
 				break;
 			case 0x02:		/* FSQRT */
-				gen_call_function_raw((void*)&FPU_FSQRT);
+				dyn_fpu_unary(DRC_FOP_SQRT);
 				break;
 			case 0x03:		/* FSINCOS */
 				gen_call_function_raw((void*)&FPU_FSINCOS);
@@ -439,11 +489,11 @@ static void dyn_fpu_esc4(){
 		switch(decode.modrm.reg){
 		case 0x00:	/* FADD STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FADD,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_ADD,FC_OP1,FC_OP2);
 			break;
 		case 0x01:	/* FMUL STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FMUL,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_MUL,FC_OP1,FC_OP2);
 			break;
 		case 0x02:  /* FCOM*/
 			dyn_fpu_top();
@@ -456,19 +506,19 @@ static void dyn_fpu_esc4(){
 			break;
 		case 0x04:  /* FSUBR STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FSUBR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_SUBR,FC_OP1,FC_OP2);
 			break;
 		case 0x05:  /* FSUB  STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FSUB,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_SUB,FC_OP1,FC_OP2);
 			break;
 		case 0x06:  /* FDIVR STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FDIVR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_DIVR,FC_OP1,FC_OP2);
 			break;
 		case 0x07:  /* FDIV STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FDIV,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_DIV,FC_OP1,FC_OP2);
 			break;
 		default:
 			break;
@@ -559,11 +609,11 @@ static void dyn_fpu_esc6(){
 		switch(decode.modrm.reg){
 		case 0x00:	/*FADDP STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FADD,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_ADD,FC_OP1,FC_OP2);
 			break;
 		case 0x01:	/* FMULP STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FMUL,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_MUL,FC_OP1,FC_OP2);
 			break;
 		case 0x02:  /* FCOMP5*/
 			dyn_fpu_top();
@@ -583,19 +633,19 @@ static void dyn_fpu_esc6(){
 			break;
 		case 0x04:  /* FSUBRP STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FSUBR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_SUBR,FC_OP1,FC_OP2);
 			break;
 		case 0x05:  /* FSUBP  STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FSUB,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_SUB,FC_OP1,FC_OP2);
 			break;
 		case 0x06:	/* FDIVRP STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FDIVR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_DIVR,FC_OP1,FC_OP2);
 			break;
 		case 0x07:  /* FDIVP STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FDIV,FC_OP1,FC_OP2);
+			dyn_fpu_arith(DRC_FOP_DIV,FC_OP1,FC_OP2);
 			break;
 		default:
 			break;
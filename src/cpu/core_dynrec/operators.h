@@ -17,6 +17,7 @@
  */
 
 #include "include/math_utils.h"
+#include "../string_spans.h"
 
 static uint8_t DRC_CALL_CONV dynrec_add_byte(uint8_t op1,uint8_t op2) DRC_FC;
 static uint8_t DRC_CALL_CONV dynrec_add_byte(uint8_t op1,uint8_t op2) {
@@ -1651,10 +1652,13 @@ static uint16_t DRC_CALL_CONV dynrec_movsb_word(uint16_t count,int16_t add_index
 		count=(uint16_t)CPU_Cycles;
 		CPU_Cycles=0;
 	}
-	for (;count>0;count--) {
+	while (count>0) {
+		count=(uint16_t)(count-StringSpans::rep_movs<uint8_t>(si_base,reg_si,di_base,reg_di,add_index,0xffff,count));
+		if (!count) break;
 		mem_writeb(di_base+reg_di,mem_readb(si_base+reg_si));
 		reg_si+=add_index;
 		reg_di+=add_index;
+		count--;
 	}
 	return count_left;
 }
@@ -1669,10 +1673,13 @@ static uint32_t DRC_CALL_CONV dynrec_movsb_dword(uint32_t count,int32_t add_inde
 		count=CPU_Cycles;
 		CPU_Cycles=0;
 	}
-	for (;count>0;count--) {
+	while (count>0) {
+		count-=StringSpans::rep_movs<uint8_t>(si_base,reg_esi,di_base,reg_edi,add_index,0xffffffff,count);
+		if (!count) break;
 		mem_writeb(di_base+reg_edi,mem_readb(si_base+reg_esi));
 		reg_esi+=add_index;
 		reg_edi+=add_index;
+		count--;
 	}
 	return count_left;
 }
@@ -1688,10 +1695,13 @@ static uint16_t DRC_CALL_CONV dynrec_movsw_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
-	for (;count>0;count--) {
+	while (count>0) {
+		count=(uint16_t)(count-StringSpans::rep_movs<uint16_t>(si_base,reg_si,di_base,reg_di,add_index,0xffff,count));
+		if (!count) break;
 		mem_writew(di_base+reg_di,mem_readw(si_base+reg_si));
 		reg_si+=add_index;
 		reg_di+=add_index;
+		count--;
 	}
 	return count_left;
 }
@@ -1707,10 +1717,13 @@ static uint32_t DRC_CALL_CONV dynrec_movsw_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 1);
-	for (;count>0;count--) {
+	while (count>0) {
+		count-=StringSpans::rep_movs<uint16_t>(si_base,reg_esi,di_base,reg_edi,add_index,0xffffffff,count);
+		if (!count) break;
 		mem_writew(di_base+reg_edi,mem_readw(si_base+reg_esi));
 		reg_esi+=add_index;
 		reg_edi+=add_index;
+		count--;
 	}
 	return count_left;
 }
@@ -1726,10 +1739,13 @@ static uint16_t DRC_CALL_CONV dynrec_movsd_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 2);
-	for (;count>0;count--) {
+	while (count>0) {
+		count=(uint16_t)(count-StringSpans::rep_movs<uint32_t>(si_base,reg_si,di_base,reg_di,add_index,0xffff,count));
+		if (!count) break;
 		mem_writed(di_base+reg_di,mem_readd(si_base+reg_si));
 		reg_si+=add_index;
 		reg_di+=add_index;
+		count--;
 	}
 	return count_left;
 }
@@ -1745,10 +1761,13 @@ static uint32_t DRC_CALL_CONV dynrec_movsd_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 2);
-	for (;count>0;count--) {
+	while (count>0) {
+		count-=StringSpans::rep_movs<uint32_t>(si_base,reg_esi,di_base,reg_edi,add_index,0xffffffff,count);
+		if (!count) break;
 		mem_writed(di_base+reg_edi,mem_readd(si_base+reg_esi));
 		reg_esi+=add_index;
 		reg_edi+=add_index;
+		count--;
 	}
 	return count_left;
 }
@@ -1871,9 +1890,12 @@ static uint16_t DRC_CALL_CONV dynrec_stosb_word(uint16_t count,int16_t add_index
 		count=(uint16_t)CPU_Cycles;
 		CPU_Cycles=0;
 	}
-	for (;count>0;count--) {
+	while (count>0) {
+		count=(uint16_t)(count-StringSpans::rep_stos<uint8_t>(di_base,reg_di,reg_al,add_index,0xffff,count));
+		if (!count) break;
 		mem_writeb(di_base+reg_di,reg_al);
 		reg_di+=add_index;
+		count--;
 	}
 	return count_left;
 }
@@ -1888,9 +1910,12 @@ static uint32_t DRC_CALL_CONV dynrec_stosb_dword(uint32_t count,int32_t add_inde
 		count=CPU_Cycles;
 		CPU_Cycles=0;
 	}
-	for (;count>0;count--) {
+	while (count>0) {
+		count-=StringSpans::rep_stos<uint8_t>(di_base,reg_edi,reg_al,add_index,0xffffffff,count);
+		if (!count) break;
 		mem_writeb(di_base+reg_edi,reg_al);
 		reg_edi+=add_index;
+		count--;
 	}
 	return count_left;
 }
@@ -1906,9 +1931,12 @@ static uint16_t DRC_CALL_CONV dynrec_stosw_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 1);
-	for (;count>0;count--) {
+	while (count>0) {
+		count=(uint16_t)(count-StringSpans::rep_stos<uint16_t>(di_base,reg_di,reg_ax,add_index,0xffff,count));
+		if (!count) break;
 		mem_writew(di_base+reg_di,reg_ax);
 		reg_di+=add_index;
+		count--;
 	}
 	return count_left;
 }
@@ -1924,9 +1952,12 @@ static uint32_t DRC_CALL_CONV dynrec_stosw_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 1);
-	for (;count>0;count--) {
+	while (count>0) {
+		count-=StringSpans::rep_stos<uint16_t>(di_base,reg_edi,reg_ax,add_index,0xffffffff,count);
+		if (!count) break;
 		mem_writew(di_base+reg_edi,reg_ax);
 		reg_edi+=add_index;
+		count--;
 	}
 	return count_left;
 }
@@ -1942,9 +1973,12 @@ static uint16_t DRC_CALL_CONV dynrec_stosd_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 2);
-	for (;count>0;count--) {
+	while (count>0) {
+		count=(uint16_t)(count-StringSpans::rep_stos<uint32_t>(di_base,reg_di,reg_eax,add_index,0xffff,count));
+		if (!count) break;
 		mem_writed(di_base+reg_di,reg_eax);
 		reg_di+=add_index;
+		count--;
 	}
 	return count_left;
 }
@@ -1960,9 +1994,12 @@ static uint32_t DRC_CALL_CONV dynrec_stosd_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 2);
-	for (;count>0;count--) {
+	while (count>0) {
+		count-=StringSpans::rep_stos<uint32_t>(di_base,reg_edi,reg_eax,add_index,0xffffffff,count);
+		if (!count) break;
 		mem_writed(di_base+reg_edi,reg_eax);
 		reg_edi+=add_index;
+		count--;
 	}
 	return count_left;
 }
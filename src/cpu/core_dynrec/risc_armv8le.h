@@ -38,6 +38,9 @@
 // use FC_SEGS_ADDR to hold the address of "Segs" and to access it using FC_SEGS_ADDR
 #define DRC_USE_SEGS_ADDR
 
+// generate the double precision fpu arithmetic inline instead of calling the fpu functions
+#define DRC_USE_FPU_DOUBLE_OPS
+
 // register mapping
 typedef uint8_t HostReg;
 
@@ -334,6 +337,24 @@ typedef uint8_t HostReg;
 // ubfm dst, src, #rimm, #simm		@	0 <= rimm < 64, 0 <= simm < 64
 #define UBFM64(dst, src, rimm, simm) (0xd3400000 + (dst) + ((src) << 5) + ((rimm) << 16) + ((simm) << 10) )
 
+// floating point (double precision)
+// ldr dreg, [addr1, addr2, lsl #imm]		@	imm = 0/3
+#define LDR_D_REG_LSL_IMM(reg, addr1, addr2, imm) (0xfc606800 + (reg) + ((addr1) << 5) + ((addr2) << 16) + ((imm)?0x00001000:0) )
+// str dreg, [addr1, addr2, lsl #imm]		@	imm = 0/3
+#define STR_D_REG_LSL_IMM(reg, addr1, addr2, imm) (0xfc206800 + (reg) + ((addr1) << 5) + ((addr2) << 16) + ((imm)?0x00001000:0) )
+// fadd dst, src1, src2
+#define FADD_D(dst, src1, src2) (0x1e602800 + (dst) + ((src1) << 5) + ((src2) << 16) )
+// fsub dst, src1, src2
+#define FSUB_D(dst, src1, src2) (0x1e603800 + (dst) + ((src1) << 5) + ((src2) << 16) )
+// fmul dst, src1, src2
+#define FMUL_D(dst, src1, src2) (0x1e600800 + (dst) + ((src1) << 5) + ((src2) << 16) )
+// fdiv dst, src1, src2
+#define FDIV_D(dst, src1, src2) (0x1e601800 + (dst) + ((src1) << 5) + ((src2) << 16) )
+// fsqrt dst, src
+#define FSQRT_D(dst, src) (0x1e61c000 + (dst) + ((src) << 5) )
+// fabs dst, src
+#define FABS_D(dst, src) (0x1e60c000 + (dst) + ((src) << 5) )
+
 
 // move a full register from reg_src to reg_dst
 static void gen_mov_regs(HostReg reg_dst,HostReg reg_src) {
@@ -1231,3 +1252,54 @@ static void gen_mov_regbyte_from_reg_low(HostReg src_reg,Bitu index) {
 }
 
 #endif
+
+// fpu arithmetic on an array of doubles, the indices are held in registers
+// d0 and d1 are free to use as the generated code never keeps values in them
+// across instructions
+
+// arr[dst_index] = arr[dst_index] op arr[src_index]
+static void gen_fop_double(DrcFpuOp op,double* arr,HostReg dst_index,HostReg src_index) {
+	gen_mov_qword_to_reg_imm(temp1, (uint64_t)arr);
+	cache_addd( LDR_D_REG_LSL_IMM(0, temp1, dst_index, 3) );      // ldr d0, [temp1, dst_index, lsl #3]
+	cache_addd( LDR_D_REG_LSL_IMM(1, temp1, src_index, 3) );      // ldr d1, [temp1, src_index, lsl #3]
+	switch (op) {
+		case DRC_FOP_ADD:
+			cache_addd( FADD_D(0, 0, 1) );      // fadd d0, d0, d1
+			break;
+		case DRC_FOP_MUL:
+			cache_addd( FMUL_D(0, 0, 1) );      // fmul d0, d0, d1
+			break;
+		case DRC_FOP_SUB:
+			cache_addd( FSUB_D(0, 0, 1) );      // fsub d0, d0, d1
+			break;
+		case DRC_FOP_SUBR:
+			cache_addd( FSUB_D(0, 1, 0) );      // fsub d0, d1, d0
+			break;
+		case DRC_FOP_DIV:
+			cache_addd( FDIV_D(0, 0, 1) );      // fdiv d0, d0, d1
+			break;
+		case DRC_FOP_DIVR:
+			cache_addd( FDIV_D(0, 1, 0) );      // fdiv d0, d1, d0
+			break;
+		default:
+			IllegalOptionDynrec("gen_fop_double");
+	}
+	cache_addd( STR_D_REG_LSL_IMM(0, temp1, dst_index, 3) );      // str d0, [temp1, dst_index, lsl #3]
+}
+
+// arr[index] = op(arr[index])
+static void gen_fop_double_unary(DrcFpuOp op,double* arr,HostReg index) {
+	gen_mov_qword_to_reg_imm(temp1, (uint64_t)arr);
+	cache_addd( LDR_D_REG_LSL_IMM(0, temp1, index, 3) );      // ldr d0, [temp1, index, lsl #3]
+	switch (op) {
+		case DRC_FOP_SQRT:
+			cache_addd( FSQRT_D(0, 0) );      // fsqrt d0, d0
+			break;
+		case DRC_FOP_ABS:
+			cache_addd( FABS_D(0, 0) );      // fabs d0, d0
+			break;
+		default:
+			IllegalOptionDynrec("gen_fop_double_unary");
+	}
+	cache_addd( STR_D_REG_LSL_IMM(0, temp1, index, 3) );      // str d0, [temp1, index, lsl #3]
+}
@@ -17,8 +17,11 @@
  */
 #include "dosbox.h"
 
+#include <utility>
+
 #include "callback.h"
 #include "cpu.h"
+#include "cpu_profiling.h"
 #include "fpu.h"
 #include "inout.h"
 #include "lazyflags.h"
@@ -137,10 +140,15 @@ static inline uint32_t Fetchd() {
 
 #define EALookupTable (core.ea_table)
 
-Bits CPU_Core_Normal_Run() noexcept
+// In single step mode exactly one instruction is executed, without consuming
+// a cycle; the caller does the cycle accounting. Used by cores that hand the
+// instructions they can't execute themselves over to this core.
+template <bool single_step>
+static Bits run_normal_core() noexcept
 {
-	ZoneScoped;
-	while (CPU_Cycles-->0) {
+	auto is_first_step = true;
+	while (single_step ? std::exchange(is_first_step, false)
+	                   : CPU_Cycles-- > 0) {
 		LOADIP;
 		core.opcode_index=cpu.code.big*0x200;
 		core.prefixes=cpu.code.big;
@@ -158,7 +166,9 @@ Bits CPU_Core_Normal_Run() noexcept
 		cycle_count++;
 #endif
 restart_opcode:
-		switch (core.opcode_index+Fetchb()) {
+		const auto opcode = core.opcode_index + Fetchb();
+		CPU_PROFILE_OPCODE(opcode);
+		switch (opcode) {
 		#include "core_normal/prefix_none.h"
 		#include "core_normal/prefix_0f.h"
 		#include "core_normal/prefix_66.h"
@@ -183,7 +193,9 @@ restart_opcode:
 		}
 		SAVEIP;
 	}
-	FillFlags();
+	if constexpr (!single_step) {
+		FillFlags();
+	}
 	return CBRET_NONE;
 decode_end:
 	SAVEIP;
@@ -191,6 +203,17 @@ decode_end:
 	return CBRET_NONE;
 }
 
+Bits CPU_Core_Normal_Run() noexcept
+{
+	ZoneScoped;
+	return run_normal_core<false>();
+}
+
+Bits CPU_Core_Normal_Step() noexcept
+{
+	return run_normal_core<true>();
+}
+
 Bits CPU_Core_Normal_Trap_Run() noexcept
 {
 	Bits oldCycles = CPU_Cycles;
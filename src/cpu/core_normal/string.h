@@ -17,6 +17,7 @@
  */
 
 #include "../string_ops.h"
+#include "../string_spans.h"
 
 #define LoadD(_BLAH) _BLAH
 
@@ -92,46 +93,88 @@ static void DoString(STRING_OP type) {
 		}
 		break;
 	case R_STOSB:
-		for (;count>0;count--) {
+		while (count > 0) {
+			count -= StringSpans::rep_stos<uint8_t>(
+			        di_base, di_index, reg_al,
+			        static_cast<int32_t>(add_index), add_mask, count);
+			if (!count) {
+				break;
+			}
 			SaveMb(di_base+di_index,reg_al);
 			di_index=(di_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_STOSW:
 		add_index *= 2;
-		for (;count>0;count--) {
+		while (count > 0) {
+			count -= StringSpans::rep_stos<uint16_t>(
+			        di_base, di_index, reg_ax,
+			        static_cast<int32_t>(add_index), add_mask, count);
+			if (!count) {
+				break;
+			}
 			SaveMw(di_base+di_index,reg_ax);
 			di_index=(di_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_STOSD:
 		add_index *= 4;
-		for (;count>0;count--) {
+		while (count > 0) {
+			count -= StringSpans::rep_stos<uint32_t>(
+			        di_base, di_index, reg_eax,
+			        static_cast<int32_t>(add_index), add_mask, count);
+			if (!count) {
+				break;
+			}
 			SaveMd(di_base+di_index,reg_eax);
 			di_index=(di_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_MOVSB:
-		for (;count>0;count--) {
+		while (count > 0) {
+			count -= StringSpans::rep_movs<uint8_t>(
+			        si_base, si_index, di_base, di_index,
+			        static_cast<int32_t>(add_index), add_mask, count);
+			if (!count) {
+				break;
+			}
 			SaveMb(di_base+di_index,LoadMb(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
 			si_index=(si_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_MOVSW:
 		add_index *= 2;
-		for (;count>0;count--) {
+		while (count > 0) {
+			count -= StringSpans::rep_movs<uint16_t>(
+			        si_base, si_index, di_base, di_index,
+			        static_cast<int32_t>(add_index), add_mask, count);
+			if (!count) {
+				break;
+			}
 			SaveMw(di_base+di_index,LoadMw(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
 			si_index=(si_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_MOVSD:
 		add_index *= 4;
-		for (;count>0;count--) {
+		while (count > 0) {
+			count -= StringSpans::rep_movs<uint32_t>(
+			        si_base, si_index, di_base, di_index,
+			        static_cast<int32_t>(add_index), add_mask, count);
+			if (!count) {
+				break;
+			}
 			SaveMd(di_base+di_index,LoadMd(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
 			si_index=(si_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_LODSB:
@@ -23,12 +23,16 @@
 #include <cstddef>
 #include <sstream>
 
+#include "cpu_profiling.h"
+#include "fpu.h"
 #include "memory.h"
 #include "debug.h"
 #include "mapper.h"
 #include "setup.h"
+#include "snapshot.h"
 #include "programs.h"
 #include "paging.h"
+#include "pic.h"
 #include "lazyflags.h"
 #include "support.h"
 
@@ -62,6 +66,7 @@ int64_t CPU_IODelayRemoved = 0;
 CPU_Decoder * cpudecoder;
 bool CPU_CycleAutoAdjust = false;
 Bitu CPU_AutoDetermineMode = 0;
+bool CPU_DynamicScheduling = true;
 
 ArchitectureType CPU_ArchitectureType = ArchitectureType::Mixed;
 
@@ -69,6 +74,7 @@ Bitu CPU_extflags_toggle=0;	// ID and AC flags may be toggled depending on emula
 
 Bitu CPU_PrefetchQueueSize=0;
 
+void CPU_Core_Cached_Init();
 void CPU_Core_Full_Init(void);
 void CPU_Core_Normal_Init(void);
 void CPU_Core_Simple_Init(void);
@@ -76,11 +82,14 @@ void CPU_Core_Simple_Init(void);
 void CPU_Core_Dyn_X86_Init(void);
 void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache);
 void CPU_Core_Dyn_X86_Cache_Close(void);
+void CPU_Core_Dyn_X86_Cache_Clear();
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu);
+void CPU_Core_Dyn_X86_SyncFPU();
 #elif (C_DYNREC)
 void CPU_Core_Dynrec_Init(void);
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
 void CPU_Core_Dynrec_Cache_Close(void);
+void CPU_Core_Dynrec_Cache_Clear();
 #endif
 
 /* In debug mode exceptions are tested and dosbox exits when 
@@ -364,6 +373,7 @@ enum TSwitchType {
 };
 
 bool CPU_SwitchTask(Bitu new_tss_selector,TSwitchType tstype,Bitu old_eip) {
+	CPU_PROFILE_EVENT(TaskSwitch);
 	FillFlags();
 	TaskStateSegment new_tss;
 	if (!new_tss.SetSelector(new_tss_selector)) 
@@ -561,6 +571,12 @@ void CPU_DebugException(uint32_t triggers,Bitu oldeip) {
 
 void CPU_Exception(Bitu which,Bitu error ) {
 //	LOG_MSG("Exception %d error %x",which,error);
+	CPU_PROFILE_EVENT(Exception);
+	// Both the faults raised while paging in a page on demand and the
+	// ones of the checked memory accesses end up here
+	if (which == EXCEPTION_PF) {
+		CPU_PROFILE_EVENT(PageFault);
+	}
 	cpu.exception.error=error;
 	CPU_Interrupt(which,CPU_INT_EXCEPTION | ((which>=8) ? CPU_INT_HAS_ERROR : 0),reg_eip);
 }
@@ -572,6 +588,7 @@ void CPU_Interrupt(Bitu num,Bitu type,Bitu oldeip) {
 		return;
 	}
 	lastint=num;
+	CPU_PROFILE_EVENT(InterruptCall);
 	FillFlags();
 #if C_DEBUG
 	switch (num) {
@@ -2187,6 +2204,50 @@ void CPU_Reset_AutoAdjust(void) {
 	ticksScheduled = 0;
 }
 
+// The core-independent state: the caches of the dynamic cores are dropped on
+// load, as the code they were translated from has been replaced
+static void save_snapshot(SnapshotWriter& writer)
+{
+#if (C_DYNAMIC_X86)
+	CPU_Core_Dyn_X86_SyncFPU();
+#endif
+	FillFlags();
+
+	writer.Write(cpu_regs);
+	writer.Write(Segs);
+	writer.Write(cpu);
+	writer.Write(cpu_tss);
+	writer.Write(fpu);
+	writer.Write(lastint);
+	writer.Write(cpudecoder == &HLT_Decode);
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+#if (C_DYNAMIC_X86)
+	CPU_Core_Dyn_X86_SyncFPU();
+	CPU_Core_Dyn_X86_Cache_Clear();
+#elif (C_DYNREC)
+	CPU_Core_Dynrec_Cache_Clear();
+#endif
+	// The decoder pointers are only valid within this run
+	const auto running_decoder = (cpudecoder == &HLT_Decode)
+	                                   ? cpu.hlt.old_decoder
+	                                   : cpudecoder;
+	reader.Read(cpu_regs);
+	reader.Read(Segs);
+	reader.Read(cpu);
+	reader.Read(cpu_tss);
+	reader.Read(fpu);
+	reader.Read(lastint);
+	const auto is_halted = reader.Read<bool>();
+
+	lflags.type = t_UNKNOWN;
+
+	cpu.hlt.old_decoder = running_decoder;
+	cpudecoder = is_halted ? &HLT_Decode : running_decoder;
+}
+
 class CPU final : public Module_base {
 private:
 	static bool inited;
@@ -2238,6 +2299,7 @@ public:
 
 		/* Init the cpu cores */
 		CPU_Core_Normal_Init();
+		CPU_Core_Cached_Init();
 		CPU_Core_Simple_Init();
 		CPU_Core_Full_Init();
 #if (C_DYNAMIC_X86)
@@ -2249,6 +2311,7 @@ public:
 		                  PRIMARY_MOD, "cycledown", "Dec Cycles");
 		MAPPER_AddHandler(CPU_CycleIncrease, SDL_SCANCODE_F12,
 		                  PRIMARY_MOD, "cycleup", "Inc Cycles");
+		SNAPSHOT_AddComponent("cpu", save_snapshot, load_snapshot);
 		Change_Config(configuration);
 		CPU_JMP(false,0,0,0);					//Setup the first cpu core
 	}
@@ -2335,10 +2398,13 @@ public:
 
 		CPU_CycleUp=section->Get_int("cycleup");
 		CPU_CycleDown=section->Get_int("cycledown");
+		CPU_DynamicScheduling = section->Get_bool("dynamic_scheduling");
 		std::string core(section->Get_string("core"));
 		cpudecoder=&CPU_Core_Normal_Run;
 		if (core == "normal") {
 			cpudecoder=&CPU_Core_Normal_Run;
+		} else if (core == "cached") {
+			cpudecoder=&CPU_Core_Cached_Run;
 		} else if (core =="simple") {
 			cpudecoder=&CPU_Core_Simple_Run;
 		} else if (core == "full") {
@@ -2427,6 +2493,24 @@ public:
 
 static CPU * test;
 
+bool CPU_ServiceEventsInCore([[maybe_unused]] CPU_Decoder* core)
+{
+#if C_DEBUG
+	// The debugger checks for breaks when the main loop is re-entered
+	return false;
+#else
+	if (!CPU_DynamicScheduling) {
+		return false;
+	}
+	// Starts the next timeslice, with the cycles left until the next
+	// event's deadline
+	if (!PIC_RunQueue()) {
+		return false;
+	}
+	return cpudecoder == core;
+#endif
+}
+
 void CPU_ShutDown([[maybe_unused]] Section* sec) {
 #if (C_DYNAMIC_X86)
 	CPU_Core_Dyn_X86_Cache_Close();
@@ -2442,6 +2526,10 @@ void CPU_Init(Section* sec)
 
 	test = new (std::nothrow) CPU(sec);
 
+#if C_CPU_PROFILING
+	CPU_Profiling_Init();
+#endif
+
 	constexpr auto changeable_at_runtime = true;
 	sec->AddDestroyFunction(&CPU_ShutDown, changeable_at_runtime);
 }
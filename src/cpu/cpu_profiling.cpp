@@ -0,0 +1,240 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cpu_profiling.h"
+
+#if C_CPU_PROFILING
+
+#include <cinttypes>
+#include <cstdio>
+
+#include "timer.h"
+#include "tracy.h"
+
+std::array<uint64_t, NumCpuProfileCounters> cpu_profile_counters = {};
+
+using Category = CpuProfileCounter;
+
+static constexpr const char* CsvFilename = "cpu_profile.csv";
+
+// Column names of the CSV file; the Tracy plots use the same names with a
+// "cpu: " prefix. Both have to be string literals, Tracy keeps the pointers.
+static constexpr std::array<const char*, NumCpuProfileCounters> counter_names = {
+        "alu",           "data_transfer", "stack",
+        "branch",        "string",        "fpu",
+        "segment_load",  "io",            "interrupt",
+        "system",        "other",         "exceptions",
+        "interrupts",    "page_faults",   "task_switches",
+        "cache_invalidations",
+        "decoder_entries"};
+
+static std::array<Category, 0x200> build_opcode_categories()
+{
+	std::array<Category, 0x200> categories = {};
+	categories.fill(Category::Other);
+
+	auto set = [&](const uint16_t first, const uint16_t last, const Category category) {
+		for (auto op = first; op <= last; ++op) {
+			categories[op] = category;
+		}
+	};
+
+	// One-byte opcodes
+
+	// ADD, OR, ADC, SBB, AND, SUB, XOR, CMP in all their forms, with
+	// the PUSH/POP segment and prefix slots overwritten below
+	set(0x00, 0x3f, Category::Alu);
+	set(0x06, 0x06, Category::Stack);
+	set(0x07, 0x07, Category::SegmentLoad);
+	set(0x0e, 0x0e, Category::Stack);
+	set(0x16, 0x16, Category::Stack);
+	set(0x17, 0x17, Category::SegmentLoad);
+	set(0x1e, 0x1e, Category::Stack);
+	set(0x1f, 0x1f, Category::SegmentLoad);
+	// The 0x0f escape is counted with the opcode byte following it
+	for (const uint16_t prefix : {0x0f, 0x26, 0x2e, 0x36, 0x3e}) {
+		categories[prefix] = Category::None;
+	}
+	set(0x40, 0x4f, Category::Alu);          // INC, DEC
+	set(0x50, 0x61, Category::Stack);        // PUSH, POP, PUSHA, POPA
+	set(0x63, 0x63, Category::System);       // ARPL
+	set(0x64, 0x67, Category::None);         // FS, GS, operand and address size
+	set(0x68, 0x68, Category::Stack);        // PUSH imm
+	set(0x69, 0x69, Category::Alu);          // IMUL
+	set(0x6a, 0x6a, Category::Stack);        // PUSH imm8
+	set(0x6b, 0x6b, Category::Alu);          // IMUL
+	set(0x6c, 0x6f, Category::String);       // INS, OUTS
+	set(0x70, 0x7f, Category::Branch);       // Jcc
+	set(0x80, 0x85, Category::Alu);          // Group 1, TEST
+	set(0x86, 0x8d, Category::DataTransfer); // XCHG, MOV, LEA
+	set(0x8e, 0x8e, Category::SegmentLoad);  // MOV sreg
+	set(0x8f, 0x8f, Category::Stack);        // POP
+	set(0x90, 0x97, Category::DataTransfer); // NOP, XCHG
+	set(0x98, 0x99, Category::Alu);          // CBW, CWD
+	set(0x9a, 0x9a, Category::Branch);       // CALL far
+	set(0x9b, 0x9b, Category::Fpu);          // WAIT
+	set(0x9c, 0x9d, Category::Stack);        // PUSHF, POPF
+	set(0x9e, 0x9f, Category::DataTransfer); // SAHF, LAHF
+	set(0xa0, 0xa3, Category::DataTransfer); // MOV moffs
+	set(0xa4, 0xa7, Category::String);       // MOVS, CMPS
+	set(0xa8, 0xa9, Category::Alu);          // TEST
+	set(0xaa, 0xaf, Category::String);       // STOS, LODS, SCAS
+	set(0xb0, 0xbf, Category::DataTransfer); // MOV imm
+	set(0xc0, 0xc1, Category::Alu);          // Group 2
+	set(0xc2, 0xc3, Category::Branch);       // RET
+	set(0xc4, 0xc5, Category::SegmentLoad);  // LES, LDS
+	set(0xc6, 0xc7, Category::DataTransfer); // MOV imm
+	set(0xc8, 0xc9, Category::Stack);        // ENTER, LEAVE
+	set(0xca, 0xcb, Category::Branch);       // RETF
+	set(0xcc, 0xcf, Category::Interrupt);    // INT3, INT, INTO, IRET
+	set(0xd0, 0xd5, Category::Alu);          // Group 2, AAM, AAD
+	set(0xd7, 0xd7, Category::DataTransfer); // XLAT
+	set(0xd8, 0xdf, Category::Fpu);
+	set(0xe0, 0xe3, Category::Branch);       // LOOP, JCXZ
+	set(0xe4, 0xe7, Category::Io);           // IN, OUT
+	set(0xe8, 0xeb, Category::Branch);       // CALL, JMP
+	set(0xec, 0xef, Category::Io);           // IN, OUT
+	set(0xf0, 0xf0, Category::None);         // LOCK
+	set(0xf1, 0xf1, Category::Interrupt);    // ICEBP
+	set(0xf2, 0xf3, Category::None);         // REPNZ, REPZ
+	set(0xf4, 0xf4, Category::System);       // HLT
+	set(0xf6, 0xf7, Category::Alu);          // Group 3
+	set(0xfa, 0xfb, Category::System);       // CLI, STI
+	set(0xfe, 0xfe, Category::Alu);          // INC, DEC
+
+	// Two-byte opcodes
+	constexpr auto Op0f = CpuProfileTwoByteOpcodes;
+
+	set(Op0f + 0x00, Op0f + 0x03, Category::System); // Groups 6/7, LAR, LSL
+	set(Op0f + 0x06, Op0f + 0x09, Category::System); // CLTS, INVD, WBINVD
+	set(Op0f + 0x20, Op0f + 0x26, Category::System); // MOV CRx, DRx, TRx
+	set(Op0f + 0x30, Op0f + 0x32, Category::System); // WRMSR, RDTSC, RDMSR
+	set(Op0f + 0x80, Op0f + 0x8f, Category::Branch); // Jcc
+	set(Op0f + 0x90, Op0f + 0x9f, Category::Alu);    // SETcc
+	set(Op0f + 0xa0, Op0f + 0xa0, Category::Stack);  // PUSH FS
+	set(Op0f + 0xa1, Op0f + 0xa1, Category::SegmentLoad); // POP FS
+	set(Op0f + 0xa2, Op0f + 0xa2, Category::System);      // CPUID
+	set(Op0f + 0xa3, Op0f + 0xa5, Category::Alu);   // BT, SHLD
+	set(Op0f + 0xa8, Op0f + 0xa8, Category::Stack); // PUSH GS
+	set(Op0f + 0xa9, Op0f + 0xa9, Category::SegmentLoad); // POP GS
+	set(Op0f + 0xab, Op0f + 0xaf, Category::Alu); // BTS, SHRD, IMUL
+	set(Op0f + 0xb0, Op0f + 0xb1, Category::Alu); // CMPXCHG
+	set(Op0f + 0xb2, Op0f + 0xb2, Category::SegmentLoad); // LSS
+	set(Op0f + 0xb3, Op0f + 0xb3, Category::Alu);         // BTR
+	set(Op0f + 0xb4, Op0f + 0xb5, Category::SegmentLoad); // LFS, LGS
+	set(Op0f + 0xb6, Op0f + 0xb7, Category::DataTransfer); // MOVZX
+	set(Op0f + 0xba, Op0f + 0xbd, Category::Alu); // Group 8, BTC, BSF, BSR
+	set(Op0f + 0xbe, Op0f + 0xbf, Category::DataTransfer); // MOVSX
+	set(Op0f + 0xc0, Op0f + 0xc1, Category::Alu);          // XADD
+	set(Op0f + 0xc8, Op0f + 0xcf, Category::DataTransfer); // BSWAP
+
+	return categories;
+}
+
+static const auto opcode_categories = build_opcode_categories();
+
+void CPU_ProfileOpcode(const Bitu opcode)
+{
+	const auto category = opcode_categories[opcode & 0x1ff];
+	if (category != Category::None) {
+		CPU_ProfileEvent(category);
+	}
+}
+
+static FILE* csv_file     = nullptr;
+static bool csv_failed    = false;
+static uint32_t ticks     = 0;
+static uint32_t seconds   = 0;
+
+static void write_csv_row()
+{
+	if (csv_failed) {
+		return;
+	}
+	if (!csv_file) {
+		csv_file = fopen(CsvFilename, "w");
+		if (!csv_file) {
+			LOG_WARNING("CPU: Can't create '%s', profile won't be written",
+			            CsvFilename);
+			csv_failed = true;
+			return;
+		}
+		LOG_MSG("CPU: Writing the CPU profile to '%s'", CsvFilename);
+
+		fprintf(csv_file, "second");
+		for (const auto name : counter_names) {
+			fprintf(csv_file, ",%s", name);
+		}
+		fprintf(csv_file, "\n");
+	}
+
+	fprintf(csv_file, "%u", seconds);
+	for (const auto count : cpu_profile_counters) {
+		fprintf(csv_file, ",%" PRIu64, count);
+	}
+	fprintf(csv_file, "\n");
+	fflush(csv_file);
+}
+
+static void plot_counters()
+{
+#if C_TRACY
+	static constexpr std::array<const char*, NumCpuProfileCounters> plot_names = {
+	        "cpu: alu",           "cpu: data_transfer", "cpu: stack",
+	        "cpu: branch",        "cpu: string",        "cpu: fpu",
+	        "cpu: segment_load",  "cpu: io",            "cpu: interrupt",
+	        "cpu: system",        "cpu: other",         "cpu: exceptions",
+	        "cpu: interrupts",    "cpu: page_faults",   "cpu: task_switches",
+	        "cpu: cache_invalidations",
+	        "cpu: decoder_entries"};
+
+	for (size_t i = 0; i < NumCpuProfileCounters; ++i) {
+		TracyPlot(plot_names[i], static_cast<int64_t>(cpu_profile_counters[i]));
+	}
+#endif
+}
+
+// Reports and resets the counters once every emulated second
+static void profile_tick_handler()
+{
+	if (++ticks < 1000) {
+		return;
+	}
+	ticks = 0;
+	++seconds;
+
+	plot_counters();
+	write_csv_row();
+
+	cpu_profile_counters.fill(0);
+}
+
+void CPU_Profiling_Init()
+{
+	static bool is_initialized = false;
+	if (is_initialized) {
+		return;
+	}
+	is_initialized = true;
+
+	TIMER_AddTickHandler(&profile_tick_handler);
+}
+
+#endif // C_CPU_PROFILING
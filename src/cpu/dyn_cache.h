@@ -19,13 +19,19 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <new>
 #include <type_traits>
+#include <unordered_map>
+#include <vector>
 
+#include "huge_pages.h"
 #include "mem_unaligned.h"
 #include "paging.h"
+#include "pic.h"
+#include "smc_page_stats.h"
 #include "types.h"
 
 #if defined(HAVE_MMAP)
@@ -47,6 +53,10 @@
 
 class CodePageHandler;
 
+// indexed by physical page number, the entries are never removed so the
+// statistics survive the code pages being released and set up again
+static std::unordered_map<Bitu, SmcPageStats> smc_page_stats = {};
+
 // basic cache block representation
 class CacheBlock {
 public:
@@ -61,6 +71,10 @@ public:
 
 	void Clear();
 
+	// check if any byte in the given range of the page is translated code
+	// of this block, skipping the holes of the write mask
+	bool HasCodeInRange(const Bitu start, const Bitu end) const;
+
 	// link this cache block to another block, index specifies the code
 	// path (always zero for unconditional links, 0/1 for conditional ones
 	void LinkTo(Bitu index, CacheBlock *toblock)
@@ -185,6 +199,15 @@ public:
 			delete [] invalidation_map;
 			invalidation_map = nullptr;
 		}
+
+		smc_stats = &smc_page_stats[phys_page];
+	}
+
+	// the page's code is modified too often to be worth translating, so
+	// the core should interpret it
+	bool IsInterpreted() const
+	{
+		return smc_stats->IsInterpreted();
 	}
 
 	// clear out blocks that contain code which has been modified
@@ -195,6 +218,8 @@ public:
 		                               // modified, it has to be exited
 		                               // as soon as possible
 
+		bool has_invalidated = false;
+
 		uint32_t ip_point=SegPhys(cs)+reg_eip;
 		ip_point = (PAGING_GetPhysicalPage(ip_point) -
 		            check_cast<uint32_t>(phys_page << 12)) +
@@ -204,22 +229,31 @@ public:
 			// see if there is still some code in the range
 			for (Bitu count=start;count<=end;count++) map+=write_map[count];
 			if (!map)
-				return is_current_block; // no more code, finished
+				break; // no more code, finished
 
 			CacheBlock *block = hash_map[index];
 			while (block) {
 				CacheBlock *nextblock = block->hash.next;
-				// test if this block is in the range
-				if (start<=block->page.end && end>=block->page.start) {
+				// test if the modified bytes are code of this
+				// block, data in the write mask holes and
+				// outside of its range don't count
+				if (block->HasCodeInRange(start, end)) {
 					if (ip_point<=block->page.end && ip_point>=block->page.start) is_current_block=true;
 					block->Clear(); // clear the block,
 					                // decrements the
 					                // write_map accordingly
+					CPU_PROFILE_EVENT(CodeCacheInvalidation);
+					has_invalidated = true;
 				}
 				block=nextblock;
 			}
 			index--;
 		}
+		if (has_invalidated && smc_stats->CountInvalidation()) {
+			LOG(LOG_CPU, LOG_NORMAL)("DYNCACHE: Code in page %05" PRIxPTR " is modified too often, interpreting it for %u ms",
+			                         phys_page,
+			                         smc_stats->interpreted_until - PIC_Ticks);
+		}
 		return is_current_block;
 	}
 
@@ -548,6 +582,8 @@ private:
 	                        // a page
 	HostPt hostmem = nullptr;
 	Bitu phys_page = 0;
+
+	SmcPageStats* smc_stats = nullptr;
 };
 
 static inline void cache_add_unused_block(CacheBlock *block)
@@ -645,6 +681,22 @@ inline void CacheBlock::Cache::AddDwordToWriteMaskAt(const size_t page_index)
 	add_to_unaligned_uint32(wmapmask + map_offset, 0x01010101);
 }
 
+bool CacheBlock::HasCodeInRange(const Bitu start, const Bitu end) const
+{
+	const auto first = std::max(start, static_cast<Bitu>(page.start));
+	const auto last  = std::min(end, static_cast<Bitu>(page.end));
+	for (auto i = first; i <= last; ++i) {
+		const auto mask_index = i - cache.maskstart;
+		const bool is_hole = cache.wmapmask && i >= cache.maskstart &&
+		                     mask_index < cache.masklen &&
+		                     cache.wmapmask[mask_index];
+		if (!is_hole) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void CacheBlock::Clear()
 {
 	Bitu ind;
@@ -984,15 +1036,18 @@ static void cache_init(bool enable) {
 			assert(lp_vmem);
 			cache_code_start_ptr = static_cast<uint8_t *>(lp_vmem);
 #elif defined(HAVE_MMAP)
-			int map_flags = MAP_PRIVATE | MAP_ANON;
-			int prot_flags = PROT_READ | PROT_WRITE | PROT_EXEC;
-#if defined(HAVE_MAP_JIT)
-			map_flags |= MAP_JIT;
-#endif
-			cache_code_start_ptr=static_cast<uint8_t *>(mmap(nullptr, cache_code_size, prot_flags, map_flags, -1, 0));
-			if (cache_code_start_ptr == MAP_FAILED) {
+			// The translated blocks are spread over the whole cache,
+			// so it gets huge pages like the guest RAM
+			cache_code_start_ptr = static_cast<uint8_t*>(
+			        HUGEPAGES_Allocate(cache_code_size, true));
+			if (!cache_code_start_ptr) {
 				E_Exit("DYNCACHE: Failed memory-mapping cache memory because: %s", strerror(errno));
 			}
+			if (HUGEPAGES_GetMode() != HugePageMode::Off) {
+				LOG_MSG("DYNCACHE: Code cache is backed by %s",
+				        HUGEPAGES_ToString(HUGEPAGES_GetBacking(
+				                cache_code_start_ptr)));
+			}
 #else
 			cache_code_start_ptr=static_cast<uint8_t *>(malloc(cache_code_size));
 			if (!cache_code_start_ptr) {
@@ -1071,7 +1126,35 @@ static void cache_init(bool enable) {
 	}
 }
 
+// report the pages that had their code invalidated the most, to help
+// spotting programs that suffer from self-modifying code
+static void cache_log_smc_stats()
+{
+	std::vector<std::pair<Bitu, const SmcPageStats*>> pages = {};
+	for (const auto& [page, stats] : smc_page_stats) {
+		if (stats.times_demoted) {
+			pages.emplace_back(page, &stats);
+		}
+	}
+	if (pages.empty()) {
+		return;
+	}
+	std::sort(pages.begin(), pages.end(), [](const auto& a, const auto& b) {
+		return a.second->invalidations > b.second->invalidations;
+	});
+	constexpr size_t max_reported_pages = 8;
+	pages.resize(std::min(pages.size(), max_reported_pages));
+
+	LOG_MSG("DYNCACHE: Code pages interpreted due to self-modifying code:");
+	for (const auto& [page, stats] : pages) {
+		LOG_MSG("DYNCACHE:   page %05" PRIxPTR ": %" PRIu64
+		        " invalidations, demoted %u times",
+		        page, stats->invalidations, stats->times_demoted);
+	}
+}
+
 static void cache_close(void) {
+	cache_log_smc_stats();
 /*	for (;;) {
 		if (cache.used_pages) {
 			CodePageHandler * cpage=cache.used_pages;
@@ -1095,3 +1178,15 @@ static void cache_close(void) {
 	cache_code_link_blocks = NULL;
 	cache_initialized = false; */
 }
+
+// Drops all the translated code, for when the guest memory gets replaced
+// without going through the page handlers
+static void cache_clear()
+{
+	if (!cache_initialized) {
+		return;
+	}
+	while (cache.used_pages) {
+		cache.used_pages->ClearRelease();
+	}
+}
@@ -29,7 +29,9 @@
 #include "lazyflags.h"
 #include "cpu.h"
 #include "debug.h"
+#include "huge_pages.h"
 #include "setup.h"
+#include "snapshot.h"
 
 #define LINK_TOTAL		(64*1024)
 
@@ -821,7 +823,7 @@ void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
 }
 
 void PAGING_LinkPage(uint32_t lin_page,uint32_t phys_page) {
-	const auto handler=MEM_GetPageHandler(phys_page);
+	const auto mapping=MEM_GetPageMapping(phys_page);
 	const auto lin_base=lin_page << 12;
 	if (lin_page>=TLB_SIZE || phys_page>=TLB_SIZE) 
 		E_Exit("Illegal page");
@@ -833,18 +835,16 @@ void PAGING_LinkPage(uint32_t lin_page,uint32_t phys_page) {
 	}
 
 	paging.tlb.phys_page[lin_page]=phys_page;
-	if (handler->flags & PFLAG_READABLE) paging.tlb.read[lin_page]=handler->GetHostReadPt(phys_page)-lin_base;
-	else paging.tlb.read[lin_page]=nullptr;
-	if (handler->flags & PFLAG_WRITEABLE) paging.tlb.write[lin_page]=handler->GetHostWritePt(phys_page)-lin_base;
-	else paging.tlb.write[lin_page]=nullptr;
+	paging.tlb.read[lin_page]=mapping.read ? mapping.read-lin_base : nullptr;
+	paging.tlb.write[lin_page]=mapping.write ? mapping.write-lin_base : nullptr;
 
 	paging.links.entries[paging.links.used++]=lin_page;
-	paging.tlb.readhandler[lin_page]=handler;
-	paging.tlb.writehandler[lin_page]=handler;
+	paging.tlb.readhandler[lin_page]=mapping.handler;
+	paging.tlb.writehandler[lin_page]=mapping.handler;
 }
 
 void PAGING_LinkPage_ReadOnly(uint32_t lin_page,uint32_t phys_page) {
-	const auto handler=MEM_GetPageHandler(phys_page);
+	const auto mapping=MEM_GetPageMapping(phys_page);
 	const auto lin_base=lin_page << 12;
 	if (lin_page>=TLB_SIZE || phys_page>=TLB_SIZE) 
 		E_Exit("Illegal page");
@@ -856,12 +856,11 @@ void PAGING_LinkPage_ReadOnly(uint32_t lin_page,uint32_t phys_page) {
 	}
 
 	paging.tlb.phys_page[lin_page]=phys_page;
-	if (handler->flags & PFLAG_READABLE) paging.tlb.read[lin_page]=handler->GetHostReadPt(phys_page)-lin_base;
-	else paging.tlb.read[lin_page]=nullptr;
+	paging.tlb.read[lin_page]=mapping.read ? mapping.read-lin_base : nullptr;
 	paging.tlb.write[lin_page]=nullptr;
 
 	paging.links.entries[paging.links.used++]=lin_page;
-	paging.tlb.readhandler[lin_page]=handler;
+	paging.tlb.readhandler[lin_page]=mapping.handler;
 	paging.tlb.writehandler[lin_page]=&init_page_handler_userro;
 }
 
@@ -927,7 +926,7 @@ void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
 
 void PAGING_LinkPage(uint32_t lin_page, uint32_t phys_page)
 {
-	PageHandler* handler = MEM_GetPageHandler(phys_page);
+	const auto mapping = MEM_GetPageMapping(phys_page);
 	Bitu lin_base=lin_page << 12;
 	if (lin_page>=(TLB_SIZE*(TLB_BANKS+1)) || phys_page>=(TLB_SIZE*(TLB_BANKS+1))) 
 		E_Exit("Illegal page");
@@ -939,19 +938,17 @@ void PAGING_LinkPage(uint32_t lin_page, uint32_t phys_page)
 
 	tlb_entry *entry = get_tlb_entry(lin_base);
 	entry->phys_page=phys_page;
-	if (handler->flags & PFLAG_READABLE) entry->read=handler->GetHostReadPt(phys_page)-lin_base;
-	else entry->read=0;
-	if (handler->flags & PFLAG_WRITEABLE) entry->write=handler->GetHostWritePt(phys_page)-lin_base;
-	else entry->write=0;
+	entry->read=mapping.read ? mapping.read-lin_base : 0;
+	entry->write=mapping.write ? mapping.write-lin_base : 0;
 
  	paging.links.entries[paging.links.used++]=lin_page;
-	entry->readhandler=handler;
-	entry->writehandler=handler;
+	entry->readhandler=mapping.handler;
+	entry->writehandler=mapping.handler;
 }
 
 void PAGING_LinkPage_ReadOnly(uint32_t lin_page, uint32_t phys_page)
 {
-	PageHandler* handler = MEM_GetPageHandler(phys_page);
+	const auto mapping = MEM_GetPageMapping(phys_page);
 	Bitu lin_base=lin_page << 12;
 	if (lin_page>=(TLB_SIZE*(TLB_BANKS+1)) || phys_page>=(TLB_SIZE*(TLB_BANKS+1))) 
 		E_Exit("Illegal page");
@@ -963,12 +960,11 @@ void PAGING_LinkPage_ReadOnly(uint32_t lin_page, uint32_t phys_page)
 
 	tlb_entry *entry = get_tlb_entry(lin_base);
 	entry->phys_page=phys_page;
-	if (handler->flags & PFLAG_READABLE) entry->read=handler->GetHostReadPt(phys_page)-lin_base;
-	else entry->read=0;
+	entry->read=mapping.read ? mapping.read-lin_base : 0;
 	entry->write=0;
 
  	paging.links.entries[paging.links.used++]=lin_page;
-	entry->readhandler=handler;
+	entry->readhandler=mapping.handler;
 	entry->writehandler=&init_page_handler_userro;
 }
 
@@ -1009,6 +1005,58 @@ bool PAGING_Enabled()
 	return paging.enabled;
 }
 
+// The TLB is rebuilt from the page tables in guest memory, only the mapping of
+// the first megabyte (changed by the A20 gate and EMS) has to be kept
+static void save_snapshot(SnapshotWriter& writer)
+{
+	writer.Write(paging.cr3);
+	writer.Write(paging.cr2);
+	writer.Write(paging.enabled);
+	writer.WriteBytes(paging.firstmb.data(),
+	                  paging.firstmb.size() * sizeof(paging.firstmb[0]));
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+	const auto cr3     = reader.Read<uint32_t>();
+	paging.cr2         = reader.Read<uint32_t>();
+	const auto enabled = reader.Read<bool>();
+	reader.ReadBytes(paging.firstmb.data(),
+	                 paging.firstmb.size() * sizeof(paging.firstmb[0]));
+
+	PAGING_SetDirBase(cr3);
+	PAGING_Enable(enabled);
+	PAGING_ClearTLB();
+}
+
+// The TLB arrays are indexed by the linear page, so a program's accesses
+// spread over them like over the guest RAM. They're allocated before the
+// configuration is read, so only transparent huge pages can be used.
+static void advise_tlb_huge_pages()
+{
+#if defined(USE_FULL_TLB)
+	static bool is_advised = false;
+	if (is_advised || HUGEPAGES_GetMode() == HugePageMode::Off) {
+		return;
+	}
+	is_advised = true;
+
+	auto advise = [](auto* array) {
+		return HUGEPAGES_Advise(array, sizeof(array[0]) * TLB_SIZE) ==
+		       HugePageBacking::Transparent;
+	};
+	const auto all_advised = advise(paging.tlb.read) &
+	                         advise(paging.tlb.write) &
+	                         advise(paging.tlb.readhandler.data()) &
+	                         advise(paging.tlb.writehandler.data()) &
+	                         advise(paging.tlb.phys_page.data());
+
+	LOG_MSG("PAGING: TLB arrays are backed by %s",
+	        HUGEPAGES_ToString(all_advised ? HugePageBacking::Transparent
+	                                       : HugePageBacking::None));
+#endif
+}
+
 class PAGING final : public Module_base{
 public:
 	PAGING(Section* configuration):Module_base(configuration){
@@ -1019,6 +1067,9 @@ public:
 			paging.firstmb[i]=i;
 		}
 		pf_queue.used=0;
+		advise_tlb_huge_pages();
+
+		SNAPSHOT_AddComponent("paging", save_snapshot, load_snapshot);
 	}
 };
 
@@ -0,0 +1,73 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef DOSBOX_SMC_PAGE_STATS_H
+#define DOSBOX_SMC_PAGE_STATS_H
+
+#include <algorithm>
+#include <cstdint>
+
+#include "pic.h"
+
+// Self-modifying code statistics of a physical page. Pages whose translated
+// code gets invalidated over and over (typically because the program keeps
+// its variables right next to its code) are demoted to interpreted execution
+// for a while, instead of being retranslated after every write.
+struct SmcPageStats {
+	// invalidations within the window that trigger the demotion
+	static constexpr uint32_t DemoteThreshold = 32;
+	static constexpr uint32_t WindowMs        = 100;
+	// the interpreted period doubles with each repeated demotion
+	static constexpr uint32_t InterpretMs      = 1000;
+	static constexpr uint32_t MaxInterpretMs   = 16000;
+
+	uint64_t invalidations = 0; // writes that invalidated code
+	uint32_t times_demoted = 0;
+
+	uint32_t window_start         = 0;
+	uint32_t window_invalidations = 0;
+	uint32_t interpreted_until    = 0; // in PIC ticks
+
+	bool IsInterpreted() const
+	{
+		return times_demoted && PIC_Ticks < interpreted_until;
+	}
+
+	// returns true if the page got demoted
+	bool CountInvalidation()
+	{
+		++invalidations;
+		if (PIC_Ticks - window_start >= WindowMs) {
+			window_start         = PIC_Ticks;
+			window_invalidations = 0;
+		}
+		if (++window_invalidations < DemoteThreshold) {
+			return false;
+		}
+		window_invalidations = 0;
+
+		const auto shift = std::min(times_demoted, 4u);
+		interpreted_until = PIC_Ticks + std::min(InterpretMs << shift,
+		                                         MaxInterpretMs);
+		++times_demoted;
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef DOSBOX_STRING_SPANS_H
+#define DOSBOX_STRING_SPANS_H
+
+// Fast path for REP MOVS and REP STOS: the elements that lie in plain RAM
+// pages are transferred a whole page-contained span at a time with
+// memmove/memset instead of one element at a time through the TLB.
+//
+// A page qualifies when the TLB maps it directly to host memory, which is
+// exactly when the regular element-wise accesses would bypass the page
+// handlers as well. Pages with handlers that need to see every access (code
+// pages of the dynamic cores, memory-mapped devices, tracked video memory)
+// are never mapped like that, so they keep using the element-wise path.
+//
+// The functions take the segment base, the index (SI/DI or ESI/EDI, updated
+// in place), the address mask for 16-bit index wrapping, the step in bytes
+// (negative when the direction flag is set) and the number of elements, and
+// return the number of elements transferred. They stop at the first element
+// that needs the regular path, such as an element straddling two pages or
+// a page that isn't mapped yet; the caller transfers that element the
+// regular way and then tries again.
+
+#include "dosbox.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "mem.h"
+#include "paging.h"
+
+namespace StringSpans {
+
+constexpr uint32_t PageSize = 4096;
+
+// Number of elements, starting with the one at the index and moving in the
+// direction of the step, that stay within the page and don't wrap around
+// the address mask
+static inline uint32_t elements_in_page(const PhysPt base, const uint32_t index,
+                                        const uint32_t add_mask, const int32_t step)
+{
+	const auto size = static_cast<uint32_t>(step > 0 ? step : -step);
+
+	const auto page_offset = (base + index) & (PageSize - 1);
+	if (page_offset + size > PageSize ||
+	    static_cast<uint64_t>(index) + size - 1 > add_mask) {
+		return 0;
+	}
+	if (step > 0) {
+		const auto in_page = (PageSize - page_offset) / size;
+		const auto before_wrap = (static_cast<uint64_t>(add_mask) - index + 1) / size;
+		return static_cast<uint32_t>(std::min<uint64_t>(in_page, before_wrap));
+	} else {
+		const auto in_page     = page_offset / size + 1;
+		const auto before_wrap = index / size + 1;
+		return std::min(in_page, before_wrap);
+	}
+}
+
+// Host address of the lowest byte of a span of 'count' elements that starts
+// at the given linear address, or nullptr if the page isn't plain RAM
+static inline HostPt span_start(const HostPt tlb_base, const PhysPt address,
+                                const uint32_t count, const int32_t step)
+{
+	if (!tlb_base) {
+		return nullptr;
+	}
+	const auto lowest = step > 0 ? address
+	                             : address - (count - 1) * static_cast<uint32_t>(-step);
+	return tlb_base + lowest;
+}
+
+template <typename T, typename Index>
+static inline uint32_t rep_movs(const PhysPt si_base, Index& si_index,
+                                const PhysPt di_base, Index& di_index,
+                                const int32_t step, const uint32_t add_mask,
+                                const uint32_t count)
+{
+#if C_HEAVY_DEBUG
+	// Keep every access visible to the memory breakpoints
+	return 0;
+#endif
+	uint32_t done = 0;
+	while (done < count) {
+		const auto si_address = si_base + si_index;
+		const auto di_address = di_base + di_index;
+
+		const auto num_elements = std::min({count - done,
+		                                    elements_in_page(si_base, si_index, add_mask, step),
+		                                    elements_in_page(di_base, di_index, add_mask, step)});
+		if (!num_elements) {
+			break;
+		}
+		const auto src = span_start(get_tlb_read(si_address), si_address,
+		                            num_elements, step);
+		const auto dst = span_start(get_tlb_write(di_address), di_address,
+		                            num_elements, step);
+		if (!src || !dst) {
+			break;
+		}
+		const auto num_bytes = num_elements * sizeof(T);
+
+		// An element-wise copy in the same direction as an overlapping
+		// destination re-reads what it has just written (a common way
+		// to fill memory with a pattern), which memmove doesn't do
+		const bool overlaps = dst < src + num_bytes && src < dst + num_bytes;
+		if (overlaps && ((step > 0 && dst > src) || (step < 0 && dst < src))) {
+			break;
+		}
+		memmove(dst, src, num_bytes);
+
+		const auto advance = static_cast<uint32_t>(step) * num_elements;
+		si_index = static_cast<Index>((si_index + advance) & add_mask);
+		di_index = static_cast<Index>((di_index + advance) & add_mask);
+		done += num_elements;
+	}
+	return done;
+}
+
+template <typename T, typename Index>
+static inline uint32_t rep_stos(const PhysPt di_base, Index& di_index,
+                                const T value, const int32_t step,
+                                const uint32_t add_mask, const uint32_t count)
+{
+#if C_HEAVY_DEBUG
+	return 0;
+#endif
+	uint32_t done = 0;
+	while (done < count) {
+		const auto di_address = di_base + di_index;
+
+		const auto num_elements = std::min(
+		        count - done, elements_in_page(di_base, di_index, add_mask, step));
+		if (!num_elements) {
+			break;
+		}
+		const auto dst = span_start(get_tlb_write(di_address), di_address,
+		                            num_elements, step);
+		if (!dst) {
+			break;
+		}
+		if constexpr (sizeof(T) == 1) {
+			memset(dst, value, num_elements);
+		} else {
+			// The value is stored in guest (little-endian) byte order
+			for (uint32_t i = 0; i < num_elements; ++i) {
+				if constexpr (sizeof(T) == 2) {
+					host_writew(dst + i * sizeof(T), value);
+				} else {
+					host_writed(dst + i * sizeof(T), value);
+				}
+			}
+		}
+
+		di_index = static_cast<Index>(
+		        (di_index + static_cast<uint32_t>(step) * num_elements) & add_mask);
+		done += num_elements;
+	}
+	return done;
+}
+
+} // namespace StringSpans
+
+#endif
@@ -43,6 +43,8 @@
 #include "decoders/SDL_sound.h"
 #include "sdlcd/SDL_cdrom.h"
 
+class ReadOnlyFileMapping;
+
 // CDROM data and audio format constants
 #define BYTES_PER_RAW_REDBOOK_FRAME    2352u
 #define BYTES_PER_COOKED_REDBOOK_FRAME 2048u
@@ -230,6 +232,9 @@ public:
 
 class CDROM_Interface_Image final : public CDROM_Interface
 {
+	// Compares the ways of reading the tracks
+	friend class CdromImageTest;
+
 private:
 	// Nested Class Definitions
 	class TrackFile {
@@ -261,6 +266,7 @@ private:
 	class BinaryFile final : public TrackFile {
 	public:
 		BinaryFile(const char* filename, bool& error);
+		explicit BinaryFile(std::shared_ptr<const ReadOnlyFileMapping> shared_mapping);
 		~BinaryFile() override;
 
 		BinaryFile()                  = delete;
@@ -287,9 +293,19 @@ private:
 		{
 			audio_pos = pos;
 		}
+		bool isMapped() const
+		{
+			return mapping != nullptr;
+		}
 
 	private:
+		bool readMapped(uint8_t* buffer, const uint32_t offset,
+		                const uint32_t requested_bytes);
+
 		std::ifstream* file;
+		// Set instead of the file when the image, or the decoded audio
+		// of a compressed track, is read through a shared mapping
+		std::shared_ptr<const ReadOnlyFileMapping> mapping = {};
 	};
 
 	class AudioFile final : public TrackFile {
@@ -376,6 +392,8 @@ private:
 
 	// Private utility functions
 	bool  LoadIsoFile(char *filename);
+	static std::shared_ptr<TrackFile> LoadAudioFile(const std::string& filename,
+	                                                bool& error);
 	bool  CanReadPVD(TrackFile *file,
 	                 const uint16_t sectorSize,
 	                 const bool mode2);
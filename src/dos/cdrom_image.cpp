@@ -26,12 +26,14 @@
 #include <cassert>
 #include <cctype>
 #include <chrono>
+#include <cinttypes>
 #include <cmath>
 #include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <map>
 #include <sstream>
 #include <vector>
 
@@ -42,12 +44,19 @@
 #endif
 
 #include "channel_names.h"
+#include "control.h"
+#include "cross.h"
 #include "drives.h"
 #include "fs_utils.h"
 #include "math_utils.h"
+#include "mem_host.h"
 #include "setup.h"
 #include "string_utils.h"
 
+#define XXH_INLINE_ALL 1
+#define XXH_NO_INLINE_HINTS 1
+#include "decoders/xxhash.h"
+
 using namespace std;
 
 // String maximums, local to this file
@@ -99,15 +108,114 @@ uint32_t CDROM_Interface_Image::TrackFile::adjustOverRead(const uint32_t offset,
 	return adjusted_bytes;
 }
 
+static bool use_shared_image_mappings()
+{
+	const auto section = control ? static_cast<Section_prop*>(
+	                                       control->GetSection("dosbox"))
+	                             : nullptr;
+	return section && section->Get_bool("shared_cd_images");
+}
+
+// The mappings of the image files, shared by all the tracks and drives
+// reading the same file. The mappings themselves are shared with the other
+// processes mapping the file through the host's page cache.
+static std::shared_ptr<const ReadOnlyFileMapping> get_shared_mapping(const char* filename)
+{
+	static std::map<std::string, std::weak_ptr<const ReadOnlyFileMapping>> mappings = {};
+
+	std::error_code ec = {};
+	const auto path    = std_fs::canonical(filename, ec);
+	if (ec) {
+		return nullptr;
+	}
+	// Forget the images that aren't mounted anymore
+	for (auto it = mappings.begin(); it != mappings.end();) {
+		it = it->second.expired() ? mappings.erase(it) : std::next(it);
+	}
+	const auto key = path.string();
+	if (const auto it = mappings.find(key); it != mappings.end()) {
+		return it->second.lock();
+	}
+	auto mapping = std::make_shared<const ReadOnlyFileMapping>(path);
+	if (!mapping->IsOpen()) {
+		return nullptr;
+	}
+	mappings.emplace(key, mapping);
+	return mapping;
+}
+
+// The decoded audio of the compressed tracks, kept in the config directory
+constexpr auto DecodedAudioDir = "cdaudio";
+
+// The decoded audio files are named after a hash of the track file's path,
+// size and modification time, so a replaced track gets decoded again
+static std_fs::path get_decoded_audio_path(const std::string& filename)
+{
+	std::error_code ec = {};
+	const auto path    = std_fs::canonical(filename, ec);
+	if (ec) {
+		return {};
+	}
+	const auto size = std_fs::file_size(path, ec);
+	if (ec) {
+		return {};
+	}
+	const auto modified = std_fs::last_write_time(path, ec);
+	if (ec) {
+		return {};
+	}
+	const auto key = format_string("%s|%" PRIuMAX "|%lld",
+	                               path.string().c_str(),
+	                               static_cast<uintmax_t>(size),
+	                               static_cast<long long>(
+	                                       modified.time_since_epoch().count()));
+	const auto hash = XXH64(key.data(), key.size(), 0);
+	return GetConfigDir() / DecodedAudioDir /
+	       format_string("%016" PRIx64 ".pcm", static_cast<uint64_t>(hash));
+}
+
+// Maps a complete decoded audio file. They're only ever renamed into place
+// once fully written, so any file found can be used.
+static std::shared_ptr<const ReadOnlyFileMapping> map_decoded_audio(const std_fs::path& path)
+{
+	std::error_code ec = {};
+	if (!std_fs::is_regular_file(path, ec)) {
+		return nullptr;
+	}
+	auto mapping = std::make_shared<const ReadOnlyFileMapping>(path);
+	if (!mapping->IsOpen() || mapping->Size() > MAX_REDBOOK_BYTES ||
+	    mapping->Size() % BYTES_PER_REDBOOK_PCM_FRAME) {
+		return nullptr;
+	}
+	return mapping;
+}
+
 CDROM_Interface_Image::BinaryFile::BinaryFile(const char *filename, bool &error)
         : TrackFile(BYTES_PER_RAW_REDBOOK_FRAME),
           file(nullptr)
 {
+	// Images too large to map on 32-bit hosts are read from the file
+	if (use_shared_image_mappings()) {
+		mapping = get_shared_mapping(filename);
+		if (mapping) {
+			error = false;
+			return;
+		}
+	}
 	file = new ifstream(filename, ios::in | ios::binary);
 	// If new fails, an exception is generated and scope leaves this constructor
 	error = file->fail();
 }
 
+CDROM_Interface_Image::BinaryFile::BinaryFile(
+        std::shared_ptr<const ReadOnlyFileMapping> shared_mapping)
+        : TrackFile(BYTES_PER_RAW_REDBOOK_FRAME),
+          file(nullptr),
+          mapping(std::move(shared_mapping))
+{
+	assert(mapping && mapping->IsOpen());
+}
+
 CDROM_Interface_Image::BinaryFile::~BinaryFile()
 {
 	// Guard: only cleanup if needed
@@ -122,6 +230,10 @@ bool CDROM_Interface_Image::BinaryFile::read(uint8_t *buffer,
                                              const uint32_t offset,
                                              const uint32_t requested_bytes)
 {
+	if (mapping) {
+		return readMapped(buffer, offset, requested_bytes);
+	}
+
 	// Check for logic bugs and illegal values
 	assertm(file && buffer, "The file and/or buffer pointer is invalid");
 	assertm(offset <= MAX_REDBOOK_BYTES, "Requested offset exceeds CDROM size");
@@ -139,9 +251,34 @@ bool CDROM_Interface_Image::BinaryFile::read(uint8_t *buffer,
 	return !file->fail();
 }
 
+// Copies the sectors straight out of the mapping, without any state to seek
+bool CDROM_Interface_Image::BinaryFile::readMapped(uint8_t* buffer,
+                                                   const uint32_t offset,
+                                                   const uint32_t requested_bytes)
+{
+	assertm(mapping && buffer, "The mapping and/or buffer pointer is invalid");
+	assertm(offset <= MAX_REDBOOK_BYTES, "Requested offset exceeds CDROM size");
+	assertm(requested_bytes <= MAX_REDBOOK_BYTES, "Requested bytes exceeds CDROM size");
+
+	const uint32_t adjusted_bytes = adjustOverRead(offset, requested_bytes);
+	if (adjusted_bytes == 0) // no work to do!
+		return true;
+
+	if (!offsetInsideTrack(offset))
+		return false;
+
+	memcpy(buffer, mapping->Data() + offset, adjusted_bytes);
+	return true;
+}
+
 int CDROM_Interface_Image::BinaryFile::getLength()
 {
 	// Return our cached result if we've already been asked before
+	if (length_redbook_bytes < 0 && mapping) {
+		assertm(mapping->Size() <= MAX_REDBOOK_BYTES,
+		        "Track length exceeds the maximum CDROM size");
+		length_redbook_bytes = static_cast<int>(mapping->Size());
+	}
 	if (length_redbook_bytes < 0 && file) {
 		file->seekg(0, ios::end);
 		/**
@@ -170,6 +307,11 @@ uint16_t CDROM_Interface_Image::BinaryFile::getEndian()
 
 bool CDROM_Interface_Image::BinaryFile::seek(const uint32_t offset)
 {
+	// The mapped reads don't need any repositioning
+	if (mapping) {
+		return offsetInsideTrack(offset);
+	}
+
 	// Check for logic bugs and illegal values
 	assertm(file, "The file pointer needs to be valid, but is the nullptr");
 	assertm(offset <= MAX_REDBOOK_BYTES, "Requested offset exceeds CDROM size");
@@ -195,12 +337,21 @@ uint32_t CDROM_Interface_Image::BinaryFile::decode(int16_t *buffer,
                                                    const uint32_t desired_track_frames)
 {
 	// Guard against logic bugs and illegal values
-	assertm(buffer && file, "The file pointer or buffer are invalid");
+	assertm(buffer && (file || mapping), "The file pointer or buffer are invalid");
 	assertm(desired_track_frames <= MAX_REDBOOK_FRAMES,
 	        "Requested number of frames exceeds the maximum for a CDROM");
 	assertm(audio_pos < MAX_REDBOOK_BYTES,
 	        "Tried to decode audio before the playback position was set");
 
+	if (mapping) {
+		const auto length = static_cast<uint32_t>(getLength());
+		const auto bytes_read = std::min(desired_track_frames * BYTES_PER_REDBOOK_PCM_FRAME,
+		                                 length > audio_pos ? length - audio_pos : 0);
+		memcpy(buffer, mapping->Data() + audio_pos, bytes_read);
+		audio_pos += bytes_read;
+		return ceil_udivide(bytes_read, BYTES_PER_REDBOOK_PCM_FRAME);
+	}
+
 	// Reposition against our last audio position if needed
 	if (static_cast<uint32_t>(file->tellg()) != audio_pos)
 		if (!seek(audio_pos))
@@ -480,6 +631,99 @@ int CDROM_Interface_Image::AudioFile::getLength()
 	return length_redbook_bytes;
 }
 
+/**
+ *  With shared CD images, compressed tracks are decoded only once into the
+ *  cache of decoded audio. The later mounts, in this and in other instances,
+ *  read the track through a mapping of the decoded file like a BIN track.
+ */
+std::shared_ptr<CDROM_Interface_Image::TrackFile> CDROM_Interface_Image::LoadAudioFile(
+        const std::string& filename, bool& error)
+{
+	const auto cache_path = use_shared_image_mappings()
+	                              ? get_decoded_audio_path(filename)
+	                              : std_fs::path();
+	if (!cache_path.empty()) {
+		if (auto mapping = map_decoded_audio(cache_path)) {
+			error = false;
+			return make_shared<BinaryFile>(std::move(mapping));
+		}
+	}
+
+	auto audio = make_shared<AudioFile>(filename.c_str(), error);
+
+	// Only CD quality audio can be read back like the tracks of a BIN
+	if (error || cache_path.empty() ||
+	    audio->getRate() != REDBOOK_PCM_FRAMES_PER_SECOND ||
+	    audio->getChannels() != REDBOOK_CHANNELS || !audio->seek(0)) {
+		return audio;
+	}
+
+	// Write to a file of our own first, so the other instances never see
+	// a partial track
+	std::error_code ec = {};
+	create_dir(cache_path.parent_path(), 0700, OK_IF_EXISTS);
+	static const auto random_suffix = CreateRandomizer<uint32_t>(0, UINT32_MAX);
+	auto temp_path = cache_path;
+	temp_path += format_string(".%08x.tmp", random_suffix());
+
+	LOG_MSG("CDROM: Decoding %s into the shared audio cache",
+	        get_basename(filename).c_str());
+
+	// The track table is laid out from the length the decoder reports, so
+	// the cached file must span the same number of sectors
+	const auto sectors_in = [](const uint32_t num_bytes) {
+		return (num_bytes + BYTES_PER_RAW_REDBOOK_FRAME - 1) /
+		       BYTES_PER_RAW_REDBOOK_FRAME;
+	};
+	const auto track_sectors = sectors_in(
+	        static_cast<uint32_t>(audio->getLength()));
+
+	std::ofstream out(temp_path, ios::binary);
+	constexpr uint32_t FramesPerChunk = 4096;
+	std::vector<int16_t> frames(FramesPerChunk * REDBOOK_CHANNELS);
+	std::vector<uint8_t> bytes(FramesPerChunk * BYTES_PER_REDBOOK_PCM_FRAME);
+	uint32_t decoded_bytes = 0;
+	while (out) {
+		const auto num_frames = audio->decode(frames.data(), FramesPerChunk);
+		if (num_frames == 0) {
+			break;
+		}
+		// The decoded files are little endian, like BIN images
+		const auto num_samples = num_frames * REDBOOK_CHANNELS;
+		for (size_t i = 0; i < num_samples; ++i) {
+			host_writew_at(bytes.data(), i, static_cast<uint16_t>(frames[i]));
+		}
+		const auto num_bytes = num_frames * BYTES_PER_REDBOOK_PCM_FRAME;
+		decoded_bytes += num_bytes;
+		if (decoded_bytes > MAX_REDBOOK_BYTES) {
+			break;
+		}
+		out.write(reinterpret_cast<const char*>(bytes.data()), num_bytes);
+	}
+	out.close();
+
+	if (out && (decoded_bytes > MAX_REDBOOK_BYTES ||
+	            sectors_in(decoded_bytes) != track_sectors)) {
+		LOG_WARNING("CDROM: Decoded length of %s doesn't match its track length, not caching it",
+		            get_basename(filename).c_str());
+		std_fs::remove(temp_path, ec);
+		return audio;
+	}
+	if (out) {
+		std_fs::rename(temp_path, cache_path, ec);
+	}
+	if (!out || ec) {
+		LOG_WARNING("CDROM: Can't write the decoded audio to '%s'",
+		            cache_path.string().c_str());
+		std_fs::remove(temp_path, ec);
+		return audio;
+	}
+	if (auto mapping = map_decoded_audio(cache_path)) {
+		return make_shared<BinaryFile>(std::move(mapping));
+	}
+	return audio;
+}
+
 // initialize static members
 int CDROM_Interface_Image::refCount = 0;
 CDROM_Interface_Image* CDROM_Interface_Image::images[26] = {};
@@ -1252,7 +1496,7 @@ bool CDROM_Interface_Image::LoadCueSheet(char *cuefile)
 				track.file = make_shared<BinaryFile>(filename.c_str(), error);
 			}
 			else {
-				track.file = make_shared<AudioFile>(filename.c_str(), error);
+				track.file = LoadAudioFile(filename, error);
 				/**
 				 *  SDL_Sound first tries using a decoder having a matching
 				 *  registered extension as the filename, and then falls back to
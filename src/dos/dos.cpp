@@ -739,8 +739,7 @@ static Bitu DOS_21Handler(void) {
 		{ 
 			uint16_t toread=DOS_GetAmount();
 			dos.echo=true;
-			if (DOS_ReadFile(reg_bx,dos_copybuf,&toread)) {
-				MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
+			if (DOS_ReadFileToMemory(reg_bx, SegPhys(ds) + reg_dx, &toread)) {
 				reg_ax=toread;
 				CALLBACK_SCF(false);
 			} else {
@@ -754,8 +753,7 @@ static Bitu DOS_21Handler(void) {
 	case 0x40:					/* WRITE Write to file or device */
 		{
 			uint16_t towrite=DOS_GetAmount();
-			MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
-			if (DOS_WriteFile(reg_bx,dos_copybuf,&towrite)) {
+			if (DOS_WriteFileFromMemory(reg_bx, SegPhys(ds) + reg_dx, &towrite)) {
 				reg_ax=towrite;
 	   			CALLBACK_SCF(false);
 			} else {
@@ -19,6 +19,7 @@
 
 #include "dos_system.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include "dosbox.h"
@@ -378,6 +379,30 @@ DOS_File &DOS_File::operator=(const DOS_File &orig)
 	return *this;
 }
 
+bool DOS_File::ReadBulk(uint8_t* data, uint32_t* size)
+{
+	constexpr uint32_t MaxChunkSize = 0xf000;
+
+	uint32_t done = 0;
+	while (done < *size) {
+		const auto requested = static_cast<uint16_t>(
+		        std::min(*size - done, MaxChunkSize));
+		auto num_read = requested;
+		if (!Read(data + done, &num_read)) {
+			if (done == 0) {
+				return false;
+			}
+			break;
+		}
+		done += num_read;
+		if (num_read < requested) {
+			break;
+		}
+	}
+	*size = done;
+	return true;
+}
+
 uint8_t DOS_FindDevice(const char* name)
 {
 	/* should only check for the names before the dot and spacepadded */
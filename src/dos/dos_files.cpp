@@ -19,6 +19,7 @@
 
 #include "dos_inc.h"
 
+#include <algorithm>
 #include <array>
 #include <cctype>
 #include <climits>
@@ -29,7 +30,9 @@
 #include "dosbox.h"
 #include "bios.h"
 #include "mem.h"
+#include "paging.h"
 #include "regs.h"
+#include "snapshot.h"
 #include "drives.h"
 #include "cross.h"
 #include "string_utils.h"
@@ -50,6 +53,14 @@ DOS_File* Files[DOS_FILES] = {};
 // the drive manager class.
 std::array<DOS_Drive*, DOS_DRIVES> Drives = {};
 
+// Counts the writes to files, not devices, to tell when files may have changed
+static uint32_t file_change_count = 0;
+
+uint32_t DOS_GetFileChangeCount()
+{
+	return file_change_count;
+}
+
 uint8_t DOS_GetDefaultDrive(void) {
 //	return DOS_SDA(DOS_SDA_SEG,DOS_SDA_OFS).GetDrive();
 	uint8_t d = DOS_SDA(DOS_SDA_SEG,DOS_SDA_OFS).GetDrive();
@@ -450,6 +461,24 @@ bool DOS_FindNext(void) {
 	return false;
 }
 
+void DOS_PrefetchTree(const char* const dir)
+{
+	uint8_t drive;
+	char fulldir[DOS_PATHLENGTH];
+	if (DOS_MakeName(dir, fulldir, &drive)) {
+		Drives.at(drive)->PrefetchTree(fulldir);
+	}
+}
+
+void DOS_StopPrefetching()
+{
+	for (const auto drive : Drives) {
+		if (drive) {
+			drive->StopPrefetching();
+		}
+	}
+}
+
 
 bool DOS_ReadFile(uint16_t entry,uint8_t * data,uint16_t * amount,bool fcb) {
 	uint32_t handle = fcb?entry:RealHandle(entry);
@@ -473,6 +502,16 @@ bool DOS_ReadFile(uint16_t entry,uint8_t * data,uint16_t * amount,bool fcb) {
 	return ret;
 }
 
+bool DOS_ReadFileBulk(const uint16_t entry, uint8_t* data, uint32_t* amount)
+{
+	const uint32_t handle = RealHandle(entry);
+	if (handle >= DOS_FILES || !Files[handle] || !Files[handle]->IsOpen()) {
+		DOS_SetError(DOSERR_INVALID_HANDLE);
+		return false;
+	}
+	return Files[handle]->ReadBulk(data, amount);
+}
+
 bool DOS_WriteFile(uint16_t entry,uint8_t * data,uint16_t * amount,bool fcb) {
 	uint32_t handle = fcb?entry:RealHandle(entry);
 	if (handle>=DOS_FILES) {
@@ -489,12 +528,120 @@ bool DOS_WriteFile(uint16_t entry,uint8_t * data,uint16_t * amount,bool fcb) {
 		return false;
 	}
 */
+	if (!(Files[handle]->GetInformation() & 0x8000)) {
+		++file_change_count;
+	}
 	uint16_t towrite=*amount;
 	bool ret=Files[handle]->Write(data,&towrite);
 	*amount=towrite;
 	return ret;
 }
 
+// Host address of the guest memory at the linear address, when the TLB maps
+// its page straight to host memory. That's exactly when the CPU's accesses
+// bypass the page handlers too; pages with handlers that need to see the
+// accesses (code pages of the dynamic cores, video memory and other
+// memory-mapped devices) are never mapped like that.
+static HostPt get_host_pt([[maybe_unused]] const PhysPt address,
+                          [[maybe_unused]] const bool writing)
+{
+#if C_HEAVY_DEBUG
+	// Keep every access visible to the memory breakpoints
+	return nullptr;
+#else
+	auto tlb_base = writing ? get_tlb_write(address) : get_tlb_read(address);
+
+	// Without paging, linking the page can't fault
+	if (!tlb_base && !PAGING_Enabled() && PAGING_ForcePageInit(address)) {
+		tlb_base = writing ? get_tlb_write(address) : get_tlb_read(address);
+	}
+	return tlb_base ? tlb_base + address : nullptr;
+#endif
+}
+
+// Transfers the data between the file and the guest memory directly, a run
+// of pages that are contiguous in host memory at a time, and through the
+// copy buffer for the pages that need their handlers.
+static bool transfer_guest_memory(const uint16_t entry, const PhysPt address,
+                                  uint16_t* amount, const bool fcb,
+                                  const bool to_file)
+{
+	const uint32_t handle = fcb ? entry : RealHandle(entry);
+
+	// Devices are transferred in one go; a console read would wait for
+	// another line of input if it was split
+	const auto is_device = handle < DOS_FILES && Files[handle] &&
+	                       dynamic_cast<DOS_Device*>(Files[handle]);
+	if (is_device || *amount == 0) {
+		if (to_file) {
+			MEM_BlockRead(address, dos_copybuf, *amount);
+			return DOS_WriteFile(entry, dos_copybuf, amount, fcb);
+		}
+		if (!DOS_ReadFile(entry, dos_copybuf, amount, fcb)) {
+			return false;
+		}
+		MEM_BlockWrite(address, dos_copybuf, *amount);
+		return true;
+	}
+
+	constexpr uint32_t PageSize = 4096;
+
+	uint32_t done = 0;
+	while (done < *amount) {
+		const auto span_address = address + done;
+		const auto remaining    = *amount - done;
+
+		const auto host = get_host_pt(span_address, !to_file);
+		auto span_size = std::min(remaining, PageSize - (span_address & (PageSize - 1)));
+		while (host && span_size < remaining &&
+		       get_host_pt(span_address + span_size, !to_file) == host + span_size) {
+			span_size += std::min(remaining - span_size, PageSize);
+		}
+
+		auto transferred = static_cast<uint16_t>(span_size);
+		bool success     = false;
+		if (host) {
+			success = to_file ? DOS_WriteFile(entry, host, &transferred, fcb)
+			                  : DOS_ReadFile(entry, host, &transferred, fcb);
+		} else if (to_file) {
+			MEM_BlockRead(span_address, dos_copybuf, span_size);
+			success = DOS_WriteFile(entry, dos_copybuf, &transferred, fcb);
+		} else {
+			success = DOS_ReadFile(entry, dos_copybuf, &transferred, fcb);
+			if (success) {
+				MEM_BlockWrite(span_address, dos_copybuf, transferred);
+			}
+		}
+
+		// A failure after some of the data was transferred is reported
+		// as a short transfer, like a host read stopping early
+		if (!success) {
+			if (done == 0) {
+				return false;
+			}
+			break;
+		}
+		done += transferred;
+		if (transferred < span_size) {
+			break;
+		}
+	}
+	*amount = static_cast<uint16_t>(done);
+	return true;
+}
+
+bool DOS_ReadFileToMemory(const uint16_t entry, const PhysPt address,
+                          uint16_t* amount, const bool fcb)
+{
+	return transfer_guest_memory(entry, address, amount, fcb, false);
+}
+
+bool DOS_WriteFileFromMemory(const uint16_t entry, const PhysPt address,
+                             uint16_t* amount, const bool fcb)
+{
+	return transfer_guest_memory(entry, address, amount, fcb, true);
+}
+
 bool DOS_SeekFile(uint16_t entry,uint32_t * pos,uint32_t type,bool fcb) {
 	uint32_t handle = fcb?entry:RealHandle(entry);
 	if (handle>=DOS_FILES) {
@@ -592,6 +739,7 @@ bool DOS_CreateFile(const char* name, FatAttributeFlags attributes,
 	}
 	bool foundit = Drives.at(drive)->FileCreate(&Files[handle], fullname, attributes);
 	if (foundit) { 
+		++file_change_count;
 		Files[handle]->SetDrive(drive);
 		Files[handle]->AddRef();
 		if (!fcb) psp.SetFileHandle(*entry,handle);
@@ -1262,15 +1410,14 @@ uint8_t DOS_FCBRead(uint16_t seg, uint16_t offset, uint16_t recno)
 	fcb.GetRecord(cur_block,cur_rec);
 	uint32_t pos=((cur_block*128)+cur_rec)*rec_size;
 	if (!DOS_SeekFile(fhandle,&pos,DOS_SEEK_SET,true)) return FCB_READ_NODATA; 
+	const PhysPt record = RealToPhysical(dos.dta()) + recno * rec_size;
 	uint16_t toread=rec_size;
-	if (!DOS_ReadFile(fhandle,dos_copybuf,&toread,true)) return FCB_READ_NODATA;
+	if (!DOS_ReadFileToMemory(fhandle, record, &toread, true)) return FCB_READ_NODATA;
 	if (toread == 0)
 		return FCB_READ_NODATA;
-	if (toread < rec_size) { //Zero pad copybuffer to rec_size
-		Bitu i = toread;
-		while(i < rec_size) dos_copybuf[i++] = 0;
+	for (auto i = toread; i < rec_size; ++i) { // Zero pad the record
+		mem_writeb(record + i, 0);
 	}
-	MEM_BlockWrite(RealToPhysical(dos.dta())+recno*rec_size,dos_copybuf,rec_size);
 	if (++cur_rec>127) { cur_block++;cur_rec=0; }
 	fcb.SetRecord(cur_block,cur_rec);
 	if (toread==rec_size) return FCB_SUCCESS;
@@ -1295,9 +1442,9 @@ uint8_t DOS_FCBWrite(uint16_t seg, uint16_t offset, uint16_t recno)
 	fcb.GetRecord(cur_block,cur_rec);
 	uint32_t pos=((cur_block*128)+cur_rec)*rec_size;
 	if (!DOS_SeekFile(fhandle,&pos,DOS_SEEK_SET,true)) return FCB_ERR_WRITE; 
-	MEM_BlockRead(RealToPhysical(dos.dta())+recno*rec_size,dos_copybuf,rec_size);
 	uint16_t towrite=rec_size;
-	if (!DOS_WriteFile(fhandle,dos_copybuf,&towrite,true)) return FCB_ERR_WRITE;
+	if (!DOS_WriteFileFromMemory(fhandle, RealToPhysical(dos.dta()) + recno * rec_size, &towrite, true))
+		return FCB_ERR_WRITE;
 	uint32_t size;uint16_t date,time;
 	fcb.GetSizeDateTime(size,date,time);
 	if (pos+towrite>size) size=pos+towrite;
@@ -1568,6 +1715,89 @@ bool DOS_SetFileDate(uint16_t entry, uint16_t ntime, uint16_t ndate)
 	return true;
 }
 
+// The DOS kernel state outside of the guest memory: the DOS block, the
+// current directories and the open files. Files are reopened by name when
+// loading, so the mounted drives have to match the ones of the snapshot.
+static void save_snapshot(SnapshotWriter& writer)
+{
+	writer.Write(dos);
+
+	for (const auto drive : Drives) {
+		writer.WriteString(drive ? drive->curdir : "");
+	}
+
+	for (const auto file : Files) {
+		writer.Write(file != nullptr);
+		if (!file) {
+			continue;
+		}
+		const auto device = dynamic_cast<DOS_Device*>(file);
+		writer.Write(device != nullptr);
+		writer.WriteString(file->name);
+		writer.Write(file->GetDrive());
+		writer.Write(file->flags);
+		writer.Write(static_cast<int64_t>(file->refCtr));
+
+		uint32_t position = 0;
+		if (!device && file->IsOpen()) {
+			file->Seek(&position, DOS_SEEK_CUR);
+		}
+		writer.Write(position);
+	}
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+	const auto country = dos.tables.country;
+	reader.Read(dos);
+	dos.tables.country = country;
+
+	for (const auto drive : Drives) {
+		const auto curdir = reader.ReadString();
+		if (drive) {
+			safe_strcpy(drive->curdir, curdir.c_str());
+		}
+	}
+
+	for (auto& file : Files) {
+		if (file) {
+			if (file->IsOpen()) {
+				file->Close();
+			}
+			delete file;
+			file = nullptr;
+		}
+		if (!reader.Read<bool>()) {
+			continue;
+		}
+		const auto is_device = reader.Read<bool>();
+		auto name            = reader.ReadString();
+		const auto drive     = reader.Read<uint8_t>();
+		const auto flags     = reader.Read<uint32_t>();
+		const auto ref_count = reader.Read<int64_t>();
+		auto position        = reader.Read<uint32_t>();
+
+		if (is_device) {
+			for (const auto device : Devices) {
+				if (device && device->IsName(name.c_str())) {
+					file = new DOS_Device(*device);
+					break;
+				}
+			}
+		} else if (drive < DOS_DRIVES && Drives[drive] &&
+		           Drives[drive]->FileOpen(&file, name.data(), flags)) {
+			file->SetDrive(drive);
+			file->Seek(&position, DOS_SEEK_SET);
+		}
+		if (!file) {
+			LOG_WARNING("DOS: Can't reopen '%s' of the snapshot", name.c_str());
+			continue;
+		}
+		file->flags  = flags;
+		file->refCtr = static_cast<Bits>(ref_count);
+	}
+}
+
 void DOS_SetupFiles()
 {
 	/* Setup the File Handles */
@@ -1581,4 +1811,6 @@ void DOS_SetupFiles()
 
 	Drives.at(z_drive_index) = DriveManager::RegisterFilesystemImage(
 	        z_drive_index, std::make_unique<Virtual_Drive>());
+
+	SNAPSHOT_AddComponent("dos", save_snapshot, load_snapshot);
 }
@@ -20,9 +20,19 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
 #include <iterator>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+#if defined(HAVE_SYS_INOTIFY_H)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
 #include "cross.h"
 #include "dos_inc.h"
 #include "drives.h"
@@ -31,6 +41,367 @@
 
 int fileInfoCounter = 0;
 
+// Where an entry goes in a list sorted by short name: after the entries
+// with the same name, like a linear search for the first greater one
+static std::vector<DOS_Drive_Cache::CFileInfo*>::iterator find_insert_position(
+        std::vector<DOS_Drive_Cache::CFileInfo*>& list, const char* shortname)
+{
+	return std::upper_bound(list.begin(),
+	                        list.end(),
+	                        shortname,
+	                        [](const char* name, const DOS_Drive_Cache::CFileInfo* info) {
+		                        return strcmp(name, info->shortname) < 0;
+	                        });
+}
+
+static const char* get_short_name(const char* name)
+{
+	return name;
+}
+
+static const char* get_short_name(const DOS_Drive_Cache::CFileInfo* info)
+{
+	return info->shortname;
+}
+
+// Host names are case-insensitive on Windows
+static std::string get_name_key(const char* name)
+{
+	std::string key = name;
+#if defined(WIN32)
+	lowcase(key);
+#endif
+	return key;
+}
+
+// A change made on the host to a watched directory
+struct HostChange {
+	enum class Type { Added, Removed, Overflowed };
+
+	Type type         = Type::Added;
+	int watch_id      = -1;
+	std::string name  = {};
+	bool is_directory = false;
+};
+
+// Watches the cached directories for the changes made to them on the host.
+// The changes are only read when asked for, so they get applied on the
+// emulation thread in between the cache's own operations.
+class DOS_Drive_Cache::HostWatcher {
+public:
+	HostWatcher();
+	~HostWatcher();
+
+	HostWatcher(const HostWatcher&)            = delete;
+	HostWatcher& operator=(const HostWatcher&) = delete;
+
+	bool IsValid() const
+	{
+		return fd >= 0;
+	}
+
+	void Watch(CFileInfo* dir, const char* path);
+	void Unwatch(const CFileInfo* dir);
+
+	// The directory of a change, or nullptr if it isn't watched anymore
+	CFileInfo* GetDir(const int watch_id) const
+	{
+		const auto it = dirs.find(watch_id);
+		return it != dirs.end() ? it->second : nullptr;
+	}
+
+	// The changes made since the last call, without waiting for any
+	std::vector<HostChange> ReadChanges();
+
+private:
+	void Forget(int watch_id);
+
+	int fd = -1;
+	std::unordered_map<int, CFileInfo*> dirs            = {};
+	std::unordered_map<const CFileInfo*, int> watch_ids = {};
+	[[maybe_unused]] bool reported_failure              = false;
+};
+
+#if defined(HAVE_SYS_INOTIFY_H)
+
+DOS_Drive_Cache::HostWatcher::HostWatcher()
+        : fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{}
+
+DOS_Drive_Cache::HostWatcher::~HostWatcher()
+{
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+void DOS_Drive_Cache::HostWatcher::Watch(CFileInfo* dir, const char* path)
+{
+	constexpr uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+	                          IN_MOVED_TO | IN_ONLYDIR;
+
+	const auto watch_id = inotify_add_watch(fd, path, mask);
+	if (watch_id < 0) {
+		// Most likely the host's limit of watches is reached; the
+		// directory then only gets updated by RESCAN
+		if (!reported_failure) {
+			LOG_WARNING("DIRCACHE: Can't watch '%s' for host changes: %s",
+			            path,
+			            strerror(errno));
+			reported_failure = true;
+		}
+		return;
+	}
+	// The same host directory reached through another path shares the
+	// watch, and only the last one of them is kept up to date
+	if (const auto previous = GetDir(watch_id); previous && previous != dir) {
+		watch_ids.erase(previous);
+	}
+	if (const auto it = watch_ids.find(dir);
+	    it != watch_ids.end() && it->second != watch_id) {
+		Unwatch(dir);
+	}
+	dirs[watch_id]  = dir;
+	watch_ids[dir] = watch_id;
+}
+
+void DOS_Drive_Cache::HostWatcher::Unwatch(const CFileInfo* dir)
+{
+	const auto it = watch_ids.find(dir);
+	if (it == watch_ids.end()) {
+		return;
+	}
+	inotify_rm_watch(fd, it->second);
+	dirs.erase(it->second);
+	watch_ids.erase(it);
+}
+
+void DOS_Drive_Cache::HostWatcher::Forget(const int watch_id)
+{
+	if (const auto dir = GetDir(watch_id); dir) {
+		watch_ids.erase(dir);
+		dirs.erase(watch_id);
+	}
+}
+
+std::vector<HostChange> DOS_Drive_Cache::HostWatcher::ReadChanges()
+{
+	std::vector<HostChange> changes = {};
+	if (dirs.empty()) {
+		return changes;
+	}
+	alignas(inotify_event) char buffer[16 * 1024];
+	ssize_t num_bytes = 0;
+	while ((num_bytes = read(fd, buffer, sizeof(buffer))) > 0) {
+		for (auto pos = buffer; pos < buffer + num_bytes;) {
+			const auto event = reinterpret_cast<const inotify_event*>(pos);
+			pos += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				changes.push_back({HostChange::Type::Overflowed});
+				continue;
+			}
+			// The directory itself is gone
+			if (event->mask & IN_IGNORED) {
+				Forget(event->wd);
+				continue;
+			}
+			if (event->len == 0) {
+				continue;
+			}
+			const auto type = (event->mask & (IN_CREATE | IN_MOVED_TO))
+			                        ? HostChange::Type::Added
+			                        : HostChange::Type::Removed;
+			changes.push_back({type,
+			                   event->wd,
+			                   event->name,
+			                   (event->mask & IN_ISDIR) != 0});
+		}
+	}
+	return changes;
+}
+
+#else
+
+DOS_Drive_Cache::HostWatcher::HostWatcher() {}
+
+DOS_Drive_Cache::HostWatcher::~HostWatcher() {}
+
+void DOS_Drive_Cache::HostWatcher::Watch(CFileInfo*, const char*) {}
+
+void DOS_Drive_Cache::HostWatcher::Unwatch(const CFileInfo*) {}
+
+void DOS_Drive_Cache::HostWatcher::Forget(int) {}
+
+std::vector<HostChange> DOS_Drive_Cache::HostWatcher::ReadChanges()
+{
+	return {};
+}
+
+#endif
+
+// Lists the directories of a host tree on worker threads, ahead of the
+// cache reading them in. Only the host listings are made there: the cache
+// isn't thread-safe, so the entries and their short names are still
+// created on the main thread.
+class DOS_Drive_Cache::DirPrefetcher {
+public:
+	// The paths are host paths ending with the separator, like dirPath
+	explicit DirPrefetcher(const std::string& root);
+	~DirPrefetcher();
+
+	DirPrefetcher(const DirPrefetcher&)            = delete;
+	DirPrefetcher& operator=(const DirPrefetcher&) = delete;
+
+	// Takes the listing of a directory of the tree, waiting for it if a
+	// worker is at it and listing it right away if none got to it yet.
+	// Returns false for the directories outside the tree and the ones
+	// that can't be listed.
+	bool Take(const std::string& path, std::vector<DirectoryEntry>& entries);
+
+	// Waits until the tree is listed or the listings not taken yet are
+	// at the limit
+	void WaitUntilIdle();
+
+private:
+	void Work();
+	void QueueSubdirs(const std::string& path,
+	                  const std::vector<DirectoryEntry>& entries);
+
+	// Enough listings to keep ahead of the cache; the workers wait once
+	// that many weren't taken yet
+	static constexpr size_t MaxListings = 1024;
+	// Bounds the walk through trees with symbolic links looping back
+	static constexpr size_t MaxDirs = 65536;
+
+	std::mutex mutex                        = {};
+	std::condition_variable work_available  = {};
+	std::condition_variable listing_done    = {};
+	std::deque<std::string> queue           = {};
+	std::unordered_set<std::string> queued  = {};
+	std::unordered_set<std::string> listing = {};
+	std::unordered_map<std::string, std::vector<DirectoryEntry>> listings = {};
+	size_t num_dirs                  = 0;
+	bool stop                        = false;
+	std::vector<std::thread> workers = {};
+};
+
+DOS_Drive_Cache::DirPrefetcher::DirPrefetcher(const std::string& root)
+{
+	queue.push_back(root);
+	queued.insert(root);
+	num_dirs = 1;
+
+	const auto num_workers = std::clamp(std::thread::hardware_concurrency(), 1u, 4u);
+	for (unsigned i = 0; i < num_workers; ++i) {
+		workers.emplace_back(&DirPrefetcher::Work, this);
+	}
+}
+
+DOS_Drive_Cache::DirPrefetcher::~DirPrefetcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	work_available.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void DOS_Drive_Cache::DirPrefetcher::Work()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		work_available.wait(lock, [this] {
+			return stop || (!queue.empty() && listings.size() < MaxListings);
+		});
+		if (stop) {
+			return;
+		}
+		const auto path = std::move(queue.front());
+		queue.pop_front();
+		// Skip the ones the main thread took over
+		if (queued.erase(path) == 0) {
+			listing_done.notify_all();
+			continue;
+		}
+		listing.insert(path);
+
+		lock.unlock();
+		std::vector<DirectoryEntry> entries = {};
+		const auto is_listed = list_directory(path.c_str(), entries);
+		lock.lock();
+
+		listing.erase(path);
+		if (is_listed) {
+			QueueSubdirs(path, entries);
+			listings.emplace(path, std::move(entries));
+		}
+		listing_done.notify_all();
+	}
+}
+
+void DOS_Drive_Cache::DirPrefetcher::QueueSubdirs(const std::string& path,
+                                                  const std::vector<DirectoryEntry>& entries)
+{
+	auto num_queued = 0;
+	for (const auto& entry : entries) {
+		if (!entry.is_directory || entry.name == "." || entry.name == "..") {
+			continue;
+		}
+		// The cache can't read in the longer paths anyway
+		if (path.length() + entry.name.length() + 1 >= CROSS_LEN ||
+		    num_dirs >= MaxDirs) {
+			continue;
+		}
+		auto subdir = path + entry.name + CROSS_FILESPLIT;
+		if (queued.insert(subdir).second) {
+			queue.push_back(std::move(subdir));
+			++num_dirs;
+			++num_queued;
+		}
+	}
+	if (num_queued) {
+		work_available.notify_all();
+	}
+}
+
+bool DOS_Drive_Cache::DirPrefetcher::Take(const std::string& path,
+                                          std::vector<DirectoryEntry>& entries)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	listing_done.wait(lock, [&] { return listing.count(path) == 0; });
+
+	if (const auto it = listings.find(path); it != listings.end()) {
+		entries = std::move(it->second);
+		listings.erase(it);
+		work_available.notify_all();
+		return true;
+	}
+	// The cache got ahead of the workers, so list it right away
+	if (queued.erase(path) == 0) {
+		return false;
+	}
+	lock.unlock();
+	const auto is_listed = list_directory(path.c_str(), entries);
+	lock.lock();
+	if (is_listed) {
+		QueueSubdirs(path, entries);
+	}
+	return is_listed;
+}
+
+void DOS_Drive_Cache::DirPrefetcher::WaitUntilIdle()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	listing_done.wait(lock, [this] {
+		return (queue.empty() && listing.empty()) ||
+		       listings.size() >= MaxListings;
+	});
+}
+
 bool SortByName(DOS_Drive_Cache::CFileInfo* const a,
                 DOS_Drive_Cache::CFileInfo* const b)
 {
@@ -95,6 +466,7 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path)
 }
 
 DOS_Drive_Cache::~DOS_Drive_Cache(void) {
+	StopPrefetching();
 	Clear();
 	for (uint32_t i=0; i<MAX_OPENDIRS; i++) {
 		DeleteFileInfo(dirFindFirst[i]);
@@ -112,6 +484,7 @@ void DOS_Drive_Cache::Clear(void) {
 
 void DOS_Drive_Cache::EmptyCache(void) {
 	// Empty Cache and reinit
+	StopPrefetching();
 	Clear();
 	dirBase		= new CFileInfo;
 	save_dir	= nullptr;
@@ -184,6 +557,8 @@ char* DOS_Drive_Cache::GetExpandNameAndNormaliseCase(const char* path)
 	static char work [CROSS_LEN] = { 0 };
 	char dir [CROSS_LEN];
 
+	ApplyHostChanges();
+
 	work[0] = 0;
 	safe_strcpy (dir, path);
 
@@ -366,6 +741,187 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
 	// clear lists
 	dir->fileList.clear();
 	dir->longNameList.clear();
+	dir->index.reset();
+	save_dir = nullptr;
+}
+
+bool DOS_Drive_Cache::WatchHostChanges()
+{
+	if (watcher) {
+		return true;
+	}
+	watcher = std::make_unique<HostWatcher>();
+	if (!watcher->IsValid()) {
+		LOG_WARNING("DIRCACHE: Watching for host changes is not available, use RESCAN instead");
+		watcher.reset();
+		return false;
+	}
+	// Read in the directories again to watch them
+	EmptyCache();
+	return true;
+}
+
+void DOS_Drive_Cache::PrefetchTree(const char* host_dir)
+{
+	// The watched directories have to be watched before they're listed,
+	// so they're read in on the main thread
+	if (watcher) {
+		return;
+	}
+	std::string root = host_dir;
+	if (root.empty() || root.length() >= CROSS_LEN) {
+		return;
+	}
+	if (root.back() != CROSS_FILESPLIT) {
+		root += CROSS_FILESPLIT;
+	}
+	prefetcher = std::make_unique<DirPrefetcher>(root);
+}
+
+void DOS_Drive_Cache::StopPrefetching()
+{
+	prefetcher.reset();
+}
+
+void DOS_Drive_Cache::WaitForPrefetching()
+{
+	if (prefetcher) {
+		prefetcher->WaitUntilIdle();
+	}
+}
+
+// Reads in the directory at dirPath from its prefetched listing, if it has one
+bool DOS_Drive_Cache::ReadPrefetched(CFileInfo* dir)
+{
+	std::vector<DirectoryEntry> entries = {};
+	if (!prefetcher || !prefetcher->Take(dirPath, entries)) {
+		return false;
+	}
+	GetNameIndex(dir).isLoading = true;
+	for (const auto& entry : entries) {
+		CreateEntry(dir, entry.name.c_str(), entry.is_directory);
+	}
+	FinishLoading(dir);
+	return true;
+}
+
+// Reads the host changes to the watched directories and applies them entry
+// by entry, so the cached directories stay in place
+void DOS_Drive_Cache::ApplyHostChanges()
+{
+	if (!watcher || applyingHostChanges) {
+		return;
+	}
+	applyingHostChanges = true;
+
+	bool overflowed = false;
+	for (const auto& change : watcher->ReadChanges()) {
+		if (change.type == HostChange::Type::Overflowed) {
+			overflowed = true;
+			break;
+		}
+		// Entries of directories not read in yet get picked up when
+		// they are
+		CFileInfo* dir = watcher->GetDir(change.watch_id);
+		if (!dir || !IsCachedIn(dir)) {
+			continue;
+		}
+		// The changes made by DOS itself are already in the cache,
+		// and renames arrive as a removal and an addition
+		if (change.type == HostChange::Type::Added) {
+			AddHostEntry(dir, change.name.c_str(), change.is_directory);
+		} else {
+			RemoveHostEntry(dir, change.name.c_str());
+		}
+	}
+	// The kernel dropped changes, so nothing but a full rescan helps
+	if (overflowed) {
+		LOG_WARNING("DIRCACHE: Too many host changes at once, rescanning");
+		EmptyCache();
+	}
+	applyingHostChanges = false;
+}
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindHostEntry(CFileInfo* dir, const char* name)
+{
+	if (dir->index) {
+		const auto& long_names = dir->index->longNames;
+		if (const auto it = long_names.find(get_name_key(name));
+		    it != long_names.end()) {
+			return it->second;
+		}
+	}
+	// Otherwise the short name is the name in upper case
+	char shortname[CROSS_LEN];
+	safe_strcpy(shortname, name);
+	upcase(shortname);
+	RemoveTrailingDot(shortname);
+
+	const auto range = std::equal_range(dir->fileList.begin(),
+	                                    dir->fileList.end(),
+	                                    shortname,
+	                                    [](const auto& a, const auto& b) {
+		                                    return strcmp(get_short_name(a),
+		                                                  get_short_name(b)) < 0;
+	                                    });
+	for (auto it = range.first; it != range.second; ++it) {
+		if ((*it)->orgname == name) {
+			return *it;
+		}
+	}
+	return nullptr;
+}
+
+void DOS_Drive_Cache::AddHostEntry(CFileInfo* dir, const char* name, bool is_directory)
+{
+	if (FindHostEntry(dir, name)) {
+		return;
+	}
+	CFileInfo* info = CreateEntry(dir, name, is_directory);
+
+	// Keep the open searches on the entry they were at
+	const auto pos = std::find(dir->fileList.begin(), dir->fileList.end(), info);
+	const auto index = static_cast<Bitu>(pos - dir->fileList.begin());
+	for (uint32_t i = 0; i < MAX_OPENDIRS; i++) {
+		if ((dirSearch[i] == dir) && (index <= dirSearch[i]->nextEntry)) {
+			dirSearch[i]->nextEntry++;
+		}
+	}
+}
+
+void DOS_Drive_Cache::RemoveHostEntry(CFileInfo* dir, const char* name)
+{
+	CFileInfo* info = FindHostEntry(dir, name);
+	if (!info) {
+		return;
+	}
+	const auto pos = std::find(dir->fileList.begin(), dir->fileList.end(), info);
+	assert(pos != dir->fileList.end());
+	const auto index = static_cast<Bitu>(pos - dir->fileList.begin());
+	dir->fileList.erase(pos);
+
+	auto& long_names = dir->longNameList;
+	long_names.erase(std::remove(long_names.begin(), long_names.end(), info),
+	                 long_names.end());
+	if (dir->index) {
+		// The shortest "~number" part per prefix can stay, as it only
+		// has to be no longer than the ones left
+		auto& index_names = dir->index->longNames;
+		if (const auto it = index_names.find(get_name_key(name));
+		    it != index_names.end() && it->second == info) {
+			index_names.erase(it);
+		}
+		dir->index->wineNames.clear();
+		dir->index->hasWineNames = false;
+	}
+
+	for (uint32_t i = 0; i < MAX_OPENDIRS; i++) {
+		if ((dirSearch[i] == dir) && (index < dirSearch[i]->nextEntry)) {
+			dirSearch[i]->nextEntry--;
+		}
+	}
+	// A removed directory takes its cached contents along
+	DeleteFileInfo(info);
 	save_dir = nullptr;
 }
 
@@ -375,6 +931,8 @@ bool DOS_Drive_Cache::IsCachedIn(CFileInfo* curDir) {
 
 
 bool DOS_Drive_Cache::GetShortName(const char* fullname, char* shortname) {
+	ApplyHostChanges();
+
 	// Get Dir Info
 	char expand[CROSS_LEN] = {0};
 	CFileInfo* curDir = FindDirInfo(fullname,expand);
@@ -385,22 +943,26 @@ bool DOS_Drive_Cache::GetShortName(const char* fullname, char* shortname) {
 	else
 		return false;
 
-	std::vector<CFileInfo*>::size_type filelist_size = curDir->longNameList.size();
-	if (GCC_UNLIKELY(filelist_size<=0))
+	if (GCC_UNLIKELY(curDir->longNameList.empty()))
 		return false;
 
-	// The orgname part of the list is not sorted (shortname is)! So we can only walk through it.
-	for(Bitu i = 0; i < filelist_size; i++) {
-#if defined (WIN32)
-		if (strcasecmp(pos,curDir->longNameList[i]->orgname) == 0) {
-#else
-		if (strcmp(pos,curDir->longNameList[i]->orgname) == 0) {
-#endif
-			safe_strncpy(shortname, curDir->longNameList[i]->shortname, DOS_NAMELENGTH_ASCII);
-			return true;
-		}
+	// The list is sorted by the short names, so look the host name up in
+	// the index instead
+	const auto& long_names = GetNameIndex(curDir).longNames;
+	const auto it = long_names.find(get_name_key(pos));
+	if (it == long_names.end())
+		return false;
+
+	safe_strncpy(shortname, it->second->shortname, DOS_NAMELENGTH_ASCII);
+	return true;
+}
+
+DOS_Drive_Cache::NameIndex& DOS_Drive_Cache::GetNameIndex(CFileInfo* dir)
+{
+	if (!dir->index) {
+		dir->index = std::make_unique<NameIndex>();
 	}
-	return false;
+	return *dir->index;
 }
 
 int DOS_Drive_Cache::CompareShortname(const char* compareName, const char* shortName) {
@@ -441,23 +1003,48 @@ unsigned DOS_Drive_Cache::CreateShortNameID(CFileInfo *curDir, const char *name)
 	if (filelist_size == 0)
 		return 1; // short name IDs start with 1
 
+	const auto& list = curDir->longNameList;
+
+	// CompareShortname() gives the same result for all the names starting
+	// with the same "prefix~" when they all have a "~number" part long
+	// enough to not extend the comparison past the '~'. The runs of those
+	// can be skipped in one go, as directories with many similar long
+	// names would otherwise take a walk through all of them per name.
+	const auto& min_number_sizes = GetNameIndex(curDir).minNumberSizes;
+	const auto name_len = std::min(strcspn(name, "."), static_cast<size_t>(8));
+	auto find_uniform_run_end = [&](const size_t pos) -> size_t {
+		const char* other = list[pos]->shortname;
+		const char* cpos  = strchr(other, '~');
+		if (!cpos) return pos + 1;
+		const auto prefix_len = static_cast<size_t>(cpos - other) + 1;
+		const auto it = min_number_sizes.find(std::string(other, prefix_len));
+		if (it == min_number_sizes.end() || name_len > prefix_len - 1 + it->second)
+			return pos + 1;
+		const auto end = std::partition_point(list.begin() + pos, list.end(),
+		                                      [&](const CFileInfo* info) {
+			                                      return strncmp(info->shortname, other, prefix_len) == 0;
+		                                      });
+		return static_cast<size_t>(end - list.begin());
+	};
+
 	unsigned found_nr = 0;
 	Bits low = 0;
 	Bits high = (Bits)(filelist_size - 1);
 
 	while (low <= high) {
 		auto mid = (low + high) / 2;
-		const char *other_shortname = curDir->longNameList[mid]->shortname;
+		const char *other_shortname = list[mid]->shortname;
 		const int res = CompareShortname(name, other_shortname);
 		
 		if (res>0)	low  = mid+1; else
 		if (res<0)	high = mid-1; 
 		else {
 			// any more same x chars in next entries ?	
+			size_t pos = static_cast<size_t>(mid);
 			do {
-				found_nr = curDir->longNameList[mid]->shortNr;
-				mid++;
-			} while((Bitu)mid < filelist_size && (CompareShortname(name, curDir->longNameList[mid]->shortname) == 0));
+				pos = find_uniform_run_end(pos);
+				found_nr = list[pos - 1]->shortNr;
+			} while (pos < filelist_size && (CompareShortname(name, list[pos]->shortname) == 0));
 			break;
 		};
 	}
@@ -479,12 +1066,13 @@ bool DOS_Drive_Cache::RemoveTrailingDot(char* shortname) {
 #define WINE_DRIVE_SUPPORT 1
 #if WINE_DRIVE_SUPPORT
 //Changes to interact with WINE by supporting their namemangling.
-//The code is rather slow, because orglist is unordered, so it needs to be avoided if possible.
+//The hashed names of a directory are indexed on the first lookup, but that's
+//still slow, so it needs to be avoided if possible.
 //Hence the tests in GetLongFileName
 
 
 // From the Wine project
-static Bits wine_hash_short_file_name( char* name, char* buffer )
+static Bits wine_hash_short_file_name(const char* name, char* buffer)
 {
 	constexpr char hash_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ012345";
 
@@ -512,9 +1100,9 @@ static Bits wine_hash_short_file_name( char* name, char* buffer )
 		return is_invalid ? '_' : toupper(c);
 	};
 
-	char *p = nullptr;
-	char *ext = nullptr;
-	char *end = name + strlen(name);
+	const char *p = nullptr;
+	const char *ext = nullptr;
+	const char *end = name + strlen(name);
 	char *dst = nullptr;
 	uint16_t hash = 0;
 	int i = 0;
@@ -572,29 +1160,67 @@ Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName, const size
 		if (res>0)	low  = mid+1; else
 		if (res<0)	high = mid-1; else
 		{	// Found
-			safe_strncpy(shortName, curDir->fileList[mid]->orgname, shortName_len);
+			safe_strncpy(shortName, curDir->fileList[mid]->orgname.c_str(), shortName_len);
 			return mid;
 		};
 	}
 #ifdef WINE_DRIVE_SUPPORT
-	if (strlen(shortName) < 8 || shortName[4] != '~' || shortName[5] == '.' || shortName[6] == '.' || shortName[7] == '.') return -1; // not available
-	// else it's most likely a Wine style short name ABCD~###, # = not dot  (length at least 8) 
-	// The above test is rather strict as the following loop can be really slow if filelist_size is large.
-	char buff[CROSS_LEN];
-	for (Bitu i = 0; i < filelist_size; i++) {
-		res = wine_hash_short_file_name(curDir->fileList[i]->orgname,buff);
-		buff[res] = 0;
-		if (!strcmp(shortName,buff)) {	
-			// Found
-			safe_strncpy(shortName, curDir->fileList[i]->orgname, shortName_len);
-			return (Bits)i;
-		}
+	if (const auto info = FindWineName(curDir, shortName); info) {
+		// Found
+		const auto pos = std::lower_bound(curDir->fileList.begin(),
+		                                  curDir->fileList.end(),
+		                                  info->shortname,
+		                                  [](const CFileInfo* other, const char* name) {
+			                                  return strcmp(other->shortname, name) < 0;
+		                                  });
+		assert(pos != curDir->fileList.end() && *pos == info);
+		safe_strncpy(shortName, info->orgname.c_str(), shortName_len);
+		return pos - curDir->fileList.begin();
 	}
 #endif
 	// not available
 	return -1;
 }
 
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindWineName([[maybe_unused]] CFileInfo* curDir,
+                                                          [[maybe_unused]] const char* shortName)
+{
+#ifdef WINE_DRIVE_SUPPORT
+	if (strlen(shortName) < 8 || shortName[4] != '~' || shortName[5] == '.' || shortName[6] == '.' || shortName[7] == '.') return nullptr; // not available
+	// else it's most likely a Wine style short name ABCD~###, # = not dot  (length at least 8) 
+	// The above test is rather strict as indexing the names is slow if the directory is large.
+	auto& index = GetNameIndex(curDir);
+	if (!index.hasWineNames) {
+		// The first entry with a hashed name wins, like in a walk
+		// through the list
+		char buff[CROSS_LEN];
+		for (const auto info : curDir->fileList) {
+			const auto len = wine_hash_short_file_name(info->orgname.c_str(), buff);
+			index.wineNames.emplace(std::string(buff, len), info);
+		}
+		index.hasWineNames = true;
+	}
+	const auto it = index.wineNames.find(shortName);
+	return it != index.wineNames.end() ? it->second : nullptr;
+#else
+	return nullptr;
+#endif
+}
+
+// Checks if an entry has the short name while the directory is read in, when
+// the entries aren't sorted yet
+bool DOS_Drive_Cache::IsShortNameTaken(CFileInfo* curDir, char* shortName)
+{
+	if (!curDir->index || !curDir->index->isLoading) {
+		return GetLongName(curDir, shortName, CROSS_LEN) >= 0;
+	}
+	if (curDir->fileList.empty()) return false;
+
+	RemoveTrailingDot(shortName);
+	return curDir->index->loadingShortNames.count(shortName) > 0 ||
+	       FindWineName(curDir, shortName) != nullptr;
+}
+
 bool DOS_Drive_Cache::RemoveSpaces(char* str) {
 // Removes all spaces
 	char*	curpos	= str;
@@ -612,7 +1238,7 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 
 	// Remove Spaces
 	char tmpNameBuffer[CROSS_LEN];
-	safe_strcpy(tmpNameBuffer, info->orgname);
+	safe_strcpy(tmpNameBuffer, info->orgname.c_str());
 	char* tmpName = tmpNameBuffer;
 	upcase(tmpName);
 	createShort = RemoveSpaces(tmpName);
@@ -639,7 +1265,7 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 	if (!createShort) {
 		char buffer[CROSS_LEN];
 		safe_strcpy(buffer, tmpName);
-		createShort = (GetLongName(curDir, buffer, sizeof(buffer)) >= 0);
+		createShort = IsShortNameTaken(curDir, buffer);
 	}
 
 	if (createShort) {
@@ -683,27 +1309,18 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 		}
 
 		// keep list sorted for CreateShortNameID to work correctly
-		if (curDir->longNameList.size()>0) {
-			if (!(strcmp(info->shortname,curDir->longNameList.back()->shortname)<0)) {
-				// append at end of list
-				curDir->longNameList.push_back(info);
-			} else {
-				// look for position where to insert this element
-				bool found=false;
-				std::vector<CFileInfo*>::iterator it;
-				for (it=curDir->longNameList.begin(); it!=curDir->longNameList.end(); ++it) {
-					if (strcmp(info->shortname,(*it)->shortname)<0) {
-						found = true;
-						break;
-					}
-				}
-				// Put it in longname list...
-				if (found) curDir->longNameList.insert(it,info);
-				else curDir->longNameList.push_back(info);
-			}
-		} else {
-			// empty file list, append
-			curDir->longNameList.push_back(info);
+		auto& list = curDir->longNameList;
+		list.insert(find_insert_position(list, info->shortname), info);
+		auto& index = GetNameIndex(curDir);
+		index.longNames.emplace(get_name_key(info->orgname.c_str()), info);
+
+		const char* cpos = strchr(info->shortname, '~');
+		assert(cpos);
+		const auto prefix = std::string(info->shortname, cpos - info->shortname + 1);
+		const auto number_size = strcspn(cpos, ".");
+		const auto [it, inserted] = index.minNumberSizes.emplace(prefix, number_size);
+		if (!inserted) {
+			it->second = std::min(it->second, number_size);
 		}
 	} else {
 		safe_strcpy(info->shortname, tmpName);
@@ -771,7 +1388,7 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 		// Follow Directory
 		if ((nextDir>=0) && curDir->fileList[nextDir]->isDir) {
 			curDir = curDir->fileList[nextDir];
-			safe_strcpy(curDir->orgname, dir);
+			curDir->orgname = dir;
 			if (!IsCachedIn(curDir)) {
 				if (OpenDir(curDir,expandedPath,id)) {
 					char buffer[CROSS_LEN];
@@ -801,6 +1418,8 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 }
 
 bool DOS_Drive_Cache::OpenDir(const char* path, uint16_t& id) {
+	ApplyHostChanges();
+
 	char expand[CROSS_LEN] = {0};
 	CFileInfo* dir = FindDirInfo(path,expand);
 	if (OpenDir(dir,expand,id)) {
@@ -839,45 +1458,54 @@ bool DOS_Drive_Cache::OpenDir(CFileInfo* dir, const char* expand, uint16_t& id)
 	return false;
 }
 
-void DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, bool is_directory) {
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, bool is_directory) {
 	CFileInfo* info = new CFileInfo;
-	safe_strcpy(info->orgname, name);
+	info->orgname = name;
 	info->shortNr = 0;
 	info->isDir = is_directory;
 
 	// Check for long filenames...
 	CreateShortName(dir, info);		
 
-	bool found = false;
-
-	// keep list sorted (so GetLongName works correctly, used by CreateShortName in this routine)
-	if (dir->fileList.size()>0) {
-		if (!(strcmp(info->shortname,dir->fileList.back()->shortname)<0)) {
-			// append at end of list
-			dir->fileList.push_back(info);
-		} else {
-			// look for position where to insert this element
-			std::vector<CFileInfo*>::iterator it;
-			for (it=dir->fileList.begin(); it!=dir->fileList.end(); ++it) {
-				if (strcmp(info->shortname,(*it)->shortname)<0) {
-					found = true;
-					break;
-				}
-			}
-			// Put file in lists
-			if (found) dir->fileList.insert(it,info);
-			else dir->fileList.push_back(info);
-		}
-	} else {
-		// empty file list, append
+	if (dir->index && dir->index->isLoading) {
 		dir->fileList.push_back(info);
+		dir->index->loadingShortNames.emplace(info->shortname);
+	} else {
+		// keep list sorted (so GetLongName works correctly, used by CreateShortName in this routine)
+		dir->fileList.insert(find_insert_position(dir->fileList, info->shortname), info);
+	}
+
+	// the Wine-style names get indexed again on the next lookup
+	if (dir->index && dir->index->hasWineNames) {
+		dir->index->wineNames.clear();
+		dir->index->hasWineNames = false;
 	}
+	return info;
+}
+
+void DOS_Drive_Cache::FinishLoading(CFileInfo* dir)
+{
+	// A stable sort puts them in the order that inserting each after the
+	// ones with the same name would have
+	std::stable_sort(dir->fileList.begin(),
+	                 dir->fileList.end(),
+	                 [](const CFileInfo* a, const CFileInfo* b) {
+		                 return strcmp(a->shortname, b->shortname) < 0;
+	                 });
+
+	auto& index             = GetNameIndex(dir);
+	index.loadingShortNames = {};
+	index.isLoading         = false;
+
+	// the first of the Wine-style names depends on the order
+	index.wineNames    = {};
+	index.hasWineNames = false;
 }
 
 void DOS_Drive_Cache::CopyEntry(CFileInfo* dir, CFileInfo* from) {
 	CFileInfo* info = new CFileInfo;
-	// just copy things into new fileinfo
-	safe_strcpy(info->orgname, from->orgname);
+	// just copy things into new fileinfo; the searches only return the
+	// short names, so the host name is left out
 	safe_strcpy(info->shortname, from->shortname);
 	info->shortNr = from->shortNr;
 	info->isDir = from->isDir;
@@ -890,7 +1518,7 @@ bool DOS_Drive_Cache::ReadDir(uint16_t id, char* &result) {
 	if (id >= MAX_OPENDIRS)
 		return false;
 
-	if (!IsCachedIn(dirSearch[id])) {
+	if (!IsCachedIn(dirSearch[id]) && !ReadPrefetched(dirSearch[id])) {
 		// Try to open directory
 		dir_information* dirp = open_directory(dirPath);
 		if (!dirp) {
@@ -900,7 +1528,15 @@ bool DOS_Drive_Cache::ReadDir(uint16_t id, char* &result) {
 			}
 			return false;
 		}
-		// Read complete directory
+		// Watch it before reading it, so the changes made while it's
+		// read don't get lost
+		if (watcher) {
+			watcher->Watch(dirSearch[id], dirPath);
+		}
+		// Read complete directory, sorting the entries once it's done
+		// instead of inserting each in place
+		GetNameIndex(dirSearch[id]).isLoading = true;
+
 		char dir_name[CROSS_LEN];
 		bool is_directory;
 		if (read_directory_first(dirp, dir_name, is_directory)) {
@@ -909,6 +1545,7 @@ bool DOS_Drive_Cache::ReadDir(uint16_t id, char* &result) {
 				CreateEntry(dirSearch[id], dir_name, is_directory);
 			}
 		}
+		FinishLoading(dirSearch[id]);
 
 		// close dir
 		close_directory(dirp);
@@ -1024,6 +1661,9 @@ void DOS_Drive_Cache::ClearFileInfo(CFileInfo *dir) {
 		dirSearch[dir->id] = nullptr;
 		dir->id = MAX_OPENDIRS;
 	}
+	if (watcher) {
+		watcher->Unwatch(dir);
+	}
 }
 
 void DOS_Drive_Cache::DeleteFileInfo(CFileInfo *dir) {
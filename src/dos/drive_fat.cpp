@@ -18,6 +18,7 @@
 
 #include "drives.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -45,6 +46,7 @@ public:
 	fatFile(const fatFile&) = delete; // prevent copy
 	fatFile& operator=(const fatFile&) = delete; // prevent assignment
 	bool Read(uint8_t * data,uint16_t * size) override;
+	bool ReadBulk(uint8_t* data, uint32_t* size) override;
 	bool Write(uint8_t * data,uint16_t * size) override;
 	bool Seek(uint32_t * pos,uint32_t type) override;
 	bool Close() override;
@@ -152,6 +154,59 @@ bool fatFile::Read(uint8_t * data, uint16_t *size) {
 	return true;
 }
 
+// Reads whole sectors straight into the destination and only goes through
+// the sector buffer for the partial ones
+bool fatFile::ReadBulk(uint8_t* data, uint32_t* size)
+{
+	// check if file opened in write-only mode
+	if ((this->flags & 0xf) == OPEN_WRITE) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	const uint32_t sector_size = myDrive->getSectorSize();
+	const uint32_t requested   = seekpos < filelength
+	                                   ? std::min(*size, filelength - seekpos)
+	                                   : 0;
+	uint32_t done = 0;
+	while (done < requested) {
+		if (!loadedSector) {
+			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+			if (currentSector == 0) {
+				/* EOC reached before EOF */
+				break;
+			}
+			curSectOff = seekpos % sector_size;
+			if (curSectOff == 0 && requested - done >= sector_size) {
+				myDrive->readSector(currentSector, data + done);
+				done += sector_size;
+				seekpos += sector_size;
+				continue;
+			}
+			myDrive->readSector(currentSector, sectorBuffer);
+			loadedSector = true;
+		}
+		const auto chunk = std::min(sector_size - curSectOff, requested - done);
+		memcpy(data + done, sectorBuffer + curSectOff, chunk);
+		done += chunk;
+		seekpos += chunk;
+		curSectOff += chunk;
+		if (curSectOff >= sector_size) {
+			loadedSector = false;
+		}
+	}
+	// Leave the sector at the position loaded, like Read and Seek do
+	if (!loadedSector) {
+		currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+		if (currentSector != 0) {
+			curSectOff = seekpos % sector_size;
+			myDrive->readSector(currentSector, sectorBuffer);
+			loadedSector = true;
+		}
+	}
+	*size = done;
+	return true;
+}
+
 bool fatFile::Write(uint8_t * data, uint16_t *size) {
 	// check if file opened in read-only mode
 	if ((this->flags & 0xf) == OPEN_READ || myDrive->isReadOnly()) {
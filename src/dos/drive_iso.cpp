@@ -18,6 +18,7 @@
 
 #include "drives.h"
 
+#include <algorithm>
 #include <cctype>
 #include <cstring>
 
@@ -37,6 +38,7 @@ public:
 	isoFile &operator=(const isoFile &) = delete; // prevent assignment
 
 	bool Read(uint8_t *data, uint16_t *size) override;
+	bool ReadBulk(uint8_t* data, uint32_t* size) override;
 	bool Write(uint8_t *data, uint16_t *size) override;
 	bool Seek(uint32_t *pos, uint32_t type) override;
 	bool Close() override;
@@ -109,6 +111,37 @@ bool isoFile::Read(uint8_t *data, uint16_t *size) {
 	return true;
 }
 
+// Reads whole sectors straight into the destination
+bool isoFile::ReadBulk(uint8_t* data, uint32_t* size)
+{
+	const auto requested = filePos < fileEnd ? std::min(*size, fileEnd - filePos) : 0;
+
+	uint32_t done = 0;
+	while (done < requested) {
+		const auto sector     = filePos / ISO_FRAMESIZE;
+		const auto sector_pos = filePos % ISO_FRAMESIZE;
+		const auto chunk = std::min<uint32_t>(ISO_FRAMESIZE - sector_pos, requested - done);
+		if (chunk == ISO_FRAMESIZE && static_cast<int>(sector) != cachedSector) {
+			if (!drive->readSector(data + done, sector)) {
+				break;
+			}
+		} else {
+			if (static_cast<int>(sector) != cachedSector) {
+				if (!drive->readSector(buffer, sector)) {
+					cachedSector = -1;
+					break;
+				}
+				cachedSector = static_cast<int>(sector);
+			}
+			memcpy(data + done, buffer + sector_pos, chunk);
+		}
+		done += chunk;
+		filePos += chunk;
+	}
+	*size = done;
+	return true;
+}
+
 bool isoFile::Write(uint8_t* /*data*/, uint16_t* /*size*/) {
 	return false;
 }
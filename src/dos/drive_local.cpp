@@ -530,6 +530,24 @@ bool localDrive::TestDir(char* dir)
 	return path_exists(newdir);
 }
 
+void localDrive::PrefetchTree(const char* dir)
+{
+	char newdir[CROSS_LEN];
+	safe_strcpy(newdir, basedir);
+	safe_strcat(newdir, dir);
+	CROSS_FILENAME(newdir);
+	dirCache.ExpandNameAndNormaliseCase(newdir);
+	// Searches name a pattern within the directory
+	if (!is_directory(newdir)) {
+		const auto last_split = strrchr(newdir, CROSS_FILESPLIT);
+		if (!last_split) {
+			return;
+		}
+		*(last_split + 1) = 0;
+	}
+	dirCache.PrefetchTree(newdir);
+}
+
 bool localDrive::Rename(char* oldname, char* newname)
 {
 	char newold[CROSS_LEN];
@@ -670,6 +688,14 @@ void localFile::fseek_and_check(int whence)
 
 //TODO Maybe use fflush, but that seemed to fuck up in visual c
 bool localFile::Read(uint8_t *data, uint16_t *size)
+{
+	uint32_t bulk_size = *size;
+	const bool result  = localFile::ReadBulk(data, &bulk_size);
+	*size              = static_cast<uint16_t>(bulk_size);
+	return result;
+}
+
+bool localFile::ReadBulk(uint8_t* data, uint32_t* size)
 {
 	// check if the file is opened in write-only mode
 	if ((this->flags & 0xf) == OPEN_WRITE) {
@@ -684,7 +710,7 @@ bool localFile::Read(uint8_t *data, uint16_t *size)
 
 	last_action = LastAction::Read;
 	const auto requested = *size;
-	const auto actual = static_cast<uint16_t>(fread(data, 1, requested, fhandle));
+	const auto actual = static_cast<uint32_t>(fread(data, 1, requested, fhandle));
 	*size = actual; // always save the actual
 
 	if (actual != requested) {
@@ -25,17 +25,31 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <fstream>
+#include <iterator>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "dos_inc.h"
 #include "string_utils.h"
 #include "cross.h"
 #include "inout.h"
+#include "mem_host.h"
 #include "timer.h"
 #include "fs_utils.h"
 #include "std_filesystem.h"
 
+#if defined(HAVE_COPY_FILE_RANGE)
+#include <unistd.h>
+#endif
+
+#if defined(HAVE_FICLONE)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
 #define OVERLAY_DIR 1
 bool logoverlay = false;
 using namespace std;
@@ -74,6 +88,30 @@ using namespace std;
  * it changes (when deleting a file or adding one)
  */
 
+/* The cached information is also kept in an index file in the root of the
+ * overlay, so mounting doesn't need to walk the whole overlay directory. It
+ * starts with a snapshot of the information and each change gets appended to
+ * it as a record like "+DEL DIR\FILE.EXT" or "-FIL FILE.EXT", with DEL, RMD,
+ * DIR, FIL and MAP standing for the deleted files, the deleted directories,
+ * the directories only in the overlay, the files in the overlay and the files
+ * with a block map. Walking the overlay (on the first mount or on a rescan)
+ * writes a new snapshot. The special DBOVERLAY files stay the reference, so
+ * the index can always be rebuilt from them.
+ *
+ * The header carries a stamp of the modification times of the overlay
+ * directories holding the indexed entries, updated when the drive gets
+ * unmounted. When the overlay was changed outside of DOSBox, or DOSBox
+ * didn't get to unmount it, the stamp doesn't match anymore and the overlay
+ * gets walked again.
+ */
+constexpr char OverlayIndexName[]     = "DBOVERLAY_INDEX.DAT";
+constexpr char OverlayIndexTempName[] = "DBOVERLAY_INDEX.TMP";
+constexpr char OverlayIndexHeader[]   = "DBOVERLAY INDEX 2";
+constexpr int OverlayIndexStampDigits = 16;
+
+// Rewrite the index when it has this many records more than needed
+constexpr size_t MaxObsoleteIndexRecords = 256;
+
 
 //directories that exist only in overlay can not be added to the drive_cache currently. 
 //Either upgrade addentry to support directories. (without actually caching stuff in! (code in testing))
@@ -205,6 +243,175 @@ bool Overlay_Drive::TestDir(char * dir) {
 	return localDrive::TestDir(dir);
 }
 
+// Overlay files of this size or larger are copied block by block, as they
+// get written to
+constexpr uint64_t MinBlockCopyFileSize = 4 * 1024 * 1024;
+constexpr uint64_t OverlayBlockSize     = 64 * 1024;
+
+// The blocks of an overlay file that weren't written to yet. They are holes
+// in the overlay file and get read from the base file instead. The map is
+// kept in a special file next to the overlay file until all blocks are
+// copied.
+struct OverlayBlockMap {
+	std::string marker_path     = {};
+	uint64_t base_size          = 0;
+	std::vector<bool> from_base = {};
+	size_t num_from_base        = 0;
+
+	bool IsFromBase(const uint64_t block) const
+	{
+		return block < from_base.size() && from_base[block];
+	}
+
+	void SetCopied(const uint64_t block)
+	{
+		if (IsFromBase(block)) {
+			from_base[block] = false;
+			--num_from_base;
+		}
+	}
+
+	bool Save() const;
+	bool Load();
+};
+
+constexpr char BlockMapMagic[]        = "DBOVLMAP";
+constexpr size_t BlockMapMagicSize    = sizeof(BlockMapMagic) - 1;
+constexpr uint32_t BlockMapVersion    = 1;
+constexpr size_t BlockMapHeaderSize   = BlockMapMagicSize + 4 + 4 + 8;
+
+bool OverlayBlockMap::Save() const
+{
+	if (num_from_base == 0) {
+		std::error_code ec = {};
+		std_fs::remove(marker_path, ec);
+		return !ec;
+	}
+	std::vector<uint8_t> data(BlockMapHeaderSize + (from_base.size() + 7) / 8);
+	memcpy(data.data(), BlockMapMagic, BlockMapMagicSize);
+	host_writed(data.data() + BlockMapMagicSize, BlockMapVersion);
+	host_writed(data.data() + BlockMapMagicSize + 4, OverlayBlockSize);
+	host_writeq(data.data() + BlockMapMagicSize + 8, base_size);
+	for (size_t block = 0; block < from_base.size(); ++block) {
+		if (from_base[block]) {
+			data[BlockMapHeaderSize + block / 8] |= 1 << (block % 8);
+		}
+	}
+	FILE* f = fopen(marker_path.c_str(), "wb");
+	if (!f) {
+		return false;
+	}
+	const bool written = fwrite(data.data(), 1, data.size(), f) == data.size();
+	return (fclose(f) == 0) && written;
+}
+
+bool OverlayBlockMap::Load()
+{
+	FILE* f = fopen(marker_path.c_str(), "rb");
+	if (!f) {
+		return false;
+	}
+	std::vector<uint8_t> data = {};
+	uint8_t buffer[4096];
+	size_t num_read = 0;
+	while ((num_read = fread(buffer, 1, sizeof(buffer), f)) != 0) {
+		data.insert(data.end(), buffer, buffer + num_read);
+	}
+	fclose(f);
+
+	if (data.size() < BlockMapHeaderSize ||
+	    memcmp(data.data(), BlockMapMagic, BlockMapMagicSize) != 0 ||
+	    host_readd(data.data() + BlockMapMagicSize) != BlockMapVersion ||
+	    host_readd(data.data() + BlockMapMagicSize + 4) != OverlayBlockSize) {
+		return false;
+	}
+	base_size = host_readq(data.data() + BlockMapMagicSize + 8);
+
+	const auto num_blocks = (base_size + OverlayBlockSize - 1) / OverlayBlockSize;
+	if (data.size() != BlockMapHeaderSize + (num_blocks + 7) / 8) {
+		return false;
+	}
+	from_base.assign(num_blocks, false);
+	num_from_base = 0;
+	for (size_t block = 0; block < num_blocks; ++block) {
+		if (data[BlockMapHeaderSize + block / 8] & (1 << (block % 8))) {
+			from_base[block] = true;
+			++num_from_base;
+		}
+	}
+	return true;
+}
+
+static uint64_t get_file_size(FILE* f)
+{
+	struct stat file_stat;
+	if (fstat(cross_fileno(f), &file_stat) != 0 || file_stat.st_size < 0) {
+		return 0;
+	}
+	return static_cast<uint64_t>(file_stat.st_size);
+}
+
+// Makes the new file share the data of the whole file, on the filesystems
+// that can do it
+static bool clone_file([[maybe_unused]] FILE* from, [[maybe_unused]] FILE* to)
+{
+#if defined(HAVE_FICLONE)
+	return ioctl(cross_fileno(to), FICLONE, cross_fileno(from)) == 0;
+#else
+	return false;
+#endif
+}
+
+// Copies a range of one file to the same place in another one, within the
+// host's kernel where possible. The file positions are left undefined.
+static bool copy_file_data(FILE* from, FILE* to, const uint64_t offset,
+                           const uint64_t num_bytes)
+{
+	if (fflush(to) != 0) {
+		return false;
+	}
+	uint64_t num_copied = 0;
+#if defined(HAVE_COPY_FILE_RANGE)
+	auto from_offset = static_cast<off_t>(offset);
+	auto to_offset   = static_cast<off_t>(offset);
+	while (num_copied < num_bytes) {
+		// Stops at the end of the file, or when the two files can't
+		// be copied between this way
+		const auto result = copy_file_range(cross_fileno(from),
+		                                    &from_offset,
+		                                    cross_fileno(to),
+		                                    &to_offset,
+		                                    num_bytes - num_copied,
+		                                    0);
+		if (result <= 0) {
+			break;
+		}
+		num_copied += static_cast<uint64_t>(result);
+	}
+	if (num_copied == num_bytes) {
+		return true;
+	}
+#endif
+	const auto position = static_cast<long>(offset + num_copied);
+	if (fseek(from, position, SEEK_SET) != 0 || fseek(to, position, SEEK_SET) != 0) {
+		return false;
+	}
+	std::vector<uint8_t> buffer(OverlayBlockSize);
+	while (num_copied < num_bytes) {
+		const auto num_wanted = std::min<uint64_t>(buffer.size(),
+		                                           num_bytes - num_copied);
+		const auto num_read = fread(buffer.data(), 1, num_wanted, from);
+		if (num_read == 0) {
+			break;
+		}
+		if (fwrite(buffer.data(), 1, num_read, to) != num_read) {
+			return false;
+		}
+		num_copied += num_read;
+	}
+	return !ferror(from);
+}
+
 class OverlayFile final : public localFile {
 public:
 	OverlayFile(const char* name, const std_fs::path& path, FILE* handle,
@@ -216,6 +423,36 @@ public:
 			LOG_MSG("constructing OverlayFile: %s", name);
 	}
 
+	~OverlayFile() override
+	{
+		if (base_handle) {
+			fclose(base_handle);
+		}
+	}
+
+	bool Read(uint8_t* data, uint16_t* size) override
+	{
+		uint32_t bulk_size = *size;
+		const bool result  = ReadBulk(data, &bulk_size);
+		*size              = static_cast<uint16_t>(bulk_size);
+		return result;
+	}
+
+	bool ReadBulk(uint8_t* data, uint32_t* size) override
+	{
+		if (!block_map || block_map->num_from_base == 0) {
+			return localFile::ReadBulk(data, size);
+		}
+		const auto pos = ftell(fhandle);
+		if (!localFile::ReadBulk(data, size)) {
+			return false;
+		}
+		if (pos >= 0) {
+			read_from_base(static_cast<uint64_t>(pos), data, *size);
+		}
+		return true;
+	}
+
 	bool Write(uint8_t * data,uint16_t * size) override {
 		uint32_t f = flags&0xf;
 		if (!overlay_active && (f == OPEN_READWRITE || f == OPEN_WRITE)) {
@@ -233,13 +470,102 @@ public:
 			overlay_active = true;
 			
 		}
+		if (block_map && block_map->num_from_base != 0 &&
+		    !copy_blocks_from_base(*size)) {
+			DOS_SetError(DOSERR_ACCESS_DENIED);
+			return false;
+		}
 		return localFile::Write(data,size);
 	}
+
+	bool Close() override
+	{
+		const bool is_last_reference = (refCtr == 1);
+		const bool result = localFile::Close();
+		if (is_last_reference && base_handle) {
+			fclose(base_handle);
+			base_handle = nullptr;
+		}
+		return result;
+	}
+
 	bool create_copy();
+	void use_block_map(const std::shared_ptr<OverlayBlockMap>& map, FILE* base)
+	{
+		block_map   = map;
+		base_handle = base;
+	}
 //private:
+	void read_from_base(uint64_t pos, uint8_t* data, uint32_t size);
+	bool copy_blocks_from_base(uint16_t size);
+
 	bool overlay_active;
+	std::shared_ptr<OverlayBlockMap> block_map = {};
+	FILE* base_handle                          = nullptr;
 };
 
+// Fills in the parts of the data that are still in the base file
+void OverlayFile::read_from_base(const uint64_t pos, uint8_t* data, const uint32_t size)
+{
+	const auto end = std::min<uint64_t>(pos + size, block_map->base_size);
+	for (auto block = pos / OverlayBlockSize; block * OverlayBlockSize < end; ++block) {
+		if (!block_map->IsFromBase(block)) {
+			continue;
+		}
+		const auto start = std::max(pos, block * OverlayBlockSize);
+		const auto stop  = std::min(end, (block + 1) * OverlayBlockSize);
+		if (fseek(base_handle, static_cast<long>(start), SEEK_SET) != 0 ||
+		    fread(data + (start - pos), 1, stop - start, base_handle) != stop - start) {
+			LOG_ERR("OVERLAY: Failed reading the base file of '%s'", GetName());
+			return;
+		}
+	}
+}
+
+// Copies the blocks a write of the given size at the current position goes
+// to, or for a truncation, the block it ends in
+bool OverlayFile::copy_blocks_from_base(const uint16_t size)
+{
+	const auto pos = ftell(fhandle);
+	if (pos < 0) {
+		return false;
+	}
+	const auto first_block = static_cast<uint64_t>(pos) / OverlayBlockSize;
+	const auto last_block  = size ? (static_cast<uint64_t>(pos) + size - 1) / OverlayBlockSize
+	                              : first_block;
+	bool changed = false;
+	for (auto block = first_block; block <= last_block; ++block) {
+		if (!block_map->IsFromBase(block)) {
+			continue;
+		}
+		const auto offset = block * OverlayBlockSize;
+		const auto num_bytes = std::min(OverlayBlockSize, block_map->base_size - offset);
+		if (!copy_file_data(base_handle, fhandle, offset, num_bytes)) {
+			LOG_ERR("OVERLAY: Failed copying a block of '%s' to the overlay: %s",
+			        GetName(),
+			        strerror(errno));
+			fseek(fhandle, pos, SEEK_SET);
+			return false;
+		}
+		block_map->SetCopied(block);
+		changed = true;
+	}
+	// Truncating also takes the blocks after the position out of the base
+	// file, as they're zeros if the file grows again
+	if (size == 0) {
+		for (auto block = first_block + 1; block < block_map->from_base.size(); ++block) {
+			changed |= block_map->IsFromBase(block);
+			block_map->SetCopied(block);
+		}
+	}
+	if (changed && !block_map->Save()) {
+		LOG_ERR("OVERLAY: Failed updating the block map of '%s': %s",
+		        GetName(),
+		        strerror(errno));
+	}
+	return fseek(fhandle, pos, SEEK_SET) == 0;
+}
+
 //Create leading directories of a file being overlayed if they exist in the original (localDrive).
 //This function is used to create copies of existing files, so all leading directories exist in the original.
 
@@ -265,6 +591,9 @@ std::pair<FILE*, std_fs::path> Overlay_Drive::create_file_in_overlay(
 		//try again
 		f = fopen(newname,mode);
 	}
+	if (f) {
+		add_DOSname_to_cache(dos_filename);
+	}
 
 	return {f, newname};
 }
@@ -310,9 +639,10 @@ bool OverlayFile::create_copy() {
 	}
 
 	FILE* newhandle = nullptr;
+	Overlay_Drive* od = nullptr;
 	uint8_t drive_set = GetDrive();
 	if (drive_set != 0xff && drive_set < DOS_DRIVES && Drives[drive_set]){
-		const auto od = dynamic_cast<Overlay_Drive*>(Drives[drive_set]);
+		od = dynamic_cast<Overlay_Drive*>(Drives[drive_set]);
 		if (od) {
 			std_fs::path path = {};
 			// TODO: check wb+
@@ -321,10 +651,31 @@ bool OverlayFile::create_copy() {
 	}
  
 	if (!newhandle) return false;
-	char buffer[BUFSIZ];
-	size_t s;
-	while ( (s = fread(buffer,1,BUFSIZ,lhandle)) != 0 ) fwrite(buffer, 1, s, newhandle);
-	fclose(lhandle);
+
+	// Sharing the data is cheapest, otherwise large files only get their
+	// blocks copied when they're written to
+	const auto base_size = get_file_size(lhandle);
+	bool copied = clone_file(lhandle, newhandle);
+	if (!copied && base_size >= MinBlockCopyFileSize &&
+	    ftruncate(cross_fileno(newhandle), static_cast<off_t>(base_size)) == 0) {
+		block_map = od->create_block_map(GetName(), base_size);
+		if (block_map) {
+			base_handle = lhandle;
+			copied      = true;
+		}
+	}
+	if (!copied) {
+		copied = copy_file_data(lhandle, newhandle, 0, base_size);
+	}
+	if (!base_handle) {
+		fclose(lhandle);
+	}
+	if (!copied) {
+		LOG_ERR("OVERLAY: Failed copying file '%s' to the overlay: %s",
+		        GetName(), strerror(errno));
+		fclose(newhandle);
+		return false;
+	}
 
 	//Set copied file handle to position of the old one
 	if (fseek(newhandle, location_in_old_file, SEEK_SET) != 0) {
@@ -406,7 +757,18 @@ Overlay_Drive::Overlay_Drive(const char *startdir,
 	//add_deleted_path(dirname); //update_cache will add the overlap_folder
 	overlap_folder = dirname;
 
-	update_cache(true);
+	// Only walk the overlay when it has no usable index
+	if (!load_index()) {
+		update_cache(true);
+	}
+}
+
+Overlay_Drive::~Overlay_Drive()
+{
+	if (index_file) {
+		fclose(index_file);
+		stamp_index();
+	}
 }
 
 void Overlay_Drive::convert_overlay_to_DOSname_in_base(char* dirname ) 
@@ -521,6 +883,19 @@ bool Overlay_Drive::FileOpen(DOS_File * * file,char * name,uint32_t flags) {
 		OverlayFile* f = ccc(*file);
 		f->flags = flags; //ccc copies the flags of the localfile, which were not correct in this case
 		f->overlay_active = overlayed; //No need to switch if already in overlayed.
+		if (const auto block_map = overlayed ? get_block_map(name) : nullptr; block_map) {
+			char basename[CROSS_LEN];
+			safe_strcpy(basename, basedir);
+			safe_strcat(basename, name);
+			CROSS_FILENAME(basename);
+			FILE* base = fopen(dirCache.GetExpandNameAndNormaliseCase(basename), "rb");
+			if (base) {
+				f->use_block_map(block_map, base);
+			} else {
+				LOG_ERR("OVERLAY: Missing the base file of '%s', its unwritten parts read as zeros",
+				        name);
+			}
+		}
 		*file = f;
 	}
 	return fileopened;
@@ -535,6 +910,9 @@ bool Overlay_Drive::FileCreate(DOS_File** file, char* name,
 	//check if leading part of filename is a deleted directory
 	if (check_if_leading_is_deleted(name)) return false;
 
+	// Recreating the file drops what's in the base file
+	remove_block_map(name);
+
 	auto [f, path] = create_file_in_overlay(name, "wb+");
 	if (!f) {
 		if (logoverlay) {
@@ -564,10 +942,15 @@ void Overlay_Drive::add_DOSname_to_cache(const char* name) {
 		if (name == (*itc)) return;
 	}
 	DOSnames_cache.push_back(name);
+	journal_index('+', "FIL", name);
 }
 void Overlay_Drive::remove_DOSname_from_cache(const char* name) {
 	for (std::vector<std::string>::iterator it = DOSnames_cache.begin(); it != DOSnames_cache.end(); ++it) {
-		if (name == (*it)) { DOSnames_cache.erase(it); return;}
+		if (name == (*it)) {
+			DOSnames_cache.erase(it);
+			journal_index('-', "FIL", name);
+			return;
+		}
 	}
 
 }
@@ -625,6 +1008,11 @@ void Overlay_Drive::update_cache(bool read_directory_contents) {
 	std::vector<std::string> dirnames;
 	std::vector<std::string> filenames;
 	if (read_directory_contents) {
+		// Rewritten from scratch below
+		if (index_file) {
+			fclose(index_file);
+			index_file = nullptr;
+		}
 		//Clear all lists
 		DOSnames_cache.clear();
 		DOSdirs_cache.clear();
@@ -774,8 +1162,10 @@ void Overlay_Drive::update_cache(bool read_directory_contents) {
 	if (read_directory_contents) {
 		for (i = specials.begin(); i != specials.end(); ++i) {
 			//Specials look like this DBOVERLAY_YYY_FILENAME.EXT or DIRNAME[\/]DBOVERLAY_YYY_FILENAME.EXT where 
-			//YYY is the operation involved. Currently only DEL is supported.
+			//YYY is the operation involved.
 			//DEL = file marked as deleted, (but exists in localDrive!)
+			//RMD = directory marked as deleted
+			//MAP = blocks of the overlay file that are still in the base file
 			std::string name(*i);
 			std::string special_dir("");
 			std::string special_file("");
@@ -805,11 +1195,17 @@ void Overlay_Drive::update_cache(bool read_directory_contents) {
 				while ( (s = name.find('/')) != std::string::npos) name.replace(s,1,"\\");
 				add_deleted_path(name.c_str(),false);
 
+			} else if (special_operation == "MAP") {
+				name = special_dir + special_file;
+				//CROSS_DOSFILENAME for strings:
+				while ( (s = name.find('/')) != std::string::npos) name.replace(s,1,"\\");
+				load_block_map(name.c_str());
 			} else {
 				if (logoverlay) LOG_MSG("unsupported operation %s on %s",special_operation.c_str(),(*i).c_str());
 			}
 
 		}
+		write_index();
 	}
 	if (logoverlay) {
 		LOG_MSG("OPTIMISE: update cache took %" PRId64, GetTicksSince(a));
@@ -994,6 +1390,7 @@ bool Overlay_Drive::FileUnlink(char * name) {
 		}
 		std::error_code ec = {};
 		if (std_fs::remove(overlayname, ec)) {
+			remove_block_map(name);
 			// Overlay file removed, mark basefile as deleted if it
 			// exists:
 			if (localDrive::FileExists(name))
@@ -1011,6 +1408,7 @@ bool Overlay_Drive::FileUnlink(char * name) {
 		DOS_SetError(DOSERR_ACCESS_DENIED);
 		return false;
 	} else { //Removed from overlay.
+		remove_block_map(name);
 		//TODO IF it exists in the basedir: and more locations above.
 		if (localDrive::FileExists(name)) add_deleted_file(name,true);
 		remove_DOSname_from_cache(name);
@@ -1078,35 +1476,393 @@ void Overlay_Drive::add_deleted_file(const char* name,bool create_on_disk) {
 	if (logoverlay) LOG_MSG("add del file %s",name);
 	if (!is_deleted_file(name)) {
 		deleted_files_in_base.push_back(name);
-		if (create_on_disk) add_special_file_to_disk(name, "DEL");
-
+		if (create_on_disk) {
+			add_special_file_to_disk(name, "DEL");
+			journal_index('+', "DEL", name);
+		}
 	}
 }
 
 void Overlay_Drive::add_special_file_to_disk(const char* dosname, const char* operation) {
-	std::string name = create_filename_of_special_operation(dosname, operation);
-	char overlayname[CROSS_LEN];
-	safe_strcpy(overlayname, overlaydir);
-	safe_strcat(overlayname, name.c_str());
-	CROSS_FILENAME(overlayname);
-	FILE* f = fopen(overlayname,"wb+");
+	const auto overlayname = get_special_file_path(dosname, operation);
+	FILE* f = fopen(overlayname.c_str(),"wb+");
 	if (!f) {
 		Sync_leading_dirs(dosname);
-		f = fopen(overlayname,"wb+");
+		f = fopen(overlayname.c_str(),"wb+");
 	}
-	if (!f) E_Exit("Failed creation of %s",overlayname);
+	if (!f) E_Exit("Failed creation of %s",overlayname.c_str());
 	char buf[5] = {'e','m','p','t','y'};
 	fwrite(buf,5,1,f);
 	fclose(f);
 }
 
 void Overlay_Drive::remove_special_file_from_disk(const char* dosname, const char* operation) {
-	std::string name = create_filename_of_special_operation(dosname,operation);
+	const auto overlayname = get_special_file_path(dosname, operation);
+	if(unlink(overlayname.c_str()) != 0) E_Exit("Failed removal of %s",overlayname.c_str());
+}
+
+std::string Overlay_Drive::get_special_file_path(const char* dosname, const char* operation) {
 	char overlayname[CROSS_LEN];
 	safe_strcpy(overlayname, overlaydir);
-	safe_strcat(overlayname, name.c_str());
+	safe_strcat(overlayname, create_filename_of_special_operation(dosname, operation).c_str());
 	CROSS_FILENAME(overlayname);
-	if(unlink(overlayname) != 0) E_Exit("Failed removal of %s",overlayname);
+	return overlayname;
+}
+
+std::shared_ptr<OverlayBlockMap> Overlay_Drive::create_block_map(const char* dos_filename,
+                                                                 const uint64_t base_size)
+{
+	const auto num_blocks = (base_size + OverlayBlockSize - 1) / OverlayBlockSize;
+
+	auto block_map         = std::make_shared<OverlayBlockMap>();
+	block_map->marker_path = get_special_file_path(dos_filename, "MAP");
+	block_map->base_size   = base_size;
+	block_map->from_base.assign(num_blocks, true);
+	block_map->num_from_base = num_blocks;
+	if (!block_map->Save()) {
+		LOG_ERR("OVERLAY: Failed creating the block map of '%s': %s",
+		        dos_filename,
+		        strerror(errno));
+		return nullptr;
+	}
+	block_maps[dos_filename] = block_map;
+	journal_index('+', "MAP", dos_filename);
+	return block_map;
+}
+
+std::shared_ptr<OverlayBlockMap> Overlay_Drive::get_block_map(const char* dos_filename)
+{
+	const auto it = block_maps.find(dos_filename);
+	if (it == block_maps.end()) {
+		return nullptr;
+	}
+	// Completely copied by now
+	if (it->second->num_from_base == 0) {
+		block_maps.erase(it);
+		journal_index('-', "MAP", dos_filename);
+		return nullptr;
+	}
+	return it->second;
+}
+
+void Overlay_Drive::load_block_map(const char* dosname)
+{
+	// The maps in use are already up to date
+	if (block_maps.count(dosname)) {
+		return;
+	}
+	auto block_map         = std::make_shared<OverlayBlockMap>();
+	block_map->marker_path = get_special_file_path(dosname, "MAP");
+	if (!block_map->Load()) {
+		LOG_ERR("OVERLAY: Invalid block map for '%s', its unwritten parts read as zeros",
+		        dosname);
+		return;
+	}
+	block_maps[dosname] = block_map;
+}
+
+void Overlay_Drive::remove_block_map(const char* dosname)
+{
+	const auto it = block_maps.find(dosname);
+	if (it == block_maps.end()) {
+		return;
+	}
+	// Also for the files still open with the map
+	auto& block_map = *it->second;
+	block_map.from_base.assign(block_map.from_base.size(), false);
+	block_map.num_from_base = 0;
+	block_map.Save();
+	block_maps.erase(it);
+	journal_index('-', "MAP", dosname);
+}
+
+bool Overlay_Drive::copy_remaining_blocks(const char* dosname)
+{
+	const auto block_map = get_block_map(dosname);
+	if (!block_map) {
+		return true;
+	}
+	char overlayname[CROSS_LEN];
+	safe_strcpy(overlayname, overlaydir);
+	safe_strcat(overlayname, dosname);
+	CROSS_FILENAME(overlayname);
+
+	char basename[CROSS_LEN];
+	safe_strcpy(basename, basedir);
+	safe_strcat(basename, dosname);
+	CROSS_FILENAME(basename);
+
+	FILE* overlay = fopen(overlayname, "rb+");
+	FILE* base = fopen(dirCache.GetExpandNameAndNormaliseCase(basename), "rb");
+	bool copied = overlay && base;
+	for (uint64_t block = 0; copied && block < block_map->from_base.size(); ++block) {
+		if (!block_map->IsFromBase(block)) {
+			continue;
+		}
+		const auto offset = block * OverlayBlockSize;
+		copied = copy_file_data(base,
+		                        overlay,
+		                        offset,
+		                        std::min(OverlayBlockSize, block_map->base_size - offset));
+		if (copied) {
+			block_map->SetCopied(block);
+		}
+	}
+	if (overlay) {
+		copied = (fclose(overlay) == 0) && copied;
+	}
+	if (base) {
+		fclose(base);
+	}
+	if (!block_map->Save() || !copied) {
+		LOG_ERR("OVERLAY: Failed copying the rest of '%s' to the overlay", dosname);
+		return false;
+	}
+	block_maps.erase(dosname);
+	journal_index('-', "MAP", dosname);
+	return true;
+}
+
+bool Overlay_Drive::load_index()
+{
+	const auto index_path = std::string(overlaydir) + OverlayIndexName;
+	std::ifstream file(index_path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	const std::string contents((std::istreambuf_iterator<char>(file)),
+	                           std::istreambuf_iterator<char>());
+	// Like "DBOVERLAY INDEX 2 0123456789abcdef"
+	constexpr auto header_length = sizeof(OverlayIndexHeader) - 1;
+	auto pos = contents.find('\n');
+	if (pos != header_length + 1 + OverlayIndexStampDigits ||
+	    contents.compare(0, header_length, OverlayIndexHeader) != 0 ||
+	    contents[header_length] != ' ') {
+		LOG_WARNING("OVERLAY: Ignoring the invalid index '%s'", index_path.c_str());
+		return false;
+	}
+	const auto stamp = strtoull(contents.c_str() + header_length + 1, nullptr, 16);
+
+	// Replay the records, remembering the order the entries were added in
+	// as the overlay-only directories have to come after their parents. A
+	// record without its newline got interrupted and is left out.
+	std::unordered_map<std::string, size_t> entries = {};
+	size_t num_records                              = 0;
+	for (auto end = contents.find('\n', ++pos); end != std::string::npos;
+	     pos = end + 1, end = contents.find('\n', pos)) {
+		// Like "+DEL NAME"
+		if (end - pos < 6 || contents[pos + 4] != ' ') {
+			continue;
+		}
+		auto record = contents.substr(pos + 1, end - pos - 1);
+		if (contents[pos] == '+') {
+			entries.emplace(std::move(record), num_records);
+		} else if (contents[pos] == '-') {
+			entries.erase(record);
+		}
+		++num_records;
+	}
+	std::vector<std::pair<size_t, const std::string*>> ordered = {};
+	ordered.reserve(entries.size());
+	for (const auto& [record, order] : entries) {
+		ordered.emplace_back(order, &record);
+	}
+	std::sort(ordered.begin(), ordered.end());
+
+	DOSnames_cache.clear();
+	DOSdirs_cache.clear();
+	deleted_files_in_base.clear();
+	deleted_paths_in_base.clear();
+	add_deleted_path(overlap_folder.c_str(), false);
+
+	std::vector<std::string> mapped_files = {};
+	for (const auto& [order, record] : ordered) {
+		const auto kind = record->substr(0, 3);
+		auto name       = record->substr(4);
+		if (kind == "FIL") {
+			DOSnames_cache.emplace_back(std::move(name));
+		} else if (kind == "DIR") {
+			DOSdirs_cache.emplace_back(std::move(name));
+		} else if (kind == "DEL") {
+			deleted_files_in_base.emplace_back(std::move(name));
+		} else if (kind == "RMD") {
+			if (name != overlap_folder) {
+				deleted_paths_in_base.push_back(name);
+				deleted_files_in_base.emplace_back(std::move(name));
+			}
+		} else if (kind == "MAP") {
+			mapped_files.emplace_back(std::move(name));
+		}
+	}
+	if (get_index_stamp() != stamp) {
+		LOG_MSG("OVERLAY: The overlay changed since it was indexed, reading it again");
+		return false;
+	}
+	update_cache(false);
+
+	// Completely copied files dropped their map without a record
+	for (const auto& name : mapped_files) {
+		std::error_code ec = {};
+		if (std_fs::exists(get_special_file_path(name.c_str(), "MAP"), ec)) {
+			load_block_map(name.c_str());
+		}
+	}
+
+	if (num_records > 2 * entries.size() + MaxObsoleteIndexRecords) {
+		write_index();
+	} else {
+		index_file        = fopen(index_path.c_str(), "ab");
+		index_num_records = num_records;
+	}
+	return true;
+}
+
+void Overlay_Drive::write_index()
+{
+	if (index_file) {
+		fclose(index_file);
+		index_file = nullptr;
+	}
+	const auto index_path = std::string(overlaydir) + OverlayIndexName;
+	const auto temp_path  = std::string(overlaydir) + OverlayIndexTempName;
+
+	FILE* f = fopen(temp_path.c_str(), "wb");
+	if (!f) {
+		LOG_WARNING("OVERLAY: Failed writing the index '%s': %s",
+		            temp_path.c_str(),
+		            strerror(errno));
+		return;
+	}
+	size_t num_records = 0;
+	auto write_record  = [&](const char* kind, const std::string& name) {
+		fprintf(f, "+%s %s\n", kind, name.c_str());
+		++num_records;
+	};
+	// Stamped once it's in place, as creating it changes the root
+	fprintf(f, "%s %0*d\n", OverlayIndexHeader, OverlayIndexStampDigits, 0);
+	for (const auto& name : DOSnames_cache) {
+		write_record("FIL", name);
+	}
+	for (const auto& name : DOSdirs_cache) {
+		write_record("DIR", name);
+	}
+	for (const auto& name : deleted_paths_in_base) {
+		if (name != overlap_folder) {
+			write_record("RMD", name);
+		}
+	}
+	// The deleted directories are in the deleted files as well
+	for (const auto& name : deleted_files_in_base) {
+		if (!contains(deleted_paths_in_base, name)) {
+			write_record("DEL", name);
+		}
+	}
+	for (const auto& [name, block_map] : block_maps) {
+		write_record("MAP", name);
+	}
+	const bool written = !ferror(f);
+	std::error_code ec = {};
+	if (fclose(f) != 0 || !written ||
+	    (std_fs::rename(temp_path, index_path, ec), ec)) {
+		LOG_WARNING("OVERLAY: Failed writing the index '%s'", index_path.c_str());
+		std_fs::remove(temp_path, ec);
+		std_fs::remove(index_path, ec);
+		return;
+	}
+	stamp_index();
+	index_file        = fopen(index_path.c_str(), "ab");
+	index_num_records = num_records;
+}
+
+// Hashes the modification times of the overlay root and of the overlay
+// directories holding the indexed entries, which change when anything gets
+// added to, removed from or renamed in them
+uint64_t Overlay_Drive::get_index_stamp()
+{
+	std::set<std::string> dirs = {""};
+	auto add_parents = [&](const std::string& name) {
+		for (auto pos = name.find('\\'); pos != std::string::npos;
+		     pos = name.find('\\', pos + 1)) {
+			dirs.insert(name.substr(0, pos));
+		}
+	};
+	for (const auto& name : DOSnames_cache) {
+		add_parents(name);
+	}
+	for (const auto& name : DOSdirs_cache) {
+		add_parents(name);
+		dirs.insert(name);
+	}
+	// The special files are in the parent directories
+	for (const auto& name : deleted_files_in_base) {
+		add_parents(name);
+	}
+	for (const auto& [name, block_map] : block_maps) {
+		add_parents(name);
+	}
+
+	// FNV-1a
+	uint64_t stamp = 0xcbf29ce484222325;
+	auto add_bytes = [&](const void* data, const size_t num_bytes) {
+		for (size_t i = 0; i < num_bytes; ++i) {
+			stamp ^= static_cast<const uint8_t*>(data)[i];
+			stamp *= 0x100000001b3;
+		}
+	};
+	for (const auto& dir : dirs) {
+		auto path = std::string(overlaydir) + dir;
+		std::replace(path.begin(), path.end(), '\\', CROSS_FILESPLIT);
+
+		std::error_code ec = {};
+		const auto mtime   = std_fs::last_write_time(path, ec);
+		const int64_t ticks = ec ? -1 : mtime.time_since_epoch().count();
+		add_bytes(dir.c_str(), dir.size() + 1);
+		add_bytes(&ticks, sizeof(ticks));
+	}
+	return stamp;
+}
+
+// Writes the current stamp into the header; rewriting the file in place
+// leaves the directory's modification time alone
+void Overlay_Drive::stamp_index()
+{
+	const auto index_path = std::string(overlaydir) + OverlayIndexName;
+	FILE* f = fopen(index_path.c_str(), "r+b");
+	if (!f) {
+		return;
+	}
+	const auto stamp = get_index_stamp();
+	if (fseek(f, sizeof(OverlayIndexHeader), SEEK_SET) != 0 ||
+	    fprintf(f, "%0*" PRIx64, OverlayIndexStampDigits, stamp) < 0) {
+		LOG_WARNING("OVERLAY: Failed stamping the index '%s'", index_path.c_str());
+	}
+	fclose(f);
+}
+
+void Overlay_Drive::journal_index(const char operation, const char* kind,
+                                  const std::string& name)
+{
+	if (!index_file) {
+		return;
+	}
+	// Flushed right away, so the index stays in line with the overlay
+	// even when DOSBox doesn't get to exit cleanly
+	if (fprintf(index_file, "%c%s %s\n", operation, kind, name.c_str()) < 0 ||
+	    fflush(index_file) != 0) {
+		LOG_WARNING("OVERLAY: Failed updating the index, the overlay gets read again on the next mount");
+		fclose(index_file);
+		index_file = nullptr;
+
+		std::error_code ec = {};
+		std_fs::remove(std::string(overlaydir) + OverlayIndexName, ec);
+		return;
+	}
+	// Compact the index when most of it is outdated
+	const auto num_entries = DOSnames_cache.size() + DOSdirs_cache.size() +
+	                         deleted_files_in_base.size() + block_maps.size();
+	if (++index_num_records > 2 * num_entries + MaxObsoleteIndexRecords) {
+		write_index();
+	}
 }
 
 std::string Overlay_Drive::create_filename_of_special_operation(const char* dosname, const char* operation) {
@@ -1142,6 +1898,7 @@ void Overlay_Drive::add_DOSdir_to_cache(const char* name) {
 	LOG_MSG("Adding name to overlay_only_dir_cache %s",name);
 	if (!is_dir_only_in_overlay(name)) {
 		DOSdirs_cache.push_back(name); 
+		journal_index('+', "DIR", name);
 	}
 }
 
@@ -1149,6 +1906,7 @@ void Overlay_Drive::remove_DOSdir_from_cache(const char* name) {
 	for(std::vector<std::string>::iterator it = DOSdirs_cache.begin(); it != DOSdirs_cache.end(); ++it) {
 		if ( *it == name) {
 			DOSdirs_cache.erase(it);
+			journal_index('-', "DIR", name);
 			return;
 		}
 	}
@@ -1158,7 +1916,10 @@ void Overlay_Drive::remove_deleted_file(const char* name,bool create_on_disk) {
 	for(std::vector<std::string>::iterator it = deleted_files_in_base.begin(); it != deleted_files_in_base.end(); ++it) {
 		if (*it == name) {
 			deleted_files_in_base.erase(it);
-			if (create_on_disk) remove_special_file_from_disk(name, "DEL");
+			if (create_on_disk) {
+				remove_special_file_from_disk(name, "DEL");
+				journal_index('-', "DEL", name);
+			}
 			return;
 		}
 	}
@@ -1170,7 +1931,10 @@ void Overlay_Drive::add_deleted_path(const char* name, bool create_on_disk) {
 		deleted_paths_in_base.push_back(name);
 		//Add it to deleted files as well, so it gets skipped in FindNext. 
 		//Maybe revise that.
-		if (create_on_disk) add_special_file_to_disk(name,"RMD");
+		if (create_on_disk) {
+			add_special_file_to_disk(name, "RMD");
+			journal_index('+', "RMD", name);
+		}
 		add_deleted_file(name,false);
 	}
 }
@@ -1194,7 +1958,10 @@ void Overlay_Drive::remove_deleted_path(const char* name, bool create_on_disk) {
 		if (*it == name) {
 			deleted_paths_in_base.erase(it);
 			remove_deleted_file(name,false); //Rethink maybe.
-			if (create_on_disk) remove_special_file_from_disk(name,"RMD");
+			if (create_on_disk) {
+				remove_special_file_from_disk(name, "RMD");
+				journal_index('-', "RMD", name);
+			}
 			break;
 		}
 	}
@@ -1268,10 +2035,18 @@ bool Overlay_Drive::Rename(char * oldname,char * newname) {
 	// check if overlaynameold exists and if so rename it to overlaynamenew
 	std::error_code ec = {};
 	if (std_fs::exists(overlaynameold, ec)) {
+		// The base file goes away, so it needs all of its blocks first
+		if (!copy_remaining_blocks(oldname)) {
+			return false;
+		}
 		std_fs::rename(overlaynameold, overlaynamenew, ec);
 
 		result = !ec; // success if no error-code
 
+		if (result) {
+			remove_DOSname_from_cache(oldname);
+			add_DOSname_to_cache(newname);
+		}
 		// Overlay file renamed: mark the old base file as deleted.
 		if (result == true && localDrive::FileExists(oldname)) {
 			add_deleted_file(oldname, true);
@@ -1291,10 +2066,13 @@ bool Overlay_Drive::Rename(char * oldname,char * newname) {
 			fclose(o);
 			return false;
 		}
-		char buffer[BUFSIZ];
-		size_t s;
-		while ( (s = fread(buffer,1,BUFSIZ,o)) ) fwrite(buffer, 1, s, n);
+		const bool copied = clone_file(o, n) ||
+		                    copy_file_data(o, n, 0, get_file_size(o));
 		fclose(o); fclose(n);
+		if (!copied) {
+			LOG_ERR("OVERLAY: Failed copying file '%s' to the overlay", oldname);
+			return false;
+		}
 
 		//File copied.
 		//Mark old file as deleted
@@ -1310,7 +2088,7 @@ bool Overlay_Drive::Rename(char * oldname,char * newname) {
 		//Ensure that the file is not marked as deleted anymore.
 		if (is_deleted_file(newname)) remove_deleted_file(newname,true);
 		dirCache.EmptyCache();
-		update_cache(true);
+		update_cache(false);
 		if (logoverlay) {
 			LOG_MSG("OPTIMISE: rename took %" PRId64, GetTicksSince(a));
 		}
@@ -401,6 +401,9 @@ void MOUNT::Run(void) {
 				        mediaid,
 				        section->Get_bool(
 				                "allow_write_protected_files"));
+				if (section->Get_bool("watch_host_changes")) {
+					newdrive->dirCache.WatchHostChanges();
+				}
 			}
 		}
 	} else {
@@ -167,7 +167,9 @@ void TREE::Run()
 	                             ? shorten_path(path, static_cast<uint16_t>(len_limit))
 	                             : path;
 	output.AddString("%s\n", tmp_str.c_str());
+	DOS_PrefetchTree(path.c_str());
 	DisplayTree(output, path + '\\');
+	DOS_StopPrefetching();
 
 	if (!skip_empty_line) {
 		output.AddString("\n");
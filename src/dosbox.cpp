@@ -34,11 +34,13 @@
 #include "capture/capture.h"
 #include "control.h"
 #include "cpu.h"
+#include "cpu_profiling.h"
 #include "cross.h"
 #include "debug.h"
 #include "dos/dos_locale.h"
 #include "dos_inc.h"
 #include "hardware.h"
+#include "huge_pages.h"
 #include "inout.h"
 #include "ints/int10.h"
 #include "mapper.h"
@@ -54,6 +56,7 @@
 #include "render.h"
 #include "setup.h"
 #include "shell.h"
+#include "snapshot.h"
 #include "support.h"
 #include "timer.h"
 #include "tracy.h"
@@ -139,10 +142,15 @@ void Null_Init([[maybe_unused]] Section *sec) {
 	// do nothing
 }
 
+// Nesting level of the emulation loop; the DOS shell and the host-side
+// interrupt handlers run the machine from within their own calls
+static int machine_depth = 0;
+
 static Bitu Normal_Loop() {
 	Bits ret;
 	while (1) {
 		if (PIC_RunQueue()) {
+			CPU_PROFILE_EVENT(DecoderEntry);
 			ret = (*cpudecoder)();
 			if (GCC_UNLIKELY(ret<0)) return 1;
 			if (ret>0) {
@@ -156,6 +164,7 @@ static Bitu Normal_Loop() {
 		} else {
 			if (!GFX_Events())
 				return 0;
+			SNAPSHOT_RunPendingRequest(machine_depth);
 			if (ticksRemain > 0) {
 				TIMER_AddTick();
 				ticksRemain--;
@@ -166,7 +175,8 @@ static Bitu Normal_Loop() {
 
 void increaseticks() { //Make it return ticksRemain and set it in the function above to remove the global variable.
 	ZoneScoped;
-	if (GCC_UNLIKELY(ticksLocked)) { // For Fast Forward Mode
+	// Fast forward mode, or offline rendering of captures
+	if (GCC_UNLIKELY(ticksLocked || CAPTURE_IsRenderingOffline())) {
 		ticksRemain=5;
 		/* Reset any auto cycle guessing for this frame */
 		ticksLast = GetTicks();
@@ -319,8 +329,10 @@ void DOSBOX_SetNormalLoop() {
 
 void DOSBOX_RunMachine()
 {
+	++machine_depth;
 	while ((*loop)() == 0 && !shutdown_requested)
 		;
+	--machine_depth;
 }
 
 static void DOSBOX_UnlockSpeed( bool pressed ) {
@@ -402,6 +414,8 @@ static void DOSBOX_RealInit(Section* sec)
 
 	DOSBOX_SetMachineTypeFromConfig(section);
 
+	HUGEPAGES_SetMode(section->Get_string("huge_pages"));
+
 	// Set the user's prefered MCB fault handling strategy
 	DOS_SetMcbFaultStrategy(section->Get_string("mcb_fault_strategy").c_str());
 
@@ -525,6 +539,20 @@ void DOSBOX_Init()
 	        "though a few games might require a higher value.\n"
 	        "There is generally no speed advantage when raising this value.");
 
+	const char* huge_pages_modes[] = {"off", "transparent", "explicit", nullptr};
+	pstring = secprop->Add_string("huge_pages", only_at_start, huge_pages_modes[1]);
+	pstring->Set_values(huge_pages_modes);
+	pstring->Set_help(
+	        "Back the guest RAM, the paging TLB and the dynamic core's code cache with\n"
+	        "2 MB host pages, which lowers the host TLB misses of programs accessing\n"
+	        "their memory all over the place:\n"
+	        "  off:          Use regular host pages.\n"
+	        "  transparent:  Let the host kernel assemble huge pages when it can (default).\n"
+	        "  explicit:     Use the huge pages reserved by the administrator, falling back\n"
+	        "                to transparent huge pages if there aren't enough of them.\n"
+	        "Which regions got huge pages is logged at startup. Hosts without huge page\n"
+	        "support use regular pages.");
+
 	const char *mcb_fault_strategies[] = {"repair", "report", "allow", "deny", nullptr};
 	pstring = secprop->Add_string("mcb_fault_strategy",
 	                              only_at_start,
@@ -638,6 +666,23 @@ void DOSBOX_Init()
 	        "you're using a copy-on-write or network-based filesystem, this setting avoids\n"
 	        "triggering write operations for these write-protected files.");
 
+	pbool = secprop->Add_bool("watch_host_changes", when_idle, false);
+	pbool->Set_help(
+	        "Keep mounted directories up to date with the files added, removed, or renamed\n"
+	        "on the host while DOSBox is running (disabled by default). Without it, use\n"
+	        "RESCAN after changing files on the host. Only supported on Linux; it doesn't\n"
+	        "apply to overlay mounts.");
+
+	pbool = secprop->Add_bool("shared_cd_images", when_idle, false);
+	pbool->Set_help(
+	        "Share the tracks of CD images mounted with IMGMOUNT between DOSBox instances\n"
+	        "(disabled by default). Compressed audio tracks (FLAC, Opus, MP3, ...) are\n"
+	        "decoded only once, into the 'cdaudio' folder of the config directory; later\n"
+	        "mounts and other instances read the decoded audio from there instead of\n"
+	        "decoding the tracks again. The decoded files and the BIN and ISO images are\n"
+	        "read through shared, read-only memory mappings. Don't change the image files\n"
+	        "while they're mounted.");
+
 	pbool = secprop->Add_bool("shell_config_shortcuts", when_idle, true);
 	pbool->Set_help(
 	        "Allow shortcuts for simpler configuration management (enabled by default).\n"
@@ -645,6 +690,28 @@ void DOSBOX_Init()
 	        "'sbtype sb16', and instead of 'config -get sbtype', you can just execute\n"
 	        "the 'sbtype' command.");
 
+	pstring = secprop->Add_path("snapshot_file", when_idle, "snapshot.dbs");
+	pstring->Set_help(
+	        "File to save the machine snapshots to and to load them from ('snapshot.dbs'\n"
+	        "by default). Snapshots are saved with the 'Save Snap' hotkey and loaded with\n"
+	        "the 'Load Snap' hotkey. They can only be loaded by the same DOSBox version with\n"
+	        "the same 'machine', 'memsize', 'ems' and video memory settings and the same\n"
+	        "mounted drives.\n"
+	        "Notes:\n"
+	        "  - The Sound Blaster and OPL state is saved. The other sound devices carry on\n"
+	        "    from the state they're in when the snapshot is loaded.\n"
+	        "  - Saving waits up to a second for the emulated devices to finish what\n"
+	        "    they're doing, like a Sound Blaster DMA transfer, and fails otherwise.\n"
+	        "  - Snapshots are best saved while a program is running, not at the DOS prompt.");
+
+	pbool = secprop->Add_bool("resume_snapshot", only_at_start, false);
+	pbool->Set_help(
+	        "Resume the 'snapshot_file' snapshot at startup (disabled by default).\n"
+	        "The snapshot is loaded once the startup reaches the point the snapshot was\n"
+	        "saved at, typically when the first program is started.");
+
+	secprop->AddInitFunction(&SNAPSHOT_Init);
+
 	// Configure render settings
 	RENDER_AddConfigSection(control);
 
@@ -659,12 +726,14 @@ void DOSBOX_Init()
 	  "dynamic",
 #endif
 	  "normal",
+	  "cached",
 	  "simple",
 	  nullptr };
 	pstring = secprop->Add_string("core", when_idle, "auto");
 	pstring->Set_values(cores);
 	pstring->Set_help("CPU core used in emulation ('auto' by default). 'auto' will switch to dynamic\n"
-	                  "if available and appropriate.");
+	                  "if available and appropriate. 'cached' is an interpreter that decodes\n"
+	                  "instructions only once, for when the dynamic core is not available.");
 
 	const char* cputype_values[] = { "auto", "386", "386_slow", "486_slow", "pentium_slow", "386_prefetch", nullptr};
 	pstring = secprop->Add_string("cputype", always, "auto");
@@ -700,6 +769,12 @@ void DOSBOX_Init()
 	pint->Set_help("Number of cycles subtracted with the decrease cycles hotkey (20 by default).\n"
 	               "Setting it lower than 100 will be a percentage.");
 
+	pbool = secprop->Add_bool("dynamic_scheduling", always, true);
+	pbool->Set_help(
+	        "Let the dynamic core service the emulated hardware events itself and run\n"
+	        "straight to the next event, instead of returning to the main loop after\n"
+	        "every timeslice (enabled by default).");
+
 #if C_FPU
 	secprop->AddInitFunction(&FPU_Init);
 #endif
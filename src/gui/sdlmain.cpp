@@ -4257,6 +4257,9 @@ static void messages_add_command_line()
 	        "\n"
 	        "  --socket <num>           Run nullmodem on the specified socket number.\n"
 	        "\n"
+	        "  --startup-trace          Log how long each configuration section takes to\n"
+	        "                           initialise at startup.\n"
+	        "\n"
 	        "  -h, -?, --help           Print help message and exit.\n"
 	        "\n"
 	        "  -V, --version            Print version information and exit.\n");
@@ -29,6 +29,7 @@
 #include "pic.h"
 #include "paging.h"
 #include "setup.h"
+#include "snapshot.h"
 
 std::unique_ptr<DmaController> primary   = {};
 std::unique_ptr<DmaController> secondary = {};
@@ -92,18 +93,19 @@ static void perform_dma_io(const DMA_DIRECTION direction, const PhysPt spage,
 		// Determine how many bytes to transfer within this page
 		const auto chunk_bytes = std::min(remaining_bytes, bytes_to_page_end);
 
+		// DMA bypasses the page handlers and accesses physical memory
+		// directly (like phys_readb and phys_writeb), so the chunk is
+		// contiguous in host memory and can be copied in one go.
+		const auto chunk_pt = MemBase + chunk_start;
+
 		// Copy the data from the page address into the data pointer
 		if (direction == DMA_DIRECTION::READ) {
-			for (auto i = 0; i < chunk_bytes; ++i) {
-				data_pt[i] = phys_readb(chunk_start + i);
-			}
+			memcpy(data_pt, chunk_pt, chunk_bytes);
 		}
 
 		// Copy the data from the data pointer into the page address
 		else if (direction == DMA_DIRECTION::WRITE) {
-			for (auto i = 0; i < chunk_bytes; ++i) {
-				phys_writeb(chunk_start + i, data_pt[i]);
-			}
+			memcpy(chunk_pt, data_pt, chunk_bytes);
 		}
 
 		mem_address += chunk_bytes;
@@ -635,6 +637,61 @@ void DMA_SetWrapping(const uint32_t wrap)
 	dma_wrapping = wrap;
 }
 
+// The channel registers; the devices using the channels don't get notified,
+// as they keep their current state
+static void save_snapshot(SnapshotWriter& writer)
+{
+	for (const auto controller : {primary.get(), secondary.get()}) {
+		for (uint8_t i = 0; i < 4; ++i) {
+			const auto channel = controller ? controller->GetChannel(i)
+			                                : nullptr;
+			writer.Write(channel != nullptr);
+			if (!channel) {
+				continue;
+			}
+			writer.Write(channel->page_base);
+			writer.Write(channel->curr_addr);
+			writer.Write(channel->base_addr);
+			writer.Write(channel->base_count);
+			writer.Write(channel->curr_count);
+			writer.Write(channel->page_num);
+			writer.Write(channel->is_incremented);
+			writer.Write(channel->is_autoiniting);
+			writer.Write(channel->is_masked);
+			writer.Write(channel->has_reached_terminal_count);
+			writer.Write(channel->has_raised_request);
+		}
+	}
+	writer.Write(dma_wrapping);
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+	for (uint8_t channel_num = 0; channel_num < 8; ++channel_num) {
+		if (!reader.Read<bool>()) {
+			continue;
+		}
+		const auto channel = DMA_GetChannel(channel_num);
+		if (!channel) {
+			return;
+		}
+		reader.Read(channel->page_base);
+		reader.Read(channel->curr_addr);
+		reader.Read(channel->base_addr);
+		reader.Read(channel->base_count);
+		reader.Read(channel->curr_count);
+		reader.Read(channel->page_num);
+		reader.Read(channel->is_incremented);
+		reader.Read(channel->is_autoiniting);
+		reader.Read(channel->is_masked);
+		reader.Read(channel->has_reached_terminal_count);
+		reader.Read(channel->has_raised_request);
+	}
+	reader.Read(dma_wrapping);
+
+	UpdateEMSMapping();
+}
+
 void DMA_Destroy(Section* /*sec*/)
 {
 	primary   = {};
@@ -648,4 +705,5 @@ void DMA_Init(Section* sec)
 	for (i = 0; i < LINK_START; i++) {
 		ems_board_mapping[i] = i;
 	}
+	SNAPSHOT_AddComponent("dma", save_snapshot, load_snapshot);
 }
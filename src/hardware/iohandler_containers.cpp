@@ -21,6 +21,7 @@
 
 #include "dosbox.h"
 
+#include <array>
 #include <cassert>
 #include <cstring>
 #include <functional>
@@ -54,16 +55,125 @@ IO_WriteHandleObject::~IO_WriteHandleObject(){
 	// static_cast<uint32_t>(m_port));
 }
 
+// Plain function handlers are called directly, skipping the std::function
+using io_read_fn  = io_val_t (*)(io_port_t port, io_width_t width);
+using io_write_fn = void (*)(io_port_t port, io_val_t val, io_width_t width);
+
+// Flat per-port dispatch slots, so port accesses don't need a hash lookup.
+// The slots point into the handler maps below; the maps own the handlers
+// and keep the registration bookkeeping (their nodes never move, so the
+// pointers stay valid until the handler is freed). Empty slots stand for
+// unhandled ports.
+struct io_read_slot_t {
+	io_read_fn direct        = nullptr;
+	const io_read_f* wrapped = nullptr;
+};
+
+struct io_write_slot_t {
+	io_write_fn direct        = nullptr;
+	const io_write_f* wrapped = nullptr;
+};
+
+constexpr auto num_io_ports = static_cast<size_t>(UINT16_MAX) + 1;
+
+static std::array<io_read_slot_t, num_io_ports> io_read_slots[io_widths]   = {};
+static std::array<io_write_slot_t, num_io_ports> io_write_slots[io_widths] = {};
+
 // type-sized IO handlers
 std::unordered_map<io_port_t, io_read_f> io_read_handlers[io_widths] = {};
-constexpr auto &io_read_byte_handler = io_read_handlers[0];
-constexpr auto &io_read_word_handler = io_read_handlers[1];
-constexpr auto &io_read_dword_handler = io_read_handlers[2];
-
 std::unordered_map<io_port_t, io_write_f> io_write_handlers[io_widths] = {};
-constexpr auto &io_write_byte_handler = io_write_handlers[0];
-constexpr auto &io_write_word_handler = io_write_handlers[1];
-constexpr auto &io_write_dword_handler = io_write_handlers[2];
+
+constexpr int byte_index  = 0;
+constexpr int word_index  = 1;
+constexpr int dword_index = 2;
+
+static io_read_slot_t to_read_slot(const io_read_f& handler)
+{
+	io_read_slot_t slot = {};
+	if (const auto fn = handler.target<io_read_fn>(); fn && *fn) {
+		slot.direct = *fn;
+	} else {
+		slot.wrapped = &handler;
+	}
+	return slot;
+}
+
+static io_write_slot_t to_write_slot(const io_write_f& handler)
+{
+	io_write_slot_t slot = {};
+	if (const auto fn = handler.target<io_write_fn>(); fn && *fn) {
+		slot.direct = *fn;
+	} else {
+		slot.wrapped = &handler;
+	}
+	return slot;
+}
+
+static inline bool is_handled(const io_read_slot_t& slot)
+{
+	return slot.direct || slot.wrapped;
+}
+
+static inline bool is_handled(const io_write_slot_t& slot)
+{
+	return slot.direct || slot.wrapped;
+}
+
+static inline io_val_t call_reader(const io_read_slot_t& slot,
+                                   const io_port_t port, const io_width_t width)
+{
+	return slot.direct ? slot.direct(port, width) : (*slot.wrapped)(port, width);
+}
+
+static inline void call_writer(const io_write_slot_t& slot, const io_port_t port,
+                               const io_val_t val, const io_width_t width)
+{
+	if (slot.direct) {
+		slot.direct(port, val, width);
+	} else {
+		(*slot.wrapped)(port, val, width);
+	}
+}
+
+static void set_read_handler(const int index, const io_port_t port,
+                             const io_read_f& handler)
+{
+	auto& stored = io_read_handlers[index][port];
+	stored       = handler;
+
+	io_read_slots[index][port] = to_read_slot(stored);
+}
+
+static void set_write_handler(const int index, const io_port_t port,
+                              const io_write_f& handler)
+{
+	auto& stored = io_write_handlers[index][port];
+	stored       = handler;
+
+	io_write_slots[index][port] = to_write_slot(stored);
+}
+
+static void free_read_handler(const int index, const io_port_t port)
+{
+	io_read_slots[index][port] = {};
+	io_read_handlers[index].erase(port);
+}
+
+static void free_write_handler(const int index, const io_port_t port)
+{
+	io_write_slots[index][port] = {};
+	io_write_handlers[index].erase(port);
+}
+
+void clear_port_handlers()
+{
+	for (int i = 0; i < io_widths; ++i) {
+		io_read_slots[i].fill({});
+		io_write_slots[i].fill({});
+		io_read_handlers[i].clear();
+		io_write_handlers[i].clear();
+	}
+}
 
 constexpr io_val_t blocked_read(const io_port_t, const io_width_t)
 {
@@ -73,31 +183,33 @@ constexpr io_val_t blocked_read(const io_port_t, const io_width_t)
 // type-sized IO handler API
 uint8_t read_byte_from_port(const io_port_t port)
 {
-	const auto [it, was_blocked] = io_read_byte_handler.emplace(port, blocked_read);
-	if (was_blocked)
+	auto& slot = io_read_slots[byte_index][port];
+	if (!is_handled(slot)) {
 		LOG(LOG_IO, LOG_WARN)("Unhandled read from port %04Xh; blocking", port);
-	return it->second(port, io_width_t::byte) & 0xff;
+		slot.direct = blocked_read;
+	}
+	return call_reader(slot, port, io_width_t::byte) & 0xff;
 }
 
 uint16_t read_word_from_port(const io_port_t port)
 {
-	const auto reader = io_read_word_handler.find(port);
-	const auto value = reader != io_read_word_handler.end()
-	                           ? (reader->second(port, io_width_t::word) & 0xffff)
-	                           : static_cast<io_val_t>(
-	                                     read_byte_from_port(port) |
-	                                     (read_byte_from_port(port + 1) << 8));
+	const auto& slot = io_read_slots[word_index][port];
+	const auto value = is_handled(slot)
+	                         ? (call_reader(slot, port, io_width_t::word) & 0xffff)
+	                         : static_cast<io_val_t>(
+	                                   read_byte_from_port(port) |
+	                                   (read_byte_from_port(port + 1) << 8));
 	return check_cast<uint16_t>(value);
 }
 
 uint32_t read_dword_from_port(const io_port_t port)
 {
-	const auto reader = io_read_dword_handler.find(port);
-	const auto value = reader != io_read_dword_handler.end()
-	                           ? reader->second(port, io_width_t::dword)
-	                           : static_cast<io_val_t>(
-	                                     read_word_from_port(port) |
-	                                     (read_word_from_port(port + 2) << 16));
+	const auto& slot = io_read_slots[dword_index][port];
+	const auto value = is_handled(slot)
+	                         ? call_reader(slot, port, io_width_t::dword)
+	                         : static_cast<io_val_t>(
+	                                   read_word_from_port(port) |
+	                                   (read_word_from_port(port + 2) << 16));
 	assert(value <= UINT32_MAX);
 	return static_cast<uint32_t>(value);
 }
@@ -109,19 +221,21 @@ constexpr void blocked_write(const io_port_t, const io_val_t, const io_width_t)
 
 void write_byte_to_port(const io_port_t port, const uint8_t val)
 {
-	const auto [it, was_blocked] = io_write_byte_handler.emplace(port, blocked_write);
-	if (was_blocked)
+	auto& slot = io_write_slots[byte_index][port];
+	if (!is_handled(slot)) {
 		LOG(LOG_IO, LOG_WARN)("Unhandled write of value 0x%02x"
 		                      " (%u) to port %04Xh; blocking",
 		                      val, val, port);
-	it->second(port, val, io_width_t::byte);
+		slot.direct = blocked_write;
+	}
+	call_writer(slot, port, val, io_width_t::byte);
 }
 
 void write_word_to_port(const io_port_t port, const uint16_t val)
 {
-	const auto writer = io_write_word_handler.find(port);
-	if (writer != io_write_word_handler.end()) {
-		writer->second(port, val, io_width_t::word);
+	const auto& slot = io_write_slots[word_index][port];
+	if (is_handled(slot)) {
+		call_writer(slot, port, val, io_width_t::word);
 	} else {
 		write_byte_to_port(port, static_cast<uint8_t>(val & 0xff));
 		write_byte_to_port(port + 1, static_cast<uint8_t>(val >> 8));
@@ -130,9 +244,9 @@ void write_word_to_port(const io_port_t port, const uint16_t val)
 
 void write_dword_to_port(const io_port_t port, const uint32_t val)
 {
-	const auto writer = io_write_dword_handler.find(port);
-	if (writer != io_write_dword_handler.end()) {
-		writer->second(port, val, io_width_t::dword);
+	const auto& slot = io_write_slots[dword_index][port];
+	if (is_handled(slot)) {
+		call_writer(slot, port, val, io_width_t::dword);
 	} else {
 		write_word_to_port(port, static_cast<uint16_t>(val & 0xffff));
 		write_word_to_port(port + 2, static_cast<uint16_t>(val >> 16));
@@ -145,11 +259,11 @@ void IO_RegisterReadHandler(io_port_t port,
                             io_port_t range)
 {
 	while (range--) {
-		io_read_byte_handler[port] = handler;
+		set_read_handler(byte_index, port, handler);
 		if (max_width == io_width_t::word || max_width == io_width_t::dword)
-			io_read_word_handler[port] = handler;
+			set_read_handler(word_index, port, handler);
 		if (max_width == io_width_t::dword)
-			io_read_dword_handler[port] = handler;
+			set_read_handler(dword_index, port, handler);
 		++port;
 	}
 }
@@ -160,11 +274,11 @@ void IO_RegisterWriteHandler(io_port_t port,
                              io_port_t range)
 {
 	while (range--) {
-		io_write_byte_handler[port] = handler;
+		set_write_handler(byte_index, port, handler);
 		if (max_width == io_width_t::word || max_width == io_width_t::dword)
-			io_write_word_handler[port] = handler;
+			set_write_handler(word_index, port, handler);
 		if (max_width == io_width_t::dword)
-			io_write_dword_handler[port] = handler;
+			set_write_handler(dword_index, port, handler);
 		++port;
 	}
 }
@@ -174,11 +288,11 @@ void IO_FreeReadHandler(io_port_t port,
                         io_port_t range)
 {
 	while (range--) {
-		io_read_byte_handler.erase(port);
+		free_read_handler(byte_index, port);
 		if (max_width == io_width_t::word || max_width == io_width_t::dword)
-			io_read_word_handler.erase(port);
+			free_read_handler(word_index, port);
 		if (max_width == io_width_t::dword)
-			io_read_dword_handler.erase(port);
+			free_read_handler(dword_index, port);
 		++port;
 	}
 }
@@ -188,11 +302,11 @@ void IO_FreeWriteHandler(io_port_t port,
                          io_port_t range)
 {
 	while (range--) {
-		io_write_byte_handler.erase(port);
+		free_write_handler(byte_index, port);
 		if (width == io_width_t::word || width == io_width_t::dword)
-			io_write_word_handler.erase(port);
+			free_write_handler(word_index, port);
 		if (width == io_width_t::dword)
-			io_write_dword_handler.erase(port);
+			free_write_handler(dword_index, port);
 		++port;
 	}
 }
@@ -21,11 +21,13 @@
 
 #include <cstring>
 
+#include "huge_pages.h"
 #include "inout.h"
 #include "paging.h"
 #include "pci_bus.h"
 #include "regs.h"
 #include "setup.h"
+#include "snapshot.h"
 #include "support.h"
 
 constexpr auto megabyte = 1024 * 1024;
@@ -37,12 +39,25 @@ constexpr auto SafeMegabytesDos   = 31;
 constexpr auto SafeMegabytesWin95 = 480;
 constexpr auto SafeMegabytesWin98 = 512;
 
+// How the accesses to a physical page are carried out. Kept in a byte per
+// page next to the handlers, so linking a page into the TLB only has to ask
+// the handler for devices.
+enum class PageType : uint8_t {
+	Ram,
+	Rom,
+	Unmapped,
+	Device,
+};
+
 static struct MemoryBlock {
-	struct page_t {
+	// Page-aligned, so snapshots can map the guest RAM back in from the
+	// snapshot file
+	struct alignas(dos_pagesize) page_t {
 		uint8_t bytes[dos_pagesize] = {};
 	};
-	std::vector<page_t> pages           = {};
+	std::vector<page_t, HugePageAllocator<page_t>> pages = {};
 	std::vector<PageHandler*> phandlers = {};
+	std::vector<PageType> ptypes        = {};
 	std::vector<MemHandle> mhandles     = {};
 	struct {
 		Bitu start_page = 0;
@@ -141,6 +156,26 @@ static IllegalPageHandler illegal_page_handler;
 static RAMPageHandler ram_page_handler;
 static ROMPageHandler rom_page_handler;
 
+static PageType get_page_type(const PageHandler* handler)
+{
+	if (handler == &ram_page_handler) {
+		return PageType::Ram;
+	}
+	if (handler == &rom_page_handler) {
+		return PageType::Rom;
+	}
+	if (handler == &illegal_page_handler) {
+		return PageType::Unmapped;
+	}
+	return PageType::Device;
+}
+
+static void set_page_handler(const Bitu phys_page, PageHandler* handler)
+{
+	memory.phandlers[phys_page] = handler;
+	memory.ptypes[phys_page]    = get_page_type(handler);
+}
+
 void MEM_SetLFB(Bitu page, Bitu pages, PageHandler *handler, PageHandler *mmiohandler) {
 	memory.lfb.handler=handler;
 	memory.lfb.mmiohandler=mmiohandler;
@@ -174,16 +209,45 @@ PageHandler * MEM_GetPageHandler(Bitu phys_page) {
 	return &illegal_page_handler;
 }
 
+static PageMapping get_device_mapping(PageHandler* handler, const Bitu phys_page)
+{
+	PageMapping mapping = {handler, nullptr, nullptr};
+	if (handler->flags & PFLAG_READABLE) {
+		mapping.read = handler->GetHostReadPt(phys_page);
+	}
+	if (handler->flags & PFLAG_WRITEABLE) {
+		mapping.write = handler->GetHostWritePt(phys_page);
+	}
+	return mapping;
+}
+
+PageMapping MEM_GetPageMapping(const Bitu phys_page)
+{
+	if (phys_page < memory.pages.size()) {
+		const auto handler   = memory.phandlers[phys_page];
+		const auto host_page = MemBase + phys_page * dos_pagesize;
+
+		switch (memory.ptypes[phys_page]) {
+		case PageType::Ram: return {handler, host_page, host_page};
+		case PageType::Rom: return {handler, host_page, nullptr};
+		case PageType::Unmapped: return {handler, nullptr, nullptr};
+		case PageType::Device: break;
+		}
+		return get_device_mapping(handler, phys_page);
+	}
+	return get_device_mapping(MEM_GetPageHandler(phys_page), phys_page);
+}
+
 void MEM_SetPageHandler(Bitu phys_page,Bitu pages,PageHandler * handler) {
 	for (;pages>0;pages--) {
-		memory.phandlers[phys_page]=handler;
+		set_page_handler(phys_page, handler);
 		phys_page++;
 	}
 }
 
 void MEM_ResetPageHandler(Bitu phys_page, Bitu pages) {
 	for (;pages>0;pages--) {
-		memory.phandlers[phys_page]=&ram_page_handler;
+		set_page_handler(phys_page, &ram_page_handler);
 		phys_page++;
 	}
 }
@@ -240,6 +304,11 @@ uint32_t MEM_TotalPages(void)
 	return check_cast<uint32_t>(memory.pages.size());
 }
 
+uint32_t MEM_NumHandles()
+{
+	return check_cast<uint32_t>(memory.mhandles.size());
+}
+
 uint32_t MEM_FreeLargest()
 {
 	uint32_t size    = 0;
@@ -681,7 +750,7 @@ void MEM_RemoveEMSPageFrame()
 {
 	/* Setup rom at 0xe0000-0xf0000 */
 	for (Bitu ct=0xe0;ct<0xf0;ct++) {
-		memory.phandlers[ct] = &rom_page_handler;
+		set_page_handler(ct, &rom_page_handler);
 	}
 }
 
@@ -689,7 +758,7 @@ void MEM_PreparePCJRCartRom()
 {
 	/* Setup rom at 0xd0000-0xe0000 */
 	for (Bitu ct=0xd0;ct<0xe0;ct++) {
-		memory.phandlers[ct] = &rom_page_handler;
+		set_page_handler(ct, &rom_page_handler);
 	}
 }
 
@@ -715,6 +784,33 @@ HostPt GetMemBase(void)
 	return MemBase;
 }
 
+// The guest RAM itself is saved by the snapshot code, this is the state
+// describing it
+static void save_snapshot(SnapshotWriter& writer)
+{
+	writer.Write(memory.a20.enabled);
+	writer.Write(memory.a20.controlport);
+
+	writer.Write(static_cast<uint32_t>(memory.mhandles.size()));
+	writer.WriteBytes(memory.mhandles.data(),
+	                  memory.mhandles.size() * sizeof(MemHandle));
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+	const auto a20_enabled = reader.Read<bool>();
+	reader.Read(memory.a20.controlport);
+
+	if (reader.Read<uint32_t>() == memory.mhandles.size()) {
+		reader.ReadBytes(memory.mhandles.data(),
+		                 memory.mhandles.size() * sizeof(MemHandle));
+	} else {
+		LOG_WARNING("MEMORY: The snapshot has a different memory handle table");
+		reader.SkipRemaining();
+	}
+	MEM_A20_Enable(a20_enabled);
+}
+
 class MEMORY final : public Module_base {
 private:
 	IO_ReadHandleObject ReadHandler   = {};
@@ -740,9 +836,16 @@ public:
 		        num_megabytes,
 		        static_cast<void*>(MemBase));
 
+		if (HUGEPAGES_GetMode() != HugePageMode::Off) {
+			LOG_MSG("MEMORY: Guest RAM is backed by %s",
+			        HUGEPAGES_ToString(HUGEPAGES_GetBacking(MemBase)));
+		}
+
 		// Setup the page handlers, defaulting to the RAM handler
 		memory.phandlers.clear();
 		memory.phandlers.resize(num_pages, &ram_page_handler);
+		memory.ptypes.clear();
+		memory.ptypes.resize(num_pages, PageType::Ram);
 
 		// Setup the memory handers, defaulting to 0 which means
 		// memory-allocation
@@ -752,7 +855,7 @@ public:
 		using page_range_t = std::pair<uint16_t, uint16_t>;
 		auto install_rom_page_handlers = [&](const page_range_t& page_range) {
 			for (auto p = page_range.first; p < page_range.second; ++p) {
-				memory.phandlers.at(p) = &rom_page_handler;
+				set_page_handler(p, &rom_page_handler);
 			}
 		};
 
@@ -774,6 +877,8 @@ public:
 		WriteHandler.Install(0x92, write_p92, io_width_t::byte);
 		ReadHandler.Install(0x92, read_p92, io_width_t::byte);
 		InitA20();
+
+		SNAPSHOT_AddComponent("memory", save_snapshot, load_snapshot);
 	}
 };
 
@@ -2342,8 +2342,18 @@ static void mix_samples(const int frames_requested)
 	mixer.frames_done = frames_requested;
 }
 
+static void handle_mix_no_sound();
+
 static void handle_mix_samples()
 {
+	// When rendering captures offline, emulation runs faster than the audio
+	// device can consume frames. Mix purely from emulated time and discard
+	// the output after capturing; the device plays silence meanwhile.
+	if (CAPTURE_IsRenderingOffline()) {
+		handle_mix_no_sound();
+		return;
+	}
+
 	MIXER_LockAudioDevice();
 
 	mix_samples(mixer.frames_needed);
@@ -31,6 +31,7 @@
 #include "mapper.h"
 #include "mem.h"
 #include "setup.h"
+#include "snapshot.h"
 #include "support.h"
 
 #ifdef _MSC_VER
@@ -93,6 +94,12 @@ void Timer::Stop()
 	enabled = false;
 }
 
+void Timer::ShiftTime(const double offset)
+{
+	start += offset;
+	trigger += offset;
+}
+
 void Timer::Start(const double time)
 {
 	// Only properly start when not running before
@@ -1023,6 +1030,92 @@ OPL::~OPL()
 	MIXER_DeregisterChannel(channel);
 }
 
+// The synthesiser's internal state, like the envelope positions, isn't
+// saved: the registers are written again on load, which restarts the notes
+// that are playing. The timer times are stored relative to the moment of the
+// snapshot.
+void OPL::SaveSnapshot(SnapshotWriter& writer) const
+{
+	writer.Write(mode);
+	writer.WriteBytes(cache, sizeof(cache));
+	writer.Write(reg);
+	writer.Write(ctrl.index);
+	writer.Write(ctrl.lvol);
+	writer.Write(ctrl.rvol);
+	writer.Write(ctrl.active);
+
+	const auto now = PIC_FullIndex();
+	for (auto c : chip) {
+		c.timer0.ShiftTime(-now);
+		c.timer1.ShiftTime(-now);
+		writer.Write(c);
+	}
+}
+
+void OPL::LoadSnapshot(SnapshotReader& reader)
+{
+	if (reader.Read<Mode>() != mode) {
+		LOG_WARNING("OPL: The snapshot was saved in a different OPL mode, keeping the current state");
+		reader.SkipRemaining();
+		return;
+	}
+	RenderUpToNow();
+
+	reader.ReadBytes(cache, sizeof(cache));
+	reader.Read(reg);
+	reader.Read(ctrl.index);
+	reader.Read(ctrl.lvol);
+	reader.Read(ctrl.rvol);
+	reader.Read(ctrl.active);
+
+	const auto now = PIC_FullIndex();
+	for (auto& c : chip) {
+		reader.ReadBytes(&c, sizeof(c));
+		c.timer0.ShiftTime(now);
+		c.timer1.ShiftTime(now);
+	}
+
+	// Select the OPL3 mode first, and key the notes on last once their
+	// operators and frequencies are set up
+	auto is_key_on = [](const io_port_t port) {
+		const auto index = port & 0xff;
+		return (index >= 0xb0 && index <= 0xb8) || index == 0xbd;
+	};
+	WriteReg(0x105, cache[0x105]);
+	WriteReg(0x104, cache[0x104]);
+	for (io_port_t port = 0; port < ARRAY_LEN(cache); ++port) {
+		if (port != 0x104 && port != 0x105 && !is_key_on(port)) {
+			WriteReg(port, cache[port]);
+		}
+	}
+	for (io_port_t port = 0; port < ARRAY_LEN(cache); ++port) {
+		if (is_key_on(port)) {
+			WriteReg(port, cache[port]);
+		}
+	}
+}
+
+static void save_snapshot(SnapshotWriter& writer)
+{
+	writer.Write(opl != nullptr);
+	if (opl) {
+		opl->SaveSnapshot(writer);
+	}
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+	const auto had_opl = reader.Read<bool>();
+	if (had_opl && opl) {
+		opl->LoadSnapshot(reader);
+		return;
+	}
+	if (had_opl != (opl != nullptr)) {
+		LOG_WARNING("OPL: The snapshot was saved with a different 'oplmode' setting");
+	}
+	reader.SkipRemaining();
+}
+
 void OPL_ShutDown([[maybe_unused]] Section* sec)
 {
 	opl = {};
@@ -1033,6 +1126,8 @@ void OPL_Init(Section* sec, const OplMode oplmode)
 	assert(sec);
 	opl = std::make_unique<OPL>(sec, oplmode);
 
+	SNAPSHOT_AddComponent("opl", save_snapshot, load_snapshot);
+
 	constexpr auto changeable_at_runtime = true;
 	sec->AddDestroyFunction(&OPL_ShutDown, changeable_at_runtime);
 }
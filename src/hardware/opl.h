@@ -45,6 +45,9 @@ public:
 	void Stop();
 	void Start(const double time);
 
+	// Moves the timer in time, as the times in snapshots are relative
+	void ShiftTime(const double offset);
+
 private:
 	double start            = 0.0; // Rounded down start time
 	double trigger          = 0.0; // Time when you overflow
@@ -77,6 +80,8 @@ typedef uint8_t RegisterCache[512];
 
 // Internal class used for dro capturing
 class Capture;
+class SnapshotReader;
+class SnapshotWriter;
 
 enum class Mode { Opl2, DualOpl2, Opl3, Opl3Gold };
 
@@ -97,6 +102,9 @@ public:
 	// prevent assignment
 	OPL &operator=(const OPL &) = delete;
 
+	void SaveSnapshot(SnapshotWriter& writer) const;
+	void LoadSnapshot(SnapshotReader& reader);
+
 private:
 	IO_ReadHandleObject ReadHandler[3];
 	IO_WriteHandleObject WriteHandler[3];
@@ -17,12 +17,17 @@
  */
 
 #include "dosbox.h"
+
+#include <vector>
+
 #include "inout.h"
 #include "cpu.h"
 #include "callback.h"
 #include "pic.h"
 #include "timer.h"
 #include "setup.h"
+#include "snapshot.h"
+#include "support.h"
 
 // PIC Controllers
 // ~~~~~~~~~~~~~~~
@@ -383,7 +388,8 @@ static void inline primary_startIRQ(uint8_t i)
 void PIC_runIRQs(void) {
 	if (!GETFLAG(IF)) return;
 	if (GCC_UNLIKELY(!PIC_IRQCheck)) return;
-	if (GCC_UNLIKELY(cpudecoder==CPU_Core_Normal_Trap_Run)) return;
+	if (GCC_UNLIKELY(cpudecoder==CPU_Core_Normal_Trap_Run ||
+	                 cpudecoder==CPU_Core_Cached_Trap_Run)) return;
 
 	const uint8_t p = (primary_controller.irr & primary_controller.imrr) &
 	                  primary_controller.isrr;
@@ -611,6 +617,44 @@ void TIMER_AddTick(void) {
 	}
 }
 
+// The event queue isn't part of the snapshot: its entries belong to the
+// devices scheduling them. Only the events their devices re-schedule on load
+// can be pending when a snapshot is saved.
+static std::vector<PIC_EventHandler> snapshot_safe_events = {};
+
+void PIC_AddSnapshotSafeEvent(PIC_EventHandler handler)
+{
+	if (!contains(snapshot_safe_events, handler)) {
+		snapshot_safe_events.push_back(handler);
+	}
+}
+
+static bool is_ready_for_snapshot()
+{
+	for (auto entry = pic_queue.next_entry; entry; entry = entry->next) {
+		if (!contains(snapshot_safe_events, entry->pic_event)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void save_snapshot(SnapshotWriter& writer)
+{
+	for (const auto& pic : pics) {
+		writer.Write(pic);
+	}
+	writer.Write(PIC_IRQCheck);
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+	for (auto& pic : pics) {
+		reader.Read(pic);
+	}
+	reader.Read(PIC_IRQCheck);
+}
+
 /* Use full name to avoid name clash with compile option for position-independent code */
 class PIC_8259A final : public Module_base {
 private:
@@ -670,6 +714,9 @@ public:
 		pic_queue.entries[PIC_QUEUESIZE-1].next=nullptr;
 		pic_queue.free_entry=&pic_queue.entries[0];
 		pic_queue.next_entry=nullptr;
+
+		SNAPSHOT_AddComponent("pic", save_snapshot, load_snapshot,
+		                      is_ready_for_snapshot);
 	}
 
 	~PIC_8259A(){
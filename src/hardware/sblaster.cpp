@@ -40,6 +40,7 @@
 #include "pic.h"
 #include "setup.h"
 #include "shell.h"
+#include "snapshot.h"
 #include "string_utils.h"
 #include "support.h"
 
@@ -655,20 +656,46 @@ static void DSP_DMA_CallBack(const DmaChannel* chan, DMAEvent event)
 	}
 }
 
-static uint8_t decode_adpcm_portion(const int bit_portion,
-                                    const uint8_t adjust_map[],
-                                    const int8_t scale_map[], const int last_index)
-{
-	auto& scale  = sb.adpcm.stepsize;
-	auto& sample = sb.adpcm.reference;
+// Decodes a block of ADPCM bytes into unsigned 8-bit samples in one pass. The
+// reference and step size are held in locals for the duration of the block
+// (instead of round-tripping through the 'sb' struct per sample) and only
+// written back at the end.
+class AdpcmBlockDecoder {
+public:
+	AdpcmBlockDecoder(const uint8_t* _adjust_map, const int8_t* _scale_map,
+	                  const int _last_index)
+	        : adjust_map(_adjust_map),
+	          scale_map(_scale_map),
+	          last_index(_last_index),
+	          scale(sb.adpcm.stepsize),
+	          sample(sb.adpcm.reference)
+	{}
+
+	~AdpcmBlockDecoder()
+	{
+		sb.adpcm.stepsize  = check_cast<uint16_t>(scale);
+		sb.adpcm.reference = check_cast<uint8_t>(sample);
+	}
 
-	const auto i = std::clamp(bit_portion + scale, 0, last_index);
-	scale = (scale + adjust_map[i]) & 0xff;
-	sample = static_cast<uint8_t>(clamp(sample + scale_map[i], 0, 255));
-	return sample;
-}
+	uint8_t Decode(const int bit_portion)
+	{
+		const auto i = std::clamp(bit_portion + scale, 0, last_index);
+		scale  = (scale + adjust_map[i]) & 0xff;
+		sample = std::clamp(sample + scale_map[i], 0, 255);
+		return static_cast<uint8_t>(sample);
+	}
+
+private:
+	const uint8_t* adjust_map = nullptr;
+	const int8_t* scale_map   = nullptr;
+	const int last_index      = 0;
+
+	int scale  = 0;
+	int sample = 0;
+};
 
-static std::array<uint8_t, 4> decode_ADPCM_2(const uint8_t data)
+// The decode_ADPCM_N functions decode 'num_bytes' of N-bit ADPCM data into 'out'
+static void decode_ADPCM_2(const uint8_t* in, const uint32_t num_bytes, uint8_t* out)
 {
 	// clang-format off
 
@@ -684,17 +711,21 @@ static std::array<uint8_t, 4> decode_ADPCM_2(const uint8_t data)
 		252, 0, 252, 0
 	};
 	static_assert(ARRAY_LEN(scale_map) == ARRAY_LEN(adjust_map));
-	constexpr auto last_i = static_cast<uint8_t>(sizeof(scale_map) - 1);;
-
-	return {decode_adpcm_portion((data >> 6) & 0x3, adjust_map, scale_map, last_i),
-	        decode_adpcm_portion((data >> 4) & 0x3, adjust_map, scale_map, last_i),
-	        decode_adpcm_portion((data >> 2) & 0x3, adjust_map, scale_map, last_i),
-	        decode_adpcm_portion((data >> 0) & 0x3, adjust_map, scale_map, last_i)};
+	constexpr auto last_i = static_cast<uint8_t>(sizeof(scale_map) - 1);
+
+	AdpcmBlockDecoder decoder(adjust_map, scale_map, last_i);
+	for (uint32_t i = 0; i < num_bytes; ++i) {
+		const auto data = in[i];
+		*out++ = decoder.Decode((data >> 6) & 0x3);
+		*out++ = decoder.Decode((data >> 4) & 0x3);
+		*out++ = decoder.Decode((data >> 2) & 0x3);
+		*out++ = decoder.Decode((data >> 0) & 0x3);
+	}
 
 	// clang-format on
 }
 
-static std::array<uint8_t, 3> decode_ADPCM_3(const uint8_t data)
+static void decode_ADPCM_3(const uint8_t* in, const uint32_t num_bytes, uint8_t* out)
 {
 	// clang-format off
 
@@ -713,16 +744,20 @@ static std::array<uint8_t, 3> decode_ADPCM_3(const uint8_t data)
 		248, 0, 0, 0, 248, 0, 0, 0
 	};
 	static_assert(ARRAY_LEN(scale_map) == ARRAY_LEN(adjust_map));
-	constexpr auto last_i = static_cast<uint8_t>(sizeof(scale_map) - 1);;
-
-	return {decode_adpcm_portion((data >> 5) & 0x7, adjust_map, scale_map, last_i),
-	        decode_adpcm_portion((data >> 2) & 0x7, adjust_map, scale_map, last_i),
-	        decode_adpcm_portion((data & 0x3) << 1, adjust_map, scale_map, last_i)};
+	constexpr auto last_i = static_cast<uint8_t>(sizeof(scale_map) - 1);
+
+	AdpcmBlockDecoder decoder(adjust_map, scale_map, last_i);
+	for (uint32_t i = 0; i < num_bytes; ++i) {
+		const auto data = in[i];
+		*out++ = decoder.Decode((data >> 5) & 0x7);
+		*out++ = decoder.Decode((data >> 2) & 0x7);
+		*out++ = decoder.Decode((data & 0x3) << 1);
+	}
 
 	// clang-format on
 }
 
-static std::array<uint8_t, 2> decode_ADPCM_4(const uint8_t data)
+static void decode_ADPCM_4(const uint8_t* in, const uint32_t num_bytes, uint8_t* out)
 {
 	// clang-format off
 
@@ -743,10 +778,14 @@ static std::array<uint8_t, 2> decode_ADPCM_4(const uint8_t data)
 		240, 0, 0, 0, 0,  0,  0,  0
 	};
 	static_assert(ARRAY_LEN(scale_map) == ARRAY_LEN(adjust_map));
-	constexpr auto last_i = static_cast<uint8_t>(sizeof(scale_map) - 1);;
+	constexpr auto last_i = static_cast<uint8_t>(sizeof(scale_map) - 1);
 
-	return {decode_adpcm_portion(data >> 4,  adjust_map, scale_map, last_i),
-	        decode_adpcm_portion(data & 0xf, adjust_map, scale_map, last_i)};
+	AdpcmBlockDecoder decoder(adjust_map, scale_map, last_i);
+	for (uint32_t i = 0; i < num_bytes; ++i) {
+		const auto data = in[i];
+		*out++ = decoder.Decode(data >> 4);
+		*out++ = decoder.Decode(data & 0xf);
+	}
 
 	// clang-format on
 }
@@ -802,14 +841,12 @@ static void PlayDMATransfer(uint32_t bytes_requested)
 
 	last_dma_callback = PIC_FullIndex();
 
-	// Temporary counter for ADPCM modes
-
-	auto decode_adpcm_dma =
-	        [&](auto decode_adpcm_fn) -> std::tuple<uint32_t, uint32_t, uint16_t> {
-
+	// ADPCM modes decode the whole DMA block and hand it to the mixer in
+	// a single call
+	auto decode_adpcm_dma = [&](auto decode_adpcm_fn,
+	                            const uint8_t samples_per_byte)
+	        -> std::tuple<uint32_t, uint32_t, uint16_t> {
 		const uint32_t num_bytes = ReadDMA8(bytes_to_read);
-		uint32_t num_samples = 0;
-		uint16_t num_frames  = 0;
 
 		// Parse the reference ADPCM byte, if provided
 		uint32_t i = 0;
@@ -819,29 +856,34 @@ static void PlayDMATransfer(uint32_t bytes_requested)
 			sb.adpcm.stepsize=MIN_ADAPTIVE_STEP_SIZE;
 			++i;
 		}
+
 		// Decode the remaining DMA buffer into samples using the provided function
-		while (i < num_bytes) {
-			const auto decoded = decode_adpcm_fn(sb.dma.buf.b8[i]);
-			constexpr auto num_decoded = check_cast<uint8_t>(decoded.size());
-			sb.chan->AddSamples_m8(num_decoded, maybe_silence(num_decoded, decoded.data()));
-			num_samples += num_decoded;
-			++i;
+		static std::array<uint8_t, DMA_BUFSIZE * 4> decoded = {};
+		const auto num_adpcm_bytes = num_bytes - i;
+		const auto num_samples = num_adpcm_bytes * samples_per_byte;
+		assert(num_samples <= decoded.size());
+
+		if (num_samples) {
+			decode_adpcm_fn(sb.dma.buf.b8 + i, num_adpcm_bytes, decoded.data());
+			sb.chan->AddSamples_m8(num_samples,
+			                       maybe_silence(num_samples, decoded.data()));
 		}
-		 // ADPCM is mono
-		num_frames = check_cast<uint16_t>(num_samples);
+
+		// ADPCM is mono
+		const auto num_frames = check_cast<uint16_t>(num_samples);
 		return {num_bytes, num_samples, num_frames};
 	};
 
 	//Read the actual data, process it and send it off to the mixer
 	switch (sb.dma.mode) {
 	case DSP_DMA_2:
-		std::tie(bytes_read, samples, frames) = decode_adpcm_dma(decode_ADPCM_2);
+		std::tie(bytes_read, samples, frames) = decode_adpcm_dma(decode_ADPCM_2, 4);
 		break;
 	case DSP_DMA_3:
-		std::tie(bytes_read, samples, frames) = decode_adpcm_dma(decode_ADPCM_3);
+		std::tie(bytes_read, samples, frames) = decode_adpcm_dma(decode_ADPCM_3, 3);
 		break;
 	case DSP_DMA_4:
-		std::tie(bytes_read, samples, frames) = decode_adpcm_dma(decode_ADPCM_4);
+		std::tie(bytes_read, samples, frames) = decode_adpcm_dma(decode_ADPCM_4, 2);
 		break;
 	case DSP_DMA_8:
  		if (sb.dma.stereo) {
@@ -2187,6 +2229,92 @@ OplMode find_oplmode()
 	return opl_mode;
 }
 
+// The DMA transfers are driven by the mixer callback and can't be resumed
+// from a snapshot, so only an idle DSP can be saved
+static bool is_ready_for_snapshot()
+{
+	return !sb.chan || sb.mode == MODE_NONE || sb.mode == MODE_DAC;
+}
+
+// The settings from the configuration, like the warmup times, the mixer
+// being enabled, and the DMA channel, are kept as they are
+static void save_snapshot(SnapshotWriter& writer)
+{
+	writer.Write(sb.type);
+	if (!sb.chan) {
+		return;
+	}
+	auto dma = sb.dma;
+	dma.chan = nullptr;
+
+	writer.Write(sb.freq);
+	writer.Write(dma);
+	writer.Write(sb.speaker);
+	writer.Write(sb.time_constant);
+	writer.Write(sb.mode);
+	writer.Write(sb.irq);
+	writer.Write(sb.dsp);
+	writer.Write(sb.dac);
+	writer.Write(sb.mixer);
+	writer.Write(sb.adpcm);
+	writer.Write(sb.e2);
+	writer.WriteBytes(ASP_regs, sizeof(ASP_regs));
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+	if (reader.Read<SB_TYPES>() != sb.type) {
+		LOG_WARNING("%s: The snapshot was saved with a different 'sbtype' setting",
+		            CardType());
+		reader.SkipRemaining();
+		return;
+	}
+	if (!sb.chan) {
+		reader.SkipRemaining();
+		return;
+	}
+
+	// Stop whatever the DSP is doing in the current session
+	PIC_RemoveEvents(PlayDMATransfer);
+	PIC_RemoveEvents(SuppressDMATransfer);
+	PIC_RemoveEvents(DSP_RaiseIRQEvent);
+	PIC_RemoveEvents(DSP_FinishReset);
+	if (sb.dma.chan) {
+		sb.dma.chan->ClearRequest();
+	}
+	ProcessDMATransfer = &PlayDMATransfer;
+
+	const auto dma_chan       = sb.dma.chan;
+	const auto cold_warmup_ms = sb.dsp.cold_warmup_ms;
+	const auto hot_warmup_ms  = sb.dsp.hot_warmup_ms;
+	const auto mixer_enabled  = sb.mixer.enabled;
+
+	reader.Read(sb.freq);
+	reader.Read(sb.dma);
+	reader.Read(sb.speaker);
+	reader.Read(sb.time_constant);
+	DSP_ChangeMode(reader.Read<DSP_MODES>());
+	reader.Read(sb.irq);
+	reader.Read(sb.dsp);
+	reader.Read(sb.dac);
+	reader.Read(sb.mixer);
+	reader.Read(sb.adpcm);
+	reader.Read(sb.e2);
+	reader.ReadBytes(ASP_regs, sizeof(ASP_regs));
+
+	sb.dma.chan           = dma_chan;
+	sb.dsp.cold_warmup_ms = cold_warmup_ms;
+	sb.dsp.hot_warmup_ms  = hot_warmup_ms;
+	sb.mixer.enabled      = mixer_enabled;
+
+	CTMIXER_UpdateVolumes();
+
+	// The speaker-output is always enabled on the SB16
+	if (sb.type != SBT_16) {
+		sb.chan->Enable(sb.speaker);
+	}
+}
+
 void SBLASTER_ShutDown(Section*);
 
 class SBLASTER final {
@@ -2376,6 +2504,11 @@ public:
 
 		CTMIXER_Reset();
 
+		SNAPSHOT_AddComponent("sblaster",
+		                      save_snapshot,
+		                      load_snapshot,
+		                      is_ready_for_snapshot);
+
 		ProcessDMATransfer = &PlayDMATransfer;
 
 		SetupEnvironment();
@@ -0,0 +1,525 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "snapshot.h"
+
+#include <algorithm>
+#include <array>
+#include <optional>
+
+#include "config.h"
+
+#if defined(C_SYSTEM_ZLIB_NG)
+#include <zlib-ng.h>
+#define compress2 zng_compress2
+#define compressBound zng_compressBound
+#define uncompress zng_uncompress
+#else
+#include <zlib.h>
+#endif
+
+#include "cross.h"
+#include "ems.h"
+#include "fs_utils.h"
+#include "logging.h"
+#include "mapper.h"
+#include "mem.h"
+#include "pic.h"
+#include "support.h"
+#include "vga.h"
+
+// File layout
+// ~~~~~~~~~~~
+// header:      magic, build, machine, memory size, EMS type, video memory
+//              size, memory handle table size, and emulation loop depth
+// components:  number of components, then for each: name, uncompressed size,
+//              compressed size, and the zlib-compressed data
+// RAM:         guest RAM at the RAM offset stored in the header
+//
+// The RAM offset is aligned generously so the guest RAM can be mapped
+// directly from the file on hosts with large memory pages.
+
+constexpr std::array<char, 8> Magic = {'D', 'B', 'S', 'N', 'A', 'P', '0', '1'};
+
+constexpr uint64_t RamAlignment = 64 * 1024;
+
+// How long a requested save waits for the busy components, in milliseconds
+// of emulated time
+constexpr uint32_t MaxSaveWaitMs = 1000;
+
+// zlib-ng's native API uses size_t for the buffer sizes
+using ZlibSize = decltype(compressBound(0));
+
+struct Component {
+	std::string name                 = {};
+	SnapshotSaveHandler save_handler = nullptr;
+	SnapshotLoadHandler load_handler = nullptr;
+	SnapshotReadyCheck ready_check   = nullptr;
+};
+
+static std::vector<Component> components = {};
+
+struct Header {
+	std::string build     = {};
+	uint32_t machine      = 0;
+	uint32_t num_pages    = 0;
+	uint32_t ems_type     = 0;
+	uint32_t vmemsize     = 0;
+	uint32_t num_mhandles = 0;
+	int32_t depth         = 0;
+	uint64_t ram_offset   = 0;
+};
+
+enum class Request { None, Save, Load };
+
+static struct {
+	std_fs::path path = {};
+
+	Request request = Request::None;
+
+	// When the pending save was requested, in PIC ticks
+	uint32_t save_requested_at = 0;
+
+	// Resuming at start-up waits until the emulation loop reaches the
+	// depth the snapshot was saved at
+	std::optional<int32_t> resume_depth = {};
+} snapshot = {};
+
+void SNAPSHOT_AddComponent(const char* name, SnapshotSaveHandler save_handler,
+                           SnapshotLoadHandler load_handler,
+                           SnapshotReadyCheck ready_check)
+{
+	for (auto& component : components) {
+		if (component.name == name) {
+			component.save_handler = save_handler;
+			component.load_handler = load_handler;
+			component.ready_check  = ready_check;
+			return;
+		}
+	}
+	components.push_back({name, save_handler, load_handler, ready_check});
+}
+
+// Returns the first component whose state can't be saved at the moment
+static const Component* find_busy_component()
+{
+	for (const auto& component : components) {
+		if (component.ready_check && !component.ready_check()) {
+			return &component;
+		}
+	}
+	return nullptr;
+}
+
+static uint64_t ram_size()
+{
+	return static_cast<uint64_t>(MEM_TotalPages()) * dos_pagesize;
+}
+
+static bool write_all(FILE* file, const void* data, const size_t num_bytes)
+{
+	return fwrite(data, 1, num_bytes, file) == num_bytes;
+}
+
+static bool read_all(FILE* file, void* data, const size_t num_bytes)
+{
+	return fread(data, 1, num_bytes, file) == num_bytes;
+}
+
+static std::vector<uint8_t> serialise_header(const Header& header)
+{
+	SnapshotWriter writer = {};
+	writer.Write(Magic);
+	writer.WriteString(header.build);
+	writer.Write(header.machine);
+	writer.Write(header.num_pages);
+	writer.Write(header.ems_type);
+	writer.Write(header.vmemsize);
+	writer.Write(header.num_mhandles);
+	writer.Write(header.depth);
+	writer.Write(header.ram_offset);
+	return writer.Data();
+}
+
+static std::optional<Header> read_header(FILE* file)
+{
+	auto read_value = [file](auto& value) {
+		return read_all(file, &value, sizeof(value));
+	};
+
+	std::array<char, 8> magic = {};
+	uint32_t build_length     = 0;
+	if (!read_value(magic) || magic != Magic || !read_value(build_length) ||
+	    build_length > 256) {
+		return {};
+	}
+	Header header = {};
+	header.build.resize(build_length);
+	if (!read_all(file, header.build.data(), build_length) ||
+	    !read_value(header.machine) || !read_value(header.num_pages) ||
+	    !read_value(header.ems_type) || !read_value(header.vmemsize) ||
+	    !read_value(header.num_mhandles) || !read_value(header.depth) ||
+	    !read_value(header.ram_offset)) {
+		return {};
+	}
+	return header;
+}
+
+static bool is_zero_page(const uint8_t* page)
+{
+	return std::all_of(page, page + dos_pagesize, [](const uint8_t b) {
+		return b == 0;
+	});
+}
+
+// Writes the guest RAM, skipping the all-zero pages. The caller extends the
+// file to its full size, so the skipped pages become holes that read back as
+// zeroes.
+static bool write_ram(FILE* file, const uint64_t ram_offset)
+{
+	const auto num_pages = MEM_TotalPages();
+
+	for (uint32_t page = 0; page < num_pages; ++page) {
+		const auto data = MemBase + static_cast<size_t>(page) * dos_pagesize;
+		if (is_zero_page(data)) {
+			continue;
+		}
+		const auto offset = ram_offset + static_cast<uint64_t>(page) * dos_pagesize;
+		if (cross_fseeko(file, static_cast<int64_t>(offset), SEEK_SET) != 0 ||
+		    !write_all(file, data, dos_pagesize)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool SNAPSHOT_Save(const std_fs::path& path, const int machine_depth)
+{
+	if (const auto busy = find_busy_component(); busy) {
+		LOG_WARNING("SNAPSHOT: Can't save while the '%s' component is busy",
+		            busy->name.c_str());
+		return false;
+	}
+
+	// The snapshot is written next to the destination and moved over it at
+	// the end, as the guest RAM might be mapped from the current snapshot
+	auto temp_path = path;
+	temp_path += ".tmp";
+
+	auto file = make_fopen(temp_path.string().c_str(), "wb");
+	if (!file) {
+		LOG_WARNING("SNAPSHOT: Can't create '%s'", temp_path.string().c_str());
+		return false;
+	}
+
+	bool success = true;
+
+	std::vector<uint8_t> compressed = {};
+
+	SnapshotWriter chunks = {};
+	chunks.Write(static_cast<uint32_t>(components.size()));
+	for (const auto& component : components) {
+		SnapshotWriter writer = {};
+		component.save_handler(writer);
+		const auto& data = writer.Data();
+
+		ZlibSize compressed_size = compressBound(static_cast<ZlibSize>(data.size()));
+		compressed.resize(compressed_size);
+		if (compress2(compressed.data(), &compressed_size, data.data(),
+		              static_cast<ZlibSize>(data.size()), Z_BEST_SPEED) != Z_OK) {
+			LOG_WARNING("SNAPSHOT: Can't compress the '%s' component",
+			            component.name.c_str());
+			success = false;
+			break;
+		}
+		chunks.WriteString(component.name);
+		chunks.Write(static_cast<uint32_t>(data.size()));
+		chunks.Write(static_cast<uint32_t>(compressed_size));
+		chunks.WriteBytes(compressed.data(), compressed_size);
+	}
+
+	Header header     = {};
+	header.build      = DOSBOX_GetDetailedVersion();
+	header.machine    = static_cast<uint32_t>(machine);
+	header.num_pages  = MEM_TotalPages();
+	header.depth      = machine_depth;
+	header.ram_offset = 0;
+
+	header.ems_type     = static_cast<uint32_t>(EMS_GetType());
+	header.vmemsize     = vga.vmemsize;
+	header.num_mhandles = MEM_NumHandles();
+
+	// The size of the header doesn't depend on the RAM offset in it
+	const auto data_end = serialise_header(header).size() + chunks.Data().size();
+	header.ram_offset   = (data_end + RamAlignment - 1) / RamAlignment * RamAlignment;
+
+	const auto header_data = serialise_header(header);
+
+	success = success && write_all(file.get(), header_data.data(), header_data.size()) &&
+	          write_all(file.get(), chunks.Data().data(), chunks.Data().size()) &&
+	          write_ram(file.get(), header.ram_offset);
+	file.reset();
+
+	std::error_code ec = {};
+	if (success) {
+		std_fs::resize_file(temp_path, header.ram_offset + ram_size(), ec);
+		success = !ec;
+	}
+	if (success) {
+		std_fs::rename(temp_path, path, ec);
+		success = !ec;
+	}
+	if (!success) {
+		LOG_WARNING("SNAPSHOT: Can't write '%s'", path.string().c_str());
+		std_fs::remove(temp_path, ec);
+		return false;
+	}
+	LOG_MSG("SNAPSHOT: Saved '%s'", path.string().c_str());
+	return true;
+}
+
+struct Chunk {
+	std::string name          = {};
+	std::vector<uint8_t> data = {};
+};
+
+static std::optional<std::vector<Chunk>> read_chunks(FILE* file)
+{
+	auto read_value = [file](auto& value) {
+		return read_all(file, &value, sizeof(value));
+	};
+
+	uint32_t num_chunks = 0;
+	if (!read_value(num_chunks)) {
+		return {};
+	}
+	std::vector<Chunk> chunks        = {};
+	std::vector<uint8_t> compressed = {};
+
+	for (uint32_t i = 0; i < num_chunks; ++i) {
+		uint32_t name_length = 0;
+		if (!read_value(name_length) || name_length > 256) {
+			return {};
+		}
+		Chunk chunk = {};
+		chunk.name.resize(name_length);
+
+		uint32_t size            = 0;
+		uint32_t compressed_size = 0;
+		if (!read_all(file, chunk.name.data(), name_length) ||
+		    !read_value(size) || !read_value(compressed_size)) {
+			return {};
+		}
+		compressed.resize(compressed_size);
+		chunk.data.resize(size);
+		ZlibSize uncompressed_size = size;
+		if (!read_all(file, compressed.data(), compressed_size) ||
+		    uncompress(chunk.data.data(), &uncompressed_size,
+		               compressed.data(), compressed_size) != Z_OK ||
+		    uncompressed_size != size) {
+			return {};
+		}
+		chunks.push_back(std::move(chunk));
+	}
+	return chunks;
+}
+
+static bool is_compatible(const Header& header)
+{
+	if (header.build != DOSBOX_GetDetailedVersion()) {
+		LOG_WARNING("SNAPSHOT: The snapshot was saved by a different build (%s)",
+		            header.build.c_str());
+		return false;
+	}
+	if (header.machine != static_cast<uint32_t>(machine) ||
+	    header.num_pages != MEM_TotalPages()) {
+		LOG_WARNING("SNAPSHOT: The snapshot was saved with a different 'machine' or 'memsize' setting");
+		return false;
+	}
+	if (header.ems_type != EMS_GetType()) {
+		LOG_WARNING("SNAPSHOT: The snapshot was saved with a different 'ems' setting");
+		return false;
+	}
+	if (header.vmemsize != vga.vmemsize) {
+		LOG_WARNING("SNAPSHOT: The snapshot was saved with a different amount of video memory");
+		return false;
+	}
+	if (header.num_mhandles != MEM_NumHandles()) {
+		LOG_WARNING("SNAPSHOT: The snapshot was saved with a different memory handle table");
+		return false;
+	}
+	return true;
+}
+
+static void load_ram(FILE* file, const std_fs::path& path, const uint64_t ram_offset)
+{
+	const auto size = static_cast<size_t>(ram_size());
+
+	if (map_file_over_memory(path, ram_offset, MemBase, size)) {
+		return;
+	}
+	if (cross_fseeko(file, static_cast<int64_t>(ram_offset), SEEK_SET) != 0 ||
+	    !read_all(file, MemBase, size)) {
+		E_Exit("SNAPSHOT: Can't read the guest RAM from '%s'",
+		       path.string().c_str());
+	}
+}
+
+bool SNAPSHOT_Load(const std_fs::path& path, const int machine_depth)
+{
+	auto file = make_fopen(path.string().c_str(), "rb");
+	if (!file) {
+		LOG_WARNING("SNAPSHOT: Can't open '%s'", path.string().c_str());
+		return false;
+	}
+
+	const auto header = read_header(file.get());
+	if (!header) {
+		LOG_WARNING("SNAPSHOT: '%s' isn't a valid snapshot", path.string().c_str());
+		return false;
+	}
+	if (!is_compatible(*header)) {
+		return false;
+	}
+
+	const auto chunks = read_chunks(file.get());
+	if (!chunks) {
+		LOG_WARNING("SNAPSHOT: '%s' is damaged", path.string().c_str());
+		return false;
+	}
+
+	// Check that every component can be restored before changing anything
+	std::vector<const Chunk*> component_chunks = {};
+	for (const auto& component : components) {
+		const auto chunk = std::find_if(chunks->begin(),
+		                                chunks->end(),
+		                                [&](const Chunk& c) {
+			                                return c.name == component.name;
+		                                });
+		if (chunk == chunks->end()) {
+			LOG_WARNING("SNAPSHOT: The '%s' component is missing from the snapshot",
+			            component.name.c_str());
+			return false;
+		}
+		component_chunks.push_back(&*chunk);
+	}
+
+	if (header->depth != machine_depth) {
+		LOG_WARNING("SNAPSHOT: The snapshot was saved in a different program nesting level, "
+		            "returning from the current program might crash");
+	}
+
+	load_ram(file.get(), path, header->ram_offset);
+
+	// From here on, the machine state is a mix of the old and the snapshot
+	// state until all the components are loaded, so there's no way back
+	for (size_t i = 0; i < components.size(); ++i) {
+		SnapshotReader reader(component_chunks[i]->data);
+		components[i].load_handler(reader);
+		if (!reader.IsValid()) {
+			E_Exit("SNAPSHOT: Can't restore the '%s' component from '%s'",
+			       components[i].name.c_str(),
+			       path.string().c_str());
+		}
+	}
+
+	LOG_MSG("SNAPSHOT: Loaded '%s'", path.string().c_str());
+	return true;
+}
+
+void SNAPSHOT_RunPendingRequest(const int machine_depth)
+{
+	switch (snapshot.request) {
+	case Request::None: return;
+	case Request::Save:
+		// Give the busy components some time to finish what they're doing
+		if (find_busy_component() &&
+		    PIC_Ticks - snapshot.save_requested_at < MaxSaveWaitMs) {
+			return;
+		}
+		SNAPSHOT_Save(snapshot.path, machine_depth);
+		break;
+	case Request::Load:
+		if (snapshot.resume_depth && *snapshot.resume_depth != machine_depth) {
+			return;
+		}
+		SNAPSHOT_Load(snapshot.path, machine_depth);
+		break;
+	}
+	snapshot.request      = Request::None;
+	snapshot.resume_depth = {};
+}
+
+static void save_snapshot_handler(const bool pressed)
+{
+	if (pressed) {
+		snapshot.request           = Request::Save;
+		snapshot.save_requested_at = PIC_Ticks;
+	}
+}
+
+static void load_snapshot_handler(const bool pressed)
+{
+	if (pressed) {
+		snapshot.request      = Request::Load;
+		snapshot.resume_depth = {};
+	}
+}
+
+// Queues the resume of the snapshot; it's loaded once the emulation loop
+// runs at the same depth it was saved at, so the DOS shell is in the same
+// state
+static void request_resume()
+{
+	auto file = make_fopen(snapshot.path.string().c_str(), "rb");
+	if (!file) {
+		LOG_WARNING("SNAPSHOT: Can't open '%s' to resume it",
+		            snapshot.path.string().c_str());
+		return;
+	}
+	const auto header = read_header(file.get());
+	if (!header || !is_compatible(*header)) {
+		LOG_WARNING("SNAPSHOT: Can't resume '%s'", snapshot.path.string().c_str());
+		return;
+	}
+	snapshot.request      = Request::Load;
+	snapshot.resume_depth = header->depth;
+}
+
+void SNAPSHOT_Init(Section* sec)
+{
+	const auto section = static_cast<Section_prop*>(sec);
+	assert(section);
+
+	snapshot.path = section->Get_path("snapshot_file")->realpath;
+
+	MAPPER_AddHandler(save_snapshot_handler, SDL_SCANCODE_F3, PRIMARY_MOD,
+	                  "savesnap", "Save Snap");
+	MAPPER_AddHandler(load_snapshot_handler, SDL_SCANCODE_F3, MMOD2,
+	                  "loadsnap", "Load Snap");
+
+	static bool resume_checked = false;
+	if (!resume_checked) {
+		resume_checked = true;
+		if (section->Get_bool("resume_snapshot")) {
+			request_resume();
+		}
+	}
+}
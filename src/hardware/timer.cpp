@@ -18,6 +18,7 @@
 
 #include "timer.h"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
@@ -28,6 +29,7 @@
 #include "math_utils.h"
 #include "mixer.h"
 #include "setup.h"
+#include "snapshot.h"
 
 const std::chrono::steady_clock::time_point system_start_time = std::chrono::steady_clock::now();
 
@@ -630,6 +632,46 @@ bool TIMER_GetOutput2()
 	return counter_output(channel_2);
 }
 
+// The start times are stored relative to the moment of the snapshot, as the
+// emulated clock keeps running from where it's at when the snapshot is loaded
+static void save_snapshot(SnapshotWriter& writer)
+{
+	const auto now = PIC_FullIndex();
+	for (auto channel : pit) {
+		channel.start -= now;
+		writer.Write(channel);
+	}
+	writer.Write(gate2);
+	writer.Write(latched_timerstatus);
+	writer.Write(latched_timerstatus_locked);
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+	const auto now = PIC_FullIndex();
+	for (auto& channel : pit) {
+		reader.Read(channel);
+		channel.start += now;
+	}
+	reader.Read(gate2);
+	reader.Read(latched_timerstatus);
+	reader.Read(latched_timerstatus_locked);
+
+	// Re-schedule the next IRQ 0, unless the channel is waiting for its
+	// count or has already fired in the one-shot mode
+	PIC_RemoveEvents(PIT0_Event);
+	if (!channel_0.mode_changed) {
+		const auto remaining = channel_0.start + channel_0.delay - now;
+		if (channel_0.mode != PitMode::InterruptOnTerminalCount) {
+			PIC_AddEvent(PIT0_Event, std::max(remaining, 0.0));
+		} else if (remaining > 0.0) {
+			PIC_AddEvent(PIT0_Event, remaining);
+		}
+	}
+	PCSPEAKER_SetPITControl(channel_2.mode);
+	PCSPEAKER_SetCounter(channel_2.count, channel_2.mode);
+}
+
 class TIMER final : public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler[4];
@@ -683,6 +725,9 @@ public:
 		latched_timerstatus_locked=false;
 		gate2 = false;
 		PIC_AddEvent(PIT0_Event, channel_0.delay);
+
+		PIC_AddSnapshotSafeEvent(PIT0_Event);
+		SNAPSHOT_AddComponent("pit", save_snapshot, load_snapshot);
 	}
 	~TIMER(){
 		PIC_RemoveEvents(PIT0_Event);
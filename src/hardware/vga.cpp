@@ -26,7 +26,9 @@
 #include "../ints/int10.h"
 #include "logging.h"
 #include "math_utils.h"
+#include "mem.h"
 #include "pic.h"
+#include "snapshot.h"
 #include "string_utils.h"
 #include "video.h"
 
@@ -390,6 +392,122 @@ void VGA_EnablePixelDoubling(const bool enable)
 	vga.draw.pixel_doubling_enabled = enable;
 }
 
+// The Tandy video pointers point into either the video memory or the guest
+// RAM, so they're stored as the area plus the offset into it
+enum class TandyBase : uint8_t { None, VideoMemory, GuestRam };
+
+static void save_tandy_pointer(SnapshotWriter& writer, const uint8_t* pointer)
+{
+	if (!pointer) {
+		writer.Write(TandyBase::None);
+		writer.Write(uint32_t(0));
+	} else if (pointer >= vga.mem.linear && pointer < vga.mem.linear + vga.vmemsize) {
+		writer.Write(TandyBase::VideoMemory);
+		writer.Write(static_cast<uint32_t>(pointer - vga.mem.linear));
+	} else {
+		writer.Write(TandyBase::GuestRam);
+		writer.Write(static_cast<uint32_t>(pointer - MemBase));
+	}
+}
+
+static uint8_t* load_tandy_pointer(SnapshotReader& reader)
+{
+	const auto base   = reader.Read<TandyBase>();
+	const auto offset = reader.Read<uint32_t>();
+	switch (base) {
+	case TandyBase::VideoMemory: return vga.mem.linear + offset;
+	case TandyBase::GuestRam: return MemBase + offset;
+	default: return nullptr;
+	}
+}
+
+// The register blocks are copied byte-wise: their bit_view unions make them
+// formally non-trivially-copyable, but they only hold plain register values
+static void save_snapshot(SnapshotWriter& writer)
+{
+	writer.Write(vga.vmemsize);
+
+	writer.Write(vga.mode);
+	writer.Write(vga.misc_output);
+	writer.WriteBytes(&vga.config, sizeof(vga.config));
+	writer.WriteBytes(&vga.seq, sizeof(vga.seq));
+	writer.WriteBytes(&vga.attr, sizeof(vga.attr));
+	writer.WriteBytes(&vga.crtc, sizeof(vga.crtc));
+	writer.WriteBytes(&vga.gfx, sizeof(vga.gfx));
+	writer.WriteBytes(&vga.dac, sizeof(vga.dac));
+	writer.WriteBytes(&vga.latch, sizeof(vga.latch));
+	writer.WriteBytes(&vga.s3, sizeof(vga.s3));
+	writer.WriteBytes(&vga.svga, sizeof(vga.svga));
+	writer.WriteBytes(&vga.herc, sizeof(vga.herc));
+	writer.WriteBytes(&vga.other, sizeof(vga.other));
+	writer.Write(vga.vmemwrap);
+	writer.Write(vga.ega_mode_with_vga_colors);
+
+	writer.WriteBytes(&vga.tandy, sizeof(vga.tandy));
+	save_tandy_pointer(writer, vga.tandy.draw_base);
+	save_tandy_pointer(writer, vga.tandy.mem_base);
+
+	writer.WriteBytes(vga.draw.font, sizeof(vga.draw.font));
+	for (const auto table : vga.draw.font_tables) {
+		writer.Write(static_cast<uint32_t>(table ? table - vga.draw.font : 0));
+	}
+
+	writer.WriteBytes(vga.mem.linear, vga.vmemsize);
+	writer.WriteBytes(vga.fastmem, vga.vmemsize * 2);
+
+	writer.WriteBytes(CGA_2_Table, sizeof(CGA_2_Table));
+	writer.WriteBytes(CGA_4_Table, sizeof(CGA_4_Table));
+	writer.WriteBytes(CGA_4_HiRes_Table, sizeof(CGA_4_HiRes_Table));
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+	// Checked by the snapshot code before loading anything as well
+	if (reader.Read<uint32_t>() != vga.vmemsize) {
+		LOG_WARNING("VIDEO: The snapshot has a different amount of video memory");
+		reader.SkipRemaining();
+		return;
+	}
+
+	reader.Read(vga.mode);
+	reader.Read(vga.misc_output);
+	reader.ReadBytes(&vga.config, sizeof(vga.config));
+	reader.ReadBytes(&vga.seq, sizeof(vga.seq));
+	reader.ReadBytes(&vga.attr, sizeof(vga.attr));
+	reader.ReadBytes(&vga.crtc, sizeof(vga.crtc));
+	reader.ReadBytes(&vga.gfx, sizeof(vga.gfx));
+	reader.ReadBytes(&vga.dac, sizeof(vga.dac));
+	reader.ReadBytes(&vga.latch, sizeof(vga.latch));
+	reader.ReadBytes(&vga.s3, sizeof(vga.s3));
+	reader.ReadBytes(&vga.svga, sizeof(vga.svga));
+	reader.ReadBytes(&vga.herc, sizeof(vga.herc));
+	reader.ReadBytes(&vga.other, sizeof(vga.other));
+	reader.Read(vga.vmemwrap);
+	reader.Read(vga.ega_mode_with_vga_colors);
+
+	reader.ReadBytes(&vga.tandy, sizeof(vga.tandy));
+	vga.tandy.draw_base = load_tandy_pointer(reader);
+	vga.tandy.mem_base  = load_tandy_pointer(reader);
+
+	reader.ReadBytes(vga.draw.font, sizeof(vga.draw.font));
+	for (auto& table : vga.draw.font_tables) {
+		table = vga.draw.font + reader.Read<uint32_t>() % sizeof(vga.draw.font);
+	}
+
+	reader.ReadBytes(vga.mem.linear, vga.vmemsize);
+	reader.ReadBytes(vga.fastmem, vga.vmemsize * 2);
+
+	reader.ReadBytes(CGA_2_Table, sizeof(CGA_2_Table));
+	reader.ReadBytes(CGA_4_Table, sizeof(CGA_4_Table));
+	reader.ReadBytes(CGA_4_HiRes_Table, sizeof(CGA_4_HiRes_Table));
+
+	// The drawing state is derived from the registers, so set up the
+	// memory handlers and the mode again as if the registers were just
+	// programmed
+	VGA_SetupHandlers();
+	VGA_StartResize();
+}
+
 void VGA_Init(Section* sec)
 {
 	vga.draw.resizing = false;
@@ -456,6 +574,9 @@ void VGA_Init(Section* sec)
 #endif
 		}
 	}
+
+	VGA_AddSnapshotSafeEvents();
+	SNAPSHOT_AddComponent("vga", save_snapshot, load_snapshot);
 }
 
 void SVGA_Setup_Driver(void) {
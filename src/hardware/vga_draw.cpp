@@ -2946,6 +2946,21 @@ void VGA_SetupDrawing(uint32_t /*val*/)
 	finalise_mode_change();
 }
 
+// The drawing events are derived from the registers by VGA_SetupDrawing,
+// which the snapshot load runs again
+void VGA_AddSnapshotSafeEvents()
+{
+	PIC_AddSnapshotSafeEvent(VGA_SetupDrawing);
+	PIC_AddSnapshotSafeEvent(VGA_DrawSingleLine);
+	PIC_AddSnapshotSafeEvent(VGA_DrawEGASingleLine);
+	PIC_AddSnapshotSafeEvent(VGA_DrawPart);
+	PIC_AddSnapshotSafeEvent(VGA_VertInterrupt);
+	PIC_AddSnapshotSafeEvent(VGA_Other_VertInterrupt);
+	PIC_AddSnapshotSafeEvent(VGA_DisplayStartLatch);
+	PIC_AddSnapshotSafeEvent(VGA_PanningLatch);
+	PIC_AddSnapshotSafeEvent(VGA_VerticalTimer);
+}
+
 void VGA_KillDrawing(void) {
 	PIC_RemoveEvents(VGA_DrawPart);
 	PIC_RemoveEvents(VGA_DrawSingleLine);
@@ -32,9 +32,11 @@
 #include "inout.h"
 #include "dos_inc.h"
 #include "setup.h"
+#include "snapshot.h"
 #include "support.h"
 #include "cpu.h"
 #include "dma.h"
+#include "ems.h"
 
 #define EMM_PAGEFRAME	0xE000
 #define EMM_PAGEFRAME4K	((EMM_PAGEFRAME*16)/4096)
@@ -1388,6 +1390,39 @@ Bitu GetEMSType(Section_prop * section) {
 	return rtype;
 }
 
+Bitu EMS_GetType()
+{
+	return ems_type;
+}
+
+static void save_snapshot(SnapshotWriter& writer)
+{
+	writer.Write(ems_type);
+	writer.Write(emm_handles);
+	writer.Write(emm_mappings);
+	writer.Write(emm_segmentmappings);
+	writer.Write(vcpi);
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+	// The snapshot code checks the type before loading anything, so this
+	// only guards against a damaged snapshot
+	if (reader.Read<Bitu>() != ems_type) {
+		LOG_WARNING("EMS: The snapshot was saved with a different EMS type");
+		reader.SkipRemaining();
+		return;
+	}
+	reader.ReadBytes(emm_handles, sizeof(emm_handles));
+	reader.ReadBytes(emm_mappings, sizeof(emm_mappings));
+	reader.ReadBytes(emm_segmentmappings, sizeof(emm_segmentmappings));
+	reader.Read(vcpi);
+
+	if (ems_type > 0) {
+		EMM_RestoreMappingTable();
+	}
+}
+
 class EMS final : public Module_base {
 private:
 	uint16_t ems_baseseg = 0;
@@ -1407,6 +1442,8 @@ public:
 	{
 		ems_type=0;
 
+		SNAPSHOT_AddComponent("ems", save_snapshot, load_snapshot);
+
 		/* Virtual DMA interrupt callback */
 		call_vdma.Install(&INT4B_Handler,CB_IRET,"Int 4b vdma");
 		call_vdma.Set_RealVec(0x4b);
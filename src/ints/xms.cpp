@@ -25,11 +25,13 @@
 #include "checks.h"
 #include "cpu.h"
 #include "dos_inc.h"
+#include "ems.h"
 #include "inout.h"
 #include "math_utils.h"
 #include "mem.h"
 #include "regs.h"
 #include "setup.h"
+#include "snapshot.h"
 #include "support.h"
 
 #include <cstddef>
@@ -727,8 +729,6 @@ static Bitu XMS_Handler()
 // Module object
 // ***************************************************************************
 
-Bitu GetEMSType(Section_prop* section);
-
 class XMS final : public Module_base {
 private:
 	CALLBACK_HandlerObject callbackhandler;
@@ -738,6 +738,20 @@ public:
 	~XMS() override;
 };
 
+static void save_snapshot(SnapshotWriter& writer)
+{
+	writer.Write(a20);
+	writer.Write(hma);
+	writer.Write(xms.handles);
+}
+
+static void load_snapshot(SnapshotReader& reader)
+{
+	reader.Read(a20);
+	reader.Read(hma);
+	reader.ReadBytes(xms.handles, sizeof(xms.handles));
+}
+
 XMS::XMS(Section* configuration) : Module_base(configuration), callbackhandler{}
 {
 	Section_prop* section = static_cast<Section_prop*>(configuration);
@@ -745,6 +759,8 @@ XMS::XMS(Section* configuration) : Module_base(configuration), callbackhandler{}
 	umb = {};
 	a20 = {};
 
+	SNAPSHOT_AddComponent("xms", save_snapshot, load_snapshot);
+
 	if (!section->Get_bool("xms")) {
 		return;
 	}
@@ -18,11 +18,16 @@
 
 #include "zmbv.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <condition_variable>
 #include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 #include "math_utils.h"
 #include "mem_unaligned.h"
@@ -41,11 +46,8 @@ constexpr uint8_t Mask_DeltaPalette = 0x02;
 
 // Compression flags
 constexpr uint8_t COMPRESSION_ZLIB     = 1;
-constexpr int ZLIB_COMPRESSION_LEVEL   = 6;          // 0 to 9 (0 = no compression)
 constexpr auto ZLIB_COMPRESSION_METHOD = Z_DEFLATED; // currently the only option
 constexpr int ZLIB_MEM_LEVEL           = 9;          // 1 to 9 (default 8)
-constexpr auto ZLIB_STRATEGY           = Z_FILTERED; // Z_DEFAULT_STRATEGY, Z_FILTERED,
-                                                     // Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED
 
 ZMBV_FORMAT BPPFormat(const int bpp)
 {
@@ -117,6 +119,8 @@ bool VideoCodec::SetupBuffers(const ZMBV_FORMAT _format, const int blockwidth, c
 
 	const auto blocks_needed = check_cast<uint32_t>(xblocks * yblocks);
 	blocks.resize(blocks_needed);
+	blockVectors.resize(blocks_needed);
+	blocksPerRow = xblocks;
 
 	size_t i = 0;
 	for (auto y = 0; y < yblocks; ++y) {
@@ -216,15 +220,14 @@ void VideoCodec::AlignWork(size_t & offset) {
 	offset = (offset + blocks.size() * 2u + 3u) & ~3u;
 }
 
+// Finds the best motion vector for each block in the given range. Only reads
+// the frames and writes the range's own blockVectors entries, so disjoint
+// ranges can be searched concurrently.
 template <class P>
-void VideoCodec::AddXorFrame()
+void VideoCodec::SearchBlockVectors(const size_t firstBlock, const size_t lastBlock)
 {
-	auto vectors = &work[workUsed];
-
-	AlignWork(workUsed);
-
-	size_t b = 0;
-	for (const auto & block : blocks) {
+	for (auto b = firstBlock; b < lastBlock; ++b) {
+		const auto& block = blocks[b];
 
 		int8_t bestvx   = 0;
 		int8_t bestvy   = 0;
@@ -248,23 +251,165 @@ void VideoCodec::AddXorFrame()
 				}
 			}
 		}
-		vectors[b * 2 + 0] = static_cast<uint8_t>(left_shift_signed(bestvx, 1));
-		vectors[b * 2 + 1] = static_cast<uint8_t>(left_shift_signed(bestvy, 1));
-		if (bestchange) {
+		blockVectors[b] = {bestvx, bestvy, bestchange};
+	}
+}
+
+class VideoCodec::SearchPool {
+public:
+	explicit SearchPool(int numWorkers);
+	~SearchPool();
+
+	SearchPool(const SearchPool&)            = delete;
+	SearchPool& operator=(const SearchPool&) = delete;
+
+	// Runs the job for bands 1 and up on the workers and for band 0 on
+	// the calling thread, and returns once all of them are done
+	void Run(int numBands, const std::function<void(int)>& job);
+
+private:
+	void Work(int band);
+
+	std::mutex mutex                      = {};
+	std::condition_variable jobAvailable  = {};
+	std::condition_variable jobDone       = {};
+	const std::function<void(int)>* job   = nullptr;
+	int numBands                          = 0;
+	int numPending                        = 0;
+	uint64_t generation                   = 0;
+	bool stop                             = false;
+	std::vector<std::thread> workers      = {};
+};
+
+VideoCodec::SearchPool::SearchPool(const int numWorkers)
+{
+	for (auto i = 0; i < numWorkers; ++i) {
+		workers.emplace_back(&SearchPool::Work, this, i + 1);
+	}
+}
+
+VideoCodec::SearchPool::~SearchPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	jobAvailable.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void VideoCodec::SearchPool::Run(const int _numBands,
+                                 const std::function<void(int)>& _job)
+{
+	assert(_numBands >= 1 && _numBands <= static_cast<int>(workers.size()) + 1);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job        = &_job;
+		numBands   = _numBands;
+		numPending = _numBands - 1;
+		++generation;
+	}
+	jobAvailable.notify_all();
+
+	_job(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	jobDone.wait(lock, [this] { return numPending == 0; });
+	job = nullptr;
+}
+
+void VideoCodec::SearchPool::Work(const int band)
+{
+	uint64_t seenGeneration = 0;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		jobAvailable.wait(lock, [&] {
+			return stop || generation != seenGeneration;
+		});
+		if (stop) {
+			return;
+		}
+		seenGeneration = generation;
+		if (band >= numBands) {
+			continue;
+		}
+		const auto bandJob = job;
+
+		lock.unlock();
+		(*bandJob)(band);
+		lock.lock();
+
+		if (--numPending == 0) {
+			jobDone.notify_one();
+		}
+	}
+}
+
+template <class P>
+void VideoCodec::AddXorFrame()
+{
+	auto vectors = &work[workUsed];
+
+	AlignWork(workUsed);
+
+	// Search for the motion vectors, splitting the frame into bands of
+	// whole block rows if multiple threads are available
+	const auto numBlocks = blocks.size();
+	const auto numRows   = static_cast<int>(numBlocks) / blocksPerRow;
+	const auto numBands  = std::clamp(numSearchThreads, 1, numRows);
+
+	if (numBands == 1 || !searchPool) {
+		SearchBlockVectors<P>(0, numBlocks);
+	} else {
+		const auto rowsPerBand = (numRows + numBands - 1) / numBands;
+		const auto blocksPerBand = static_cast<size_t>(rowsPerBand * blocksPerRow);
+
+		// Rounding up the rows can leave the last bands empty
+		searchPool->Run(numBands, [&](const int band) {
+			const auto first = static_cast<size_t>(band) * blocksPerBand;
+			if (first < numBlocks) {
+				SearchBlockVectors<P>(first,
+				                      std::min(first + blocksPerBand, numBlocks));
+			}
+		});
+	}
+
+	// Emit the vectors and XOR blocks in order
+	for (size_t b = 0; b < numBlocks; ++b) {
+		const auto& bv = blockVectors[b];
+
+		vectors[b * 2 + 0] = static_cast<uint8_t>(left_shift_signed(bv.x, 1));
+		vectors[b * 2 + 1] = static_cast<uint8_t>(left_shift_signed(bv.y, 1));
+		if (bv.changes) {
 			vectors[b * 2 + 0] |= 1;
-			AddXorBlock<P>(bestvx, bestvy, block);
+			AddXorBlock<P>(bv.x, bv.y, blocks[b]);
 		}
-		++b;
 	}
 }
 
 bool VideoCodec::SetupCompress(const int _width, const int _height)
+{
+	return SetupCompress(_width, _height, CompressOptions{});
+}
+
+bool VideoCodec::SetupCompress(const int _width, const int _height,
+                               const CompressOptions& options)
 {
 	width  = _width;
 	height = _height;
 	pitch  = _width + 2 * MAX_VECTOR;
 	format = ZMBV_FORMAT::NONE;
-	if (deflateInit2(&zstream, ZLIB_COMPRESSION_LEVEL, ZLIB_COMPRESSION_METHOD, ZLIB_MEM_LEVEL, ZLIB_MEM_LEVEL, ZLIB_STRATEGY) !=
+
+	numSearchThreads = std::max(options.numSearchThreads, 1);
+	searchPool.reset();
+	if (numSearchThreads > 1) {
+		searchPool = std::make_unique<SearchPool>(numSearchThreads - 1);
+	}
+
+	if (deflateInit2(&zstream, std::clamp(options.level, 0, 9), ZLIB_COMPRESSION_METHOD, ZLIB_MEM_LEVEL, ZLIB_MEM_LEVEL, options.strategy) !=
 	    Z_OK)
 		return false;
 	return true;
@@ -608,3 +753,6 @@ VideoCodec::VideoCodec()
 	CreateVectorTable();
 	memset(&zstream, 0, sizeof(zstream));
 }
+
+// Out of line, where the search pool is a complete type
+VideoCodec::~VideoCodec() = default;
@@ -20,6 +20,7 @@
 #define DOSBOX_ZMBV_H
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 #include "config.h"
@@ -75,6 +76,12 @@ private:
 		uint8_t blockheight = 0;
 	};
 
+	struct BlockVector {
+		int8_t x    = 0;
+		int8_t y    = 0;
+		int changes = 0;
+	};
+
 	struct Compress {
 		int linesDone = 0;
 		uint32_t writeSize = 0;
@@ -95,7 +102,15 @@ private:
 	std::vector<uint8_t> work = {};
 	uint32_t bufsize = 0;
 
+	// Workers searching the bands of the delta frames, kept for the
+	// whole capture
+	class SearchPool;
+
 	std::vector<FrameBlock> blocks = {};
+	std::vector<BlockVector> blockVectors = {};
+	int blocksPerRow = 0;
+	int numSearchThreads = 1;
+	std::unique_ptr<SearchPool> searchPool;
 	size_t workUsed = 0;
 	size_t workPos = 0;
 
@@ -114,6 +129,8 @@ private:
 	void CreateVectorTable();
 	bool SetupBuffers(ZMBV_FORMAT format, int blockwidth, int blockheight);
 
+	template <class P>
+	void SearchBlockVectors(size_t firstBlock, size_t lastBlock);
 	template <class P>
 	void AddXorFrame();
 	template <class P>
@@ -132,12 +149,27 @@ private:
 	void AlignWork(size_t & offset);
 
 public:
+	struct CompressOptions {
+		// zlib compression level, 0 (none) to 9 (best)
+		int level = 6;
+
+		// zlib strategy: Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY,
+		// Z_RLE, or Z_FIXED
+		int strategy = Z_FILTERED;
+
+		// Number of threads searching for motion vectors in delta frames;
+		// each takes a horizontal band of block rows
+		int numSearchThreads = 1;
+	};
+
 	VideoCodec();
+	~VideoCodec();
 
 	VideoCodec(const VideoCodec &) = delete;            // prevent copy
 	VideoCodec &operator=(const VideoCodec &) = delete; // prevent assignment
 
 	bool SetupCompress(int _width, int _height);
+	bool SetupCompress(int _width, int _height, const CompressOptions& options);
 	bool SetupDecompress(int _width, int _height);
 	ZMBV_FORMAT BPPFormat(int bpp);
 	int NeededSize(int _width, int _height, ZMBV_FORMAT _format);
@@ -27,6 +27,7 @@
 #include <cstring>
 #include <list>
 #include <string>
+#include <utility>
 
 #include <SDL.h>
 
@@ -156,6 +157,11 @@ struct Midi {
 	bool is_available    = false;
 	bool is_muted        = false;
 	MidiHandler* handler = nullptr;
+
+	// The built-in synthesizer to open on the first MIDI output, when
+	// it's not opened at startup
+	MidiHandler* pending_handler = nullptr;
+	std::string pending_config   = {};
 };
 
 static Midi midi                    = {};
@@ -294,7 +300,8 @@ uint8_t get_midi_channel(const uint8_t channel_status)
 
 static bool is_external_midi_device()
 {
-	return midi.handler->GetDeviceType() == MidiDeviceType::External;
+	return midi.handler &&
+	       midi.handler->GetDeviceType() == MidiDeviceType::External;
 }
 
 static void output_note_off_for_active_notes(const uint8_t channel)
@@ -370,11 +377,31 @@ static void sanitise_midi_stream(const MidiMessage& msg)
 	}
 }
 
+// Opens the built-in synthesizer that was left to the first MIDI output;
+// loading its ROMs or SoundFont takes a while
+static bool open_pending_handler()
+{
+	const auto handler = std::exchange(midi.pending_handler, nullptr);
+	assert(handler);
+	if (handler->Open(midi.pending_config.c_str())) {
+		midi.handler = handler;
+		LOG_MSG("MIDI: Opened device: %s", handler->GetName().data());
+		return true;
+	}
+	LOG_MSG("MIDI: Can't open device: '%s', MIDI is not available",
+	        handler->GetName().data());
+	midi.is_available = false;
+	return false;
+}
+
 void MIDI_RawOutByte(uint8_t data)
 {
 	if (!midi.is_available) {
 		return;
 	}
+	if (!midi.handler && !open_pending_handler()) {
+		return;
+	}
 
 	if (midi.sysex.start_ms) {
 		const auto passed_ticks = GetTicksSince(midi.sysex.start_ms);
@@ -538,7 +565,8 @@ void MidiHandler::Reset()
 
 void MIDI_Reset()
 {
-	if (midi.is_available) {
+	// A device that isn't open yet has nothing to reset
+	if (midi.is_available && midi.handler) {
 		midi.handler->Reset();
 	}
 }
@@ -632,6 +660,20 @@ public:
 
 		register_handlers();
 
+		// The built-in synthesizers can be opened on the first MIDI
+		// output instead
+		const auto is_lazy = section->Get_string("mididevice_loading") == "lazy";
+		if (is_lazy && (device_choice == "fluidsynth" || device_choice == "mt32")) {
+			if (const auto handler = get_handler(device_choice); handler) {
+				midi.is_available    = true;
+				midi.pending_handler = handler;
+				midi.pending_config  = midiconfig_prefs;
+				LOG_MSG("MIDI: Opening device: %s on the first MIDI output",
+				        handler->GetName().data());
+				return;
+			}
+		}
+
 		if (device_choice == "auto") {
 			// Use the first working device
 			for (const auto& handler : handlers) {
@@ -660,10 +702,13 @@ public:
 			return;
 		}
 
-		assert(midi.handler);
-		midi.handler->Close();
-		midi.handler      = {};
-		midi.is_available = false;
+		// Never opened, if there wasn't any MIDI output
+		if (midi.handler) {
+			midi.handler->Close();
+		}
+		midi.handler         = {};
+		midi.pending_handler = {};
+		midi.is_available    = false;
 
 		deregister_handlers();
 	}
@@ -807,6 +852,17 @@ void init_midi_dosbox_settings(Section_prop& secprop)
 	        "    may require a delay in order to prevent its buffer from overflowing.\n"
 	        "    In that case, add 'delaysysex' (e.g. 'midiconfig = 2 delaysysex').");
 
+	str_prop = secprop.Add_string("mididevice_loading", when_idle, "eager");
+	const char* loading_choices[] = {"eager", "lazy", nullptr};
+	str_prop->Set_values(loading_choices);
+	str_prop->Set_help(
+	        "When to load the built-in MIDI synthesizers ('eager' by default):\n"
+	        "  eager:  Load the MT-32 ROMs or the SoundFont at startup.\n"
+	        "  lazy:   Load them on the first MIDI output of a program instead, which\n"
+	        "          speeds up starting DOSBox. The program waits for the loading\n"
+	        "          then, and the synthesizer's mixer channel only appears once\n"
+	        "          it's loaded.");
+
 	str_prop = secprop.Add_string("mpu401", when_idle, "intelligent");
 	const char* mputypes[] = {"intelligent", "uart", "none", nullptr};
 	str_prop->Set_values(mputypes);
@@ -24,6 +24,7 @@
 
 #include <bitset>
 #include <cassert>
+#include <cstring>
 #include <deque>
 #include <numeric>
 #include <string>
@@ -95,6 +96,23 @@ static void init_fluid_dosbox_settings(Section_prop& secprop)
 	        "      same time. Whether this sounds good depends on the SoundFont and the\n"
 	        "      reverb settings being used.");
 
+	str_prop = secprop.Add_string("fsynth_sample_loading", when_idle, "eager");
+	str_prop->Set_values({"eager", "lazy"});
+	str_prop->Set_help(
+	        "When to load the SoundFont's samples into memory:\n"
+	        "  eager:  Load all samples when FluidSynth starts (default).\n"
+	        "  lazy:   Only load the samples of presets selected by the program, on first\n"
+	        "          use. This speeds up startup and reduces memory usage considerably\n"
+	        "          with large General MIDI SoundFonts.");
+
+	auto* bool_prop = secprop.Add_bool("fsynth_shared_soundfont", when_idle, false);
+	bool_prop->Set_help(
+	        "Read the SoundFont through a shared, read-only memory mapping (disabled by\n"
+	        "default). Concurrently running instances using the same SoundFont then read\n"
+	        "it from a single copy in the host's page cache instead of each streaming\n"
+	        "the file from disk. Combine with 'fsynth_sample_loading = lazy' to also avoid\n"
+	        "copying unused samples into each instance's memory.");
+
 	str_prop = secprop.Add_string("fsynth_filter", when_idle, "off");
 	assert(str_prop);
 	str_prop->Set_help(
@@ -214,6 +232,99 @@ static std_fs::path find_sf_file(const std::string& name)
 	return {};
 }
 
+// SoundFont file callbacks that serve FluidSynth's reads from a shared,
+// read-only memory mapping of the file
+struct MappedSoundFont {
+	std::unique_ptr<ReadOnlyFileMapping> mapping = {};
+	size_t pos = 0;
+};
+
+static bool prefetch_mapped_soundfonts = false;
+
+static void* mapped_sf_open(const char* filename)
+{
+	auto mapping = std::make_unique<ReadOnlyFileMapping>(filename);
+	if (!mapping->IsOpen()) {
+		// Let FluidSynth fall back to its default file loader
+		return nullptr;
+	}
+	if (prefetch_mapped_soundfonts) {
+		mapping->Prefetch();
+	}
+	return new MappedSoundFont{std::move(mapping)};
+}
+
+static int mapped_sf_read(void* buf, fluid_long_long_t count, void* handle)
+{
+	auto sf = static_cast<MappedSoundFont*>(handle);
+	assert(sf);
+	if (count < 0 || static_cast<size_t>(count) > sf->mapping->Size() - sf->pos) {
+		return FLUID_FAILED;
+	}
+	const auto num_bytes = static_cast<size_t>(count);
+	memcpy(buf, sf->mapping->Data() + sf->pos, num_bytes);
+	sf->pos += num_bytes;
+	return FLUID_OK;
+}
+
+static int mapped_sf_seek(void* handle, fluid_long_long_t offset, int origin)
+{
+	auto sf = static_cast<MappedSoundFont*>(handle);
+	assert(sf);
+
+	fluid_long_long_t base = 0;
+	switch (origin) {
+	case SEEK_SET: base = 0; break;
+	case SEEK_CUR: base = static_cast<fluid_long_long_t>(sf->pos); break;
+	case SEEK_END:
+		base = static_cast<fluid_long_long_t>(sf->mapping->Size());
+		break;
+	default: return FLUID_FAILED;
+	}
+	const auto new_pos = base + offset;
+	if (new_pos < 0 ||
+	    new_pos > static_cast<fluid_long_long_t>(sf->mapping->Size())) {
+		return FLUID_FAILED;
+	}
+	sf->pos = static_cast<size_t>(new_pos);
+	return FLUID_OK;
+}
+
+static fluid_long_long_t mapped_sf_tell(void* handle)
+{
+	auto sf = static_cast<MappedSoundFont*>(handle);
+	assert(sf);
+	return static_cast<fluid_long_long_t>(sf->pos);
+}
+
+static int mapped_sf_close(void* handle)
+{
+	delete static_cast<MappedSoundFont*>(handle);
+	return FLUID_OK;
+}
+
+// Registers a SoundFont loader that reads through the above mapping. It's
+// prepended to the synth's loader list, so it takes priority over the default
+// loader, which remains available as a fallback.
+static bool add_mapped_soundfont_loader(fluid_synth_t* synth,
+                                        fluid_settings_t* settings)
+{
+	auto loader = new_fluid_defsfloader(settings);
+	if (!loader) {
+		return false;
+	}
+	fluid_sfloader_set_callbacks(loader,
+	                             mapped_sf_open,
+	                             mapped_sf_read,
+	                             mapped_sf_seek,
+	                             mapped_sf_tell,
+	                             mapped_sf_close);
+
+	// The synth takes ownership of the loader
+	fluid_synth_add_sfloader(synth, loader);
+	return true;
+}
+
 static void log_unknown_midi_message(const std::vector<uint8_t>& msg)
 {
 	auto append_as_hex = [](const std::string& str, const uint8_t val) {
@@ -263,6 +374,14 @@ bool MidiHandlerFluidsynth::Open([[maybe_unused]] const char* conf)
 	                      "synth.sample-rate",
 	                      audio_frame_rate_hz);
 
+	// Lazy loading defers reading a preset's samples until a program
+	// change selects it, and unloads them once they're no longer in use
+	const bool lazy_sample_loading = (section->Get_string(
+	                                          "fsynth_sample_loading") == "lazy");
+	fluid_settings_setint(fluid_settings.get(),
+	                      "synth.dynamic-sample-loading",
+	                      lazy_sample_loading ? 1 : 0);
+
 	fsynth_ptr_t fluid_synth(new_fluid_synth(fluid_settings.get()),
 	                         delete_fluid_synth);
 	if (!fluid_synth) {
@@ -270,6 +389,18 @@ bool MidiHandlerFluidsynth::Open([[maybe_unused]] const char* conf)
 		return false;
 	}
 
+	if (section->Get_bool("fsynth_shared_soundfont")) {
+		// Eager loading reads every sample, so ask the host to pull the
+		// whole file into the page cache up-front
+		prefetch_mapped_soundfonts = !lazy_sample_loading;
+
+		if (!add_mapped_soundfont_loader(fluid_synth.get(),
+		                                 fluid_settings.get())) {
+			LOG_WARNING("FSYNTH: Failed to create the shared SoundFont "
+			            "loader, reading the SoundFont directly");
+		}
+	}
+
 	// Load the requested SoundFont or quit if none provided
 	auto [sf_filename, scale_by_percent] = parse_soundfont_pref(
 	        section->Get_string("soundfont"));
@@ -295,6 +426,10 @@ bool MidiHandlerFluidsynth::Open([[maybe_unused]] const char* conf)
 	fluid_synth_set_gain(fluid_synth.get(),
 	                     static_cast<float>(scale_by_percent) / 100.0f);
 
+	if (lazy_sample_loading) {
+		LOG_MSG("FSYNTH: Loading SoundFont samples on first use");
+	}
+
 	// Let the user know that the SoundFont was loaded
 	if (scale_by_percent == 100) {
 		LOG_MSG("FSYNTH: Using SoundFont '%s'", soundfont.c_str());
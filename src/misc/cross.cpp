@@ -306,6 +306,27 @@ void close_directory(dir_information* dirp) {
 	}
 }
 
+bool list_directory(const char* dirname, std::vector<DirectoryEntry>& entries)
+{
+	std::string pattern = dirname;
+	if (pattern.empty()) {
+		return false;
+	}
+	pattern += (pattern.back() == '\\') ? "*.*" : "\\*.*";
+
+	WIN32_FIND_DATA search_data;
+	const auto handle = FindFirstFile(pattern.c_str(), &search_data);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return path_exists(dirname);
+	}
+	do {
+		entries.push_back({search_data.cFileName,
+		                   (search_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0});
+	} while (FindNextFile(handle, &search_data));
+	FindClose(handle);
+	return true;
+}
+
 #else
 
 dir_information* open_directory(const char* dirname) {
@@ -366,6 +387,38 @@ void close_directory(dir_information* dirp) {
 	if (dirp) closedir(dirp->dir);
 }
 
+bool list_directory(const char* dirname, std::vector<DirectoryEntry>& entries)
+{
+	DIR* dir = opendir(dirname);
+	if (!dir) {
+		return false;
+	}
+	std::string path = dirname;
+	if (!path.empty() && path.back() != CROSS_FILESPLIT) {
+		path += CROSS_FILESPLIT;
+	}
+	const auto path_length = path.length();
+
+	while (const auto dentry = readdir(dir)) {
+		DirectoryEntry entry = {dentry->d_name, false};
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+		if (dentry->d_type == DT_DIR || dentry->d_type == DT_REG) {
+			entry.is_directory = (dentry->d_type == DT_DIR);
+			entries.push_back(std::move(entry));
+			continue;
+		}
+#endif
+		path.resize(path_length);
+		path += entry.name;
+		struct stat status;
+		entry.is_directory = stat(path.c_str(), &status) == 0 &&
+		                     S_ISDIR(status.st_mode);
+		entries.push_back(std::move(entry));
+	}
+	closedir(dir);
+	return true;
+}
+
 #endif
 
 // A helper for fopen that will fallback to read-only if read-write isn't possible.
@@ -29,6 +29,9 @@
 #include <optional>
 #include <sys/stat.h>
 #include <sys/types.h>
+#if defined(HAVE_MMAP)
+#include <sys/mman.h>
+#endif
 #include <unistd.h>
 
 #if defined(HAVE_SYS_XATTR_H)
@@ -120,6 +123,84 @@ int create_dir(const std_fs::path& path, uint32_t mode, uint32_t flags) noexcept
 	return err;
 }
 
+#if defined(HAVE_MMAP)
+
+ReadOnlyFileMapping::ReadOnlyFileMapping(const std_fs::path& path) noexcept
+{
+	const auto fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+	struct stat file_stat = {};
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+		close(fd);
+		return;
+	}
+	const auto file_size = static_cast<size_t>(file_stat.st_size);
+
+	// The mapping keeps its own reference to the file
+	auto mapped = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		return;
+	}
+	data = static_cast<const uint8_t*>(mapped);
+	size = file_size;
+}
+
+ReadOnlyFileMapping::~ReadOnlyFileMapping()
+{
+	if (data) {
+		munmap(const_cast<uint8_t*>(data), size);
+	}
+}
+
+void ReadOnlyFileMapping::Prefetch() const noexcept
+{
+	if (data) {
+		madvise(const_cast<uint8_t*>(data), size, MADV_WILLNEED);
+	}
+}
+
+bool map_file_over_memory(const std_fs::path& path, const uint64_t offset,
+                          void* address, const size_t size) noexcept
+{
+	const auto page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+	if (reinterpret_cast<uintptr_t>(address) % page_size ||
+	    size % page_size || offset % page_size) {
+		return false;
+	}
+	const auto fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	// MAP_FIXED atomically replaces the pages of the existing memory, and
+	// the mapping keeps its own reference to the file
+	const auto mapped = mmap(address,
+	                         size,
+	                         PROT_READ | PROT_WRITE,
+	                         MAP_PRIVATE | MAP_FIXED,
+	                         fd,
+	                         static_cast<off_t>(offset));
+	close(fd);
+	return mapped == address;
+}
+
+#else
+
+ReadOnlyFileMapping::ReadOnlyFileMapping(const std_fs::path&) noexcept {}
+
+ReadOnlyFileMapping::~ReadOnlyFileMapping() = default;
+
+void ReadOnlyFileMapping::Prefetch() const noexcept {}
+
+bool map_file_over_memory(const std_fs::path&, uint64_t, void*, size_t) noexcept
+{
+	return false;
+}
+
+#endif
+
 #if !defined(MACOSX)
 
 std_fs::path get_xdg_config_home() noexcept
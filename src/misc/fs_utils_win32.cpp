@@ -26,6 +26,7 @@
 #include <fcntl.h>
 #include <io.h>
 #include <sys/stat.h>
+#include <windows.h>
 
 #include "compiler.h"
 #include "dos_inc.h"
@@ -57,6 +58,61 @@ int create_dir(const std_fs::path& path, [[maybe_unused]] uint32_t mode,
 	return err;
 }
 
+ReadOnlyFileMapping::ReadOnlyFileMapping(const std_fs::path& path) noexcept
+{
+	const auto file = CreateFileW(path.c_str(),
+	                              GENERIC_READ,
+	                              FILE_SHARE_READ,
+	                              nullptr,
+	                              OPEN_EXISTING,
+	                              FILE_ATTRIBUTE_NORMAL,
+	                              nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	LARGE_INTEGER file_size = {};
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0) {
+		CloseHandle(file);
+		return;
+	}
+
+	// The mapping object keeps its own reference to the file
+	const auto mapping = CreateFileMappingW(
+	        file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping) {
+		return;
+	}
+	const auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(mapping);
+		return;
+	}
+	data   = static_cast<const uint8_t*>(view);
+	size   = static_cast<size_t>(file_size.QuadPart);
+	handle = mapping;
+}
+
+ReadOnlyFileMapping::~ReadOnlyFileMapping()
+{
+	if (data) {
+		UnmapViewOfFile(data);
+		CloseHandle(static_cast<HANDLE>(handle));
+	}
+}
+
+void ReadOnlyFileMapping::Prefetch() const noexcept
+{
+	// Windows 8+ has PrefetchVirtualMemory, but the page cache read-ahead
+	// on first access is sufficient on older targets.
+}
+
+bool map_file_over_memory(const std_fs::path&, uint64_t, void*, size_t) noexcept
+{
+	// Windows can't place a file view over memory that's already allocated
+	return false;
+}
+
 // ***************************************************************************
 // Local drive file/directory attribute handling
 // ***************************************************************************
@@ -0,0 +1,278 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "huge_pages.h"
+
+#include "dosbox.h"
+
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+#if defined(HAVE_MMAP)
+#include <sys/mman.h>
+#endif
+
+static HugePageMode huge_page_mode = HugePageMode::Transparent;
+
+struct Allocation {
+	size_t num_bytes        = 0;
+	HugePageBacking backing = HugePageBacking::None;
+};
+
+// Never destroyed, as the containers using the allocations can be static
+// objects of other translation units that get destroyed later
+static std::map<const void*, Allocation>& allocations = *new std::map<const void*, Allocation>();
+static std::mutex& allocations_mutex = *new std::mutex();
+
+void HUGEPAGES_SetMode(const std::string& mode)
+{
+	if (mode == "explicit") {
+		huge_page_mode = HugePageMode::Explicit;
+	} else if (mode == "transparent") {
+		huge_page_mode = HugePageMode::Transparent;
+	} else {
+		huge_page_mode = HugePageMode::Off;
+	}
+}
+
+HugePageMode HUGEPAGES_GetMode()
+{
+	return huge_page_mode;
+}
+
+const char* HUGEPAGES_ToString(const HugePageBacking backing)
+{
+	switch (backing) {
+	case HugePageBacking::Explicit: return "explicit huge pages";
+	case HugePageBacking::Transparent: return "transparent huge pages";
+	case HugePageBacking::None: break;
+	}
+	return "regular pages";
+}
+
+static size_t round_up(const size_t num_bytes, const size_t alignment)
+{
+	return (num_bytes + alignment - 1) / alignment * alignment;
+}
+
+#if defined(HAVE_MMAP)
+
+// The kernel accepts the advice even when transparent huge pages are
+// disabled, so check the setting to not report them as used
+static bool transparent_huge_pages_enabled()
+{
+	static const auto is_enabled = [] {
+		std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+		std::string setting = {};
+		std::getline(file, setting);
+		return file && setting.find("[never]") == std::string::npos;
+	}();
+	return is_enabled;
+}
+
+static bool advise_transparent(void* ptr, const size_t num_bytes)
+{
+#if defined(MADV_HUGEPAGE)
+	return transparent_huge_pages_enabled() &&
+	       madvise(ptr, num_bytes, MADV_HUGEPAGE) == 0;
+#else
+	(void)ptr;
+	(void)num_bytes;
+	return false;
+#endif
+}
+
+static int get_protection(const bool executable)
+{
+	return PROT_READ | PROT_WRITE | (executable ? PROT_EXEC : 0);
+}
+
+static void* map_regular(const size_t num_bytes, const bool executable)
+{
+	int map_flags = MAP_PRIVATE | MAP_ANON;
+#if defined(HAVE_MAP_JIT)
+	if (executable) {
+		map_flags |= MAP_JIT;
+	}
+#endif
+	const auto ptr = mmap(nullptr, num_bytes, get_protection(executable), map_flags, -1, 0);
+	return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+// Fails unless the administrator reserved enough huge pages
+static void* map_explicit([[maybe_unused]] const size_t num_bytes,
+                          [[maybe_unused]] const bool executable)
+{
+#if defined(MAP_HUGETLB)
+	const auto ptr = mmap(nullptr,
+	                      num_bytes,
+	                      get_protection(executable),
+	                      MAP_PRIVATE | MAP_ANON | MAP_HUGETLB,
+	                      -1,
+	                      0);
+	return ptr == MAP_FAILED ? nullptr : ptr;
+#else
+	return nullptr;
+#endif
+}
+
+// The kernel only assembles huge pages from huge page-aligned ranges, so map
+// a huge page more and trim the unaligned head and tail
+static void* map_huge_page_aligned(const size_t num_bytes, const bool executable)
+{
+	assert(num_bytes % HugePageSize == 0);
+
+	const auto raw = static_cast<uint8_t*>(
+	        map_regular(num_bytes + HugePageSize, executable));
+	if (!raw) {
+		return nullptr;
+	}
+	const auto address    = reinterpret_cast<uintptr_t>(raw);
+	const auto head_bytes = round_up(address, HugePageSize) - address;
+	const auto tail_bytes = HugePageSize - head_bytes;
+	if (head_bytes) {
+		munmap(raw, head_bytes);
+	}
+	if (tail_bytes) {
+		munmap(raw + head_bytes + num_bytes, tail_bytes);
+	}
+	return raw + head_bytes;
+}
+
+static void* allocate(const size_t num_bytes, const bool executable,
+                      Allocation& allocation)
+{
+	const auto huge_bytes = round_up(num_bytes, HugePageSize);
+
+	// Explicit huge pages can't be protected 4K page by 4K page, as the
+	// dynamic cores do with their code when they flip it between
+	// writable and executable
+#if defined(C_PER_PAGE_W_OR_X)
+	const auto can_use_explicit = !executable;
+#else
+	const auto can_use_explicit = true;
+#endif
+	if (huge_page_mode == HugePageMode::Explicit && can_use_explicit) {
+		if (const auto ptr = map_explicit(huge_bytes, executable); ptr) {
+			allocation = {huge_bytes, HugePageBacking::Explicit};
+			return ptr;
+		}
+	}
+	if (huge_page_mode != HugePageMode::Off && transparent_huge_pages_enabled()) {
+		if (const auto ptr = map_huge_page_aligned(huge_bytes, executable); ptr) {
+			allocation = {huge_bytes,
+			              advise_transparent(ptr, huge_bytes)
+			                      ? HugePageBacking::Transparent
+			                      : HugePageBacking::None};
+			return ptr;
+		}
+	}
+	allocation = {num_bytes, HugePageBacking::None};
+	return map_regular(num_bytes, executable);
+}
+
+static void deallocate(void* ptr, const Allocation& allocation)
+{
+	munmap(ptr, allocation.num_bytes);
+}
+
+#else
+
+// Plain allocations on hosts without mmap; the dynamic cores allocate their
+// executable memory themselves there
+static constexpr std::align_val_t HostPageAlignment = std::align_val_t(4096);
+
+static bool advise_transparent(void*, size_t)
+{
+	return false;
+}
+
+static void* allocate(const size_t num_bytes, const bool executable,
+                      Allocation& allocation)
+{
+	if (executable) {
+		return nullptr;
+	}
+	allocation = {num_bytes, HugePageBacking::None};
+	return ::operator new(num_bytes, HostPageAlignment, std::nothrow);
+}
+
+static void deallocate(void* ptr, const Allocation&)
+{
+	::operator delete(ptr, HostPageAlignment);
+}
+
+#endif
+
+void* HUGEPAGES_Allocate(const size_t num_bytes, const bool executable)
+{
+	Allocation allocation = {};
+	const auto ptr        = allocate(num_bytes, executable, allocation);
+	if (ptr) {
+		std::lock_guard<std::mutex> lock(allocations_mutex);
+		allocations[ptr] = allocation;
+	}
+	return ptr;
+}
+
+void HUGEPAGES_Free(void* ptr)
+{
+	if (!ptr) {
+		return;
+	}
+	Allocation allocation = {};
+	{
+		std::lock_guard<std::mutex> lock(allocations_mutex);
+		const auto it = allocations.find(ptr);
+		assert(it != allocations.end());
+		if (it == allocations.end()) {
+			return;
+		}
+		allocation = it->second;
+		allocations.erase(it);
+	}
+	deallocate(ptr, allocation);
+}
+
+HugePageBacking HUGEPAGES_GetBacking(const void* ptr)
+{
+	std::lock_guard<std::mutex> lock(allocations_mutex);
+	const auto it = allocations.find(ptr);
+	return it != allocations.end() ? it->second.backing : HugePageBacking::None;
+}
+
+HugePageBacking HUGEPAGES_Advise(void* ptr, const size_t num_bytes)
+{
+	if (huge_page_mode == HugePageMode::Off) {
+		return HugePageBacking::None;
+	}
+	const auto start = round_up(reinterpret_cast<uintptr_t>(ptr), HugePageSize);
+	const auto end = (reinterpret_cast<uintptr_t>(ptr) + num_bytes) /
+	                 HugePageSize * HugePageSize;
+	if (end <= start) {
+		return HugePageBacking::None;
+	}
+	return advise_transparent(reinterpret_cast<void*>(start), end - start)
+	             ? HugePageBacking::Transparent
+	             : HugePageBacking::None;
+}
@@ -20,6 +20,8 @@
 
 #include "rwqueue.h"
 
+#include "../capture/avi_writer.h"
+#include "../capture/capture_video.h"
 #include "../capture/image/image_saver.h"
 
 #include <cassert>
@@ -254,3 +256,6 @@ template class RWQueue<MidiWork>;
 
 #include "render.h"
 template class RWQueue<SaveImageTask>;
+template class RWQueue<VideoCaptureTask>;
+
+template class RWQueue<AviWriteTask>;
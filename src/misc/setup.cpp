@@ -20,6 +20,7 @@
 #include "setup.h"
 
 #include <algorithm>
+#include <chrono>
 #include <climits>
 #include <cstdlib>
 #include <fstream>
@@ -1204,9 +1205,30 @@ Config::Config(Config&& source) noexcept
 
 void Config::Init() const
 {
+	if (!arguments.startup_trace) {
+		for (const auto& sec : sectionlist) {
+			sec->ExecuteInit();
+		}
+		return;
+	}
+
+	// Report how long each section took to initialise, to see what
+	// slows down the startup
+	using namespace std::chrono;
+	auto to_ms = [](const steady_clock::duration elapsed) {
+		return duration_cast<duration<double, std::milli>>(elapsed).count();
+	};
+
+	const auto init_start = steady_clock::now();
 	for (const auto& sec : sectionlist) {
+		const auto section_start = steady_clock::now();
 		sec->ExecuteInit();
+		LOG_MSG("STARTUP: Initialised [%s] in %.2f ms",
+		        sec->GetName(),
+		        to_ms(steady_clock::now() - section_start));
 	}
+	LOG_MSG("STARTUP: Initialised all sections in %.2f ms",
+	        to_ms(steady_clock::now() - init_start));
 }
 
 void Section::AddInitFunction(SectionFunction func, bool changeable_at_runtime)
@@ -1780,6 +1802,7 @@ void Config::ParseArguments()
 	arguments.exit        = cmdline->FindRemoveBoolArgument("exit");
 	arguments.securemode = cmdline->FindRemoveBoolArgument("securemode");
 	arguments.noautoexec = cmdline->FindRemoveBoolArgument("noautoexec");
+	arguments.startup_trace = cmdline->FindRemoveBoolArgument("startup-trace");
 
 	arguments.eraseconf = cmdline->FindRemoveBoolArgument("eraseconf") ||
 	                      cmdline->FindRemoveBoolArgument("resetconf");
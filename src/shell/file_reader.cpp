@@ -20,6 +20,26 @@
 
 #include "file_reader.h"
 
+#include "drives.h"
+
+// The host file behind a file on a local drive, whose edits on the host
+// don't go through DOS
+static std_fs::path get_host_path(const std::string& filename)
+{
+	char fullname[DOS_PATHLENGTH];
+	uint8_t drive = 0;
+	if (!DOS_MakeName(filename.c_str(), fullname, &drive)) {
+		return {};
+	}
+	const auto local_drive = dynamic_cast<localDrive*>(Drives.at(drive));
+	if (!local_drive) {
+		return {};
+	}
+	char host_name[CROSS_LEN];
+	local_drive->GetSystemFilename(host_name, fullname);
+	return host_name;
+}
+
 std::optional<std::unique_ptr<FileReader>> FileReader::GetFileReader(std::string_view file)
 {
 	auto reader = std::make_unique<FileReader>(file, PrivateOnly());
@@ -32,28 +52,81 @@ std::optional<std::unique_ptr<FileReader>> FileReader::GetFileReader(std::string
 FileReader::FileReader(std::string_view file, [[maybe_unused]] PrivateOnly key)
         : filename(file),
           valid(DOS_OpenFile(filename.c_str(), (DOS_NOT_INHERIT | OPEN_READ), &handle))
-{}
+{
+	if (valid) {
+		host_path = get_host_path(filename);
+		stamp     = GetStamp();
+		contents  = ReadContents();
+	}
+}
 
-std::optional<uint8_t> FileReader::Read()
+FileReader::Stamp FileReader::GetStamp() const
+{
+	Stamp current = {DOS_GetFileChangeCount(), {}};
+	if (!host_path.empty()) {
+		std::error_code ec = {};
+		current.host_time  = std_fs::last_write_time(host_path, ec);
+	}
+	return current;
+}
+
+std::vector<uint8_t> FileReader::ReadContents() const
 {
-	std::uint8_t data        = 0;
-	std::uint16_t bytes_read = 1;
+	uint32_t size = 0;
+	DOS_SeekFile(handle, &size, DOS_SEEK_END);
+	uint32_t cursor = 0;
+	DOS_SeekFile(handle, &cursor, DOS_SEEK_SET);
 
-	bool result = DOS_ReadFile(handle, &data, &bytes_read);
-	if (!result || bytes_read == 0) {
+	std::vector<uint8_t> data(size);
+	uint32_t bytes_read = size;
+	if (!DOS_ReadFileBulk(handle, data.data(), &bytes_read)) {
+		bytes_read = 0;
+	}
+	data.resize(bytes_read);
+	return data;
+}
+
+// Batch files can be changed while they run, with the reads going on from
+// the same position in the new version, so that's checked for line by line.
+// The file is only read again after a write through DOS or, on local drives,
+// a change of its modification time on the host; the contents then tell
+// whether it really changed.
+bool FileReader::HasChanged()
+{
+	const auto current = GetStamp();
+	if (current == stamp) {
+		return false;
+	}
+	stamp = current;
+
+	auto new_contents = ReadContents();
+	if (new_contents == contents) {
+		return false;
+	}
+	contents = std::move(new_contents);
+	return true;
+}
+std::optional<uint8_t> FileReader::Read()
+{
+	if (position >= contents.size()) {
 		return std::nullopt;
 	}
+	return contents[position++];
+}
 
-	return data;
+void FileReader::Seek(const size_t new_position)
+{
+	position = new_position;
 }
 
 void FileReader::Reset()
 {
-	std::uint32_t cursor = 0;
-	DOS_SeekFile(handle, &cursor, DOS_SEEK_SET);
+	position = 0;
 }
 
 FileReader::~FileReader()
 {
-	DOS_CloseFile(handle);
+	if (valid) {
+		DOS_CloseFile(handle);
+	}
 }
@@ -23,8 +23,10 @@
 
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "shell.h"
+#include "std_filesystem.h"
 
 class FileReader final : public ByteReader {
 private:
@@ -40,6 +42,8 @@ public:
 
 	void Reset() final;
 	[[nodiscard]] std::optional<uint8_t> Read() final;
+	void Seek(size_t position) final;
+	bool HasChanged() final;
 
 	FileReader(std::string_view filename, PrivateOnly key);
 	~FileReader() final;
@@ -50,9 +54,30 @@ public:
 	FileReader& operator=(FileReader&&)      = delete;
 
 private:
-	std::string filename = {};
-	uint16_t handle      = 0;
+	// Tells when the file may have changed
+	struct Stamp {
+		uint32_t dos_changes             = 0;
+		std_fs::file_time_type host_time = {};
+
+		bool operator==(const Stamp& other) const
+		{
+			return dos_changes == other.dos_changes &&
+			       host_time == other.host_time;
+		}
+	};
+
+	Stamp GetStamp() const;
+	std::vector<uint8_t> ReadContents() const;
+
+	std::string filename   = {};
+	std_fs::path host_path = {};
+	uint16_t handle        = 0;
 	bool valid;
+
+	// The whole file, read in at once instead of a byte at a time
+	std::vector<uint8_t> contents = {};
+	size_t position               = 0;
+	Stamp stamp                   = {};
 };
 
 #endif
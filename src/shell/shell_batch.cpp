@@ -28,6 +28,7 @@ constexpr uint8_t Esc           = 27;
 constexpr uint8_t UnitSeparator = 31;
 
 [[nodiscard]] static bool found_label(std::string_view line, std::string_view label);
+[[nodiscard]] static std::optional<std::string_view> get_label(std::string_view line);
 
 BatchFile::BatchFile(const HostShell& host, std::unique_ptr<ByteReader> input_reader,
                      const std::string_view entered_name,
@@ -40,6 +41,11 @@ BatchFile::BatchFile(const HostShell& host, std::unique_ptr<ByteReader> input_re
 
 bool BatchFile::ReadLine(char* lineout)
 {
+	// Jumps into the file as it was aren't valid anymore
+	if (reader->HasChanged()) {
+		has_label_index = false;
+	}
+
 	std::string line = {};
 	while (line.empty()) {
 		line = GetLine();
@@ -78,6 +84,7 @@ std::string BatchFile::GetLine()
 		}
 
 		data = *result;
+		++position;
 
 		/* Inclusion criteria:
 		 *  - backspace for alien odyssey
@@ -143,19 +150,60 @@ std::string BatchFile::ExpandedBatchLine(std::string_view line) const
 
 bool BatchFile::Goto(const std::string_view label)
 {
-	std::string line = " ";
-	reader->Reset();
+	if (reader->HasChanged() || !has_label_index) {
+		IndexLabels();
+	}
 
-	while (!line.empty()) {
-		line = GetLine();
-		if (found_label(line, label)) {
+	auto continue_at = [this](const size_t new_position) {
+		reader->Seek(new_position);
+		position = new_position;
+	};
+
+	// Labels with whitespace match whole lines, so those are compared
+	// line by line
+	if (label.find_first_of("\t\r\n ") == std::string_view::npos) {
+		std::string name(label);
+		upcase(name);
+		if (const auto it = label_positions.find(name);
+		    it != label_positions.end()) {
+			continue_at(it->second);
 			return true;
 		}
+	} else {
+		for (const auto& [line, line_end] : label_lines) {
+			if (found_label(line, label)) {
+				continue_at(line_end);
+				return true;
+			}
+		}
 	}
 
+	// Where the search through the whole file would have left off
+	continue_at(indexed_size);
 	return false;
 }
 
+// Reads through the whole file once to find the labels, instead of every
+// GOTO searching for its label from the top
+void BatchFile::IndexLabels()
+{
+	label_positions.clear();
+	label_lines.clear();
+
+	reader->Reset();
+	position = 0;
+	for (auto line = GetLine(); !line.empty(); line = GetLine()) {
+		if (const auto name = get_label(line); name) {
+			std::string key(*name);
+			upcase(key);
+			label_positions.emplace(std::move(key), position);
+			label_lines.emplace_back(std::move(line), position);
+		}
+	}
+	indexed_size    = position;
+	has_label_index = true;
+}
+
 void BatchFile::Shift()
 {
 	cmd.Shift(1);
@@ -181,6 +229,22 @@ static bool found_label(std::string_view line, const std::string_view label)
 	return iequals(line, label);
 }
 
+// The label of a label line, up to the first whitespace; it matches the
+// labels without whitespace the same way as found_label
+static std::optional<std::string_view> get_label(std::string_view line)
+{
+	const auto label_start  = line.find_first_not_of("=\t :");
+	const auto label_prefix = line.substr(0, label_start);
+
+	if (label_start == std::string::npos ||
+	    std::count(label_prefix.begin(), label_prefix.end(), ':') != 1) {
+		return {};
+	}
+
+	line = line.substr(label_start);
+	return line.substr(0, line.find_first_of("\t\r\n "));
+}
+
 void BatchFile::SetEcho(const bool echo_on)
 {
 	echo = echo_on;
@@ -1036,6 +1036,43 @@ struct copysource {
 	{}
 };
 
+enum class CopyResult { Success, ReadError, WriteError };
+
+// Copies the rest of the source file to the target. The source is read in
+// large blocks, in one go where the drive supports it.
+static CopyResult copy_file_contents(const uint16_t source_handle,
+                                     const uint16_t target_handle)
+{
+	constexpr uint32_t BufferSize   = 1024 * 1024;
+	constexpr uint32_t MaxWriteSize  = 0xf000;
+	static std::vector<uint8_t> buffer(BufferSize);
+
+	uint32_t bytes_read = 0;
+	do {
+		bytes_read = BufferSize;
+		if (!DOS_ReadFileBulk(source_handle, buffer.data(), &bytes_read)) {
+			return CopyResult::ReadError;
+		}
+		// Also writes once for an empty read, which keeps the behaviour
+		// of the DOS calls copying a device or an empty file
+		uint32_t bytes_written = 0;
+		do {
+			const auto requested = static_cast<uint16_t>(
+			        std::min(bytes_read - bytes_written, MaxWriteSize));
+			auto num_written = requested;
+			if (!DOS_WriteFile(target_handle,
+			                   buffer.data() + bytes_written,
+			                   &num_written) ||
+			    num_written != requested) {
+				return CopyResult::WriteError;
+			}
+			bytes_written += num_written;
+		} while (bytes_written < bytes_read);
+	} while (bytes_read == BufferSize);
+
+	return CopyResult::Success;
+}
+
 void DOS_Shell::CMD_COPY(char* args)
 {
 	HELP("COPY");
@@ -1208,13 +1245,10 @@ void DOS_Shell::CMD_COPY(char* args)
 						if (!oldsource.concat || (DOS_OpenFile(nameTarget,OPEN_READWRITE,&targetHandle) &&
 					        	                  DOS_SeekFile(targetHandle,&dummy,DOS_SEEK_END))) {
 							// Copy
-							static uint8_t buffer[0x8000]; // static, otherwise stack overflow possible.
-							uint16_t toread = 0x8000;
-							do {
-								DOS_ReadFile(sourceHandle, buffer, &toread);
-								DOS_WriteFile(targetHandle, buffer, &toread);
-							} while (toread == 0x8000);
-							if (!oldsource.concat) {
+							const auto result = copy_file_contents(
+							        sourceHandle, targetHandle);
+							if (result == CopyResult::Success &&
+							    !oldsource.concat) {
 								DOS_GetFileDate(
 								        sourceHandle,
 								        &search_result
@@ -1230,10 +1264,18 @@ void DOS_Shell::CMD_COPY(char* args)
 							}
 							DOS_CloseFile(sourceHandle);
 							DOS_CloseFile(targetHandle);
-							WriteOut(" %s\n",
-							         search_result
-							                 .name.c_str());
-							if (!source.concat && !special) count++; //Only count concat files once
+							if (result == CopyResult::ReadError) {
+								WriteOut(MSG_Get("SHELL_READ_ERROR"),
+								         nameSource);
+							} else if (result == CopyResult::WriteError) {
+								WriteOut(MSG_Get("SHELL_WRITE_ERROR"),
+								         nameTarget);
+							} else {
+								WriteOut(" %s\n",
+								         search_result
+								                 .name.c_str());
+								if (!source.concat && !special) count++; //Only count concat files once
+							}
 						} else {
 							DOS_CloseFile(sourceHandle);
 							WriteOut(MSG_Get("SHELL_CMD_COPY_FAILURE"),
@@ -1441,6 +1483,9 @@ void DOS_Shell::CMD_ATTRIB(char *args)
 	DOS_DTA dta(dos.dta());
 	all_dirs.clear();
 	all_dirs.emplace_back(std::string(args));
+	if (optS) {
+		DOS_PrefetchTree(args);
+	}
 	bool found = false;
 	while (!all_dirs.empty()) {
 		attributes attribs = {add_attr_a, add_attr_s, add_attr_h,
@@ -1451,6 +1496,7 @@ void DOS_Shell::CMD_ATTRIB(char *args)
 			found = true;
 		all_dirs.erase(all_dirs.begin());
 	}
+	DOS_StopPrefetching();
 	if (!found)
 		WriteOut(MSG_Get("SHELL_FILE_NOT_FOUND"), args);
 	dos.dta(save_dta);
@@ -2436,26 +2482,14 @@ void DOS_Shell::CMD_MOVE(char* args)
 				DOS_CloseFile(source_handle);
 				continue;
 			}
-			constexpr uint16_t buffer_capacity = 4096;
-			uint8_t buffer[buffer_capacity];
-			uint16_t bytes_requested = buffer_capacity;
-			bool success             = true;
-			do {
-				if (!DOS_ReadFile(source_handle, buffer, &bytes_requested)) {
-					WriteOut(MSG_Get("SHELL_READ_ERROR"),
-					         source.c_str());
-					success = false;
-					break;
-				}
-				uint16_t bytes_read = bytes_requested;
-				if (!DOS_WriteFile(dest_handle, buffer, &bytes_requested) ||
-				    bytes_requested != bytes_read) {
-					WriteOut(MSG_Get("SHELL_WRITE_ERROR"),
-					         final_destination.c_str());
-					success = false;
-					break;
-				}
-			} while (bytes_requested == buffer_capacity);
+			const auto result = copy_file_contents(source_handle, dest_handle);
+			if (result == CopyResult::ReadError) {
+				WriteOut(MSG_Get("SHELL_READ_ERROR"), source.c_str());
+			} else if (result == CopyResult::WriteError) {
+				WriteOut(MSG_Get("SHELL_WRITE_ERROR"),
+				         final_destination.c_str());
+			}
+			const bool success = (result == CopyResult::Success);
 
 			if (success) {
 				WriteOut("%s => %s\n",
@@ -19,9 +19,21 @@
  */
 
 #include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <unordered_map>
 
+#include "../src/shell/file_reader.h"
+#include "cross.h"
+#include "dos_inc.h"
+#include "drives.h"
 #include "shell.h"
+#include "std_filesystem.h"
+
+#include "dosbox_test_fixture.h"
 
 class MockReader final : public ByteReader {
 public:
@@ -39,6 +51,23 @@ public:
 		++index;
 		return data;
 	}
+	void Seek(const size_t position) override
+	{
+		index = position;
+	}
+	bool HasChanged() override
+	{
+		const auto has_changed = changed;
+		changed                = false;
+		return has_changed;
+	}
+
+	// Like changing the file while it's read
+	void Replace(std::string&& str)
+	{
+		contents = std::move(str);
+		changed  = true;
+	}
 
 	explicit MockReader(std::string&& str) : contents(std::move(str)) {}
 
@@ -51,6 +80,7 @@ public:
 private:
 	std::string contents;
 	decltype(contents)::size_type index = 0;
+	bool changed                        = false;
 };
 
 class MockShell final : public HostShell {
@@ -216,3 +246,262 @@ TEST(BatchFileGoto, SkipLines)
 	batchfile.ReadLine(line);
 	ASSERT_STREQ(line, "after");
 }
+
+TEST(BatchFileGoto, FirstOfTheSameLabels)
+{
+	const auto shell = MockShell({});
+	auto batchfile   = BatchFile(shell,
+                                   std::make_unique<MockReader>(
+                                           ":label\nfirst\n:LABEL\nsecond"),
+                                   "",
+                                   "",
+                                   true);
+	char line[CMD_MAXLINE];
+
+	ASSERT_TRUE(batchfile.Goto("Label"));
+	batchfile.ReadLine(line);
+	ASSERT_STREQ(line, "first");
+
+	ASSERT_TRUE(batchfile.Goto("label"));
+	batchfile.ReadLine(line);
+	ASSERT_STREQ(line, "first");
+}
+
+TEST(BatchFileGoto, LabelWithTrailingText)
+{
+	const auto shell = MockShell({});
+	auto batchfile   = BatchFile(shell,
+                                   std::make_unique<MockReader>(
+                                           "before\n :label comment\r\nafter"),
+                                   "",
+                                   "",
+                                   true);
+	char line[CMD_MAXLINE];
+
+	ASSERT_TRUE(batchfile.Goto("label"));
+	batchfile.ReadLine(line);
+	ASSERT_STREQ(line, "after");
+
+	// Labels with spaces match the whole line
+	ASSERT_TRUE(batchfile.Goto("label comment\r\n"));
+	batchfile.ReadLine(line);
+	ASSERT_STREQ(line, "after");
+	ASSERT_FALSE(batchfile.Goto("label other"));
+}
+
+TEST(BatchFileGoto, LabelNotFoundReadsToTheEnd)
+{
+	const auto shell = MockShell({});
+	auto batchfile   = BatchFile(
+                shell, std::make_unique<MockReader>(":label\nline"), "", "", true);
+	char line[CMD_MAXLINE];
+
+	ASSERT_TRUE(batchfile.Goto("label"));
+	ASSERT_FALSE(batchfile.Goto("nolabel"));
+	ASSERT_FALSE(batchfile.ReadLine(line));
+}
+
+TEST(BatchFileGoto, ChangedFileIsIndexedAgain)
+{
+	const auto shell = MockShell({});
+	auto reader      = std::make_unique<MockReader>(":first\none\n:second\ntwo");
+	const auto mock_reader = reader.get();
+	auto batchfile = BatchFile(shell, std::move(reader), "", "", true);
+	char line[CMD_MAXLINE];
+
+	ASSERT_TRUE(batchfile.Goto("second"));
+	batchfile.ReadLine(line);
+	ASSERT_STREQ(line, "two");
+
+	mock_reader->Replace(":second\nnew two\n:first\nnew one");
+	ASSERT_TRUE(batchfile.Goto("second"));
+	batchfile.ReadLine(line);
+	ASSERT_STREQ(line, "new two");
+	ASSERT_TRUE(batchfile.Goto("first"));
+	batchfile.ReadLine(line);
+	ASSERT_STREQ(line, "new one");
+}
+
+// A local directory mounted as drive D, holding the batch files
+class BatchFileLocalDriveTest : public DOSBoxTestFixture {
+protected:
+	void SetUp() override
+	{
+		DOSBoxTestFixture::SetUp();
+		root = std_fs::temp_directory_path() / "dosbox_batch_file_test";
+		std_fs::remove_all(root);
+		std_fs::create_directories(root);
+
+		const auto path = root.string() + CROSS_FILESPLIT;
+		drive = std::make_unique<localDrive>(path.c_str(), 512, 32, 32765, 16000, 0xF8);
+		Drives.at(DriveIndex) = drive.get();
+	}
+
+	void TearDown() override
+	{
+		Drives.at(DriveIndex) = nullptr;
+		drive.reset();
+		std::error_code ec = {};
+		std_fs::remove_all(root, ec);
+		DOSBoxTestFixture::TearDown();
+	}
+
+	void CreateFile(const char* name, const std::string& contents)
+	{
+		std::ofstream file((root / name).string(), std::ios::binary);
+		file << contents;
+	}
+
+	static std::string ReadAll(ByteReader& reader)
+	{
+		std::string result = {};
+		while (const auto data = reader.Read()) {
+			result += static_cast<char>(*data);
+		}
+		return result;
+	}
+
+	static constexpr uint8_t DriveIndex = 3;
+
+	std_fs::path root                 = {};
+	std::unique_ptr<localDrive> drive = {};
+};
+
+TEST_F(BatchFileLocalDriveTest, FileReaderReadsTheWholeFile)
+{
+	std::string contents = {};
+	for (auto i = 0; i < 10000; ++i) {
+		contents += "echo line " + std::to_string(i) + "\r\n";
+	}
+	CreateFile("LARGE.BAT", contents);
+
+	auto reader = FileReader::GetFileReader("D:\\LARGE.BAT");
+	ASSERT_TRUE(reader);
+	EXPECT_EQ(ReadAll(**reader), contents);
+
+	(*reader)->Reset();
+	EXPECT_EQ(ReadAll(**reader), contents);
+
+	EXPECT_FALSE(FileReader::GetFileReader("D:\\MISSING.BAT"));
+}
+
+TEST_F(BatchFileLocalDriveTest, FileReaderSeeks)
+{
+	CreateFile("SEEK.BAT", "0123456789");
+
+	auto reader = FileReader::GetFileReader("D:\\SEEK.BAT");
+	ASSERT_TRUE(reader);
+
+	(*reader)->Seek(7);
+	EXPECT_EQ(ReadAll(**reader), "789");
+	(*reader)->Seek(2);
+	EXPECT_EQ((*reader)->Read(), '2');
+	(*reader)->Seek(10);
+	EXPECT_FALSE((*reader)->Read());
+}
+
+TEST_F(BatchFileLocalDriveTest, FileReaderReloadsAfterAHostChange)
+{
+	CreateFile("HOST.BAT", "first\r\nline\r\n");
+
+	auto reader = FileReader::GetFileReader("D:\\HOST.BAT");
+	ASSERT_TRUE(reader);
+	EXPECT_FALSE((*reader)->HasChanged());
+	(*reader)->Seek(7);
+
+	// Same size and within the 2 seconds of the DOS file time
+	const auto path = root / "HOST.BAT";
+	const auto time = std_fs::last_write_time(path);
+	CreateFile("HOST.BAT", "first\r\nedit\r\n");
+	std_fs::last_write_time(path, time + std::chrono::milliseconds(1));
+
+	EXPECT_TRUE((*reader)->HasChanged());
+	EXPECT_FALSE((*reader)->HasChanged());
+	EXPECT_EQ(ReadAll(**reader), "edit\r\n");
+
+	// Only the time changed
+	std_fs::last_write_time(path, time + std::chrono::milliseconds(2));
+	EXPECT_FALSE((*reader)->HasChanged());
+}
+
+TEST_F(BatchFileLocalDriveTest, FileReaderReloadsAfterAWriteThroughDos)
+{
+	CreateFile("DOS.BAT", "first\r\nline\r\n");
+
+	auto reader = FileReader::GetFileReader("D:\\DOS.BAT");
+	ASSERT_TRUE(reader);
+
+	uint16_t handle = 0;
+	ASSERT_TRUE(DOS_OpenFile("D:\\DOS.BAT", OPEN_READWRITE, &handle));
+	uint32_t pos = 7;
+	ASSERT_TRUE(DOS_SeekFile(handle, &pos, DOS_SEEK_SET));
+	uint8_t edit[]  = {'e', 'd', 'i', 't'};
+	uint16_t amount = sizeof(edit);
+	ASSERT_TRUE(DOS_WriteFile(handle, edit, &amount));
+	DOS_CloseFile(handle);
+
+	EXPECT_TRUE((*reader)->HasChanged());
+	(*reader)->Seek(7);
+	EXPECT_EQ(ReadAll(**reader), "edit\r\n");
+
+	// Writing another file leaves this one as it was
+	CreateFile("OTHER.TXT", "");
+	ASSERT_TRUE(DOS_OpenFile("D:\\OTHER.TXT", OPEN_READWRITE, &handle));
+	ASSERT_TRUE(DOS_WriteFile(handle, edit, &amount));
+	DOS_CloseFile(handle);
+	EXPECT_FALSE((*reader)->HasChanged());
+}
+
+// Runs a generated batch file of 5000 lines in 50 sections, jumping back to
+// the start of each section 20 times before going on to the next one. It only
+// reports the timing; run it with --gtest_also_run_disabled_tests.
+TEST_F(BatchFileLocalDriveTest, DISABLED_GotoLoopsBenchmark)
+{
+	using namespace std::chrono;
+
+	constexpr auto num_sections      = 50;
+	constexpr auto lines_per_section = 100;
+	constexpr auto num_loops         = 20;
+
+	std::string contents = {};
+	for (auto section = 0; section < num_sections; ++section) {
+		contents += ":section" + std::to_string(section) + "\r\n";
+		for (auto i = 0; i < lines_per_section; ++i) {
+			contents += "echo Provisioning step " + std::to_string(i) + "\r\n";
+		}
+		contents += "goto section" + std::to_string(section) + "\r\n";
+	}
+
+	CreateFile("LOOPS.BAT", contents);
+	auto reader = FileReader::GetFileReader("D:\\LOOPS.BAT");
+	ASSERT_TRUE(reader);
+
+	const auto shell = MockShell({});
+	auto batchfile   = BatchFile(shell, std::move(*reader), "", "", true);
+
+	char line[CMD_MAXLINE];
+	auto num_lines = 0;
+	auto num_jumps = 0;
+	auto loop      = 0;
+
+	const auto start = steady_clock::now();
+	while (batchfile.ReadLine(line)) {
+		++num_lines;
+		if (strncmp(line, "goto ", 5) == 0) {
+			if (++loop < num_loops) {
+				ASSERT_TRUE(batchfile.Goto(line + 5));
+				++num_jumps;
+			} else {
+				loop = 0;
+			}
+		}
+	}
+	const auto elapsed = steady_clock::now() - start;
+
+	printf("[ BENCHMARK] Running %d batch lines with %d jumps: %.1f ms\n",
+	       num_lines,
+	       num_jumps,
+	       duration_cast<microseconds>(elapsed).count() / 1000.0);
+
+	EXPECT_EQ(num_lines, num_sections * num_loops * (lines_per_section + 1));
+}
@@ -0,0 +1,288 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "../src/dos/cdrom.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "byteorder.h"
+#include "control.h"
+#include "cross.h"
+#include "mem_host.h"
+#include "setup.h"
+#include "std_filesystem.h"
+
+#include "dosbox_test_fixture.h"
+
+constexpr uint32_t DataSectors  = 20;
+constexpr uint32_t AudioSectors = 10;
+
+// The audio track ends in a partial sector, so the reads of its last
+// sector run past the end of the image
+constexpr uint32_t AudioTailBytes = 1000;
+constexpr uint32_t AudioBytes     = AudioSectors * BYTES_PER_RAW_REDBOOK_FRAME +
+                                AudioTailBytes;
+
+// A read of a track and what it returned
+struct TrackRead {
+	bool success = false;
+	std::vector<uint8_t> data = {};
+
+	bool operator==(const TrackRead& other) const
+	{
+		return success == other.success && data == other.data;
+	}
+};
+
+class CdromImageTest : public DOSBoxTestFixture {
+protected:
+	void SetUp() override
+	{
+		DOSBoxTestFixture::SetUp();
+		image_dir = std_fs::temp_directory_path() / "cdrom_image_tests";
+		std_fs::create_directories(image_dir);
+	}
+
+	void TearDown() override
+	{
+		SetSharedImages(false);
+		std_fs::remove_all(image_dir);
+		DOSBoxTestFixture::TearDown();
+	}
+
+	static void SetSharedImages(const bool enabled)
+	{
+		const auto section = static_cast<Section_prop*>(
+		        control->GetSection("dosbox"));
+		section->HandleInputline(enabled ? "shared_cd_images=true"
+		                                 : "shared_cd_images=false");
+	}
+
+	std::string WriteFile(const std::string& name,
+	                      const std::vector<uint8_t>& contents) const
+	{
+		const auto path = image_dir / name;
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(contents.data()),
+		           static_cast<std::streamsize>(contents.size()));
+		return path.string();
+	}
+
+	static std::unique_ptr<CDROM_Interface_Image> Mount(const std::string& cue_path)
+	{
+		auto cd = std::make_unique<CDROM_Interface_Image>(0);
+		EXPECT_TRUE(cd->SetDevice(cue_path.c_str(), 0));
+		return cd;
+	}
+
+	static bool IsMapped(const CDROM_Interface_Image& cd, const size_t track_index)
+	{
+		const auto file = dynamic_cast<CDROM_Interface_Image::BinaryFile*>(
+		        cd.tracks.at(track_index).file.get());
+		return file && file->isMapped();
+	}
+
+	// Reads sector sized chunks from off the start of the track until
+	// one chunk past its end
+	static std::vector<TrackRead> ReadTrack(CDROM_Interface_Image& cd,
+	                                        const size_t track_index,
+	                                        const uint32_t num_bytes)
+	{
+		const auto& track = cd.tracks.at(track_index);
+
+		std::vector<TrackRead> reads = {};
+		for (uint32_t offset = 100; offset < num_bytes + BYTES_PER_RAW_REDBOOK_FRAME;
+		     offset += BYTES_PER_RAW_REDBOOK_FRAME) {
+			TrackRead read = {};
+			read.data.resize(BYTES_PER_RAW_REDBOOK_FRAME, 0xee);
+			read.success = track.file->read(read.data.data(),
+			                                track.skip + offset,
+			                                BYTES_PER_RAW_REDBOOK_FRAME);
+			reads.push_back(read);
+		}
+		return reads;
+	}
+
+	// Decodes the track from its start the way the CD player does, and
+	// returns the samples in the host's byte order
+	static std::vector<int16_t> DecodeTrack(CDROM_Interface_Image& cd,
+	                                        const size_t track_index)
+	{
+		const auto& track = cd.tracks.at(track_index);
+		if (!track.file->seek(track.skip)) {
+			return {};
+		}
+		track.file->setAudioPosition(track.skip);
+
+		constexpr uint32_t FramesPerChunk = 1000;
+		std::vector<int16_t> chunk(FramesPerChunk * REDBOOK_CHANNELS);
+		std::vector<int16_t> samples = {};
+		for (;;) {
+			const auto num_frames = track.file->decode(chunk.data(),
+			                                           FramesPerChunk);
+			if (num_frames == 0) {
+				break;
+			}
+			samples.insert(samples.end(),
+			               chunk.begin(),
+			               chunk.begin() + num_frames * REDBOOK_CHANNELS);
+		}
+		if (track.file->getEndian() != AUDIO_S16SYS) {
+			for (auto& sample : samples) {
+				sample = static_cast<int16_t>(
+				        bswap_u16(static_cast<uint16_t>(sample)));
+			}
+		}
+		return samples;
+	}
+
+	std_fs::path image_dir = {};
+};
+
+TEST_F(CdromImageTest, MappedReadsMatchFileReads)
+{
+	std::vector<uint8_t> image((DataSectors * BYTES_PER_RAW_REDBOOK_FRAME) +
+	                           AudioBytes);
+	for (size_t i = 0; i < image.size(); ++i) {
+		image[i] = static_cast<uint8_t>(i * 31 + (i >> 11));
+	}
+	WriteFile("image.bin", image);
+	const auto cue_path = WriteFile("image.cue", [] {
+		const std::string cue =
+		        "FILE \"image.bin\" BINARY\n"
+		        "  TRACK 01 MODE1/2352\n"
+		        "    INDEX 01 00:00:00\n"
+		        "  TRACK 02 AUDIO\n"
+		        "    INDEX 01 00:00:20\n";
+		return std::vector<uint8_t>(cue.begin(), cue.end());
+	}());
+
+	SetSharedImages(false);
+	auto cd = Mount(cue_path);
+	ASSERT_FALSE(IsMapped(*cd, 0));
+	const auto file_data   = ReadTrack(*cd, 0, DataSectors * BYTES_PER_RAW_REDBOOK_FRAME);
+	const auto file_audio  = ReadTrack(*cd, 1, AudioBytes);
+	const auto file_frames = DecodeTrack(*cd, 1);
+	cd.reset();
+
+	SetSharedImages(true);
+	cd = Mount(cue_path);
+	ASSERT_TRUE(IsMapped(*cd, 0));
+	EXPECT_EQ(ReadTrack(*cd, 0, DataSectors * BYTES_PER_RAW_REDBOOK_FRAME),
+	          file_data);
+	EXPECT_EQ(ReadTrack(*cd, 1, AudioBytes), file_audio);
+	EXPECT_EQ(DecodeTrack(*cd, 1), file_frames);
+	cd.reset();
+
+	// The last read inside the track was cut off at the end of the image
+	ASSERT_EQ(file_audio.size(), AudioSectors + 2);
+	const auto& clipped_read = file_audio[AudioSectors];
+	EXPECT_TRUE(clipped_read.success);
+	EXPECT_EQ(clipped_read.data[AudioTailBytes - 100 - 1], image.back());
+	EXPECT_EQ(clipped_read.data[AudioTailBytes - 100], 0xee);
+
+	// All of the audio track was decoded, and nothing more
+	ASSERT_EQ(file_frames.size() * sizeof(int16_t), AudioBytes);
+	const auto audio_start = image.data() + DataSectors * BYTES_PER_RAW_REDBOOK_FRAME;
+	for (size_t i = 0; i < file_frames.size(); ++i) {
+		ASSERT_EQ(static_cast<uint16_t>(file_frames[i]),
+		          host_readw_at(audio_start, i));
+	}
+}
+
+TEST_F(CdromImageTest, DecodesCompressedTracksIntoTheSharedCache)
+{
+	// A CD quality WAVE file, which goes through the audio decoders
+	constexpr uint32_t NumFrames = 5000;
+	constexpr uint32_t DataBytes = NumFrames * BYTES_PER_REDBOOK_PCM_FRAME;
+
+	std::vector<uint8_t> wave(44 + DataBytes);
+	const auto write_tag = [&](const size_t offset, const char* tag) {
+		std::copy(tag, tag + 4, wave.begin() + offset);
+	};
+	write_tag(0, "RIFF");
+	host_writed(&wave[4], static_cast<uint32_t>(wave.size() - 8));
+	write_tag(8, "WAVE");
+	write_tag(12, "fmt ");
+	host_writed(&wave[16], 16);
+	host_writew(&wave[20], 1); // PCM
+	host_writew(&wave[22], REDBOOK_CHANNELS);
+	host_writed(&wave[24], REDBOOK_PCM_FRAMES_PER_SECOND);
+	host_writed(&wave[28], REDBOOK_PCM_FRAMES_PER_SECOND * BYTES_PER_REDBOOK_PCM_FRAME);
+	host_writew(&wave[32], BYTES_PER_REDBOOK_PCM_FRAME);
+	host_writew(&wave[34], 16);
+	write_tag(36, "data");
+	host_writed(&wave[40], DataBytes);
+	for (uint32_t i = 0; i < DataBytes / 2; ++i) {
+		host_writew_at(&wave[44], i, static_cast<uint16_t>(i * 257 + 3));
+	}
+	WriteFile("track.wav", wave);
+	const auto cue_path = WriteFile("audio.cue", [] {
+		const std::string cue =
+		        "FILE \"track.wav\" WAVE\n"
+		        "  TRACK 01 AUDIO\n"
+		        "    INDEX 01 00:00:00\n";
+		return std::vector<uint8_t>(cue.begin(), cue.end());
+	}());
+
+	const auto cache_dir = GetConfigDir() / "cdaudio";
+	const auto list_cache = [&] {
+		std::set<std_fs::path> files = {};
+		std::error_code ec = {};
+		for (const auto& entry : std_fs::directory_iterator(cache_dir, ec)) {
+			files.insert(entry.path());
+		}
+		return files;
+	};
+	const auto cached_before = list_cache();
+
+	SetSharedImages(false);
+	auto cd = Mount(cue_path);
+	ASSERT_FALSE(IsMapped(*cd, 0));
+	const auto decoded_frames = DecodeTrack(*cd, 0);
+	cd.reset();
+	EXPECT_EQ(decoded_frames.size(), NumFrames * REDBOOK_CHANNELS);
+	EXPECT_EQ(list_cache(), cached_before);
+
+	// The first mount decodes the track into the cache, the next one
+	// reads it from there
+	SetSharedImages(true);
+	for (auto i = 0; i < 2; ++i) {
+		cd = Mount(cue_path);
+		EXPECT_TRUE(IsMapped(*cd, 0));
+		EXPECT_EQ(DecodeTrack(*cd, 0), decoded_frames);
+		cd.reset();
+	}
+
+	const auto cached_after = list_cache();
+	EXPECT_EQ(cached_after.size(), cached_before.size() + 1);
+	for (const auto& path : cached_after) {
+		if (!cached_before.count(path)) {
+			std_fs::remove(path);
+		}
+	}
+}
@@ -0,0 +1,410 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cpu.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "callback.h"
+#include "mem.h"
+#include "regs.h"
+
+#include "../src/cpu/lazyflags.h"
+
+#include "dosbox_test_fixture.h"
+
+namespace {
+
+constexpr PhysPt CodeBase  = 0x20000;
+constexpr PhysPt DataBase  = 0x30000;
+constexpr PhysPt StackBase = 0x40000;
+
+// The code, data and stack segments, which are compared after every run
+constexpr PhysPt ComparedBase = CodeBase;
+constexpr size_t ComparedSize = 0x30000;
+
+struct MachineState {
+	uint32_t eax = 0;
+	uint32_t ebx = 0;
+	uint32_t ecx = 0;
+	uint32_t edx = 0;
+	uint32_t esi = 0;
+	uint32_t edi = 0;
+	uint32_t ebp = 0;
+	uint32_t esp = 0;
+	uint32_t eip = 0;
+	uint32_t flags = 0;
+	std::vector<uint8_t> memory = {};
+};
+
+void expect_same_state(const MachineState& cached, const MachineState& normal)
+{
+	EXPECT_EQ(cached.eax, normal.eax);
+	EXPECT_EQ(cached.ebx, normal.ebx);
+	EXPECT_EQ(cached.ecx, normal.ecx);
+	EXPECT_EQ(cached.edx, normal.edx);
+	EXPECT_EQ(cached.esi, normal.esi);
+	EXPECT_EQ(cached.edi, normal.edi);
+	EXPECT_EQ(cached.ebp, normal.ebp);
+	EXPECT_EQ(cached.esp, normal.esp);
+	EXPECT_EQ(cached.eip, normal.eip);
+	EXPECT_EQ(cached.flags, normal.flags);
+
+	ASSERT_EQ(cached.memory.size(), normal.memory.size());
+	for (size_t i = 0; i < normal.memory.size(); ++i) {
+		if (cached.memory[i] != normal.memory[i]) {
+			ADD_FAILURE() << "Memory differs at "
+			              << std::hex << ComparedBase + i;
+			break;
+		}
+	}
+}
+
+class CachedCoreTest : public DOSBoxTestFixture {
+protected:
+	using Core = Bits (*)();
+
+	// Starts the code from the beginning of its segment in real mode,
+	// with the same registers and memory contents for every run
+	void Reset(const std::vector<uint8_t>& code)
+	{
+		CPU_SET_CRX(0, 0);
+
+		std::vector<uint8_t> memory(ComparedSize);
+		for (size_t i = 0; i < memory.size(); ++i) {
+			memory[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+		}
+		std::fill_n(memory.begin(), DataBase - CodeBase, 0);
+		std::copy(code.begin(), code.end(), memory.begin());
+		MEM_BlockWrite(ComparedBase, memory.data(), memory.size());
+
+		SegSet16(cs, CodeBase / 16);
+		SegSet16(ds, DataBase / 16);
+		SegSet16(es, DataBase / 16 + 0x800);
+		SegSet16(ss, StackBase / 16);
+		reg_eax = 0x89abcdef;
+		reg_ebx = 0x1000;
+		reg_ecx = 0x2000;
+		reg_edx = 0x3000;
+		reg_esi = 0x4000;
+		reg_edi = 0x5000;
+		reg_ebp = 0x6000;
+		reg_esp = 0xfff0;
+		reg_eip = 0;
+		CPU_SetFlags(FLAG_CF | FLAG_ZF, FMASK_ALL);
+		lflags.type = t_UNKNOWN;
+	}
+
+	// Runs the code until the cycles are used up and returns the state
+	// it has left the machine in. A page fault hands the rest of the
+	// slice back to CPU_CycleLeft, like the PIC queue does.
+	MachineState Run(const Core core, const int cycles)
+	{
+		cpudecoder    = core;
+		CPU_Cycles    = cycles;
+		CPU_CycleLeft = 0;
+		for (;;) {
+			if (CPU_Cycles <= 0) {
+				if (CPU_CycleLeft <= 0) {
+					break;
+				}
+				CPU_Cycles    = CPU_CycleLeft;
+				CPU_CycleLeft = 0;
+			}
+			if (core() != CBRET_NONE) {
+				ADD_FAILURE() << "The core has left the code";
+				break;
+			}
+		}
+		FillFlags();
+
+		MachineState state = {};
+		state.eax   = reg_eax;
+		state.ebx   = reg_ebx;
+		state.ecx   = reg_ecx;
+		state.edx   = reg_edx;
+		state.esi   = reg_esi;
+		state.edi   = reg_edi;
+		state.ebp   = reg_ebp;
+		state.esp   = reg_esp;
+		state.eip   = reg_eip;
+		state.flags = reg_flags;
+		state.memory.resize(ComparedSize);
+		MEM_BlockRead(ComparedBase, state.memory.data(), ComparedSize);
+		return state;
+	}
+
+	// Runs the same code on the normal and the cached core. The code
+	// ends in an endless jump, so it stops at the same place on both
+	// cores as long as it's given enough cycles.
+	void ExpectSameAsNormalCore(const std::vector<uint8_t>& code,
+	                            const int cycles)
+	{
+		Reset(code);
+		const auto normal = Run(&CPU_Core_Normal_Run, cycles);
+		Reset(code);
+		const auto cached = Run(&CPU_Core_Cached_Run, cycles);
+		expect_same_state(cached, normal);
+	}
+};
+
+TEST_F(CachedCoreTest, RunsLikeTheNormalCore)
+{
+	// clang-format off
+	ExpectSameAsNormalCore({
+	        0xb8, 0x34, 0x12,                   // mov ax, 0x1234
+	        0xb9, 0x50, 0x00,                   // mov cx, 0x50
+	        0x31, 0xf6,                         // xor si, si
+	        0xbf, 0x00, 0x01,                   // mov di, 0x100
+	        0xbd, 0x00, 0x40,                   // mov bp, 0x4000
+	        // loop:
+	        0x01, 0xc8,                         // add ax, cx
+	        0x11, 0xc2,                         // adc dx, ax
+	        0x83, 0xeb, 0x05,                   // sub bx, 5
+	        0x31, 0xc5,                         // xor bp, ax
+	        0x09, 0x40, 0x10,                   // or [bx+si+0x10], ax
+	        0x81, 0x25, 0xf0, 0x0f,             // and word [di], 0xff0
+	        0x46,                               // inc si
+	        0x39, 0xc3,                         // cmp bx, ax
+	        0x1b, 0x52, 0x02,                   // sbb dx, [bp+si+2]
+	        0xa8, 0x01,                         // test al, 1
+	        0x8d, 0x78, 0x20,                   // lea di, [bx+si+0x20]
+	        0x0f, 0xb6, 0xda,                   // movzx bx, dl
+	        0x0f, 0xbe, 0xd8,                   // movsx bx, al
+	        0x66, 0x05, 0x78, 0x56, 0x34, 0x12, // add eax, 0x12345678
+	        0x66, 0x0f, 0xb7, 0xc9,             // movzx ecx, cx
+	        0x66, 0x25, 0xff, 0x0f, 0x00, 0x00, // and eax, 0xfff
+	        0x67, 0x66, 0x8b, 0x54, 0x88, 0x08, // mov edx, [eax+ecx*4+8]
+	        0x26, 0x66, 0x89, 0x94, 0x00, 0x02, // mov es:[si+0x200], edx
+	        0x2e, 0x8b, 0x1e, 0x04, 0x00,       // mov bx, cs:[4]
+	        0x36, 0x8b, 0x2f,                   // mov bp, ss:[bx]
+	        0x92,                               // xchg dx, ax
+	        0xc1, 0xe0, 0x03,                   // shl ax, 3
+	        0xd1, 0xda,                         // rcr dx, 1
+	        0xf7, 0xdb,                         // neg bx
+	        0x51,                               // push cx
+	        0xb9, 0x08, 0x00,                   // mov cx, 8
+	        0xf3, 0xab,                         // rep stosw
+	        0x59,                               // pop cx
+	        0x50,                               // push ax
+	        0x66, 0x52,                         // push edx
+	        0xe8, 0x0c, 0x00,                   // call function
+	        0x66, 0x5a,                         // pop edx
+	        0x58,                               // pop ax
+	        0x4a,                               // dec dx
+	        0x75, 0x02,                         // jnz skip
+	        0xf7, 0xd0,                         // not ax
+	        // skip:
+	        0xe2, 0x9c,                         // loop loop
+	        0xeb, 0xfe,                         // jmp $
+	        // function:
+	        0x0f, 0xaf, 0xc2,                   // imul ax, dx
+	        0x66, 0x11, 0xce,                   // adc esi, ecx
+	        0xc3},                              // ret
+	        4000);
+	// clang-format on
+}
+
+TEST_F(CachedCoreTest, DecodesModifiedCodeAgain)
+{
+	// clang-format off
+	ExpectSameAsNormalCore({
+	        0xb9, 0x0a, 0x00,                   // mov cx, 10
+	        0x31, 0xd2,                         // xor dx, dx
+	        0x31, 0xdb,                         // xor bx, bx
+	        // loop:
+	        0xb8, 0x00, 0x00,                   // mov ax, 0
+	        0x01, 0xc2,                         // add dx, ax
+	        0x2e, 0xff, 0x06, 0x08, 0x00,       // inc word cs:[8]
+	        0x43,                               // inc bx
+	        0x2e, 0xc6, 0x06, 0x11, 0x00, 0x4b, // mov byte cs:[0x11], 0x4b
+	        0x2e, 0xc6, 0x06, 0x1e, 0x00, 0x47, // mov byte cs:[0x1e], 0x47
+	        0x46,                               // inc si
+	        0x2e, 0xc6, 0x06, 0x1e, 0x00, 0x46, // mov byte cs:[0x1e], 0x46
+	        0xe2, 0xe0,                         // loop loop
+	        0xeb, 0xfe},                        // jmp $
+	        200);
+	// clang-format on
+
+	// The immediate changes on every pass, the increment of BX turns
+	// into a decrement after the first pass, and the increment of SI is
+	// replaced by an increment of DI right before it runs
+	EXPECT_EQ(reg_dx, 45);
+	EXPECT_EQ(reg_bx, 0xfff8);
+	EXPECT_EQ(reg_si, 0x4000);
+	EXPECT_EQ(reg_di, 0x5000 + 10);
+}
+
+TEST_F(CachedCoreTest, RestartsInstructionsAfterPageFaults)
+{
+	// Pages of the data segment that aren't present until the page
+	// fault handler maps them in
+	constexpr PhysPt PageDirectory = 0x60000;
+	constexpr PhysPt PageTable     = 0x61000;
+	constexpr uint32_t MissingPages[] = {0x31, 0x32, 0x33};
+
+	constexpr PhysPt FaultCounter = 0x4f000;
+	constexpr uint16_t HandlerOffset = 0x100;
+
+	// clang-format off
+	std::vector<uint8_t> code = {
+	        0xa1, 0x00, 0x10,                   // mov ax, [0x1000]
+	        0x05, 0x11, 0x11,                   // add ax, 0x1111
+	        0xa3, 0x02, 0x10,                   // mov [0x1002], ax
+	        0x83, 0x06, 0xfe, 0x1f, 0x03,       // add word [0x1ffe], 3
+	        0x8b, 0x1e, 0x00, 0x20,             // mov bx, [0x2000]
+	        0x66, 0x8b, 0x16, 0xfe, 0x2f,       // mov edx, [0x2ffe]
+	        0xeb, 0xfe};                        // jmp $
+
+	const std::vector<uint8_t> handler = {
+	        0x66, 0x50,                         // push eax
+	        0x1e,                               // push ds
+	        0xb8, 0x20, 0x00,                   // mov ax, flat data
+	        0x8e, 0xd8,                         // mov ds, ax
+	        0x67, 0x66, 0xff, 0x05,             // inc dword [FaultCounter]
+	        0x00, 0xf0, 0x04, 0x00,
+	        0x0f, 0x20, 0xd0,                   // mov eax, cr2
+	        0x66, 0xc1, 0xe8, 0x0c,             // shr eax, 12
+	        0x67, 0x66, 0x83, 0x0c, 0x85,       // or dword [PageTable+eax*4], 1
+	        0x00, 0x10, 0x06, 0x00, 0x01,
+	        0x0f, 0x20, 0xd8,                   // mov eax, cr3
+	        0x0f, 0x22, 0xd8,                   // mov cr3, eax
+	        0x1f,                               // pop ds
+	        0x66, 0x58,                         // pop eax
+	        0x83, 0xc4, 0x02,                   // add sp, 2
+	        0xcf};                              // iret
+	// clang-format on
+	code.resize(HandlerOffset);
+	code.insert(code.end(), handler.begin(), handler.end());
+
+	// 16-bit code, data and stack segments over the real mode ones, and
+	// a flat data segment for the handler to update the page table with
+	const auto write_descriptor = [](const PhysPt addr,
+	                                 const uint32_t base,
+	                                 const uint32_t limit,
+	                                 const uint8_t access,
+	                                 const uint8_t flags) {
+		mem_writew(addr, static_cast<uint16_t>(limit));
+		mem_writew(addr + 2, static_cast<uint16_t>(base));
+		mem_writeb(addr + 4, static_cast<uint8_t>(base >> 16));
+		mem_writeb(addr + 5, access);
+		mem_writeb(addr + 6, static_cast<uint8_t>(flags | (limit >> 16)));
+		mem_writeb(addr + 7, static_cast<uint8_t>(base >> 24));
+	};
+	constexpr PhysPt Gdt = 0x1000;
+	constexpr PhysPt Idt = 0x1100;
+
+	const auto enter_protected_mode = [&]() {
+		for (auto i = 0; i < 8; ++i) {
+			mem_writeb(Gdt + i, 0);
+		}
+		write_descriptor(Gdt + 0x08, CodeBase, 0xffff, 0x9a, 0x00);
+		write_descriptor(Gdt + 0x10, DataBase, 0xffff, 0x92, 0x00);
+		write_descriptor(Gdt + 0x18, StackBase, 0xffff, 0x92, 0x00);
+		write_descriptor(Gdt + 0x20, 0, 0xfffff, 0x92, 0x80);
+
+		// Only the page fault has a handler, an interrupt gate
+		for (auto i = 0; i < 0x100; ++i) {
+			mem_writeb(Idt + i, 0);
+		}
+		constexpr PhysPt PageFaultGate = Idt + EXCEPTION_PF * 8;
+		mem_writew(PageFaultGate, HandlerOffset);
+		mem_writew(PageFaultGate + 2, 0x08);
+		mem_writeb(PageFaultGate + 5, 0x86);
+
+		// Identity map the first 4 MB
+		mem_writed(PageDirectory, PageTable | 7);
+		for (uint32_t page = 0; page < 1024; ++page) {
+			mem_writed(PageTable + page * 4, (page << 12) | 7);
+		}
+		for (const auto page : MissingPages) {
+			mem_writed(PageTable + page * 4, (page << 12) | 6);
+		}
+		mem_writed(FaultCounter, 0);
+
+		CPU_LGDT(0x27, Gdt);
+		CPU_LIDT(0xff, Idt);
+		CPU_SET_CRX(3, PageDirectory);
+		CPU_SET_CRX(0, CR0_PROTECTION | CR0_PAGING);
+		CPU_JMP(false, 0x08, 0, 0);
+		CPU_SetSegGeneral(ds, 0x10);
+		CPU_SetSegGeneral(es, 0x10);
+		CPU_SetSegGeneral(ss, 0x18);
+		CPU_SetFlags(0, FMASK_ALL);
+		lflags.type = t_UNKNOWN;
+	};
+
+	Reset(code);
+	enter_protected_mode();
+	const auto normal = Run(&CPU_Core_Normal_Run, 1000);
+	EXPECT_EQ(mem_readd(FaultCounter), 3);
+
+	Reset(code);
+	enter_protected_mode();
+	const auto cached = Run(&CPU_Core_Cached_Run, 1000);
+	EXPECT_EQ(mem_readd(FaultCounter), 3);
+
+	CPU_SET_CRX(0, 0);
+	expect_same_state(cached, normal);
+}
+
+// Runs a loop of common instructions on both cores. Only reports the
+// timings; run it with --gtest_also_run_disabled_tests.
+TEST_F(CachedCoreTest, DISABLED_Benchmark)
+{
+	// clang-format off
+	const std::vector<uint8_t> code = {
+	        // loop:
+	        0x03, 0x04,                         // add ax, [si]
+	        0x83, 0xd2, 0x00,                   // adc dx, 0
+	        0x31, 0xc3,                         // xor bx, ax
+	        0x0f, 0xb6, 0xfb,                   // movzx di, bl
+	        0x46,                               // inc si
+	        0x81, 0xe6, 0xfe, 0x7f,             // and si, 0x7ffe
+	        0x50,                               // push ax
+	        0x59,                               // pop cx
+	        0x39, 0xca,                         // cmp dx, cx
+	        0x75, 0xeb,                         // jnz loop
+	        0xeb, 0xe9};                        // jmp loop
+	// clang-format on
+
+	constexpr auto Instructions = 20'000'000;
+
+	const auto time_core = [&](const Core core) {
+		Reset(code);
+		const auto start = std::chrono::steady_clock::now();
+		Run(core, Instructions);
+		const std::chrono::duration<double> elapsed =
+		        std::chrono::steady_clock::now() - start;
+		return Instructions / elapsed.count() / 1'000'000;
+	};
+	const auto normal_mips = time_core(&CPU_Core_Normal_Run);
+	const auto cached_mips = time_core(&CPU_Core_Cached_Run);
+
+	printf("[ BENCHMARK] Normal core: %.0f MIPS\n", normal_mips);
+	printf("[ BENCHMARK] Cached core: %.0f MIPS\n", cached_mips);
+}
+
+} // namespace
@@ -0,0 +1,299 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cpu.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include "callback.h"
+#include "fpu.h"
+#include "mem.h"
+#include "pic.h"
+#include "regs.h"
+
+#include "../src/cpu/lazyflags.h"
+
+#include "dosbox_test_fixture.h"
+
+#if C_DYNREC
+
+void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
+
+namespace {
+
+constexpr PhysPt CodeBase = 0x20000;
+constexpr PhysPt DataBase = 0x30000;
+
+// The data the code works on and stores its results to
+constexpr size_t DataSize = 0x100;
+
+struct FpuState {
+	int64_t regs[8]      = {};
+	FPU_Tag tags[8]      = {};
+	uint16_t sw          = 0;
+	uint32_t top         = 0;
+	std::vector<uint8_t> data = {};
+};
+
+void expect_same_state(const FpuState& dynrec, const FpuState& normal)
+{
+	// The registers are compared bit by bit, so NaNs compare too
+	for (auto i = 0; i < 8; ++i) {
+		EXPECT_EQ(dynrec.regs[i], normal.regs[i]) << "ST register " << i;
+		EXPECT_EQ(dynrec.tags[i], normal.tags[i]) << "Tag " << i;
+	}
+	EXPECT_EQ(dynrec.sw, normal.sw);
+	EXPECT_EQ(dynrec.top, normal.top);
+	EXPECT_EQ(dynrec.data, normal.data);
+}
+
+class DynrecCoreTest : public DOSBoxTestFixture {
+protected:
+	using Core = Bits (*)();
+
+	void SetUp() override
+	{
+		DOSBoxTestFixture::SetUp();
+		CPU_Core_Dynrec_Cache_Init(true);
+	}
+
+	// Starts the code from the beginning of its segment in real mode,
+	// with the same data and a clean FPU for every run
+	void Reset(const std::vector<uint8_t>& code, const std::vector<uint8_t>& data)
+	{
+		CPU_SET_CRX(0, 0);
+
+		MEM_BlockWrite(CodeBase, code.data(), code.size());
+		std::vector<uint8_t> memory(DataSize);
+		std::copy(data.begin(), data.end(), memory.begin());
+		MEM_BlockWrite(DataBase, memory.data(), memory.size());
+
+		fpu = {};
+
+		SegSet16(cs, CodeBase / 16);
+		SegSet16(ds, DataBase / 16);
+		reg_eip = 0;
+		CPU_SetFlags(0, FMASK_ALL);
+		lflags.type = t_UNKNOWN;
+	}
+
+	// Runs the code until the cycles are used up and returns the FPU
+	// state and the data it has left behind
+	FpuState Run(const Core core, const int cycles)
+	{
+		cpudecoder    = core;
+		CPU_Cycles    = cycles;
+		CPU_CycleLeft = 0;
+		while (CPU_Cycles > 0) {
+			if (core() != CBRET_NONE) {
+				ADD_FAILURE() << "The core has left the code";
+				break;
+			}
+		}
+
+		FpuState state = {};
+		for (auto i = 0; i < 8; ++i) {
+			state.regs[i] = fpu.regs[i].ll;
+			state.tags[i] = fpu.tags[i];
+		}
+		state.sw  = fpu.sw;
+		state.top = fpu.top;
+		state.data.resize(DataSize);
+		MEM_BlockRead(DataBase, state.data.data(), DataSize);
+		return state;
+	}
+
+	// Runs the same code on the normal and the dynamic core. The code
+	// ends in an endless jump, so it stops at the same place on both
+	// cores as long as it's given enough cycles.
+	void ExpectSameAsNormalCore(const std::vector<uint8_t>& code,
+	                            const std::vector<uint8_t>& data)
+	{
+		constexpr auto Cycles = 1000;
+
+		Reset(code, data);
+		const auto normal = Run(&CPU_Core_Normal_Run, Cycles);
+		Reset(code, data);
+		const auto dynrec = Run(&CPU_Core_Dynrec_Run, Cycles);
+		expect_same_state(dynrec, normal);
+	}
+};
+
+template <typename T>
+void put(std::vector<uint8_t>& data, const size_t offset, const T value)
+{
+	if (data.size() < offset + sizeof(T)) {
+		data.resize(offset + sizeof(T));
+	}
+	memcpy(data.data() + offset, &value, sizeof(T));
+}
+
+TEST_F(DynrecCoreTest, FpuArithmeticMatchesTheNormalCore)
+{
+	std::vector<uint8_t> data = {};
+	put(data, 0x00, 1.75);
+	put(data, 0x08, -2.5);
+	put(data, 0x10, 0.3);
+	put(data, 0x18, 1.5f);
+	put(data, 0x1c, int16_t(7));
+
+	// clang-format off
+	ExpectSameAsNormalCore({
+	        0xdb, 0xe3,                         // fninit
+	        0xdd, 0x06, 0x00, 0x00,             // fld qword [0x00]
+	        0xdd, 0x06, 0x08, 0x00,             // fld qword [0x08]
+	        0xd8, 0xc1,                         // fadd st, st1
+	        0xd8, 0xc9,                         // fmul st, st1
+	        0xd8, 0xe1,                         // fsub st, st1
+	        0xd8, 0xe9,                         // fsubr st, st1
+	        0xd8, 0xf1,                         // fdiv st, st1
+	        0xd8, 0xf9,                         // fdivr st, st1
+	        0xdc, 0x06, 0x10, 0x00,             // fadd qword [0x10]
+	        0xd8, 0x0e, 0x18, 0x00,             // fmul dword [0x18]
+	        0xde, 0x26, 0x1c, 0x00,             // fisub word [0x1c]
+	        0xd8, 0x2e, 0x18, 0x00,             // fsubr dword [0x18]
+	        0xdc, 0x36, 0x10, 0x00,             // fdiv qword [0x10]
+	        0xdc, 0x3e, 0x10, 0x00,             // fdivr qword [0x10]
+	        0xdc, 0xc1,                         // fadd st1, st
+	        0xdc, 0xc9,                         // fmul st1, st
+	        0xdc, 0xe1,                         // fsubr st1, st
+	        0xdc, 0xe9,                         // fsub st1, st
+	        0xdc, 0xf1,                         // fdivr st1, st
+	        0xdc, 0xf9,                         // fdiv st1, st
+	        0xdd, 0x1e, 0x20, 0x00,             // fstp qword [0x20]
+	        0xd9, 0xe1,                         // fabs
+	        0xd9, 0xfa,                         // fsqrt
+	        0xdd, 0x1e, 0x28, 0x00,             // fstp qword [0x28]
+	        0xdd, 0x06, 0x00, 0x00,             // fld qword [0x00]
+	        0xdd, 0x06, 0x08, 0x00,             // fld qword [0x08]
+	        0xde, 0xc1,                         // faddp st1, st
+	        0xdd, 0x06, 0x08, 0x00,             // fld qword [0x08]
+	        0xde, 0xc9,                         // fmulp st1, st
+	        0xdd, 0x06, 0x08, 0x00,             // fld qword [0x08]
+	        0xde, 0xe1,                         // fsubrp st1, st
+	        0xdd, 0x06, 0x08, 0x00,             // fld qword [0x08]
+	        0xde, 0xe9,                         // fsubp st1, st
+	        0xdd, 0x06, 0x08, 0x00,             // fld qword [0x08]
+	        0xde, 0xf1,                         // fdivrp st1, st
+	        0xdd, 0x06, 0x08, 0x00,             // fld qword [0x08]
+	        0xde, 0xf9,                         // fdivp st1, st
+	        0xdd, 0x1e, 0x30, 0x00,             // fstp qword [0x30]
+	        0xdd, 0x3e, 0x38, 0x00,             // fnstsw [0x38]
+	        0xeb, 0xfe},                        // jmp $
+	        data);
+	// clang-format on
+}
+
+TEST_F(DynrecCoreTest, FpuSpecialValuesMatchTheNormalCore)
+{
+	std::vector<uint8_t> data = {};
+	put(data, 0x00, 0.0);
+	put(data, 0x08, -2.5);
+	put(data, 0x10, -0.0);
+
+	// clang-format off
+	ExpectSameAsNormalCore({
+	        0xdb, 0xe3,                         // fninit
+	        0xdd, 0x06, 0x08, 0x00,             // fld qword [0x08]
+	        0xdd, 0x06, 0x00, 0x00,             // fld qword [0x00]
+	        0xd8, 0xf9,                         // fdivr st, st1
+	        0xdd, 0x1e, 0x20, 0x00,             // fstp qword [0x20]
+	        0xdd, 0x06, 0x00, 0x00,             // fld qword [0x00]
+	        0xdc, 0x36, 0x00, 0x00,             // fdiv qword [0x00]
+	        0xdd, 0x1e, 0x28, 0x00,             // fstp qword [0x28]
+	        0xd9, 0xfa,                         // fsqrt
+	        0xdd, 0x1e, 0x30, 0x00,             // fstp qword [0x30]
+	        0xdd, 0x06, 0x10, 0x00,             // fld qword [0x10]
+	        0xd9, 0xe1,                         // fabs
+	        0xdd, 0x1e, 0x38, 0x00,             // fstp qword [0x38]
+	        0xdd, 0x3e, 0x40, 0x00,             // fnstsw [0x40]
+	        0xeb, 0xfe},                        // jmp $
+	        data);
+	// clang-format on
+}
+
+// The cycle into the millisecond each event fired at
+std::vector<int32_t> event_cycles = {};
+
+void record_event(const uint32_t repeats)
+{
+	event_cycles.push_back(PIC_TickIndexND());
+	if (repeats) {
+		PIC_AddEvent(record_event, 0.07, repeats - 1);
+	}
+}
+
+class DynrecSchedulingTest : public DynrecCoreTest {
+protected:
+	// Runs a millisecond of code with events due throughout it, entering
+	// the core the way the main loop does, and returns the number of
+	// times the core was entered
+	int RunMillisecond(const bool dynamic_scheduling)
+	{
+		// Single instruction blocks, so the core stops right at the
+		// event deadlines
+		Reset({0xeb, 0xfe}, {}); // jmp $
+		event_cycles.clear();
+
+		CPU_DynamicScheduling = dynamic_scheduling;
+		cpudecoder            = &CPU_Core_Dynrec_Run;
+		CPU_CycleMax          = 10000;
+		CPU_CycleLeft         = CPU_CycleMax;
+		CPU_Cycles            = 0;
+
+		PIC_AddEvent(record_event, 0.05, 12);
+		PIC_AddEvent(record_event, 0.5);
+
+		auto entries = 0;
+		while (PIC_RunQueue()) {
+			++entries;
+			if (cpudecoder() != CBRET_NONE) {
+				ADD_FAILURE() << "The core has left the code";
+				break;
+			}
+		}
+		PIC_RemoveEvents(record_event);
+		return entries;
+	}
+};
+
+TEST_F(DynrecSchedulingTest, ServicesEventsInCoreWithTheSameTiming)
+{
+	RunMillisecond(false);
+	const auto main_loop_cycles = event_cycles;
+
+	const auto entries = RunMillisecond(true);
+	EXPECT_EQ(event_cycles, main_loop_cycles);
+	EXPECT_EQ(event_cycles.size(), 14u);
+
+#if !C_DEBUG
+	// The core kept running through all the events
+	EXPECT_EQ(entries, 1);
+#else
+	(void)entries;
+#endif
+}
+
+} // namespace
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cpu_profiling.h"
+
+#include <gtest/gtest.h>
+
+#if C_CPU_PROFILING
+
+#include <vector>
+
+#include "cpu.h"
+#include "mem.h"
+#include "regs.h"
+
+#include "dosbox_test_fixture.h"
+
+namespace {
+
+class CpuProfilingTest : public DOSBoxTestFixture {
+protected:
+	// Runs the code on the normal core, one cycle per instruction
+	void Run(const std::vector<uint8_t>& code, const int num_instructions)
+	{
+		constexpr uint16_t code_segment = 0x2000;
+		for (size_t i = 0; i < code.size(); ++i) {
+			mem_writeb(static_cast<PhysPt>(code_segment * 16 + i), code[i]);
+		}
+		SegSet16(cs, code_segment);
+		reg_eip = 0;
+
+		cpu_profile_counters.fill(0);
+		CPU_Cycles = num_instructions;
+		CPU_Core_Normal_Run();
+	}
+
+	uint64_t Count(const CpuProfileCounter counter) const
+	{
+		return cpu_profile_counters[static_cast<size_t>(counter)];
+	}
+};
+
+TEST_F(CpuProfilingTest, CountsTwoByteOpcodesOnce)
+{
+	Run({0x0f, 0xb6, 0xc3,        // MOVZX AX, BL
+	     0x66, 0x0f, 0xb6, 0xc3,  // MOVZX EAX, BL
+	     0x0f, 0xbe, 0xc3,        // MOVSX AX, BL
+	     0x01, 0xd8,              // ADD AX, BX
+	     0x0f, 0x84, 0x00, 0x00}, // JZ +0
+	    5);
+
+	EXPECT_EQ(Count(CpuProfileCounter::DataTransfer), 3u);
+	EXPECT_EQ(Count(CpuProfileCounter::Alu), 1u);
+	EXPECT_EQ(Count(CpuProfileCounter::Branch), 1u);
+	EXPECT_EQ(Count(CpuProfileCounter::Other), 0u);
+}
+
+TEST_F(CpuProfilingTest, DoesNotCountPrefixes)
+{
+	reg_ecx = 0;
+	Run({0x2e, 0x8b, 0x07, // MOV AX, CS:[BX]
+	     0x66, 0x40,       // INC EAX
+	     0xf3, 0xaa},      // REP STOSB with CX = 0
+	    3);
+
+	EXPECT_EQ(Count(CpuProfileCounter::DataTransfer), 1u);
+	EXPECT_EQ(Count(CpuProfileCounter::Alu), 1u);
+	EXPECT_EQ(Count(CpuProfileCounter::String), 1u);
+}
+
+} // namespace
+
+#endif // C_CPU_PROFILING
@@ -37,14 +37,21 @@
 
 #include "dos_inc.h"
 
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iterator>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include "control.h"
 #include "dos_system.h"
 #include "drives.h"
+#include "mem_host.h"
 #include "shell.h"
 #include "string_utils.h"
 
@@ -360,4 +367,491 @@ TEST_F(DOS_FilesTest, VFILE_Register)
 	EXPECT_TRUE(DOS_FindFirst("Z:\\TEST\\FILENA~3.TXT", 0, false));
 }
 
+std::vector<uint8_t> make_test_data(const size_t size)
+{
+	std::vector<uint8_t> data(size);
+	for (size_t i = 0; i < size; ++i) {
+		data[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+	}
+	return data;
+}
+
+TEST_F(DOS_FilesTest, DOS_ReadFileToMemory_Across_Pages)
+{
+	const auto data = make_test_data(20000);
+	VFILE_Register("DATA.BIN", data);
+
+	uint16_t handle = 0;
+	ASSERT_TRUE(DOS_OpenFile("Z:\\DATA.BIN", OPEN_READ, &handle));
+
+	// Starts mid-page and spans several pages
+	constexpr PhysPt address = 0x20000 - 100;
+	uint16_t amount          = 12000;
+	ASSERT_TRUE(DOS_ReadFileToMemory(handle, address, &amount));
+	EXPECT_EQ(amount, 12000);
+	for (PhysPt i = 0; i < amount; ++i) {
+		ASSERT_EQ(mem_readb(address + i), data[i]) << i;
+	}
+
+	// Stops short at the end of the file
+	amount = 12000;
+	ASSERT_TRUE(DOS_ReadFileToMemory(handle, address, &amount));
+	EXPECT_EQ(amount, 8000);
+	for (PhysPt i = 0; i < amount; ++i) {
+		ASSERT_EQ(mem_readb(address + i), data[12000 + i]) << i;
+	}
+
+	DOS_CloseFile(handle);
+}
+
+TEST_F(DOS_FilesTest, DOS_ReadFileToMemory_Into_Video_Memory)
+{
+	const auto data = make_test_data(6000);
+	VFILE_Register("VIDEO.BIN", data);
+
+	uint16_t handle = 0;
+	ASSERT_TRUE(DOS_OpenFile("Z:\\VIDEO.BIN", OPEN_READ, &handle));
+
+	// A span of the text mode memory crossing page boundaries, which
+	// goes through the VGA handlers instead of straight to host memory
+	constexpr PhysPt address = 0xb8000 + 3000;
+	uint16_t amount          = 6000;
+	ASSERT_TRUE(DOS_ReadFileToMemory(handle, address, &amount));
+	EXPECT_EQ(amount, 6000);
+	for (PhysPt i = 0; i < amount; ++i) {
+		ASSERT_EQ(mem_readb(address + i), data[i]) << i;
+	}
+
+	DOS_CloseFile(handle);
+}
+
+TEST_F(DOS_FilesTest, DOS_ReadFileToMemory_Invalid_Handle)
+{
+	uint16_t amount = 10;
+	EXPECT_FALSE(DOS_ReadFileToMemory(0xfe, 0x20000, &amount));
+	EXPECT_FALSE(DOS_WriteFileFromMemory(0xfe, 0x20000, &amount));
+}
+
+TEST_F(DOS_FilesTest, DOS_ReadFileBulk_Beyond_64K)
+{
+	const auto data = make_test_data(200000);
+	VFILE_Register("BULK.BIN", data);
+
+	uint16_t handle = 0;
+	ASSERT_TRUE(DOS_OpenFile("Z:\\BULK.BIN", OPEN_READ, &handle));
+
+	std::vector<uint8_t> buffer(150000);
+	uint32_t amount = 150000;
+	ASSERT_TRUE(DOS_ReadFileBulk(handle, buffer.data(), &amount));
+	EXPECT_EQ(amount, 150000u);
+	EXPECT_TRUE(std::equal(buffer.begin(), buffer.end(), data.begin()));
+
+	// Stops short at the end of the file
+	amount = 150000;
+	ASSERT_TRUE(DOS_ReadFileBulk(handle, buffer.data(), &amount));
+	EXPECT_EQ(amount, 50000u);
+	EXPECT_TRUE(std::equal(buffer.begin(), buffer.begin() + 50000, data.begin() + 150000));
+
+	DOS_CloseFile(handle);
+
+	EXPECT_FALSE(DOS_ReadFileBulk(handle, buffer.data(), &amount));
+}
+
+// A local directory mounted as drive D
+class DOS_FilesLocalDriveTest : public DOSBoxTestFixture {
+protected:
+	void SetUp() override
+	{
+		DOSBoxTestFixture::SetUp();
+		root = std_fs::temp_directory_path() / "dosbox_dos_files_test";
+		std_fs::remove_all(root);
+		std_fs::create_directories(root);
+
+		const auto path = root.string() + CROSS_FILESPLIT;
+		drive = std::make_unique<localDrive>(path.c_str(), 512, 32, 32765, 16000, 0xF8);
+		Drives.at(DriveIndex) = drive.get();
+	}
+
+	void TearDown() override
+	{
+		Drives.at(DriveIndex) = nullptr;
+		drive.reset();
+		std::error_code ec = {};
+		std_fs::remove_all(root, ec);
+		DOSBoxTestFixture::TearDown();
+	}
+
+	void CreateFile(const char* name, const std::vector<uint8_t>& data)
+	{
+		std::ofstream file((root / name).string(), std::ios::binary);
+		file.write(reinterpret_cast<const char*>(data.data()),
+		           static_cast<std::streamsize>(data.size()));
+	}
+
+	static constexpr uint8_t DriveIndex = 3;
+
+	std_fs::path root                 = {};
+	std::unique_ptr<localDrive> drive = {};
+};
+
+TEST_F(DOS_FilesLocalDriveTest, DOS_ReadFileBulk_Local_File)
+{
+	const auto data = make_test_data(300000);
+	CreateFile("LOCAL.BIN", data);
+
+	uint16_t handle = 0;
+	ASSERT_TRUE(DOS_OpenFile("D:\\LOCAL.BIN", OPEN_READ, &handle));
+
+	uint32_t pos = 1000;
+	ASSERT_TRUE(DOS_SeekFile(handle, &pos, DOS_SEEK_SET));
+
+	std::vector<uint8_t> buffer(data.size());
+	uint32_t amount = static_cast<uint32_t>(buffer.size());
+	ASSERT_TRUE(DOS_ReadFileBulk(handle, buffer.data(), &amount));
+	EXPECT_EQ(amount, data.size() - 1000);
+	EXPECT_TRUE(std::equal(data.begin() + 1000, data.end(), buffer.begin()));
+
+	DOS_CloseFile(handle);
+}
+
+// Reads the file in bulk from the given position, then the rest of it
+// through the DOS call, and returns what was read
+std::vector<uint8_t> read_bulk_then_rest(const char* name, uint32_t pos,
+                                         const uint32_t bulk_size)
+{
+	uint16_t handle = 0;
+	EXPECT_TRUE(DOS_OpenFile(name, OPEN_READ, &handle));
+	EXPECT_TRUE(DOS_SeekFile(handle, &pos, DOS_SEEK_SET));
+
+	std::vector<uint8_t> result(bulk_size);
+	uint32_t amount = bulk_size;
+	EXPECT_TRUE(DOS_ReadFileBulk(handle, result.data(), &amount));
+	result.resize(amount);
+
+	// The file position and the sector buffers are left consistent
+	std::vector<uint8_t> rest(1000);
+	uint16_t rest_amount = 0;
+	do {
+		rest_amount = static_cast<uint16_t>(rest.size());
+		EXPECT_TRUE(DOS_ReadFile(handle, rest.data(), &rest_amount));
+		result.insert(result.end(), rest.begin(), rest.begin() + rest_amount);
+	} while (rest_amount > 0);
+
+	DOS_CloseFile(handle);
+	return result;
+}
+
+// A 1.44 MB FAT12 floppy image with one sector per cluster
+class Fat12Floppy {
+public:
+	static constexpr uint32_t SectorSize     = 512;
+	static constexpr uint32_t FatSectors     = 9;
+	static constexpr uint32_t RootDirSector  = 1 + 2 * FatSectors;
+	static constexpr uint32_t FirstDataSector = RootDirSector + 14;
+
+	Fat12Floppy() : image(2880 * SectorSize)
+	{
+		const std::vector<uint8_t> boot_sector = {
+		        0xeb, 0x3c, 0x90, 'M', 'S', 'D', 'O', 'S', '5', '.', '0',
+		        0x00, 0x02, // bytes per sector
+		        0x01,       // sectors per cluster
+		        0x01, 0x00, // reserved sectors
+		        0x02,       // FAT copies
+		        0xe0, 0x00, // root directory entries
+		        0x40, 0x0b, // total sectors
+		        0xf0,       // media descriptor
+		        0x09, 0x00, // sectors per FAT
+		        0x12, 0x00, // sectors per track
+		        0x02, 0x00, // heads
+		};
+		std::copy(boot_sector.begin(), boot_sector.end(), image.begin());
+		image[510] = 0x55;
+		image[511] = 0xaa;
+
+		SetCluster(0, 0xff0);
+		SetCluster(1, 0xfff);
+	}
+
+	// Stores the data in the clusters in the given order; a file longer
+	// than its clusters ends its chain early
+	void AddFile(const char* name_83, const uint32_t length,
+	             const std::vector<uint16_t>& clusters,
+	             const std::vector<uint8_t>& data)
+	{
+		const auto entry = image.data() + RootDirSector * SectorSize +
+		                   num_files++ * 32;
+		memcpy(entry, name_83, 11);
+		host_writew(entry + 26, clusters.front());
+		host_writed(entry + 28, length);
+
+		for (size_t i = 0; i < clusters.size(); ++i) {
+			const auto next = i + 1 < clusters.size() ? clusters[i + 1] : 0xfff;
+			SetCluster(clusters[i], next);
+
+			const auto offset = i * SectorSize;
+			const auto size = std::min<size_t>(SectorSize, data.size() - offset);
+			std::copy(data.begin() + offset,
+			          data.begin() + offset + size,
+			          image.begin() + (FirstDataSector + clusters[i] - 2) * SectorSize);
+		}
+	}
+
+	void Save(const std_fs::path& path) const
+	{
+		std::ofstream file(path.string(), std::ios::binary);
+		file.write(reinterpret_cast<const char*>(image.data()),
+		           static_cast<std::streamsize>(image.size()));
+	}
+
+private:
+	void SetCluster(const uint32_t cluster, const uint16_t value)
+	{
+		for (uint32_t fat = 0; fat < 2; ++fat) {
+			const auto entry = image.data() + (1 + fat * FatSectors) * SectorSize +
+			                   cluster * 3 / 2;
+			auto packed = host_readw(entry);
+			if (cluster & 1) {
+				packed = static_cast<uint16_t>((packed & 0x000f) | (value << 4));
+			} else {
+				packed = static_cast<uint16_t>((packed & 0xf000) | value);
+			}
+			host_writew(entry, packed);
+		}
+	}
+
+	std::vector<uint8_t> image = {};
+	uint32_t num_files         = 0;
+};
+
+// A 2048 byte per sector ISO 9660 image with one file in its root directory
+std::vector<uint8_t> make_iso_image(const char* name, const std::vector<uint8_t>& data)
+{
+	constexpr uint32_t SectorSize    = 2048;
+	constexpr uint32_t RootDirSector = 18;
+	constexpr uint32_t FileSector    = 20;
+
+	const auto file_sectors = (static_cast<uint32_t>(data.size()) + SectorSize - 1) /
+	                          SectorSize;
+	std::vector<uint8_t> image((FileSector + file_sectors) * SectorSize);
+
+	auto write_both_endian = [](uint8_t* dest, const uint32_t value) {
+		host_writed(dest, value);
+		dest[4] = static_cast<uint8_t>(value >> 24);
+		dest[5] = static_cast<uint8_t>(value >> 16);
+		dest[6] = static_cast<uint8_t>(value >> 8);
+		dest[7] = static_cast<uint8_t>(value);
+	};
+	auto write_dir_entry = [&](uint8_t* entry, const uint32_t sector,
+	                           const uint32_t length, const uint8_t flags,
+	                           const std::string& ident) {
+		const auto entry_length = (33 + ident.size() + 1) & ~size_t(1);
+		entry[0] = static_cast<uint8_t>(entry_length);
+		write_both_endian(entry + 2, sector);
+		write_both_endian(entry + 10, length);
+		entry[25] = flags;
+		entry[32] = static_cast<uint8_t>(ident.size());
+		std::copy(ident.begin(), ident.end(), entry + 33);
+		return entry + entry_length;
+	};
+
+	// Primary and terminating volume descriptors
+	auto pvd = image.data() + 16 * SectorSize;
+	pvd[0] = 1;
+	memcpy(pvd + 1, "CD001", 5);
+	pvd[6] = 1;
+	memcpy(pvd + 40, "TEST", 4);
+	write_dir_entry(pvd + 156, RootDirSector, SectorSize, 0x02, std::string(1, '\0'));
+
+	auto terminator = image.data() + 17 * SectorSize;
+	terminator[0] = 0xff;
+	memcpy(terminator + 1, "CD001", 5);
+	terminator[6] = 1;
+
+	auto entry = image.data() + RootDirSector * SectorSize;
+	entry = write_dir_entry(entry, RootDirSector, SectorSize, 0x02, std::string(1, '\0'));
+	entry = write_dir_entry(entry, RootDirSector, SectorSize, 0x02, std::string(1, '\1'));
+	write_dir_entry(entry, FileSector, static_cast<uint32_t>(data.size()), 0,
+	                std::string(name) + ";1");
+
+	std::copy(data.begin(), data.end(), image.begin() + FileSector * SectorSize);
+	return image;
+}
+
+// A FAT floppy image mounted as drive D and an ISO image as drive E
+class DOS_FilesImageDriveTest : public DOSBoxTestFixture {
+protected:
+	void SetUp() override
+	{
+		DOSBoxTestFixture::SetUp();
+		root = std_fs::temp_directory_path() / "dosbox_dos_files_image_test";
+		std_fs::remove_all(root);
+		std_fs::create_directories(root);
+	}
+
+	void TearDown() override
+	{
+		Drives.at(FatDriveIndex) = nullptr;
+		fat_drive.reset();
+		if (iso_drive) {
+			Drives.at(IsoDriveIndex) = nullptr;
+			iso_drive->UnMount();
+			iso_drive.reset();
+		}
+		std::error_code ec = {};
+		std_fs::remove_all(root, ec);
+		DOSBoxTestFixture::TearDown();
+	}
+
+	void MountFat(const Fat12Floppy& floppy)
+	{
+		const auto path = (root / "floppy.img").string();
+		floppy.Save(path);
+		fat_drive = std::make_unique<fatDrive>(path.c_str(), 512, 18, 2, 80, 0, true);
+		ASSERT_TRUE(fat_drive->created_successfully);
+		Drives.at(FatDriveIndex) = fat_drive.get();
+	}
+
+	void MountIso(const std::vector<uint8_t>& image)
+	{
+		const auto path = (root / "cdrom.iso").string();
+		{
+			std::ofstream file(path, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(image.data()),
+			           static_cast<std::streamsize>(image.size()));
+		}
+		int error = 0;
+		iso_drive = std::make_unique<isoDrive>('E', path.c_str(), 0xf8, error);
+		ASSERT_EQ(error, 0);
+		Drives.at(IsoDriveIndex) = iso_drive.get();
+	}
+
+	static constexpr uint8_t FatDriveIndex = 3;
+	static constexpr uint8_t IsoDriveIndex = 4;
+
+	std_fs::path root                   = {};
+	std::unique_ptr<fatDrive> fat_drive = {};
+	std::unique_ptr<isoDrive> iso_drive = {};
+};
+
+TEST_F(DOS_FilesImageDriveTest, DOS_ReadFileBulk_Fat_File)
+{
+	// 8 full sectors and a partial one, in clusters spread over the disk
+	const auto data = make_test_data(8 * 512 + 300);
+	Fat12Floppy floppy = {};
+	floppy.AddFile("FAT     BIN", 8 * 512 + 300, {2, 3, 4, 10, 11, 5, 6, 20, 21}, data);
+	MountFat(floppy);
+
+	// Partial sectors at both ends of the bulk read, with whole sectors
+	// in between
+	auto result = read_bulk_then_rest("D:\\FAT.BIN", 100, 4000);
+	EXPECT_EQ(result, std::vector<uint8_t>(data.begin() + 100, data.end()));
+
+	// Sector aligned, up to the end of the file
+	result = read_bulk_then_rest("D:\\FAT.BIN", 512, 100000);
+	EXPECT_EQ(result, std::vector<uint8_t>(data.begin() + 512, data.end()));
+
+	// Within a single sector
+	result = read_bulk_then_rest("D:\\FAT.BIN", 1030, 10);
+	EXPECT_EQ(result, std::vector<uint8_t>(data.begin() + 1030, data.end()));
+}
+
+TEST_F(DOS_FilesImageDriveTest, DOS_ReadFileBulk_Fat_Chain_Ends_Before_Eof)
+{
+	const auto data = make_test_data(3 * 512);
+	Fat12Floppy floppy = {};
+	floppy.AddFile("SHORT   BIN", 3000, {30, 31, 32}, data);
+	MountFat(floppy);
+
+	uint16_t handle = 0;
+	ASSERT_TRUE(DOS_OpenFile("D:\\SHORT.BIN", OPEN_READ, &handle));
+
+	std::vector<uint8_t> buffer(3000);
+	uint32_t amount = 3000;
+	ASSERT_TRUE(DOS_ReadFileBulk(handle, buffer.data(), &amount));
+	EXPECT_EQ(amount, 3u * 512);
+	EXPECT_TRUE(std::equal(data.begin(), data.end(), buffer.begin()));
+
+	amount = 3000;
+	ASSERT_TRUE(DOS_ReadFileBulk(handle, buffer.data(), &amount));
+	EXPECT_EQ(amount, 0u);
+
+	DOS_CloseFile(handle);
+}
+
+TEST_F(DOS_FilesImageDriveTest, DOS_ReadFileBulk_Iso_File)
+{
+	// 3 full sectors and a partial one
+	const auto data = make_test_data(3 * 2048 + 1000);
+	MountIso(make_iso_image("ISO.BIN", data));
+
+	auto result = read_bulk_then_rest("E:\\ISO.BIN", 100, 5000);
+	EXPECT_EQ(result, std::vector<uint8_t>(data.begin() + 100, data.end()));
+
+	result = read_bulk_then_rest("E:\\ISO.BIN", 0, 100000);
+	EXPECT_EQ(result, data);
+
+	result = read_bulk_then_rest("E:\\ISO.BIN", 2100, 10);
+	EXPECT_EQ(result, std::vector<uint8_t>(data.begin() + 2100, data.end()));
+}
+
+// Copies a 1 GB file on a local drive, once in 64 KB pieces like a DOS
+// program does and once with bulk reads like the shell's COPY. Only
+// reports the timings; run it with --gtest_also_run_disabled_tests.
+TEST_F(DOS_FilesLocalDriveTest, DISABLED_CopyThroughputBenchmark)
+{
+	using namespace std::chrono;
+
+	constexpr uint32_t FileSize  = 1024 * 1024 * 1024;
+	constexpr uint32_t ChunkSize = 1024 * 1024;
+	{
+		const auto chunk = make_test_data(ChunkSize);
+		std::ofstream file((root / "SOURCE.BIN").string(), std::ios::binary);
+		for (uint32_t i = 0; i < FileSize / ChunkSize; ++i) {
+			file.write(reinterpret_cast<const char*>(chunk.data()), ChunkSize);
+		}
+	}
+
+	std::vector<uint8_t> buffer(ChunkSize);
+	auto time_copy = [&](const uint32_t read_size, auto&& read) {
+		uint16_t source = 0;
+		uint16_t target = 0;
+		EXPECT_TRUE(DOS_OpenFile("D:\\SOURCE.BIN", OPEN_READ, &source));
+		EXPECT_TRUE(DOS_CreateFile("D:\\TARGET.BIN", 0, &target));
+
+		const auto start = steady_clock::now();
+		uint64_t copied  = 0;
+		uint32_t amount  = 0;
+		do {
+			amount = read_size;
+			EXPECT_TRUE(read(source, &amount));
+			for (uint32_t written = 0; written < amount;) {
+				auto size = static_cast<uint16_t>(
+				        std::min<uint32_t>(amount - written, 0xf000));
+				EXPECT_TRUE(DOS_WriteFile(target, buffer.data() + written, &size));
+				written += size;
+			}
+			copied += amount;
+		} while (amount == read_size);
+		DOS_CloseFile(source);
+		DOS_CloseFile(target);
+
+		const auto elapsed = duration_cast<duration<double>>(steady_clock::now() - start);
+		EXPECT_EQ(copied, FileSize);
+		return static_cast<double>(copied) / (1024 * 1024) / elapsed.count();
+	};
+
+	const auto pieces_mb_s = time_copy(0xffff, [&](const uint16_t handle, uint32_t* amount) {
+		auto size         = static_cast<uint16_t>(*amount);
+		const bool result = DOS_ReadFile(handle, buffer.data(), &size);
+		*amount           = size;
+		return result;
+	});
+	const auto bulk_mb_s = time_copy(ChunkSize, [&](const uint16_t handle, uint32_t* amount) {
+		return DOS_ReadFileBulk(handle, buffer.data(), amount);
+	});
+
+	printf("[ BENCHMARK] Copying 1 GB, 64 KB reads: %.0f MB/s\n", pieces_mb_s);
+	printf("[ BENCHMARK] Copying 1 GB, bulk reads:  %.0f MB/s\n", bulk_mb_s);
+}
+
 } // namespace
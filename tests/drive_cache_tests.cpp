@@ -0,0 +1,391 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dos_system.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "std_filesystem.h"
+
+namespace {
+
+class DriveCacheTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		dir = std_fs::temp_directory_path() / "dosbox_drive_cache_test";
+		std_fs::remove_all(dir);
+		std_fs::create_directories(dir);
+	}
+
+	void TearDown() override
+	{
+		std::error_code ec = {};
+		std_fs::remove_all(dir, ec);
+	}
+
+	void CreateFiles(const std::vector<std::string>& names)
+	{
+		for (const auto& name : names) {
+			std::ofstream file((dir / name).string());
+		}
+	}
+
+	std::string BasePath() const
+	{
+		return dir.string() + CROSS_FILESPLIT;
+	}
+
+	// The short names of the directory's entries, without '.' and '..'
+	std::set<std::string> ReadShortNames(DOS_Drive_Cache& cache,
+	                                     const std::string& path = {})
+	{
+		std::set<std::string> names = {};
+		uint16_t id                 = 0;
+		const auto dir_path         = path.empty() ? BasePath() : path;
+		if (cache.OpenDir(dir_path.c_str(), id)) {
+			char* result = nullptr;
+			while (cache.ReadDir(id, result)) {
+				if (strcmp(result, ".") != 0 && strcmp(result, "..") != 0) {
+					names.emplace(result);
+				}
+			}
+		}
+		return names;
+	}
+
+	std::string GetShortName(DOS_Drive_Cache& cache, const std::string& name)
+	{
+		char short_name[DOS_NAMELENGTH_ASCII] = {};
+		const auto path = BasePath() + name;
+		return cache.GetShortName(path.c_str(), short_name) ? short_name : "";
+	}
+
+	// Creates a tree of directories with long names, a few levels deep
+	void CreateTree(const int num_subdirs, const int num_files, const int depth,
+	                const std_fs::path& parent)
+	{
+		for (auto i = 0; i < num_files; ++i) {
+			std::ofstream file((parent / ("long file name " + std::to_string(i) + ".txt"))
+			                           .string());
+		}
+		if (depth == 0) {
+			return;
+		}
+		for (auto i = 0; i < num_subdirs; ++i) {
+			const auto subdir = parent / ("sub directory " + std::to_string(i));
+			std_fs::create_directory(subdir);
+			CreateTree(num_subdirs, num_files, depth - 1, subdir);
+		}
+	}
+
+	// The short names of all the directories of the tree, by their paths
+	// made of short names, read in parent first like TREE does
+	std::map<std::string, std::set<std::string>> ReadTree(DOS_Drive_Cache& cache)
+	{
+		std::map<std::string, std::set<std::string>> tree = {};
+		std::vector<std::string> paths = {BasePath()};
+		for (size_t i = 0; i < paths.size(); ++i) {
+			const auto path = paths[i];
+			const auto names = ReadShortNames(cache, path);
+			for (const auto& name : names) {
+				const auto subdir = path + name;
+				if (std_fs::is_directory(cache.GetExpandNameAndNormaliseCase(
+				            subdir.c_str()))) {
+					paths.push_back(subdir + CROSS_FILESPLIT);
+				}
+			}
+			tree[path] = names;
+		}
+		return tree;
+	}
+
+	std_fs::path dir = {};
+};
+
+TEST_F(DriveCacheTest, CreatesShortNames)
+{
+	CreateFiles({"short.txt", "longfilename.txt", "a b.txt", "readme"});
+
+	DOS_Drive_Cache cache(BasePath().c_str());
+	EXPECT_EQ(ReadShortNames(cache),
+	          (std::set<std::string>{"AB~1.TXT", "LONGFI~1.TXT", "README", "SHORT.TXT"}));
+
+	EXPECT_EQ(GetShortName(cache, "longfilename.txt"), "LONGFI~1.TXT");
+	EXPECT_EQ(GetShortName(cache, "a b.txt"), "AB~1.TXT");
+
+	// Only the entries with generated short names are found
+	EXPECT_EQ(GetShortName(cache, "short.txt"), "");
+	EXPECT_EQ(GetShortName(cache, "missing name.txt"), "");
+}
+
+TEST_F(DriveCacheTest, NumbersCollidingShortNames)
+{
+	std::vector<std::string> names = {};
+	std::set<std::string> expected = {};
+	for (auto i = 1; i <= 12; ++i) {
+		names.push_back("longfilename" + std::to_string(i) + ".txt");
+		expected.emplace(i < 10 ? "LONGFI~" + std::to_string(i) + ".TXT"
+		                        : "LONGF~" + std::to_string(i) + ".TXT");
+	}
+	CreateFiles(names);
+
+	DOS_Drive_Cache cache(BasePath().c_str());
+	EXPECT_EQ(ReadShortNames(cache), expected);
+
+	// Every long name maps to a different short name, which maps back
+	std::set<std::string> short_names = {};
+	for (const auto& name : names) {
+		const auto short_name = GetShortName(cache, name);
+		EXPECT_TRUE(short_names.insert(short_name).second) << short_name;
+
+		const auto path = BasePath() + short_name;
+		EXPECT_EQ(std::string(cache.GetExpandNameAndNormaliseCase(path.c_str())),
+		          BasePath() + name);
+	}
+}
+
+TEST_F(DriveCacheTest, AddsEntriesToCachedDirectories)
+{
+	CreateFiles({"first long name.txt"});
+
+	DOS_Drive_Cache cache(BasePath().c_str());
+	EXPECT_EQ(ReadShortNames(cache), (std::set<std::string>{"FIRSTL~1.TXT"}));
+
+	CreateFiles({"first long name 2.txt"});
+	cache.AddEntry((BasePath() + "first long name 2.txt").c_str(), true);
+	EXPECT_EQ(ReadShortNames(cache),
+	          (std::set<std::string>{"FIRSTL~1.TXT", "FIRSTL~2.TXT"}));
+	EXPECT_EQ(GetShortName(cache, "first long name 2.txt"), "FIRSTL~2.TXT");
+}
+
+#if defined(HAVE_SYS_INOTIFY_H)
+
+TEST_F(DriveCacheTest, AppliesHostChanges)
+{
+	CreateFiles({"first.txt", "long file name.txt"});
+	std_fs::create_directory(dir / "subdir");
+
+	DOS_Drive_Cache cache(BasePath().c_str());
+	ASSERT_TRUE(cache.WatchHostChanges());
+	EXPECT_EQ(ReadShortNames(cache),
+	          (std::set<std::string>{"FIRST.TXT", "LONGFI~1.TXT", "SUBDIR"}));
+
+	CreateFiles({"second.txt", "another long name.txt"});
+	std_fs::remove(dir / "first.txt");
+	std_fs::rename(dir / "long file name.txt", dir / "renamed.txt");
+	std_fs::remove_all(dir / "subdir");
+	std_fs::create_directory(dir / "newdir");
+
+	EXPECT_EQ(ReadShortNames(cache),
+	          (std::set<std::string>{"ANOTHE~1.TXT", "NEWDIR", "RENAMED.TXT", "SECOND.TXT"}));
+	EXPECT_EQ(GetShortName(cache, "another long name.txt"), "ANOTHE~1.TXT");
+	EXPECT_EQ(GetShortName(cache, "long file name.txt"), "");
+
+	// The added directory can be entered
+	std::ofstream((dir / "newdir" / "inside.txt").string());
+	const auto path = BasePath() + "NEWDIR" + CROSS_FILESPLIT + "INSIDE.TXT";
+	EXPECT_EQ(std::string(cache.GetExpandNameAndNormaliseCase(path.c_str())),
+	          BasePath() + "newdir" + CROSS_FILESPLIT + "inside.txt");
+}
+
+TEST_F(DriveCacheTest, KeepsOpenSearchesInPlace)
+{
+	CreateFiles({"b.txt", "d.txt", "f.txt"});
+
+	DOS_Drive_Cache cache(BasePath().c_str());
+	ASSERT_TRUE(cache.WatchHostChanges());
+
+	uint16_t id = 0;
+	ASSERT_TRUE(cache.OpenDir(BasePath().c_str(), id));
+	char* result = nullptr;
+	do {
+		ASSERT_TRUE(cache.ReadDir(id, result));
+	} while (result[0] == '.');
+	EXPECT_STREQ(result, "B.TXT");
+
+	// Applied on the next lookup; the search continues after B.TXT
+	CreateFiles({"a.txt"});
+	std_fs::remove(dir / "b.txt");
+	EXPECT_EQ(GetShortName(cache, "a.txt"), "");
+
+	ASSERT_TRUE(cache.ReadDir(id, result));
+	EXPECT_STREQ(result, "D.TXT");
+	ASSERT_TRUE(cache.ReadDir(id, result));
+	EXPECT_STREQ(result, "F.TXT");
+	EXPECT_FALSE(cache.ReadDir(id, result));
+}
+
+#endif
+
+TEST_F(DriveCacheTest, PrefetchedTreesGetTheSameShortNames)
+{
+	CreateTree(3, 4, 3, dir);
+	std_fs::create_directory(dir / "empty directory");
+
+	DOS_Drive_Cache cache(BasePath().c_str());
+	const auto expected = ReadTree(cache);
+	ASSERT_EQ(expected.size(), 1u + 3 + 9 + 27 + 1);
+	EXPECT_EQ(expected.at(BasePath() + "SUBDIR~2" + CROSS_FILESPLIT),
+	          (std::set<std::string>{"LONGFI~1.TXT",
+	                                 "LONGFI~2.TXT",
+	                                 "LONGFI~3.TXT",
+	                                 "LONGFI~4.TXT",
+	                                 "SUBDIR~1",
+	                                 "SUBDIR~2",
+	                                 "SUBDIR~3"}));
+
+	// Changes made on the host after the listings were taken don't show,
+	// so the directories are read in from the listings
+	DOS_Drive_Cache prefetched_cache(BasePath().c_str());
+	prefetched_cache.PrefetchTree(dir.string().c_str());
+	prefetched_cache.WaitForPrefetching();
+	const auto subdir = dir / "sub directory 1" / "sub directory 2";
+	std_fs::remove(subdir / "long file name 0.txt");
+	std::ofstream((subdir / "new file.txt").string());
+	EXPECT_EQ(ReadTree(prefetched_cache), expected);
+	prefetched_cache.StopPrefetching();
+
+	DOS_Drive_Cache changed_cache(BasePath().c_str());
+	const auto changed_tree = ReadTree(changed_cache);
+	EXPECT_EQ(changed_tree.at(BasePath() + "SUBDIR~2" + CROSS_FILESPLIT +
+	                          "SUBDIR~3" + CROSS_FILESPLIT),
+	          (std::set<std::string>{"LONGFI~1.TXT",
+	                                 "LONGFI~2.TXT",
+	                                 "LONGFI~3.TXT",
+	                                 "NEWFIL~1.TXT",
+	                                 "SUBDIR~1",
+	                                 "SUBDIR~2",
+	                                 "SUBDIR~3"}));
+	std_fs::remove(subdir / "new file.txt");
+	std::ofstream((subdir / "long file name 0.txt").string());
+
+	// Stopping in the middle of the tree leaves the rest to the host reads
+	DOS_Drive_Cache stopped_cache(BasePath().c_str());
+	stopped_cache.PrefetchTree(BasePath().c_str());
+	EXPECT_EQ(ReadShortNames(stopped_cache), expected.at(BasePath()));
+	stopped_cache.StopPrefetching();
+	EXPECT_EQ(ReadTree(stopped_cache), expected);
+}
+
+// Reads in a tree of 4k directories with and without listing them ahead on
+// the worker threads. Only reports the timings; run it with
+// --gtest_also_run_disabled_tests.
+TEST_F(DriveCacheTest, DISABLED_PrefetchTreeBenchmark)
+{
+	using namespace std::chrono;
+
+	CreateTree(16, 8, 3, dir);
+
+	auto time_read_tree_ms = [&](const bool prefetch) {
+		const auto start = steady_clock::now();
+		DOS_Drive_Cache cache(BasePath().c_str());
+		if (prefetch) {
+			cache.PrefetchTree(BasePath().c_str());
+		}
+		const auto num_dirs = ReadTree(cache).size();
+		const auto elapsed  = steady_clock::now() - start;
+		EXPECT_EQ(num_dirs, 1u + 16 + 16 * 16 + 16 * 16 * 16);
+		return duration_cast<microseconds>(elapsed).count() / 1000.0;
+	};
+	const auto read_ms     = time_read_tree_ms(false);
+	const auto prefetch_ms = time_read_tree_ms(true);
+
+	printf("[ BENCHMARK] Reading in a tree of 4k directories: %.1f ms\n", read_ms);
+	printf("[ BENCHMARK] The same with prefetching:           %.1f ms\n", prefetch_ms);
+}
+
+// Names for a large directory, most of them long names sharing their first
+// characters, so their short names need long numeric tails
+std::vector<std::string> make_directory_names(const int num_entries)
+{
+	std::vector<std::string> names = {};
+	for (auto i = 0; i < num_entries; ++i) {
+		char name[64];
+		switch (i % 3) {
+		case 0: snprintf(name, sizeof(name), "gamefile_%05d.dat", i); break;
+		case 1: snprintf(name, sizeof(name), "F%05d.BIN", i); break;
+		default: snprintf(name, sizeof(name), "Some Long Name %d.txt", i); break;
+		}
+		names.emplace_back(name);
+	}
+	return names;
+}
+
+TEST_F(DriveCacheTest, IndexLargeDirectory)
+{
+	constexpr auto num_entries = 600;
+
+	const auto names = make_directory_names(num_entries);
+	CreateFiles(names);
+
+	DOS_Drive_Cache cache(BasePath().c_str());
+	EXPECT_EQ(ReadShortNames(cache).size(), static_cast<size_t>(num_entries));
+
+	auto num_found = 0;
+	for (auto i = 0; i < num_entries; i += 3) {
+		num_found += !GetShortName(cache, names[i]).empty();
+	}
+	EXPECT_EQ(num_found, (num_entries + 2) / 3);
+}
+
+// Indexes a directory of 50k entries. Only reports the timings; run it with
+// --gtest_also_run_disabled_tests.
+TEST_F(DriveCacheTest, DISABLED_IndexLargeDirectoryBenchmark)
+{
+	using namespace std::chrono;
+
+	constexpr auto num_entries = 50000;
+
+	const auto names = make_directory_names(num_entries);
+	CreateFiles(names);
+
+	const auto start = steady_clock::now();
+	DOS_Drive_Cache cache(BasePath().c_str());
+	const auto num_short_names = ReadShortNames(cache).size();
+	const auto elapsed         = steady_clock::now() - start;
+
+	const auto lookup_start = steady_clock::now();
+	auto num_found          = 0;
+	for (auto i = 0; i < num_entries; i += 3) {
+		num_found += !GetShortName(cache, names[i]).empty();
+	}
+	const auto lookup_elapsed = steady_clock::now() - lookup_start;
+
+	printf("[ BENCHMARK] Indexing %d entries: %.1f ms\n",
+	       num_entries,
+	       duration_cast<microseconds>(elapsed).count() / 1000.0);
+	printf("[ BENCHMARK] Short name lookups: %.3f us each\n",
+	       static_cast<double>(duration_cast<nanoseconds>(lookup_elapsed).count()) /
+	               1000.0 / num_found);
+
+	EXPECT_EQ(num_short_names, static_cast<size_t>(num_entries));
+	EXPECT_EQ(num_found, (num_entries + 2) / 3);
+}
+
+} // namespace
@@ -0,0 +1,304 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "drives.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "std_filesystem.h"
+#include "string_utils.h"
+
+#include "dosbox_test_fixture.h"
+
+namespace {
+
+constexpr uint8_t DriveIndex = 3;
+
+class OverlayDriveTest : public DOSBoxTestFixture {
+protected:
+	void SetUp() override
+	{
+		DOSBoxTestFixture::SetUp();
+
+		root = std_fs::temp_directory_path() / "dosbox_overlay_test";
+		std_fs::remove_all(root);
+		std_fs::create_directories(root / "base");
+		std_fs::create_directories(root / "overlay");
+
+		// Large enough to be copied block by block
+		base_data.resize(5 * 1024 * 1024 + 123);
+		for (size_t i = 0; i < base_data.size(); ++i) {
+			base_data[i] = static_cast<uint8_t>(i * 7 + i / 251);
+		}
+		std::ofstream file((root / "base" / "BIG.DAT").string(), std::ios::binary);
+		file.write(reinterpret_cast<const char*>(base_data.data()),
+		           static_cast<std::streamsize>(base_data.size()));
+	}
+
+	void TearDown() override
+	{
+		Unmount();
+		std::error_code ec = {};
+		std_fs::remove_all(root, ec);
+		DOSBoxTestFixture::TearDown();
+	}
+
+	void Mount()
+	{
+		Unmount();
+		const auto base    = (root / "base").string() + CROSS_FILESPLIT;
+		const auto overlay = (root / "overlay").string() + CROSS_FILESPLIT;
+		uint8_t error      = 0;
+		drive = std::make_unique<Overlay_Drive>(
+		        base.c_str(), overlay.c_str(), 512, 32, 32765, 16000, 0xF8, error);
+		ASSERT_EQ(error, 0);
+		Drives.at(DriveIndex) = drive.get();
+	}
+
+	void Unmount()
+	{
+		Drives.at(DriveIndex) = nullptr;
+		drive.reset();
+	}
+
+	DOS_File* Open(const char* name, const uint32_t flags)
+	{
+		char dos_name[DOS_PATHLENGTH];
+		safe_strcpy(dos_name, name);
+		DOS_File* file = nullptr;
+		if (!drive->FileOpen(&file, dos_name, flags)) {
+			return nullptr;
+		}
+		file->SetDrive(DriveIndex);
+		file->AddRef();
+		return file;
+	}
+
+	static void Close(DOS_File* file)
+	{
+		file->Close();
+		delete file;
+	}
+
+	std::vector<uint8_t> ReadAt(DOS_File* file, uint32_t pos, const uint16_t size)
+	{
+		std::vector<uint8_t> data(size);
+		EXPECT_TRUE(file->Seek(&pos, DOS_SEEK_SET));
+		uint16_t num_read = size;
+		EXPECT_TRUE(file->Read(data.data(), &num_read));
+		data.resize(num_read);
+		return data;
+	}
+
+	void WriteAt(DOS_File* file, uint32_t pos, std::vector<uint8_t> data)
+	{
+		ASSERT_TRUE(file->Seek(&pos, DOS_SEEK_SET));
+		auto num_written = static_cast<uint16_t>(data.size());
+		ASSERT_TRUE(file->Write(data.data(), &num_written));
+		ASSERT_EQ(num_written, data.size());
+	}
+
+	// DOS truncates files with zero-sized writes
+	void TruncateAt(DOS_File* file, uint32_t pos)
+	{
+		ASSERT_TRUE(file->Seek(&pos, DOS_SEEK_SET));
+		uint8_t data         = 0;
+		uint16_t num_written = 0;
+		ASSERT_TRUE(file->Write(&data, &num_written));
+	}
+
+	// The base file's data with the given bytes written over it
+	std::vector<uint8_t> Expected(const size_t pos, const uint16_t size,
+	                              const size_t written_pos = 0,
+	                              const std::vector<uint8_t>& written = {})
+	{
+		std::vector<uint8_t> data(base_data.begin() + pos,
+		                          base_data.begin() + pos + size);
+		for (size_t i = 0; i < written.size(); ++i) {
+			if (written_pos + i >= pos && written_pos + i < pos + size) {
+				data[written_pos + i - pos] = written[i];
+			}
+		}
+		return data;
+	}
+
+	std_fs::path root                    = {};
+	std::vector<uint8_t> base_data       = {};
+	std::unique_ptr<Overlay_Drive> drive = {};
+};
+
+TEST_F(OverlayDriveTest, WritesToLargeFilesKeepTheRestInTheBase)
+{
+	Mount();
+	const std::vector<uint8_t> written = {1, 2, 3, 4};
+
+	auto file = Open("BIG.DAT", OPEN_READWRITE);
+	ASSERT_TRUE(file);
+	WriteAt(file, 200000, written);
+
+	EXPECT_EQ(ReadAt(file, 199990, 20), Expected(199990, 20, 200000, written));
+	EXPECT_EQ(ReadAt(file, 196000, 65000), Expected(196000, 65000, 200000, written));
+	EXPECT_EQ(ReadAt(file, 4 * 1024 * 1024, 60000), Expected(4 * 1024 * 1024, 60000));
+	Close(file);
+
+	EXPECT_EQ(std_fs::file_size(root / "overlay" / "BIG.DAT"), base_data.size());
+	EXPECT_EQ(std_fs::file_size(root / "base" / "BIG.DAT"), base_data.size());
+
+	// Also after mounting it again
+	Mount();
+	file = Open("BIG.DAT", OPEN_READ);
+	ASSERT_TRUE(file);
+	EXPECT_EQ(ReadAt(file, 150000, 60000), Expected(150000, 60000, 200000, written));
+	Close(file);
+}
+
+TEST_F(OverlayDriveTest, TruncatedLargeFilesGrowWithZeros)
+{
+	Mount();
+	auto file = Open("BIG.DAT", OPEN_READWRITE);
+	ASSERT_TRUE(file);
+	TruncateAt(file, 300000);
+	WriteAt(file, 400000, {5, 6});
+
+	auto expected = Expected(299990, 10);
+	expected.resize(100012);
+	expected[100010] = 5;
+	expected[100011] = 6;
+	EXPECT_EQ(ReadAt(file, 299990, 60000),
+	          std::vector<uint8_t>(expected.begin(), expected.begin() + 60000));
+	EXPECT_EQ(ReadAt(file, 359990, 40022),
+	          std::vector<uint8_t>(expected.begin() + 60000, expected.end()));
+	Close(file);
+}
+
+TEST_F(OverlayDriveTest, RenamingCopiesTheRestOfTheFile)
+{
+	Mount();
+	auto file = Open("BIG.DAT", OPEN_READWRITE);
+	ASSERT_TRUE(file);
+	WriteAt(file, 10, {9});
+	Close(file);
+
+	char old_name[] = "BIG.DAT";
+	char new_name[] = "NEW.DAT";
+	ASSERT_TRUE(drive->Rename(old_name, new_name));
+
+	file = Open("NEW.DAT", OPEN_READ);
+	ASSERT_TRUE(file);
+	EXPECT_EQ(ReadAt(file, 0, 20), Expected(0, 20, 10, {9}));
+	EXPECT_EQ(ReadAt(file, 3000000, 60000), Expected(3000000, 60000));
+	Close(file);
+}
+
+TEST_F(OverlayDriveTest, KeepsTheOverlayInformationInTheIndex)
+{
+	std::ofstream((root / "base" / "OLD.TXT").string()) << "old";
+	Mount();
+
+	char old_name[] = "OLD.TXT";
+	char new_name[] = "NEW.TXT";
+	char dir_name[] = "NEWDIR";
+	ASSERT_TRUE(drive->FileUnlink(old_name));
+	ASSERT_TRUE(drive->MakeDir(dir_name));
+	DOS_File* file = nullptr;
+	ASSERT_TRUE(drive->FileCreate(&file, new_name, {}));
+	file->AddRef();
+	Close(file);
+
+	Mount();
+	EXPECT_FALSE(drive->FileExists(old_name));
+	EXPECT_TRUE(drive->FileExists(new_name));
+	EXPECT_TRUE(drive->TestDir(dir_name));
+
+	// Mounting takes the information from the index only, as long as the
+	// overlay didn't change
+	Unmount();
+	const auto index_path = root / "overlay" / "DBOVERLAY_INDEX.DAT";
+	std::ofstream(index_path.string(), std::ios::app) << "+DEL BIG.DAT\n";
+	Mount();
+	EXPECT_FALSE(drive->FileExists("BIG.DAT"));
+	EXPECT_FALSE(drive->FileExists(old_name));
+	EXPECT_TRUE(drive->FileExists(new_name));
+	EXPECT_TRUE(drive->TestDir(dir_name));
+
+	// A rescan reads the overlay again
+	drive->EmptyCache();
+	EXPECT_TRUE(drive->FileExists("BIG.DAT"));
+	EXPECT_FALSE(drive->FileExists(old_name));
+}
+
+TEST_F(OverlayDriveTest, ReadsTheOverlayChangedOutsideAgain)
+{
+	std::ofstream((root / "base" / "OLD.TXT").string()) << "old";
+	Mount();
+	char old_name[] = "OLD.TXT";
+	ASSERT_TRUE(drive->FileUnlink(old_name));
+	Unmount();
+
+	std_fs::remove(root / "overlay" / "DBOVERLAY_DEL_OLD.TXT");
+	std::ofstream((root / "overlay" / "DBOVERLAY_DEL_BIG.DAT").string()) << "empty";
+	Mount();
+	EXPECT_TRUE(drive->FileExists(old_name));
+	EXPECT_FALSE(drive->FileExists("BIG.DAT"));
+	Unmount();
+
+	// So are the directories added in the overlay
+	std_fs::create_directory(root / "overlay" / "NEWDIR");
+	std::ofstream((root / "overlay" / "NEWDIR" / "NEW.TXT").string()) << "new";
+	Mount();
+	char dir_name[] = "NEWDIR";
+	EXPECT_TRUE(drive->TestDir(dir_name));
+	EXPECT_TRUE(drive->FileExists("NEWDIR\\NEW.TXT"));
+}
+
+TEST_F(OverlayDriveTest, ReadsTheOverlayWithoutAValidIndex)
+{
+	std::ofstream((root / "base" / "OLD.TXT").string()) << "old";
+	Mount();
+	char old_name[] = "OLD.TXT";
+	ASSERT_TRUE(drive->FileUnlink(old_name));
+	Unmount();
+
+	const auto index_path = root / "overlay" / "DBOVERLAY_INDEX.DAT";
+
+	// Interrupted records are left out
+	std::ofstream(index_path.string(), std::ios::app) << "+DEL BIG.DAT";
+	Mount();
+	EXPECT_FALSE(drive->FileExists(old_name));
+	EXPECT_TRUE(drive->FileExists("BIG.DAT"));
+	Unmount();
+
+	std::ofstream(index_path.string()) << "Not an index\n+DEL BIG.DAT\n";
+	Mount();
+	EXPECT_FALSE(drive->FileExists(old_name));
+	EXPECT_TRUE(drive->FileExists("BIG.DAT"));
+
+	std::string header = {};
+	std::getline(std::ifstream(index_path.string()), header);
+	EXPECT_EQ(header.substr(0, 18), "DBOVERLAY INDEX 2 ");
+	EXPECT_EQ(header.size(), 18u + 16);
+}
+
+} // namespace
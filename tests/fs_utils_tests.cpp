@@ -102,6 +102,29 @@ TEST(SimplifyPath, CanBeSimplifiedComplex)
 	EXPECT_EQ(simplify_path(original), expected);
 }
 
+TEST(ReadOnlyFileMapping, MapsFileContents)
+{
+	constexpr char path[] = "tests/fs_utils_tests.cpp";
+	const ReadOnlyFileMapping mapping(path);
+	ASSERT_TRUE(mapping.IsOpen());
+	EXPECT_EQ(mapping.Size(), std_fs::file_size(path));
+	EXPECT_EQ(mapping.Data()[0], '/');
+	EXPECT_EQ(mapping.Data()[1], '*');
+}
+
+TEST(ReadOnlyFileMapping, EmptyFileIsNotMapped)
+{
+	const ReadOnlyFileMapping mapping("tests/files/paths/empty.txt");
+	EXPECT_FALSE(mapping.IsOpen());
+	EXPECT_EQ(mapping.Size(), 0);
+}
+
+TEST(ReadOnlyFileMapping, MissingFileIsNotMapped)
+{
+	const ReadOnlyFileMapping mapping("tests/files/paths/missing.txt");
+	EXPECT_FALSE(mapping.IsOpen());
+}
+
 TEST_F(CreateDirTest, CreateDir)
 {
 	ASSERT_FALSE(path_exists(TEST_DIR));
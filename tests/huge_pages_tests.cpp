@@ -0,0 +1,93 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "huge_pages.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+class HugePagesTest : public ::testing::TestWithParam<const char*> {
+protected:
+	void SetUp() override
+	{
+		HUGEPAGES_SetMode(GetParam());
+	}
+
+	void TearDown() override
+	{
+		HUGEPAGES_SetMode("transparent");
+	}
+};
+
+TEST_P(HugePagesTest, AllocationsAreUsableAndPageAligned)
+{
+	constexpr size_t num_bytes = 3 * HugePageSize + 1234;
+
+	const auto ptr = static_cast<uint8_t*>(HUGEPAGES_Allocate(num_bytes));
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % 4096, 0u);
+
+	memset(ptr, 0xa5, num_bytes);
+	EXPECT_EQ(ptr[0], 0xa5);
+	EXPECT_EQ(ptr[num_bytes - 1], 0xa5);
+
+	HUGEPAGES_Free(ptr);
+}
+
+TEST_P(HugePagesTest, AllocatorBacksContainers)
+{
+	std::vector<uint32_t, HugePageAllocator<uint32_t>> values(1 << 20);
+	for (size_t i = 0; i < values.size(); ++i) {
+		values[i] = static_cast<uint32_t>(i);
+	}
+	values.resize(values.size() * 2);
+	EXPECT_EQ(values[12345], 12345u);
+	EXPECT_EQ(values.back(), 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(Modes, HugePagesTest,
+                         ::testing::Values("off", "transparent", "explicit"));
+
+TEST(HugePages, OffUsesRegularPages)
+{
+	HUGEPAGES_SetMode("off");
+	EXPECT_EQ(HUGEPAGES_GetMode(), HugePageMode::Off);
+
+	const auto ptr = HUGEPAGES_Allocate(4 * HugePageSize);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_EQ(HUGEPAGES_GetBacking(ptr), HugePageBacking::None);
+	EXPECT_EQ(HUGEPAGES_Advise(ptr, 4 * HugePageSize), HugePageBacking::None);
+	HUGEPAGES_Free(ptr);
+
+	HUGEPAGES_SetMode("transparent");
+}
+
+TEST(HugePages, AdviceSkipsRangesWithoutAWholeHugePage)
+{
+	std::vector<uint8_t> small(HugePageSize / 2);
+	EXPECT_EQ(HUGEPAGES_Advise(small.data(), small.size()), HugePageBacking::None);
+}
+
+} // namespace
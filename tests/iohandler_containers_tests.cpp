@@ -21,7 +21,9 @@
 #include "../src/hardware/iohandler_containers.cpp"
 
 #include <cassert>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
 
 #include <gtest/gtest.h>
 
@@ -195,4 +197,94 @@ TEST(iohandler_containers, adjacent_dword_write)
 	EXPECT_EQ(read_word_from_port(word_port_start), val >> 16);
 }
 
+TEST(iohandler_containers, freed_ports_are_unhandled)
+{
+	constexpr uint16_t port = 0x3f0;
+
+	IO_RegisterReadHandler(port, read_byte_new, io_width_t::byte);
+	byte_val_new = 0x12;
+	EXPECT_EQ(read_byte_from_port(port), 0x12);
+
+	IO_FreeReadHandler(port, io_width_t::byte);
+	EXPECT_EQ(read_byte_from_port(port), 0xff);
+}
+
+TEST(iohandler_containers, lambda_handlers)
+{
+	constexpr uint16_t port = 0x3f2;
+
+	uint32_t last_written = 0;
+	IO_RegisterWriteHandler(
+	        port,
+	        [&](io_port_t, io_val_t val, io_width_t) { last_written = val; },
+	        io_width_t::dword);
+	IO_RegisterReadHandler(
+	        port,
+	        [&](io_port_t, io_width_t) { return last_written + 1; },
+	        io_width_t::dword);
+
+	write_dword_to_port(port, 0x12345678);
+	EXPECT_EQ(last_written, 0x12345678u);
+	EXPECT_EQ(read_dword_from_port(port), 0x12345679u);
+
+	IO_FreeWriteHandler(port, io_width_t::dword);
+	IO_FreeReadHandler(port, io_width_t::dword);
+}
+
+// Port I/O microbenchmark: times a guest-like mix of status polling and
+// register writes through the dispatch tables. It only reports the timings;
+// the expectations just keep the compiler from eliding the loops. Run it with
+// --gtest_also_run_disabled_tests.
+TEST(iohandler_containers, DISABLED_port_io_microbenchmark)
+{
+	using namespace std::chrono;
+
+	constexpr uint16_t status_port   = 0x3da; // VGA input status
+	constexpr uint16_t register_port = 0x3d4; // CRTC index/data pair
+	constexpr uint16_t dword_port    = 0xcfc; // PCI config data
+
+	uint8_t status = 0;
+	IO_RegisterReadHandler(
+	        status_port,
+	        [&](io_port_t, io_width_t) { return status ^= 0x08; },
+	        io_width_t::byte);
+	IO_RegisterWriteHandler(register_port, write_word_new, io_width_t::word);
+	IO_RegisterReadHandler(dword_port, read_dword_new, io_width_t::dword);
+
+	constexpr auto num_iterations = 1'000'000;
+
+	auto time_ns_per_op = [](auto&& operation) {
+		const auto start = steady_clock::now();
+		for (auto i = 0; i < num_iterations; ++i) {
+			operation(i);
+		}
+		const auto elapsed = steady_clock::now() - start;
+		return static_cast<double>(duration_cast<nanoseconds>(elapsed).count()) /
+		       num_iterations;
+	};
+
+	uint32_t checksum = 0;
+
+	const auto read_byte_ns = time_ns_per_op(
+	        [&](int) { checksum += read_byte_from_port(status_port); });
+
+	const auto write_word_ns = time_ns_per_op([&](int i) {
+		write_word_to_port(register_port, static_cast<uint16_t>(i));
+	});
+
+	const auto read_dword_ns = time_ns_per_op(
+	        [&](int) { checksum += read_dword_from_port(dword_port); });
+
+	printf("[ BENCHMARK] Port reads (byte):  %.2f ns per access\n", read_byte_ns);
+	printf("[ BENCHMARK] Port writes (word): %.2f ns per access\n", write_word_ns);
+	printf("[ BENCHMARK] Port reads (dword): %.2f ns per access\n", read_dword_ns);
+
+	EXPECT_EQ(word_val_new, static_cast<uint16_t>(num_iterations - 1));
+	EXPECT_NE(checksum, 0u);
+
+	IO_FreeReadHandler(status_port, io_width_t::byte);
+	IO_FreeWriteHandler(register_port, io_width_t::word);
+	IO_FreeReadHandler(dword_port, io_width_t::dword);
+}
+
 } // namespace
@@ -0,0 +1,204 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "paging.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "mem.h"
+#include "vga.h"
+
+#include "dosbox_test_fixture.h"
+
+namespace {
+
+class PageMappingTest : public DOSBoxTestFixture {};
+
+// The mapping as the handler itself describes it
+PageMapping get_handler_mapping(const Bitu phys_page)
+{
+	const auto handler  = MEM_GetPageHandler(phys_page);
+	PageMapping mapping = {handler, nullptr, nullptr};
+	if (handler->flags & PFLAG_READABLE) {
+		mapping.read = handler->GetHostReadPt(phys_page);
+	}
+	if (handler->flags & PFLAG_WRITEABLE) {
+		mapping.write = handler->GetHostWritePt(phys_page);
+	}
+	return mapping;
+}
+
+void expect_same_as_handler(const Bitu phys_page)
+{
+	const auto mapping  = MEM_GetPageMapping(phys_page);
+	const auto expected = get_handler_mapping(phys_page);
+	EXPECT_EQ(mapping.handler, expected.handler) << phys_page;
+	EXPECT_EQ(mapping.read, expected.read) << phys_page;
+	EXPECT_EQ(mapping.write, expected.write) << phys_page;
+}
+
+TEST_F(PageMappingTest, RamPagesMapToHostMemory)
+{
+	for (const Bitu phys_page : {0x00, 0x10, 0x9f, 0x100, 0x400}) {
+		const auto mapping = MEM_GetPageMapping(phys_page);
+		EXPECT_EQ(mapping.read, MemBase + phys_page * 4096);
+		EXPECT_EQ(mapping.write, MemBase + phys_page * 4096);
+		expect_same_as_handler(phys_page);
+	}
+}
+
+TEST_F(PageMappingTest, RomPagesAreReadOnly)
+{
+	for (const Bitu phys_page : {0xc0, 0xf0, 0xff}) {
+		const auto mapping = MEM_GetPageMapping(phys_page);
+		EXPECT_EQ(mapping.read, MemBase + phys_page * 4096);
+		EXPECT_EQ(mapping.write, nullptr);
+		expect_same_as_handler(phys_page);
+	}
+}
+
+TEST_F(PageMappingTest, DevicePagesMatchTheirHandlers)
+{
+	for (Bitu phys_page = 0xa0; phys_page < 0xc0; ++phys_page) {
+		expect_same_as_handler(phys_page);
+	}
+}
+
+TEST_F(PageMappingTest, PagesBeyondRamAreUnmapped)
+{
+	const Bitu phys_page = MEM_TotalPages() + 1;
+	ASSERT_LT(phys_page, vga.lfb.page);
+
+	const auto mapping = MEM_GetPageMapping(phys_page);
+	EXPECT_EQ(mapping.read, nullptr);
+	EXPECT_EQ(mapping.write, nullptr);
+	expect_same_as_handler(phys_page);
+}
+
+TEST_F(PageMappingTest, LinearFramebufferMapsToVideoMemory)
+{
+	ASSERT_NE(vga.lfb.page, 0u);
+
+	const auto mapping = MEM_GetPageMapping(vga.lfb.page + 3);
+	EXPECT_EQ(mapping.handler, MEM_GetPageHandler(vga.lfb.page + 3));
+	EXPECT_EQ(mapping.read, vga.mem.linear + 3 * 4096);
+	EXPECT_EQ(mapping.write, vga.mem.linear + 3 * 4096);
+
+	// Writes through the TLB land in the video memory
+	const PhysPt address = vga.lfb.addr + 3 * 4096 + 0x10;
+	mem_writed(address, 0x12345678);
+	EXPECT_EQ(host_readd(vga.mem.linear + 3 * 4096 + 0x10), 0x12345678u);
+}
+
+TEST_F(PageMappingTest, LinearFramebufferWrapsAtTheVideoMemoryWrap)
+{
+	ASSERT_NE(vga.lfb.page, 0u);
+	ASSERT_GE(vga.vmemsize, 4 * 64 * 1024u);
+
+	// Some modes wrap the video memory before its end, like the S3 chain-4
+	// modes do; the LFB still spans all of it
+	const auto vmemwrap = vga.vmemwrap;
+	vga.vmemwrap        = 64 * 1024;
+	PAGING_ClearTLB();
+
+	const Bitu wrapped_page = vga.lfb.page + vga.vmemwrap / 4096 + 3;
+	ASSERT_LT(wrapped_page, vga.lfb.page + vga.vmemsize / 4096);
+
+	const auto mapping = MEM_GetPageMapping(wrapped_page);
+	EXPECT_EQ(mapping.read, vga.mem.linear + 3 * 4096);
+	EXPECT_EQ(mapping.write, vga.mem.linear + 3 * 4096);
+	expect_same_as_handler(wrapped_page);
+
+	const PhysPt address = vga.lfb.addr + vga.vmemwrap + 3 * 4096 + 0x10;
+	mem_writed(address, 0x87654321);
+	EXPECT_EQ(host_readd(vga.mem.linear + 3 * 4096 + 0x10), 0x87654321u);
+
+	vga.vmemwrap = vmemwrap;
+	PAGING_ClearTLB();
+}
+
+// Random-access microbenchmark: reads spread over RAM, ROM, the VGA window
+// and the LFB with the TLB flushed every few accesses, so most of the time
+// goes into linking the pages. It only reports the timings; run it with
+// --gtest_also_run_disabled_tests.
+TEST_F(PageMappingTest, DISABLED_RandomAccessMicrobenchmark)
+{
+	using namespace std::chrono;
+
+	std::vector<PhysPt> addresses = {};
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<uint32_t> offset(0, 4095);
+	std::uniform_int_distribution<uint32_t> region(0, 3);
+	for (auto i = 0; i < 1 << 20; ++i) {
+		const auto page_offset = offset(rng);
+		switch (region(rng)) {
+		case 0: addresses.push_back(0x200000 + (offset(rng) << 12) + page_offset); break;
+		case 1: addresses.push_back(0xf0000 + ((offset(rng) & 0xf) << 12) + page_offset); break;
+		case 2: addresses.push_back(0xa0000 + ((offset(rng) & 0xf) << 12) + page_offset); break;
+		default:
+			addresses.push_back(vga.lfb.addr + ((offset(rng) & 0xff) << 12) + page_offset);
+			break;
+		}
+	}
+
+	constexpr auto flush_interval = 16;
+
+	uint32_t checksum  = 0;
+	const auto start   = steady_clock::now();
+	auto num_accesses  = 0;
+	for (const auto address : addresses) {
+		if (++num_accesses % flush_interval == 0) {
+			PAGING_ClearTLB();
+		}
+		checksum += mem_readb(address);
+	}
+	const auto elapsed = steady_clock::now() - start;
+
+	const auto access_ns = static_cast<double>(duration_cast<nanoseconds>(elapsed).count()) /
+	                       static_cast<double>(addresses.size());
+
+	// The page lookups alone, compared to asking the handlers
+	auto time_lookups_ns = [&](auto&& lookup) {
+		const auto lookup_start = steady_clock::now();
+		for (const auto address : addresses) {
+			const auto mapping = lookup(address >> 12);
+			checksum += mapping.read != nullptr;
+		}
+		const auto lookup_elapsed = steady_clock::now() - lookup_start;
+		return static_cast<double>(duration_cast<nanoseconds>(lookup_elapsed).count()) /
+		       static_cast<double>(addresses.size());
+	};
+	const auto table_ns   = time_lookups_ns(MEM_GetPageMapping);
+	const auto handler_ns = time_lookups_ns(get_handler_mapping);
+
+	printf("[ BENCHMARK] Random access, TLB flushed every %d: %.3f ns per access\n",
+	       flush_interval, access_ns);
+	printf("[ BENCHMARK] Page lookup with the page type table: %.3f ns\n", table_ns);
+	printf("[ BENCHMARK] Page lookup through the handlers:     %.3f ns\n", handler_ns);
+
+	EXPECT_NE(checksum, 0u);
+}
+
+} // namespace
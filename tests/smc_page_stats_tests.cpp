@@ -0,0 +1,109 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "../src/cpu/smc_page_stats.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+class SmcPageStatsTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		saved_ticks = PIC_Ticks;
+		PIC_Ticks   = 5000;
+	}
+
+	void TearDown() override
+	{
+		PIC_Ticks = saved_ticks;
+	}
+
+	// Invalidates the page's code back to back, as a program writing to
+	// its own code page in a tight loop does, and returns whether the
+	// last invalidation demoted the page
+	static bool Invalidate(SmcPageStats& stats, const uint32_t times)
+	{
+		bool demoted = false;
+		for (uint32_t i = 0; i < times; ++i) {
+			demoted = stats.CountInvalidation();
+		}
+		return demoted;
+	}
+
+private:
+	uint32_t saved_ticks = 0;
+};
+
+TEST_F(SmcPageStatsTest, DemotesAndPromotesAgain)
+{
+	SmcPageStats stats = {};
+
+	EXPECT_FALSE(Invalidate(stats, SmcPageStats::DemoteThreshold - 1));
+	EXPECT_FALSE(stats.IsInterpreted());
+
+	EXPECT_TRUE(Invalidate(stats, 1));
+	EXPECT_TRUE(stats.IsInterpreted());
+	EXPECT_EQ(stats.times_demoted, 1u);
+
+	PIC_Ticks += SmcPageStats::InterpretMs - 1;
+	EXPECT_TRUE(stats.IsInterpreted());
+
+	// Translated again once the interpreted period is over
+	PIC_Ticks += 1;
+	EXPECT_FALSE(stats.IsInterpreted());
+	EXPECT_EQ(stats.invalidations, SmcPageStats::DemoteThreshold);
+}
+
+TEST_F(SmcPageStatsTest, DoesNotDemoteOccasionalInvalidations)
+{
+	SmcPageStats stats = {};
+
+	// Fewer invalidations than the threshold in every window
+	constexpr auto Interval = SmcPageStats::WindowMs /
+	                          (SmcPageStats::DemoteThreshold / 2);
+	for (auto i = 0; i < 1000; ++i) {
+		EXPECT_FALSE(stats.CountInvalidation());
+		PIC_Ticks += Interval;
+	}
+	EXPECT_FALSE(stats.IsInterpreted());
+	EXPECT_EQ(stats.times_demoted, 0u);
+}
+
+TEST_F(SmcPageStatsTest, RepeatedDemotionsLastLonger)
+{
+	SmcPageStats stats = {};
+
+	auto expected_ms = SmcPageStats::InterpretMs;
+	for (auto i = 0; i < 8; ++i) {
+		ASSERT_TRUE(Invalidate(stats, SmcPageStats::DemoteThreshold));
+		EXPECT_EQ(stats.interpreted_until - PIC_Ticks, expected_ms);
+
+		// Promoted again after the period, ready for the next round
+		PIC_Ticks = stats.interpreted_until;
+		EXPECT_FALSE(stats.IsInterpreted());
+
+		expected_ms = std::min(expected_ms * 2, SmcPageStats::MaxInterpretMs);
+	}
+	EXPECT_EQ(stats.times_demoted, 8u);
+}
+
+} // namespace
@@ -0,0 +1,212 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "snapshot.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <fstream>
+
+#include "inout.h"
+#include "mem.h"
+#include "pic.h"
+#include "regs.h"
+
+#include "dosbox_test_fixture.h"
+
+namespace {
+
+TEST(SnapshotReader, ReadsBackWrittenValues)
+{
+	SnapshotWriter writer = {};
+	writer.Write(uint8_t(0x12));
+	writer.Write(uint32_t(0x3456789a));
+	writer.WriteString("component");
+	writer.Write(true);
+
+	SnapshotReader reader(writer.Data());
+	EXPECT_EQ(reader.Read<uint8_t>(), 0x12);
+	EXPECT_EQ(reader.Read<uint32_t>(), 0x3456789au);
+	EXPECT_EQ(reader.ReadString(), "component");
+	EXPECT_FALSE(reader.IsValid());
+	EXPECT_TRUE(reader.Read<bool>());
+	EXPECT_TRUE(reader.IsValid());
+}
+
+TEST(SnapshotReader, ReadingPastTheEndFails)
+{
+	SnapshotWriter writer = {};
+	writer.Write(uint16_t(0xabcd));
+
+	SnapshotReader reader(writer.Data());
+	EXPECT_EQ(reader.Read<uint32_t>(), 0u);
+	EXPECT_FALSE(reader.IsValid());
+	EXPECT_EQ(reader.ReadString(), "");
+	EXPECT_FALSE(reader.IsValid());
+}
+
+TEST(SnapshotReader, SkipsTheRemainingData)
+{
+	SnapshotWriter writer = {};
+	writer.Write(uint32_t(0x12345678));
+	writer.Write(uint64_t(0x9abcdef0));
+
+	SnapshotReader reader(writer.Data());
+	EXPECT_EQ(reader.Read<uint32_t>(), 0x12345678u);
+	reader.SkipRemaining();
+	EXPECT_TRUE(reader.IsValid());
+}
+
+class SnapshotTest : public DOSBoxTestFixture {};
+
+TEST_F(SnapshotTest, RestoresRamAndRegisters)
+{
+	const std_fs::path path = "snapshot_test.dbs";
+
+	constexpr PhysPt address = 0x123456;
+	mem_writed(address, 0xcafef00d);
+	mem_writeb(0x2000, 0x5a);
+	reg_eax = 0x11223344;
+
+	ASSERT_TRUE(SNAPSHOT_Save(path, 0));
+
+	mem_writed(address, 0);
+	mem_writeb(0x2000, 0);
+	reg_eax = 0;
+
+	ASSERT_TRUE(SNAPSHOT_Load(path, 0));
+
+	EXPECT_EQ(mem_readd(address), 0xcafef00du);
+	EXPECT_EQ(mem_readb(0x2000), 0x5a);
+	EXPECT_EQ(reg_eax, 0x11223344u);
+
+	std::error_code ec = {};
+	std_fs::remove(path, ec);
+}
+
+// Overwrites one of the settings stored in the snapshot header, counted from
+// the EMS type
+static void patch_header_setting(const std_fs::path& path, const int index,
+                                 const uint32_t value)
+{
+	const auto offset = 8 + sizeof(uint32_t) + strlen(DOSBOX_GetDetailedVersion()) +
+	                    (2 + index) * sizeof(uint32_t);
+
+	std::fstream file(path.string(),
+	                  std::ios::in | std::ios::out | std::ios::binary);
+	file.seekp(static_cast<std::streamoff>(offset));
+	file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+TEST_F(SnapshotTest, RejectsDifferentSettingsBeforeLoading)
+{
+	const std_fs::path path = "snapshot_test_settings.dbs";
+
+	constexpr PhysPt address = 0x2000;
+
+	// The EMS type, the video memory size, and the memory handle table size
+	for (auto index = 0; index < 3; ++index) {
+		reg_eax = 0x11223344;
+		mem_writeb(address, 0x5a);
+		ASSERT_TRUE(SNAPSHOT_Save(path, 0));
+		patch_header_setting(path, index, 0xffff);
+
+		reg_eax = 0;
+		mem_writeb(address, 0);
+
+		EXPECT_FALSE(SNAPSHOT_Load(path, 0));
+		EXPECT_EQ(reg_eax, 0u);
+		EXPECT_EQ(mem_readb(address), 0);
+	}
+
+	std::error_code ec = {};
+	std_fs::remove(path, ec);
+}
+
+TEST_F(SnapshotTest, RejectsInvalidFiles)
+{
+	const std_fs::path path = "snapshot_test_invalid.dbs";
+	{
+		std::ofstream file(path.string());
+		file << "Not a snapshot";
+	}
+	EXPECT_FALSE(SNAPSHOT_Load(path, 0));
+	EXPECT_FALSE(SNAPSHOT_Load("no_such_snapshot.dbs", 0));
+
+	std::error_code ec = {};
+	std_fs::remove(path, ec);
+}
+
+static void unknown_event(uint32_t /*val*/) {}
+
+TEST_F(SnapshotTest, RefusesToSaveWithUnknownEventsPending)
+{
+	const std_fs::path path = "snapshot_test_events.dbs";
+
+	std::error_code ec = {};
+	std_fs::remove(path, ec);
+
+	// The event would be lost when the snapshot is loaded
+	PIC_AddEvent(unknown_event, 1000.0);
+	EXPECT_FALSE(SNAPSHOT_Save(path, 0));
+	EXPECT_FALSE(std_fs::exists(path));
+
+	PIC_RemoveEvents(unknown_event);
+	EXPECT_TRUE(SNAPSHOT_Save(path, 0));
+
+	std_fs::remove(path, ec);
+}
+
+// Reads a register of the Sound Blaster mixer at the default base port
+static uint8_t read_sb_mixer(const uint8_t index)
+{
+	IO_WriteB(0x224, index);
+	return IO_ReadB(0x225);
+}
+
+static void write_sb_mixer(const uint8_t index, const uint8_t value)
+{
+	IO_WriteB(0x224, index);
+	IO_WriteB(0x225, value);
+}
+
+TEST_F(SnapshotTest, RestoresSoundBlasterMixer)
+{
+	const std_fs::path path = "snapshot_test_sb.dbs";
+
+	// The master volume
+	constexpr uint8_t index = 0x22;
+
+	write_sb_mixer(index, 0x5b);
+	const auto saved_volume = read_sb_mixer(index);
+	ASSERT_TRUE(SNAPSHOT_Save(path, 0));
+
+	write_sb_mixer(index, 0xff);
+	ASSERT_NE(read_sb_mixer(index), saved_volume);
+
+	ASSERT_TRUE(SNAPSHOT_Load(path, 0));
+	EXPECT_EQ(read_sb_mixer(index), saved_volume);
+
+	std::error_code ec = {};
+	std_fs::remove(path, ec);
+}
+
+} // namespace
@@ -0,0 +1,255 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "../src/cpu/string_spans.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "mem.h"
+
+#include "dosbox_test_fixture.h"
+
+namespace {
+
+class StringSpansTest : public DOSBoxTestFixture {};
+
+// Linear addresses in extended memory with the A20 bit clear, so they don't
+// alias each other whatever the state of the A20 gate
+constexpr PhysPt src_base = 0x200000;
+constexpr PhysPt dst_base = 0x400000;
+
+constexpr uint32_t mask_16bit = 0xffff;
+constexpr uint32_t mask_32bit = 0xffffffff;
+
+template <typename T>
+T read_element(const PhysPt address)
+{
+	if constexpr (sizeof(T) == 1) {
+		return mem_readb(address);
+	} else if constexpr (sizeof(T) == 2) {
+		return mem_readw(address);
+	} else {
+		return mem_readd(address);
+	}
+}
+
+template <typename T>
+void write_element(const PhysPt address, const T value)
+{
+	if constexpr (sizeof(T) == 1) {
+		mem_writeb(address, value);
+	} else if constexpr (sizeof(T) == 2) {
+		mem_writew(address, value);
+	} else {
+		mem_writed(address, value);
+	}
+}
+
+// REP MOVS the way the cores run it: the fast path, with a single element
+// through the regular path whenever the fast path stops
+template <typename T>
+void rep_movs(const PhysPt si_base, uint32_t& si, const PhysPt di_base,
+              uint32_t& di, const int32_t step, const uint32_t mask, uint32_t count)
+{
+	while (count > 0) {
+		count -= StringSpans::rep_movs<T>(si_base, si, di_base, di, step, mask, count);
+		if (!count) {
+			break;
+		}
+		write_element<T>(di_base + di, read_element<T>(si_base + si));
+		si = (si + step) & mask;
+		di = (di + step) & mask;
+		count--;
+	}
+}
+
+template <typename T>
+void rep_movs_elementwise(const PhysPt si_base, uint32_t& si, const PhysPt di_base,
+                          uint32_t& di, const int32_t step, const uint32_t mask,
+                          uint32_t count)
+{
+	for (; count > 0; count--) {
+		write_element<T>(di_base + di, read_element<T>(si_base + si));
+		si = (si + step) & mask;
+		di = (di + step) & mask;
+	}
+}
+
+template <typename T>
+void rep_stos(const PhysPt di_base, uint32_t& di, const T value,
+              const int32_t step, const uint32_t mask, uint32_t count)
+{
+	while (count > 0) {
+		count -= StringSpans::rep_stos<T>(di_base, di, value, step, mask, count);
+		if (!count) {
+			break;
+		}
+		write_element<T>(di_base + di, value);
+		di = (di + step) & mask;
+		count--;
+	}
+}
+
+void fill_pattern(const PhysPt base, const uint32_t num_bytes, const uint8_t seed)
+{
+	for (uint32_t i = 0; i < num_bytes; ++i) {
+		mem_writeb(base + i, static_cast<uint8_t>(seed + i * 7));
+	}
+}
+
+std::vector<uint8_t> read_block(const PhysPt base, const uint32_t num_bytes)
+{
+	std::vector<uint8_t> block(num_bytes);
+	for (uint32_t i = 0; i < num_bytes; ++i) {
+		block[i] = mem_readb(base + i);
+	}
+	return block;
+}
+
+// Runs the same MOVS through the fast path and element-wise on two copies
+// of the same memory area, and compares the results and final indexes
+template <typename T>
+void expect_movs_matches_elementwise(const uint32_t si_start, const uint32_t di_start,
+                                     const int32_t direction, const uint32_t mask,
+                                     const uint32_t count)
+{
+	constexpr uint32_t area_size   = 0x20000;
+	constexpr PhysPt second_area   = 0x600000;
+	constexpr PhysPt area_offset   = second_area - src_base;
+	const auto step                = direction * static_cast<int32_t>(sizeof(T));
+
+	fill_pattern(src_base, area_size, 0x11);
+	fill_pattern(second_area, area_size, 0x11);
+
+	uint32_t si = si_start;
+	uint32_t di = di_start;
+	rep_movs<T>(src_base, si, src_base, di, step, mask, count);
+
+	uint32_t expected_si = si_start;
+	uint32_t expected_di = di_start;
+	rep_movs_elementwise<T>(src_base + area_offset, expected_si,
+	                        src_base + area_offset, expected_di, step, mask, count);
+
+	EXPECT_EQ(si, expected_si);
+	EXPECT_EQ(di, expected_di);
+	EXPECT_EQ(read_block(src_base, area_size), read_block(second_area, area_size));
+}
+
+TEST_F(StringSpansTest, MovsdForwardAcrossPages)
+{
+	expect_movs_matches_elementwise<uint32_t>(0x0010, 0x9002, 1, mask_32bit, 0x3000);
+}
+
+TEST_F(StringSpansTest, MovsbBackward)
+{
+	expect_movs_matches_elementwise<uint8_t>(0x7fff, 0xcffe, -1, mask_32bit, 0x5000);
+}
+
+TEST_F(StringSpansTest, MovswWrapsAround16BitIndexes)
+{
+	expect_movs_matches_elementwise<uint16_t>(0xf000, 0x8001, 1, mask_16bit, 0x1800);
+	expect_movs_matches_elementwise<uint16_t>(0x0ffe, 0x4000, -1, mask_16bit, 0x1800);
+}
+
+TEST_F(StringSpansTest, OverlappingMovsReplicatesPattern)
+{
+	// Destination right after the source: every element copies the one
+	// just written, so the first element gets replicated
+	expect_movs_matches_elementwise<uint8_t>(0x1000, 0x1001, 1, mask_32bit, 0x2000);
+	expect_movs_matches_elementwise<uint32_t>(0x1004, 0x1000, -1, mask_32bit, 0x800);
+
+	// Overlaps that don't feed back into the copy
+	expect_movs_matches_elementwise<uint16_t>(0x1001, 0x1000, 1, mask_32bit, 0x2000);
+	expect_movs_matches_elementwise<uint16_t>(0x1000, 0x1004, -1, mask_32bit, 0x2000);
+}
+
+TEST_F(StringSpansTest, StoswFillsElements)
+{
+	fill_pattern(dst_base, 0x4000, 0x22);
+
+	uint32_t di = 0x0ffd;
+	rep_stos<uint16_t>(dst_base, di, 0xabcd, 2, mask_32bit, 0x1000);
+
+	EXPECT_EQ(di, 0x2ffdu);
+	for (uint32_t offset = 0x0ffd; offset < 0x2ffd; offset += 2) {
+		ASSERT_EQ(mem_readw(dst_base + offset), 0xabcd) << offset;
+	}
+	EXPECT_EQ(mem_readb(dst_base + 0x0ffc), static_cast<uint8_t>(0x22 + 0x0ffc * 7));
+	EXPECT_EQ(mem_readb(dst_base + 0x2ffd), static_cast<uint8_t>(0x22 + 0x2ffd * 7));
+}
+
+TEST_F(StringSpansTest, StosbBackward)
+{
+	uint32_t di = 0x3fff;
+	rep_stos<uint8_t>(dst_base, di, 0x5a, -1, mask_16bit, 0x4000);
+
+	EXPECT_EQ(di, 0xffffu);
+	EXPECT_EQ(read_block(dst_base, 0x4000), std::vector<uint8_t>(0x4000, 0x5a));
+}
+
+// REP MOVSD microbenchmark: times large block copies through the fast path
+// and element-wise, the way the cores used to do it. It only reports the
+// timings; the expectations just check that both produced the same data.
+// Run it with --gtest_also_run_disabled_tests.
+TEST_F(StringSpansTest, DISABLED_RepMovsdMicrobenchmark)
+{
+	using namespace std::chrono;
+
+	constexpr uint32_t block_size = 64 * 1024;
+	constexpr uint32_t num_dwords = block_size / 4;
+	constexpr auto num_copies     = 200;
+
+	fill_pattern(src_base, block_size, 0x33);
+
+	auto time_ns_per_byte = [&](auto&& copy) {
+		const auto start = steady_clock::now();
+		for (auto i = 0; i < num_copies; ++i) {
+			uint32_t si = 0;
+			uint32_t di = 0;
+			copy(si, di);
+		}
+		const auto elapsed = steady_clock::now() - start;
+		return static_cast<double>(duration_cast<nanoseconds>(elapsed).count()) /
+		       (static_cast<double>(block_size) * num_copies);
+	};
+
+	const auto elementwise_ns = time_ns_per_byte([&](uint32_t& si, uint32_t& di) {
+		rep_movs_elementwise<uint32_t>(src_base, si, dst_base, di, 4, mask_32bit, num_dwords);
+	});
+	const auto elementwise_copy = read_block(dst_base, block_size);
+
+	fill_pattern(dst_base, block_size, 0);
+
+	const auto fast_path_ns = time_ns_per_byte([&](uint32_t& si, uint32_t& di) {
+		rep_movs<uint32_t>(src_base, si, dst_base, di, 4, mask_32bit, num_dwords);
+	});
+
+	printf("[ BENCHMARK] REP MOVSD element-wise: %.3f ns per byte\n", elementwise_ns);
+	printf("[ BENCHMARK] REP MOVSD fast path:    %.3f ns per byte\n", fast_path_ns);
+
+	EXPECT_EQ(read_block(dst_base, block_size), elementwise_copy);
+	EXPECT_EQ(elementwise_copy, read_block(src_base, block_size));
+}
+
+} // namespace